@@ -0,0 +1,584 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+/*
+ * Benchmarks of capture, resize, change detection, box drawing and commit
+ * over a matrix of resolutions and element counts, of the CPU resizer and
+ * of tensor preparation from 1 to N threads, and of sharing frames with
+ * subscriber processes.  Results go to stdout as JSON or CSV.
+ * Runs on the soft backend by default so that it works on any host.
+ * The pools are sized up front, and pool_grows of each case counts the
+ * times a pool grew after the warm-up; the exit status is non-zero if it
+ * ever did.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "rpigrafx.h"
+
+struct resolution {
+    int width, height;
+};
+
+static const struct resolution resolutions[] = {
+    {320, 240},
+    {640, 480},
+    {1280, 720},
+    {1920, 1080},
+};
+#define NUM_RESOLUTIONS ((int) (sizeof(resolutions) / sizeof(resolutions[0])))
+
+static const int element_counts[] = {1, 16, 64};
+#define NUM_ELEMENT_COUNTS ((int) (sizeof(element_counts) / sizeof(element_counts[0])))
+
+#define BOX_SIZE 64
+#define WARMUP 3
+/* Slots of the ring and time between publications of the shm cases. */
+#define SHM_SLOTS 8
+#define SHM_INTERVAL_NS 2000000
+
+enum output_format {
+    OUTPUT_JSON,
+    OUTPUT_CSV
+};
+
+static int iterations = 100;
+static int num_subscribers = 2;
+static enum output_format output_format = OUTPUT_JSON;
+static int num_results = 0;
+
+/* Latencies of the current case in nanoseconds. */
+static int64_t *samples = NULL;
+
+static RPIGRAFX_CONTEXT_T *ctx = NULL;
+/* Pool grows of the current case and of all the cases. */
+static int grows_start, grows_total = 0;
+
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int pool_grows()
+{
+    RPIGRAFX_POOL_STATS_T stats;
+
+    rpigrafx_get_pool_stats(ctx, &stats);
+    return stats.grows;
+}
+
+/* Called when the timed iterations start. */
+static int64_t start_case()
+{
+    grows_start = pool_grows();
+    return now_ns();
+}
+
+static int compare_int64(const void *a, const void *b)
+{
+    const int64_t x = *(const int64_t*) a, y = *(const int64_t*) b;
+
+    return (x > y) - (x < y);
+}
+
+/* p in percent. samples must be sorted. */
+static double percentile_us(const int num, const double p)
+{
+    int i = (int) (p / 100 * (num - 1) + 0.5);
+
+    return samples[i] / 1e3;
+}
+
+/*
+ * Print the statistics of the samples of one case.
+ * elapsed_ns is the wall time of the whole loop, so that work which is
+ * not timed per operation is still counted in fps.
+ */
+static void report(const char *op, const struct resolution *res, const int elements, const int threads, const int64_t elapsed_ns, const int64_t bytes_per_frame)
+{
+    const int grows = pool_grows() - grows_start;
+    double mean = 0;
+    int i;
+
+    grows_total += grows;
+    qsort(samples, iterations, sizeof(*samples), compare_int64);
+    for (i = 0; i < iterations; i ++)
+        mean += samples[i];
+    mean /= iterations * 1e3;
+
+    if (output_format == OUTPUT_CSV) {
+        if (num_results == 0)
+            printf("op,width,height,elements,threads,iterations,p50_us,p99_us,mean_us,fps,bytes_per_frame,pool_grows\n");
+        printf("%s,%d,%d,%d,%d,%d,%.1f,%.1f,%.1f,%.1f,%lld,%d\n",
+               op, res->width, res->height, elements, threads, iterations,
+               percentile_us(iterations, 50), percentile_us(iterations, 99), mean,
+               iterations / (elapsed_ns / 1e9), (long long) bytes_per_frame, grows);
+    } else {
+        printf("%s\n    {\"op\": \"%s\", \"width\": %d, \"height\": %d, \"elements\": %d, \"threads\": %d, \"iterations\": %d, "
+               "\"p50_us\": %.1f, \"p99_us\": %.1f, \"mean_us\": %.1f, \"fps\": %.1f, \"bytes_per_frame\": %lld, "
+               "\"pool_grows\": %d}",
+               num_results == 0 ? "" : ",",
+               op, res->width, res->height, elements, threads, iterations,
+               percentile_us(iterations, 50), percentile_us(iterations, 99), mean,
+               iterations / (elapsed_ns / 1e9), (long long) bytes_per_frame, grows);
+    }
+    fflush(stdout);
+    num_results ++;
+}
+
+/* rpigrafx_camera_get_frame() of a new capture, resized to res. */
+static void bench_capture(RPIGRAFX_CAMERA_T *cam, const struct resolution *res)
+{
+    int64_t start = 0, t;
+    int i;
+
+    rpigrafx_camera_set_frame_size(cam, res->width, res->height);
+    for (i = -WARMUP; i < iterations; i ++) {
+        if (i == 0)
+            start = start_case();
+        t = now_ns();
+        rpigrafx_camera_ignite_capture(cam);
+        rpigrafx_camera_get_frame(cam);
+        if (i >= 0)
+            samples[i] = now_ns() - t;
+    }
+    report("capture", res, 0, 0, now_ns() - start, (int64_t) res->width * res->height * 4);
+}
+
+/*
+ * Resizing a captured frame to res through a stream, without the capture.
+ * threads 0 is the ISP; otherwise the CPU resizer with filter on threads.
+ */
+static void bench_resize(RPIGRAFX_CAMERA_T *cam, const struct resolution *res, const RPIGRAFX_FILTER_T filter, const int threads)
+{
+    static const char *names[RPIGRAFX_FILTER_MAX] = {
+        [RPIGRAFX_FILTER_NEAREST] = "resize_nearest",
+        [RPIGRAFX_FILTER_BILINEAR] = "resize_bilinear",
+        [RPIGRAFX_FILTER_AREA] = "resize_area",
+    };
+    RPIGRAFX_STREAM_T *stream = NULL;
+    RPIGRAFX_FRAME_T *frame = NULL, *resized = NULL;
+    int64_t start = 0, t;
+    int i, full_width, full_height;
+
+    /* No default stream, so that only the stream below resizes. */
+    rpigrafx_camera_get_frame_full_size(cam, &full_width, &full_height);
+    rpigrafx_camera_set_frame_size(cam, full_width, full_height);
+    stream = rpigrafx_create_stream(cam, res->width, res->height, RPIGRAFX_FORMAT_RGBA32);
+    if (threads > 0) {
+        rpigrafx_set_resize_threads(ctx, threads);
+        rpigrafx_stream_set_resizer(stream, RPIGRAFX_RESIZER_CPU, filter);
+    }
+    for (i = -WARMUP; i < iterations; i ++) {
+        if (i == 0)
+            start = start_case();
+        rpigrafx_camera_ignite_capture(cam);
+        frame = rpigrafx_camera_get_frame_handle(cam);
+        t = now_ns();
+        resized = rpigrafx_get_stream_frame(frame, stream);
+        if (i >= 0)
+            samples[i] = now_ns() - t;
+        rpigrafx_release_frame(resized);
+        rpigrafx_release_frame(frame);
+    }
+    report(threads > 0 ? names[filter] : "resize", res, 0, threads, now_ns() - start, (int64_t) res->width * res->height * 4);
+    rpigrafx_camera_ignite_capture(cam);
+    rpigrafx_destroy_stream(stream);
+}
+
+/* Change detection on frames of res, without the capture. */
+static void bench_motion(RPIGRAFX_CAMERA_T *cam, const struct resolution *res)
+{
+    RPIGRAFX_MOTION_DETECTOR_T *det = NULL;
+    RPIGRAFX_FRAME_T *frame = NULL;
+    int64_t start = 0, t;
+    int i;
+
+    det = rpigrafx_create_motion_detector(8, 8, 4);
+    rpigrafx_camera_set_frame_size(cam, res->width, res->height);
+    for (i = -WARMUP; i < iterations; i ++) {
+        if (i == 0)
+            start = start_case();
+        rpigrafx_camera_ignite_capture(cam);
+        frame = rpigrafx_camera_get_frame_handle(cam);
+        t = now_ns();
+        rpigrafx_motion_detector_update(det, frame);
+        if (i >= 0)
+            samples[i] = now_ns() - t;
+        rpigrafx_release_frame(frame);
+    }
+    report("motion", res, 0, 0, now_ns() - start, (int64_t) res->width * res->height * 4);
+    rpigrafx_destroy_motion_detector(det);
+}
+
+/* Writing frames of res into a normalized tensor on threads, without the capture. */
+static void bench_tensor(RPIGRAFX_CAMERA_T *cam, const struct resolution *res, const RPIGRAFX_TENSOR_LAYOUT_T layout,
+                         const RPIGRAFX_TENSOR_TYPE_T type, const int threads)
+{
+    const RPIGRAFX_TENSOR_CONFIG_T config = {
+        .layout = layout,
+        .order = RPIGRAFX_CHANNEL_ORDER_RGB,
+        .type = type,
+        .scale = {1 / (255 * 0.229f), 1 / (255 * 0.224f), 1 / (255 * 0.225f)},
+        .offset = {-0.485f / 0.229f, -0.456f / 0.224f, -0.406f / 0.225f},
+        .threads = threads,
+    };
+    const size_t size = rpigrafx_get_tensor_size(&config, res->width, res->height);
+    RPIGRAFX_FRAME_T *frame = NULL;
+    void *tensor = NULL;
+    int64_t start = 0, t;
+    int i;
+
+    tensor = malloc(size);
+    if (tensor == NULL) {
+        fprintf(stderr, "Failed to allocate a tensor of %zu bytes\n", size);
+        exit(EXIT_FAILURE);
+    }
+    rpigrafx_set_resize_threads(ctx, threads);
+    rpigrafx_camera_set_frame_size(cam, res->width, res->height);
+    for (i = -WARMUP; i < iterations; i ++) {
+        if (i == 0)
+            start = start_case();
+        rpigrafx_camera_ignite_capture(cam);
+        frame = rpigrafx_camera_get_frame_handle(cam);
+        t = now_ns();
+        rpigrafx_frame_to_tensor(frame, NULL, &config, tensor);
+        if (i >= 0)
+            samples[i] = now_ns() - t;
+        rpigrafx_release_frame(frame);
+    }
+    report(type == RPIGRAFX_TENSOR_TYPE_FLOAT32 ? "tensor_f32_nchw" : "tensor_i8_nhwc", res, 0, threads,
+           now_ns() - start, (int64_t) size);
+    free(tensor);
+}
+
+/* Place box i of num on a grid over the screen. */
+/*
+ * Subscriber process of bench_shm(): read every frame, check that it is
+ * the one published and still intact, and send the latencies from
+ * publication to reading to fd.  Exits non-zero if a frame was missed or
+ * torn.
+ */
+static void run_subscriber(const char *name, const int fd)
+{
+    RPIGRAFX_SUBSCRIBER_T *sub = NULL;
+    RPIGRAFX_SHARED_FRAME_T frame;
+    int64_t *latencies = samples, t;
+    int i, status = EXIT_SUCCESS;
+    const char ready = 0;
+
+    sub = rpigrafx_open_subscriber(name);
+    if (write(fd, &ready, 1) != 1)
+        _exit(EXIT_FAILURE);
+    for (i = -WARMUP; i < iterations; i ++) {
+        if (!rpigrafx_subscriber_get_next_frame(sub, &frame, 1000)) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        t = now_ns();
+        if (frame.dropped != 0 || frame.sequence != (uint64_t) (i + WARMUP)
+                || *(const uint64_t*) frame.data != frame.sequence
+                || !rpigrafx_subscriber_is_frame_valid(sub, &frame))
+            status = EXIT_FAILURE;
+        if (i >= 0)
+            latencies[i] = t - frame.receive_time;
+    }
+    rpigrafx_close_subscriber(sub);
+    if (write(fd, latencies, iterations * sizeof(*latencies)) != (ssize_t) (iterations * sizeof(*latencies)))
+        status = EXIT_FAILURE;
+    _exit(status);
+}
+
+/*
+ * Publishing captured frames of res to num_subscribers processes through a
+ * shared-memory ring, without the capture: the time to write a frame into
+ * the ring, and the worst latency over the subscribers from the end of the
+ * write to a subscriber holding the frame.  Frames are published every
+ * SHM_INTERVAL_NS, so that the subscribers keep up even on one CPU.
+ */
+static void bench_shm(RPIGRAFX_CAMERA_T *cam, const struct resolution *res)
+{
+    const struct timespec interval = {0, SHM_INTERVAL_NS};
+    RPIGRAFX_PUBLISHER_T *pub = NULL;
+    RPIGRAFX_FRAME_T *frame = NULL;
+    char name[64];
+    int fds[num_subscribers];
+    pid_t pids[num_subscribers];
+    int64_t *latencies = NULL;
+    int64_t start = 0, elapsed, t;
+    void *data = NULL;
+    int pipe_fds[2], i, j, status, failed = 0;
+    char ready;
+
+    snprintf(name, sizeof(name), "/rpigrafx-bench-%d", (int) getpid());
+    pub = rpigrafx_create_publisher(name, res->width, res->height, RPIGRAFX_FORMAT_RGBA32, SHM_SLOTS);
+    fflush(stdout);
+    for (j = 0; j < num_subscribers; j ++) {
+        if (pipe(pipe_fds)) {
+            fprintf(stderr, "Failed to create a pipe\n");
+            exit(EXIT_FAILURE);
+        }
+        pids[j] = fork();
+        if (pids[j] == -1) {
+            fprintf(stderr, "Failed to fork a subscriber\n");
+            exit(EXIT_FAILURE);
+        }
+        if (pids[j] == 0) {
+            close(pipe_fds[0]);
+            run_subscriber(name, pipe_fds[1]);
+        }
+        close(pipe_fds[1]);
+        fds[j] = pipe_fds[0];
+        if (read(fds[j], &ready, 1) != 1) {
+            fprintf(stderr, "Subscriber %d did not start\n", j);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    rpigrafx_camera_set_frame_size(cam, res->width, res->height);
+    for (i = -WARMUP; i < iterations; i ++) {
+        if (i == 0)
+            start = start_case();
+        rpigrafx_camera_ignite_capture(cam);
+        frame = rpigrafx_camera_get_frame_handle(cam);
+        t = now_ns();
+        data = rpigrafx_publisher_begin_frame(pub);
+        memcpy(data, rpigrafx_frame_get_data(frame), (size_t) res->width * res->height * 4);
+        /* Tag the frame so that the subscribers can tell it is the one published. */
+        *(uint64_t*) data = i + WARMUP;
+        rpigrafx_publisher_end_frame(pub, rpigrafx_frame_get_timestamp(frame), now_ns(), i + WARMUP);
+        if (i >= 0)
+            samples[i] = now_ns() - t;
+        rpigrafx_release_frame(frame);
+        nanosleep(&interval, NULL);
+    }
+    elapsed = now_ns() - start;
+    report("shm_publish", res, num_subscribers, 0, elapsed, (int64_t) res->width * res->height * 4);
+
+    latencies = calloc(iterations, sizeof(*latencies));
+    if (latencies == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (j = 0; j < num_subscribers; j ++) {
+        if (read(fds[j], samples, iterations * sizeof(*samples)) != (ssize_t) (iterations * sizeof(*samples)))
+            failed = 1;
+        else
+            for (i = 0; i < iterations; i ++)
+                if (samples[i] > latencies[i])
+                    latencies[i] = samples[i];
+        close(fds[j]);
+        if (waitpid(pids[j], &status, 0) != pids[j] || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+            failed = 1;
+    }
+    if (failed) {
+        fprintf(stderr, "A subscriber missed or misread frames of %dx%d\n", res->width, res->height);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(samples, latencies, iterations * sizeof(*samples));
+    report("shm_latency", res, num_subscribers, 0, elapsed, (int64_t) res->width * res->height * 4);
+    rpigrafx_destroy_publisher(pub);
+    free(latencies);
+}
+
+static void box_position(const int i, const int num, const int screen_width, const int screen_height, int *x, int *y)
+{
+    int cols = 1;
+
+    while (cols * cols < num)
+        cols ++;
+    *x = (i % cols) * (screen_width - BOX_SIZE) / cols;
+    *y = (i / cols) * (screen_height - BOX_SIZE) / cols;
+}
+
+/* rpigrafx_display_draw_box() of elements boxes, not committed. */
+static void bench_draw(RPIGRAFX_DISPLAY_T *disp, const struct resolution *res, const int elements)
+{
+    int64_t start = 0, t;
+    int i, j, x, y, screen_width, screen_height;
+
+    rpigrafx_display_get_screen_size(disp, &screen_width, &screen_height);
+    for (i = -WARMUP; i < iterations; i ++) {
+        if (i == 0)
+            start = start_case();
+        t = now_ns();
+        for (j = 0; j < elements; j ++) {
+            box_position(j, elements, screen_width, screen_height, &x, &y);
+            rpigrafx_display_draw_box(disp, x, y, BOX_SIZE, BOX_SIZE, 2, RPIGRAFX_COLOR_GREEN);
+        }
+        if (i >= 0)
+            samples[i] = now_ns() - t;
+        rpigrafx_display_remove_all_elements(disp);
+        rpigrafx_display_commit_drawings(disp);
+    }
+    report("draw", res, elements, 0, now_ns() - start, (int64_t) elements * BOX_SIZE * BOX_SIZE * 4);
+}
+
+/*
+ * rpigrafx_display_commit_drawings() of an image of res scaled to the
+ * screen and elements boxes over it.  The image is written with
+ * rpigrafx_display_render_image_scale(), which is timed as well.
+ */
+static void bench_commit(RPIGRAFX_DISPLAY_T *disp, const struct resolution *res, const int elements, void *image)
+{
+    int64_t start = 0, t;
+    int i, j, x, y, screen_width, screen_height;
+
+    rpigrafx_display_get_screen_size(disp, &screen_width, &screen_height);
+    for (i = -WARMUP; i < iterations; i ++) {
+        if (i == 0)
+            start = start_case();
+        for (j = 0; j < elements; j ++) {
+            box_position(j, elements, screen_width, screen_height, &x, &y);
+            rpigrafx_display_draw_box(disp, x, y, BOX_SIZE, BOX_SIZE, 2, RPIGRAFX_COLOR_GREEN);
+        }
+        t = now_ns();
+        rpigrafx_display_render_image_scale(disp, image, 0, 0, res->width, res->height, screen_width, screen_height);
+        rpigrafx_display_commit_drawings(disp);
+        if (i >= 0)
+            samples[i] = now_ns() - t;
+        rpigrafx_display_remove_all_elements(disp);
+    }
+    report("commit", res, elements, 0, now_ns() - start,
+           (int64_t) res->width * res->height * 4 + (int64_t) elements * BOX_SIZE * BOX_SIZE * 4);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-b backend] [-n iterations] [-f json|csv] [-t max_threads] [-p subscribers]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    /* Enough for the boxes and the tiles of the largest image. */
+    const RPIGRAFX_POOL_CONFIG_T pool_config = {
+        .frame_buffers = 3,
+        .element_slots = 128,
+        .resource_slots = 256,
+        .image_bytes = BOX_SIZE * BOX_SIZE * 4,
+    };
+    RPIGRAFX_POOL_STATS_T pool_stats;
+    RPIGRAFX_CAMERA_T *cam = NULL;
+    RPIGRAFX_DISPLAY_T *disp = NULL;
+    const char *backend = "soft";
+    void *image = NULL;
+    int opt, i, j, threads;
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    RPIGRAFX_FILTER_T filter;
+
+    while ((opt = getopt(argc, argv, "b:n:f:t:p:h")) != -1) {
+        switch (opt) {
+            case 'b':
+                backend = optarg;
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                if (iterations <= 0)
+                    usage(argv[0]);
+                break;
+            case 'f':
+                if (!strcmp(optarg, "json"))
+                    output_format = OUTPUT_JSON;
+                else if (!strcmp(optarg, "csv"))
+                    output_format = OUTPUT_CSV;
+                else
+                    usage(argv[0]);
+                break;
+            case 't':
+                max_threads = atoi(optarg);
+                if (max_threads <= 0)
+                    usage(argv[0]);
+                break;
+            case 'p':
+                num_subscribers = atoi(optarg);
+                if (num_subscribers < 0)
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    /* Measure the library, not the emulated frame rate and vsync. */
+    setenv("RPIGRAFX_SOFT_CAMERA_SIZE", "1920x1080", 0);
+    setenv("RPIGRAFX_SOFT_CAMERA_FPS", "0", 0);
+    setenv("RPIGRAFX_SOFT_DISPLAY_HZ", "0", 0);
+
+    samples = malloc(iterations * sizeof(*samples));
+    image = calloc(resolutions[NUM_RESOLUTIONS - 1].width * resolutions[NUM_RESOLUTIONS - 1].height, 4);
+    if (samples == NULL || image == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    ctx = rpigrafx_create_context_with_backend(backend);
+    rpigrafx_set_pool_config(ctx, &pool_config);
+    cam = rpigrafx_open_camera(ctx, 0);
+    rpigrafx_camera_set_camera_num(cam, 0);
+    disp = rpigrafx_open_display(ctx, 0);
+
+    if (output_format == OUTPUT_JSON)
+        printf("{\"backend\": \"%s\", \"results\": [", rpigrafx_get_backend_name(ctx));
+    for (i = 0; i < NUM_RESOLUTIONS; i ++) {
+        bench_capture(cam, &resolutions[i]);
+        bench_resize(cam, &resolutions[i], RPIGRAFX_FILTER_BILINEAR, 0);
+        bench_motion(cam, &resolutions[i]);
+        if (num_subscribers > 0)
+            bench_shm(cam, &resolutions[i]);
+        for (threads = 1; ; threads *= 2) {
+            if (threads > max_threads)
+                threads = max_threads;
+            bench_tensor(cam, &resolutions[i], RPIGRAFX_TENSOR_LAYOUT_NCHW, RPIGRAFX_TENSOR_TYPE_FLOAT32, threads);
+            bench_tensor(cam, &resolutions[i], RPIGRAFX_TENSOR_LAYOUT_NHWC, RPIGRAFX_TENSOR_TYPE_INT8, threads);
+            if (threads == max_threads)
+                break;
+        }
+        /* 1, 2, 4, ... threads up to max_threads. */
+        for (filter = RPIGRAFX_FILTER_NEAREST; filter < RPIGRAFX_FILTER_MAX; filter ++) {
+            for (threads = 1; ; threads *= 2) {
+                if (threads > max_threads)
+                    threads = max_threads;
+                bench_resize(cam, &resolutions[i], filter, threads);
+                if (threads == max_threads)
+                    break;
+            }
+        }
+        for (j = 0; j < NUM_ELEMENT_COUNTS; j ++) {
+            bench_draw(disp, &resolutions[i], element_counts[j]);
+            bench_commit(disp, &resolutions[i], element_counts[j], image);
+        }
+    }
+    rpigrafx_get_pool_stats(ctx, &pool_stats);
+    if (output_format == OUTPUT_JSON)
+        printf("\n], \"pools\": {\"frame_buffers\": [%d, %d], \"element_slots\": [%d, %d], "
+               "\"resource_slots\": [%d, %d], \"image_bytes\": [%d, %d]}}\n",
+               pool_stats.size.frame_buffers, pool_stats.high.frame_buffers,
+               pool_stats.size.element_slots, pool_stats.high.element_slots,
+               pool_stats.size.resource_slots, pool_stats.high.resource_slots,
+               pool_stats.size.image_bytes, pool_stats.high.image_bytes);
+
+    rpigrafx_destroy_context(ctx);
+    free(image);
+    free(samples);
+    if (grows_total != 0) {
+        fprintf(stderr, "Pools grew %d times after the warm-up\n", grows_total);
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
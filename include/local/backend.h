@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#ifndef LOCAL_BACKEND_H
+#define LOCAL_BACKEND_H
+
+#include <stdint.h>
+#include "rpigrafx.h"
+#include "local/camera.h"
+
+    /*
+     * Camera backend.
+     * camera.c does the bookkeeping of frames, streams and async capture and
+     * calls these for the work on buffers.  The backend keeps its state in
+     * cam->priv and stream->priv, and allocates the frame descriptors of its
+     * buffer pools with local_rpigrafx_alloc_frames().  The descriptors of
+     * cam->frames and stream->frames are freed by camera.c after close and
+     * stream_destroy.
+     */
+    struct local_rpigrafx_camera_ops {
+        /* Fill num_cameras and camera_info of ctx. */
+        void (*query_cameras)(RPIGRAFX_CONTEXT_T *ctx);
+        /*
+         * Open camera cam->camera_num with an RGBA32 capture output of
+         * cam->frame_full_width x cam->frame_full_height and set cam->frames.
+         */
+        void (*open)(struct rpigrafx_camera *cam);
+        void (*close)(struct rpigrafx_camera *cam);
+        /*
+         * Switch to camera camera_num and reconfigure the capture output and
+         * the resizer inputs for the new cam->frame_full_width x
+         * cam->frame_full_height.
+         */
+        void (*set_camera_num)(struct rpigrafx_camera *cam, const int camera_num);
+        /*
+         * Reconfigure the capture output for cam->is_video_mode,
+         * cam->frame_full_width x cam->frame_full_height, cam->video_fps and
+         * cam->sensor_mode, and the resizer inputs.  In video mode the
+         * camera streams into the queued buffers by itself.
+         */
+        void (*set_capture_mode)(struct rpigrafx_camera *cam);
+        /* Reallocate the capture buffers and cam->frames. 0 means the default number. */
+        void (*set_buffer_num)(struct rpigrafx_camera *cam, const int num);
+        /*
+         * While enabled, local_rpigrafx_camera_event() is called whenever a
+         * capture buffer gets full or goes back to the pool.
+         */
+        void (*set_event_callback)(struct rpigrafx_camera *cam, const int enable);
+        /* Queue the free capture buffers. Returns the number of buffers queued. */
+        int (*queue_buffers)(struct rpigrafx_camera *cam);
+        /*
+         * Capture one frame into a queued buffer.  In video mode, drop the
+         * full buffers instead so that the next one is captured after this.
+         */
+        void (*trigger)(struct rpigrafx_camera *cam);
+        /*
+         * Returns the frame of the next full capture buffer with data,
+         * timestamp and receive_time set, or NULL if there is none and wait
+         * is 0.
+         */
+        struct rpigrafx_frame* (*get_full)(struct rpigrafx_camera *cam, const int wait);
+        /* Give the buffer of f back to its pool. */
+        void (*release)(struct rpigrafx_frame *f);
+
+        /* Set up a resizer to the size and format of stream with at least buffer_num buffers. */
+        void (*stream_create)(struct rpigrafx_stream *stream, const int buffer_num);
+        void (*stream_destroy)(struct rpigrafx_stream *stream);
+        /*
+         * Resize src, or the crop of it if crop is not NULL, into a buffer of
+         * stream and return its frame with data set. Waits for a free buffer.
+         */
+        struct rpigrafx_frame* (*stream_resize)(struct rpigrafx_stream *stream, struct rpigrafx_frame *src, const RPIGRAFX_RECT_T *crop);
+
+        /*
+         * Route the preview output of the camera to display number
+         * display_num, whose handle of the display backend is display, at
+         * dst on layer with alpha, and back to a null sink.  start_preview
+         * is called only while the preview is stopped.
+         */
+        void (*start_preview)(struct rpigrafx_camera *cam, void *display, const int display_num,
+                              const RPIGRAFX_RECT_T *dst, const int layer, const int alpha);
+        void (*stop_preview)(struct rpigrafx_camera *cam);
+    };
+
+    /* Attributes of an element other than its rects. */
+    struct local_rpigrafx_element_attr {
+        int layer;
+        RPIGRAFX_ALPHA_T alpha;
+        int opacity;
+        RPIGRAFX_TRANSFORM_T transform;
+    };
+
+    /*
+     * Display backend.
+     * display.c does the bookkeeping of elements, resources and surfaces and
+     * calls these, which map to dispmanx calls.  Handles are non-zero.
+     * Rects are in pixels.
+     */
+    struct local_rpigrafx_display_ops {
+        void* (*open)(const int display_num, int *width, int *height);
+        void (*close)(void *display);
+        uint32_t (*resource_create)(void *display, const RPIGRAFX_FORMAT_T format, const int width, const int height);
+        void (*resource_delete)(void *display, const uint32_t resource);
+        /* Write rows y to y + height - 1 of width pixels. p points to row 0. */
+        void (*resource_write)(void *display, const uint32_t resource, const RPIGRAFX_FORMAT_T format, const int pitch, void *p, const int width, const int y, const int height);
+        void* (*update_start)(void *display);
+        /* callback is called on another thread once the update is on the screen. */
+        void (*update_submit)(void *display, void *update, void (*callback)(void *arg), void *arg);
+        void (*update_submit_sync)(void *display, void *update);
+        uint32_t (*element_add)(void *display, void *update, const struct local_rpigrafx_element_attr *attr, const RPIGRAFX_RECT_T *dst, const uint32_t resource, const RPIGRAFX_RECT_T *src);
+        void (*element_remove)(void *display, void *update, const uint32_t element);
+        /* Change everything but attr->alpha, which is fixed when the element is added. */
+        void (*element_change)(void *display, void *update, const uint32_t element, const struct local_rpigrafx_element_attr *attr, const RPIGRAFX_RECT_T *dst, const RPIGRAFX_RECT_T *src);
+    };
+
+    struct local_rpigrafx_backend {
+        const char *name;
+        /* Called when a context is created and destroyed. */
+        void (*init)();
+        void (*deinit)();
+        const struct local_rpigrafx_camera_ops *camera;
+        const struct local_rpigrafx_display_ops *display;
+    };
+
+    /* backend.c */
+    const struct local_rpigrafx_backend* local_rpigrafx_find_backend(const char *name);
+    int local_rpigrafx_getenv_int(const char *name, const int def);
+    void local_rpigrafx_getenv_size(const char *name, int *width, int *height);
+
+    /* vc.c */
+#ifdef HAVE_VC
+    extern const struct local_rpigrafx_backend local_rpigrafx_backend_vc;
+#endif
+
+    /* soft.c */
+    extern const struct local_rpigrafx_backend local_rpigrafx_backend_soft;
+
+#endif /* LOCAL_BACKEND_H */
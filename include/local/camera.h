@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#ifndef LOCAL_CAMERA_H
+#define LOCAL_CAMERA_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "rpigrafx.h"
+
+/* Maximum number of streams resized from one captured frame. */
+#define MAX_STREAMS 8
+
+/* Maximum number of planes of a frame. */
+#define MAX_PLANES 3
+
+    struct local_rpigrafx_camera_ops;
+    struct local_rpigrafx_workers;
+
+    /*
+     * Frame handles.
+     * Each buffer of the capture pool and of the resizer pools has a frame
+     * descriptor.  The buffer goes back to the pool only when the last
+     * reference to the descriptor is dropped, so the payload stays valid for
+     * as long as someone holds the frame.
+     * A captured frame owns one reference to each of its resized frames.
+     */
+    struct rpigrafx_frame {
+        struct rpigrafx_camera *camera;
+        /* Buffer of the backend. */
+        void *buffer;
+        void *data;
+        int refcount;
+        int width, height;
+        RPIGRAFX_FORMAT_T format;
+        /* In bytes from data. */
+        int num_planes;
+        int plane_offset[MAX_PLANES], plane_stride[MAX_PLANES];
+        /* Presentation timestamp of the camera in microseconds. */
+        int64_t timestamp;
+        /* CLOCK_MONOTONIC in nanoseconds when the buffer came back full. */
+        int64_t receive_time;
+        /* Count of frames captured before this one by the camera. */
+        uint64_t sequence;
+        /* Frames recycled unseen between the previous frame handed out and this one. */
+        int dropped;
+        /* Stream which produced this frame, or NULL for captured frames. */
+        struct rpigrafx_stream *stream;
+        struct rpigrafx_frame *resized[MAX_STREAMS];
+    };
+
+    /*
+     * Streams.
+     * Each stream owns a resizer, which is the one of the backend or, if
+     * resizer is RPIGRAFX_RESIZER_CPU, the one of cpu_stream.c.  A captured
+     * frame is sent to the input of every stream which needs it, so all
+     * streams are produced from one capture.  The stream used by rpigrafx_camera_set_frame_size() and
+     * rpigrafx_camera_get_frame() is default_stream of the camera.
+     */
+    struct rpigrafx_stream {
+        struct rpigrafx_camera *camera;
+        int index;
+        void *priv;
+        int width, height;
+        RPIGRAFX_FORMAT_T format;
+        struct rpigrafx_frame *frames;
+        int frames_len;
+        /*
+         * ROI streams crop the input per request instead of taking the whole
+         * captured frame, so they are not run on every capture.
+         */
+        _Bool is_roi;
+        RPIGRAFX_RESIZER_T resizer;
+        RPIGRAFX_FILTER_T filter;
+    };
+
+    struct rpigrafx_camera {
+        RPIGRAFX_CONTEXT_T *ctx;
+        const struct local_rpigrafx_camera_ops *ops;
+        void *priv;
+        int camera_num;
+
+        /* Current frame of the synchronous path. */
+        struct rpigrafx_frame *frame_full;
+        int frame_full_width, frame_full_height;
+        int frame_width, frame_height;
+        RPIGRAFX_FORMAT_T frame_encoding;
+        /* Of the default stream. */
+        RPIGRAFX_RESIZER_T frame_resizer;
+        RPIGRAFX_FILTER_T frame_filter;
+
+        /* Recorder every captured frame handed out is written to, or NULL. */
+        RPIGRAFX_RECORDER_T *recorder;
+        /* Detector every frame handed out is compared by, or NULL. */
+        RPIGRAFX_MOTION_DETECTOR_T *motion_detector;
+        /* Ring every frame handed out is published to, or NULL. */
+        RPIGRAFX_PUBLISHER_T *publisher;
+
+        _Bool is_capture_ignited, is_frame_full_ready;
+
+        /*
+         * Frames come from the video port at video_fps instead of being
+         * triggered one by one on the still port.
+         * sensor_mode 0 lets the camera choose.
+         */
+        _Bool is_video_mode;
+        int video_fps, sensor_mode;
+
+        /* Display the preview output is routed to, or NULL. */
+        RPIGRAFX_DISPLAY_T *preview_display;
+
+        /* Sequence number of the next frame captured and of the next one expected by the user. */
+        uint64_t capture_seq, deliver_seq;
+
+        /* Descriptors of the capture buffers. */
+        struct rpigrafx_frame *frames;
+        int frames_len;
+
+        struct rpigrafx_stream *streams[MAX_STREAMS];
+        struct rpigrafx_stream *default_stream;
+        pthread_mutex_t stream_mutex;
+
+        /*
+         * Asynchronous capture.
+         * The capture buffers are driven by capture_thread, which is woken up
+         * by local_rpigrafx_camera_event() whenever a buffer becomes full or
+         * is released back to the pool.  Completed frames are kept in a ring
+         * until the user takes them.
+         */
+        int capture_buffer_num;
+        struct rpigrafx_frame **ready_frames;
+        int ready_frames_len, ready_frames_head, ready_frames_num;
+        pthread_t capture_thread;
+        pthread_mutex_t capture_mutex;
+        pthread_cond_t capture_cond, frame_cond;
+        _Bool is_capture_running, is_capture_event;
+
+        /* Captured frames not recycled yet, and the most of them at once. */
+        int frames_in_use, frames_high;
+    };
+
+    /* camera.c */
+    struct rpigrafx_frame* local_rpigrafx_alloc_frames(struct rpigrafx_camera *cam, const int num);
+    void local_rpigrafx_free_frames(struct rpigrafx_frame *fs, const int num);
+    int local_rpigrafx_frame_layout(const RPIGRAFX_FORMAT_T format, const int width, const int height, int *num_planes, int *offsets, int *strides);
+    void local_rpigrafx_camera_event(struct rpigrafx_camera *cam);
+
+    /* cpu_stream.c */
+    void local_rpigrafx_cpu_stream_create(struct rpigrafx_stream *stream, const int buffer_num, const RPIGRAFX_FILTER_T filter, const int num_bands);
+    void local_rpigrafx_cpu_stream_destroy(struct rpigrafx_stream *stream);
+    struct rpigrafx_frame* local_rpigrafx_cpu_stream_resize(struct rpigrafx_stream *stream, struct rpigrafx_frame *src, const RPIGRAFX_RECT_T *crop,
+                                                            struct local_rpigrafx_workers *workers);
+    void local_rpigrafx_cpu_stream_release(struct rpigrafx_frame *f);
+
+#endif /* LOCAL_CAMERA_H */
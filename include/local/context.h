@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#ifndef LOCAL_CONTEXT_H
+#define LOCAL_CONTEXT_H
+
+#include <pthread.h>
+#include "rpigrafx.h"
+#include "local/stats.h"
+
+    struct local_rpigrafx_backend;
+    struct local_rpigrafx_workers;
+
+/* Same as MMAL_PARAMETER_CAMERA_INFO_MAX_CAMERAS. */
+#define MAX_CAMERAS 4
+/* Number of dispmanx devices (DISPMANX_ID_*). */
+#define MAX_DISPLAYS 8
+
+    struct rpigrafx_context {
+        const struct local_rpigrafx_backend *backend;
+
+        /* Protects the tables below. */
+        pthread_mutex_t mutex;
+
+        /* -1 until the cameras are queried. */
+        int num_cameras;
+        struct {
+            int max_width, max_height;
+        } camera_info[MAX_CAMERAS];
+
+        RPIGRAFX_CAMERA_T *cameras[MAX_CAMERAS];
+        RPIGRAFX_DISPLAY_T *displays[MAX_DISPLAYS];
+
+        /* Applied to the cameras and the displays when they are opened. */
+        RPIGRAFX_POOL_CONFIG_T pool_config;
+
+        /* Threads of the CPU resizer, created on the first use. */
+        int resize_threads;
+        struct local_rpigrafx_workers *workers;
+
+#ifdef RPIGRAFX_STATS
+        struct local_rpigrafx_stats stats;
+#endif
+    };
+
+    /* main.c */
+    RPIGRAFX_CAMERA_T* local_rpigrafx_default_camera();
+    RPIGRAFX_DISPLAY_T* local_rpigrafx_default_display();
+    struct local_rpigrafx_workers* local_rpigrafx_get_workers(RPIGRAFX_CONTEXT_T *ctx);
+
+    /* camera.c */
+    void local_rpigrafx_query_cameras(RPIGRAFX_CONTEXT_T *ctx);
+    void local_rpigrafx_camera_reserve_pools(RPIGRAFX_CAMERA_T *cam, const RPIGRAFX_POOL_CONFIG_T *config);
+    void local_rpigrafx_camera_get_pool_stats(RPIGRAFX_CAMERA_T *cam, RPIGRAFX_POOL_STATS_T *stats);
+
+    /* display.c */
+    void* local_rpigrafx_display_get_backend(RPIGRAFX_DISPLAY_T *disp, int *display_num);
+    void local_rpigrafx_display_reserve_pools(RPIGRAFX_DISPLAY_T *disp, const RPIGRAFX_POOL_CONFIG_T *config);
+    void local_rpigrafx_display_get_pool_stats(RPIGRAFX_DISPLAY_T *disp, RPIGRAFX_POOL_STATS_T *stats);
+
+#endif /* LOCAL_CONTEXT_H */
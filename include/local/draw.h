@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#ifndef LOCAL_DRAW_H
+#define LOCAL_DRAW_H
+
+#include <stdint.h>
+#include "rpigrafx.h"
+
+/* Same as the one of bcm_host.h, which is not available to every backend. */
+#ifndef ALIGN_UP
+#define ALIGN_UP(x, y) (((x) + (y) - 1) & ~((y) - 1))
+#endif
+
+    /*
+     * Scale and offset of the R, G, B and A channels of pixels written to a
+     * tensor; element 3 is ignored.  8-bit results are the value rounded
+     * and saturated to 0 to 255, XORed with flip.
+     */
+    struct local_rpigrafx_tensor_params {
+        float scale[4], offset[4];
+        /* Write B, G, R instead of R, G, B into packed tensors. */
+        _Bool swap_rb;
+        uint8_t flip;
+    };
+
+    /*
+     * draw.c
+     * Images are of width x height pixels with stride pixels per row.
+     * Rectangles are clipped to the image.
+     */
+    void local_rpigrafx_choose_color(void *valp, const RPIGRAFX_COLOR_T color, const RPIGRAFX_FORMAT_T format);
+    void local_rpigrafx_fill_rgba32(uint32_t *p, const int stride, const int width, const int height, const int x, const int y, const int w, const int h, const uint32_t val);
+    void local_rpigrafx_outline_rgba32(uint32_t *p, const int stride, const int width, const int height, const int x, const int y, const int w, const int h, const int border, const uint32_t val);
+    void local_rpigrafx_fill_span_rgba32(uint32_t *p, const int n, const uint32_t val);
+    void local_rpigrafx_swap_rb_rgba32(uint32_t *dst, const uint32_t *src, const int n);
+    void local_rpigrafx_rgba32_to_rgb24(uint8_t *dst, const uint32_t *src, const int n);
+    void local_rpigrafx_rgb24_to_rgba32(uint32_t *dst, const uint8_t *src, const int n);
+    void local_rpigrafx_lerp_rows_rgba32(uint32_t *dst, const uint32_t *a, const uint32_t *b, const int weight, const int n);
+    void local_rpigrafx_sum_cells_rgba32(uint32_t *sums, const uint32_t *src, const int num_cells);
+    void local_rpigrafx_sum_cells_gray8(uint32_t *sums, const uint8_t *src, const int num_cells);
+    uint32_t local_rpigrafx_sad_u8(const uint8_t *a, const uint8_t *b, const int n);
+    void local_rpigrafx_rgba32_to_planar_f32(float *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n);
+    void local_rpigrafx_rgba32_to_packed_f32(float *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n);
+    void local_rpigrafx_rgba32_to_planar_u8(uint8_t *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n);
+    void local_rpigrafx_rgba32_to_packed_u8(uint8_t *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n);
+    const char* local_rpigrafx_draw_kernels_name();
+
+    /*
+     * Pixel kernels. n is in pixels.
+     * SIMD tables may leave entries NULL; the scalar ones are used then.
+     * lerp_rows_rgba32 blends each channel of a and b with b weighted by
+     * weight / 256, rounded; weight is 1 to 255.
+     * sum_cells_* add the luma weight of pixels 8i to 8i+7 of src to sums[i],
+     * R + 2G + B for RGBA32 and Y for gray8; num_cells is in cells of 8
+     * pixels.  sad_u8 returns the sum of absolute differences of n bytes.
+     * rgba32_to_planar_* write R, G and B to dst[0], dst[1] and dst[2], and
+     * rgba32_to_packed_* write three elements per pixel; the scale is
+     * applied before the offset, unfused, so that every kernel rounds alike.
+     */
+    struct local_rpigrafx_draw_kernels {
+        const char *name;
+        void (*fill_span_rgba32)(uint32_t *p, const int n, const uint32_t val);
+        void (*swap_rb_rgba32)(uint32_t *dst, const uint32_t *src, const int n);
+        void (*rgba32_to_rgb24)(uint8_t *dst, const uint32_t *src, const int n);
+        void (*rgb24_to_rgba32)(uint32_t *dst, const uint8_t *src, const int n);
+        void (*lerp_rows_rgba32)(uint32_t *dst, const uint32_t *a, const uint32_t *b, const int weight, const int n);
+        void (*sum_cells_rgba32)(uint32_t *sums, const uint32_t *src, const int num_cells);
+        void (*sum_cells_gray8)(uint32_t *sums, const uint8_t *src, const int num_cells);
+        uint32_t (*sad_u8)(const uint8_t *a, const uint8_t *b, const int n);
+        void (*rgba32_to_planar_f32)(float *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n);
+        void (*rgba32_to_packed_f32)(float *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n);
+        void (*rgba32_to_planar_u8)(uint8_t *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n);
+        void (*rgba32_to_packed_u8)(uint8_t *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n);
+    };
+
+    /* draw.c */
+    extern const struct local_rpigrafx_draw_kernels local_rpigrafx_draw_kernels_scalar;
+    void local_rpigrafx_fill_span_rgba32_scalar(uint32_t *p, const int n, const uint32_t val);
+    void local_rpigrafx_swap_rb_rgba32_scalar(uint32_t *dst, const uint32_t *src, const int n);
+    void local_rpigrafx_rgba32_to_rgb24_scalar(uint8_t *dst, const uint32_t *src, const int n);
+    void local_rpigrafx_rgb24_to_rgba32_scalar(uint32_t *dst, const uint8_t *src, const int n);
+    void local_rpigrafx_lerp_rows_rgba32_scalar(uint32_t *dst, const uint32_t *a, const uint32_t *b, const int weight, const int n);
+    void local_rpigrafx_sum_cells_rgba32_scalar(uint32_t *sums, const uint32_t *src, const int num_cells);
+    void local_rpigrafx_sum_cells_gray8_scalar(uint32_t *sums, const uint8_t *src, const int num_cells);
+    uint32_t local_rpigrafx_sad_u8_scalar(const uint8_t *a, const uint8_t *b, const int n);
+    void local_rpigrafx_rgba32_to_planar_f32_scalar(float *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n);
+    void local_rpigrafx_rgba32_to_packed_f32_scalar(float *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n);
+    void local_rpigrafx_rgba32_to_planar_u8_scalar(uint8_t *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n);
+    void local_rpigrafx_rgba32_to_packed_u8_scalar(uint8_t *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n);
+
+    /* draw_sse2.c */
+#ifdef __SSE2__
+    extern const struct local_rpigrafx_draw_kernels local_rpigrafx_draw_kernels_sse2;
+#endif
+
+    /* draw_neon.c */
+#ifdef HAVE_NEON
+    extern const struct local_rpigrafx_draw_kernels local_rpigrafx_draw_kernels_neon;
+#endif
+
+#endif /* LOCAL_DRAW_H */
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#ifndef LOCAL_RECORD_H
+#define LOCAL_RECORD_H
+
+#include <stdint.h>
+#include "rpigrafx.h"
+
+    struct local_rpigrafx_recording;
+
+    /* A frame of a recording.  data points into the mapped file. */
+    struct local_rpigrafx_recorded_frame {
+        int width, height;
+        RPIGRAFX_FORMAT_T format;
+        int64_t timestamp;
+        const void *data;
+        int size;
+    };
+
+    /*
+     * record.c
+     * Frames are numbered from the oldest one in the ring.
+     */
+    struct local_rpigrafx_recording* local_rpigrafx_open_recording(const char *path);
+    void local_rpigrafx_close_recording(struct local_rpigrafx_recording *r);
+    int local_rpigrafx_recording_num_frames(const struct local_rpigrafx_recording *r);
+    void local_rpigrafx_recording_get_frame(const struct local_rpigrafx_recording *r, const int i, struct local_rpigrafx_recorded_frame *f);
+
+#endif /* LOCAL_RECORD_H */
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#ifndef LOCAL_RESIZE_H
+#define LOCAL_RESIZE_H
+
+#include <stdint.h>
+#include "rpigrafx.h"
+
+    struct local_rpigrafx_workers;
+    struct local_rpigrafx_resizer;
+
+    /*
+     * resize.c
+     * Strides are in bytes.
+     * A resizer makes dst_width x dst_height images of format, laid out as
+     * local_rpigrafx_frame_layout() gives, from regions of RGBA32 images.
+     * The rows are split into num_bands bands for the workers.  The tables
+     * are sized for sources up to src_max_width x src_max_height and grow
+     * if a larger one comes.
+     */
+    struct local_rpigrafx_resizer* local_rpigrafx_create_resizer(const RPIGRAFX_FILTER_T filter, const RPIGRAFX_FORMAT_T format,
+                                                                 const int dst_width, const int dst_height,
+                                                                 const int src_max_width, const int src_max_height, const int num_bands);
+    void local_rpigrafx_destroy_resizer(struct local_rpigrafx_resizer *rs);
+    void local_rpigrafx_resize(struct local_rpigrafx_resizer *rs, struct local_rpigrafx_workers *workers,
+                               uint8_t *dst, const uint8_t *src, const int src_stride, const RPIGRAFX_RECT_T *src_rect);
+    void local_rpigrafx_convert_rgba32(uint8_t *dst, const RPIGRAFX_FORMAT_T format, const int *offsets, const int *strides,
+                                       uint8_t *src, const int src_stride, const int width, const int height);
+
+#endif /* LOCAL_RESIZE_H */
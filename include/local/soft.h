@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#ifndef LOCAL_SOFT_H
+#define LOCAL_SOFT_H
+
+#include "local/backend.h"
+
+    /* soft_camera.c */
+    extern const struct local_rpigrafx_camera_ops local_rpigrafx_soft_camera_ops;
+
+    /* Calls of the backend made on a soft display, for tests. */
+    struct local_rpigrafx_soft_display_counts {
+        int resources_created, resources_deleted, resource_writes, updates;
+    };
+
+    /* soft_display.c */
+    extern const struct local_rpigrafx_display_ops local_rpigrafx_soft_display_ops;
+    void local_rpigrafx_soft_display_set_preview(void *display, const void *p, const int stride,
+                                                 const RPIGRAFX_RECT_T *dst, const int layer, const int alpha);
+    void local_rpigrafx_soft_display_clear_preview(void *display);
+    void local_rpigrafx_soft_display_get_counts(void *display, struct local_rpigrafx_soft_display_counts *counts);
+    void local_rpigrafx_soft_display_read_framebuffer(void *display, void *p);
+
+#endif /* LOCAL_SOFT_H */
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#ifndef LOCAL_STATS_H
+#define LOCAL_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "rpigrafx.h"
+#include "local/sync.h"
+
+/*
+ * Instrumentation of the hot paths.
+ * It is built only with --enable-stats (RPIGRAFX_STATS); otherwise the
+ * macros below expand to nothing and the hot paths are untouched.
+ *
+ *     STATS_START(t);
+ *     ...
+ *     STATS_STAGE(ctx, RPIGRAFX_STAGE_RESIZE, t);
+ */
+
+#ifdef RPIGRAFX_STATS
+
+    struct local_rpigrafx_stats {
+        pthread_mutex_t mutex;
+        RPIGRAFX_STATS_T s;
+        /* Chrome trace-event file of RPIGRAFX_TRACE_FILE, or NULL. */
+        FILE *trace;
+        int num_trace_events;
+        /* Summaries to stderr every RPIGRAFX_STATS_INTERVAL_MS; 0 if disabled. */
+        int64_t dump_interval_ns, last_dump_ns;
+    };
+
+    /* stats.c */
+    void local_rpigrafx_stats_init(RPIGRAFX_CONTEXT_T *ctx);
+    void local_rpigrafx_stats_deinit(RPIGRAFX_CONTEXT_T *ctx);
+    void local_rpigrafx_stats_stage(RPIGRAFX_CONTEXT_T *ctx, const RPIGRAFX_STAGE_T stage, const int64_t start, const int64_t end);
+    void local_rpigrafx_stats_count(RPIGRAFX_CONTEXT_T *ctx, const RPIGRAFX_COUNTER_T counter, const int n);
+    void local_rpigrafx_stats_elements(RPIGRAFX_CONTEXT_T *ctx, const int num);
+
+#define STATS_START(t) const int64_t t = local_rpigrafx_now_ns()
+#define STATS_STAGE(ctx, stage, t) local_rpigrafx_stats_stage((ctx), (stage), (t), local_rpigrafx_now_ns())
+#define STATS_COUNT(ctx, counter, n) local_rpigrafx_stats_count((ctx), (counter), (n))
+#define STATS_ELEMENTS(ctx, num) local_rpigrafx_stats_elements((ctx), (num))
+
+#else
+
+#define STATS_START(t)
+#define STATS_STAGE(ctx, stage, t) do { } while (0)
+#define STATS_COUNT(ctx, counter, n) do { } while (0)
+#define STATS_ELEMENTS(ctx, num) do { } while (0)
+
+#endif /* RPIGRAFX_STATS */
+
+#endif /* LOCAL_STATS_H */
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#ifndef LOCAL_SYNC_H
+#define LOCAL_SYNC_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+    /* sync.c */
+    void local_rpigrafx_init_cond_monotonic(pthread_cond_t *cond);
+    int64_t local_rpigrafx_now_ns();
+    void local_rpigrafx_deadline_ms(struct timespec *deadline, const int timeout_ms);
+
+#endif /* LOCAL_SYNC_H */
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#ifndef LOCAL_TEXT_H
+#define LOCAL_TEXT_H
+
+#include <stdint.h>
+#include "rpigrafx.h"
+
+    /*
+     * Bitmap font.
+     * The glyphs are rasterized once into the atlas: glyph i occupies
+     * columns i * glyph_width to (i + 1) * glyph_width - 1, and a pixel is
+     * non-zero where it is drawn.
+     */
+    struct rpigrafx_font {
+        int glyph_width, glyph_height;
+        /* Character code of glyph 0. */
+        int first_char;
+        int num_glyphs;
+        uint8_t *atlas;
+        int atlas_width;
+    };
+
+    /* Position of a glyph in a laid-out string, relative to its origin, before scaling. */
+    struct local_rpigrafx_glyph_pos {
+        int glyph;
+        int x, y;
+    };
+
+    /* text.c */
+    const struct rpigrafx_font* local_rpigrafx_get_font(const RPIGRAFX_FONT_T *font);
+    int local_rpigrafx_layout_text(const struct rpigrafx_font *font, const char *text,
+                                   struct local_rpigrafx_glyph_pos **glyphs, int *glyphs_len, int *width, int *height);
+    void local_rpigrafx_draw_glyph_rgba32(uint32_t *p, const int stride, const int width, const int height,
+                                          const struct rpigrafx_font *font, const int glyph,
+                                          const int x, const int y, const int scale, const uint32_t val);
+
+#endif /* LOCAL_TEXT_H */
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#ifndef LOCAL_VC_H
+#define LOCAL_VC_H
+
+#include "local/backend.h"
+
+    /* vc_camera.c */
+    extern const struct local_rpigrafx_camera_ops local_rpigrafx_vc_camera_ops;
+
+    /* vc_display.c */
+    extern const struct local_rpigrafx_display_ops local_rpigrafx_vc_display_ops;
+
+#endif /* LOCAL_VC_H */
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#ifndef LOCAL_WORKERS_H
+#define LOCAL_WORKERS_H
+
+    struct local_rpigrafx_workers;
+
+    /* Runs band of num_bands bands of a job. */
+    typedef void (*local_rpigrafx_band_fn)(void *arg, const int band, const int num_bands);
+
+    /*
+     * workers.c
+     * A pool of num - 1 threads; the caller of local_rpigrafx_workers_run()
+     * is the last one.  workers may be NULL to run the bands in the caller.
+     */
+    struct local_rpigrafx_workers* local_rpigrafx_create_workers(const int num);
+    void local_rpigrafx_destroy_workers(struct local_rpigrafx_workers *w);
+    int local_rpigrafx_workers_num(const struct local_rpigrafx_workers *w);
+    void local_rpigrafx_workers_run(struct local_rpigrafx_workers *w, local_rpigrafx_band_fn fn, void *arg, const int num_bands);
+
+#endif /* LOCAL_WORKERS_H */
@@ -10,11 +10,12 @@
 #ifndef RPIGRAFX_H
 #define RPIGRAFX_H
 
-#include <bcm_host.h>
+#include <stddef.h>
 #include <stdint.h>
 
 
-    typedef DISPMANX_ELEMENT_HANDLE_T RPIGRAFX_ELEMENT_T;
+    /* Handle of an element of the display backend. */
+    typedef uint32_t RPIGRAFX_ELEMENT_T;
 
     typedef enum {
         RPIGRAFX_COLOR_MIN = 0,
@@ -33,28 +34,406 @@
     typedef enum {
         RPIGRAFX_FORMAT_MIN = 0,
         RPIGRAFX_FORMAT_RGBA32,
+        /* Packed, 3 bytes per pixel. */
+        RPIGRAFX_FORMAT_RGB24,
+        RPIGRAFX_FORMAT_BGR24,
+        /* Planar Y, U, V. */
+        RPIGRAFX_FORMAT_I420,
+        /* Y plane and interleaved UV plane. */
+        RPIGRAFX_FORMAT_NV12,
+        /* 8-bit luma. */
+        RPIGRAFX_FORMAT_GRAY8,
         RPIGRAFX_FORMAT_MAX
     } RPIGRAFX_FORMAT_T;
 
+    /* How an element is blended with the elements under it. */
+    typedef enum {
+        RPIGRAFX_ALPHA_MIN = 0,
+        /* The alpha of each pixel scaled by the opacity. */
+        RPIGRAFX_ALPHA_SOURCE,
+        /* The opacity for all pixels; the alpha of the pixels is ignored. */
+        RPIGRAFX_ALPHA_FIXED,
+        RPIGRAFX_ALPHA_MAX
+    } RPIGRAFX_ALPHA_T;
+
+    /* Applied to the image of an element before it is scaled. */
+    typedef enum {
+        RPIGRAFX_TRANSFORM_MIN = 0,
+        RPIGRAFX_TRANSFORM_NONE,
+        /* Clockwise. */
+        RPIGRAFX_TRANSFORM_ROT90,
+        RPIGRAFX_TRANSFORM_ROT180,
+        RPIGRAFX_TRANSFORM_ROT270,
+        /* Mirrored left to right. */
+        RPIGRAFX_TRANSFORM_FLIP_H,
+        /* Mirrored top to bottom. */
+        RPIGRAFX_TRANSFORM_FLIP_V,
+        RPIGRAFX_TRANSFORM_MAX
+    } RPIGRAFX_TRANSFORM_T;
+
+    /* What resizes the captured frames for a stream. */
+    typedef enum {
+        RPIGRAFX_RESIZER_MIN = 0,
+        /* The ISP of the GPU, or its emulation on the soft backend. */
+        RPIGRAFX_RESIZER_ISP,
+        /* The worker threads of the context. */
+        RPIGRAFX_RESIZER_CPU,
+        RPIGRAFX_RESIZER_MAX
+    } RPIGRAFX_RESIZER_T;
+
+    /* Filters of the CPU resizer. */
+    typedef enum {
+        RPIGRAFX_FILTER_MIN = 0,
+        RPIGRAFX_FILTER_NEAREST,
+        RPIGRAFX_FILTER_BILINEAR,
+        /* Average of the covered pixels; for shrinking. */
+        RPIGRAFX_FILTER_AREA,
+        RPIGRAFX_FILTER_MAX
+    } RPIGRAFX_FILTER_T;
+
+    /* Order of the dimensions of a tensor of one image. */
+    typedef enum {
+        RPIGRAFX_TENSOR_LAYOUT_MIN = 0,
+        /* Channels of a pixel next to each other. */
+        RPIGRAFX_TENSOR_LAYOUT_NHWC,
+        /* A plane per channel. */
+        RPIGRAFX_TENSOR_LAYOUT_NCHW,
+        RPIGRAFX_TENSOR_LAYOUT_MAX
+    } RPIGRAFX_TENSOR_LAYOUT_T;
+
+    /* Order of the three channels of a tensor; alpha is dropped. */
+    typedef enum {
+        RPIGRAFX_CHANNEL_ORDER_MIN = 0,
+        RPIGRAFX_CHANNEL_ORDER_RGB,
+        RPIGRAFX_CHANNEL_ORDER_BGR,
+        RPIGRAFX_CHANNEL_ORDER_MAX
+    } RPIGRAFX_CHANNEL_ORDER_T;
+
+    /* Type of the elements of a tensor. */
+    typedef enum {
+        RPIGRAFX_TENSOR_TYPE_MIN = 0,
+        RPIGRAFX_TENSOR_TYPE_FLOAT32,
+        /* Rounded to nearest and saturated. */
+        RPIGRAFX_TENSOR_TYPE_UINT8,
+        RPIGRAFX_TENSOR_TYPE_INT8,
+        RPIGRAFX_TENSOR_TYPE_MAX
+    } RPIGRAFX_TENSOR_TYPE_T;
+
+    typedef struct rpigrafx_context RPIGRAFX_CONTEXT_T;
+    typedef struct rpigrafx_camera RPIGRAFX_CAMERA_T;
+    typedef struct rpigrafx_display RPIGRAFX_DISPLAY_T;
+    typedef struct rpigrafx_frame RPIGRAFX_FRAME_T;
+    typedef struct rpigrafx_stream RPIGRAFX_STREAM_T;
+    typedef struct rpigrafx_surface RPIGRAFX_SURFACE_T;
+    typedef struct rpigrafx_overlay RPIGRAFX_OVERLAY_T;
+    typedef struct rpigrafx_font RPIGRAFX_FONT_T;
+    typedef struct rpigrafx_recorder RPIGRAFX_RECORDER_T;
+    typedef struct rpigrafx_motion_detector RPIGRAFX_MOTION_DETECTOR_T;
+    typedef struct rpigrafx_publisher RPIGRAFX_PUBLISHER_T;
+    typedef struct rpigrafx_subscriber RPIGRAFX_SUBSCRIBER_T;
+
+    typedef struct {
+        int x, y, width, height;
+    } RPIGRAFX_RECT_T;
+
+    typedef struct {
+        int x, y, width, height;
+        int border;
+        RPIGRAFX_COLOR_T color;
+    } RPIGRAFX_BOX_T;
+
+    typedef struct {
+        /* Top-left corner. */
+        int x, y;
+        /* '\n' starts a new line. */
+        const char *text;
+        /* Each pixel of the font is drawn as scale x scale pixels. */
+        int scale;
+        /* The background is not drawn if RPIGRAFX_COLOR_TRANSPARENT. */
+        RPIGRAFX_COLOR_T color, background;
+    } RPIGRAFX_LABEL_T;
+
+    /* Stages timed by the statistics. */
+    typedef enum {
+        RPIGRAFX_STAGE_MIN = 0,
+        /* Waiting for a captured frame. */
+        RPIGRAFX_STAGE_CAPTURE_WAIT,
+        /* Resizing a captured frame for a stream. */
+        RPIGRAFX_STAGE_RESIZE,
+        /* Writing pixels to a display resource. */
+        RPIGRAFX_STAGE_RESOURCE_WRITE,
+        /* Waiting for committed drawings to be on the screen. */
+        RPIGRAFX_STAGE_VSYNC_WAIT,
+        RPIGRAFX_STAGE_MAX
+    } RPIGRAFX_STAGE_T;
+
+    typedef enum {
+        RPIGRAFX_COUNTER_MIN = 0,
+        RPIGRAFX_COUNTER_FRAMES_CAPTURED,
+        /* Frames recycled by async capture before the user took them. */
+        RPIGRAFX_COUNTER_FRAMES_DROPPED,
+        /* Capture buffers given back to the pool. */
+        RPIGRAFX_COUNTER_BUFFERS_RECYCLED,
+        RPIGRAFX_COUNTER_RESOURCES_CREATED,
+        RPIGRAFX_COUNTER_RESOURCES_REUSED,
+        RPIGRAFX_COUNTER_COMMITS,
+        /* Sum over the commits of the elements on the screen. */
+        RPIGRAFX_COUNTER_ELEMENTS,
+        RPIGRAFX_COUNTER_MAX
+    } RPIGRAFX_COUNTER_T;
+
+    /* Bucket i counts durations of [2^i, 2^(i+1)) us; bucket 0 also has shorter ones. */
+#define RPIGRAFX_STATS_HIST_BUCKETS 24
+
+    typedef struct {
+        uint64_t count;
+        uint64_t total_ns, min_ns, max_ns;
+        uint64_t hist[RPIGRAFX_STATS_HIST_BUCKETS];
+    } RPIGRAFX_STAGE_STATS_T;
+
+    typedef struct {
+        RPIGRAFX_STAGE_STATS_T stages[RPIGRAFX_STAGE_MAX];
+        uint64_t counters[RPIGRAFX_COUNTER_MAX];
+        /* Most elements on the screen at a commit. */
+        int max_elements;
+    } RPIGRAFX_STATS_T;
+
+    /*
+     * Sizes of the pools which are allocated when a camera or a display is
+     * opened, so that capturing and drawing do not allocate.
+     * 0 leaves a pool at its default.
+     */
+    typedef struct {
+        /* Capture buffers of each camera. */
+        int frame_buffers;
+        /* Elements of the immediate-mode functions and pooled resources of each display. */
+        int element_slots, resource_slots;
+        /* Scratch image of each display, in bytes. */
+        int image_bytes;
+    } RPIGRAFX_POOL_CONFIG_T;
+
+    typedef struct {
+        /* Largest pools of the opened cameras and displays. */
+        RPIGRAFX_POOL_CONFIG_T size;
+        /* Most of each pool used at once. */
+        RPIGRAFX_POOL_CONFIG_T high;
+        /* Times a pool had to grow while drawing. */
+        int grows;
+    } RPIGRAFX_POOL_STATS_T;
+
+    /*
+     * How an RGBA32 image is written into a tensor.  Element c of a pixel
+     * of the tensor is the pixel value of channel c in order, 0 to 255,
+     * times scale[c] plus offset[c]; e.g. scale 1 / (255 * std) and offset
+     * -mean / std for normalization.
+     */
+    typedef struct {
+        RPIGRAFX_TENSOR_LAYOUT_T layout;
+        RPIGRAFX_CHANNEL_ORDER_T order;
+        RPIGRAFX_TENSOR_TYPE_T type;
+        float scale[3], offset[3];
+        /*
+         * Bands of rows run on the worker threads of the context, whose
+         * number rpigrafx_set_resize_threads() sets.  0 and 1 convert in
+         * the calling thread.
+         */
+        int threads;
+    } RPIGRAFX_TENSOR_CONFIG_T;
+
+    /*
+     * Frame read from a ring of another process.  data points into the
+     * ring and is laid out as the frames of a camera, with offsets and
+     * strides in bytes.
+     */
+    typedef struct {
+        const void *data;
+        int width, height;
+        RPIGRAFX_FORMAT_T format;
+        int num_planes;
+        int plane_offset[3], plane_stride[3];
+        int64_t timestamp, receive_time;
+        uint64_t sequence;
+        /* Frames published since the previous one read and not read. */
+        uint64_t dropped;
+        /* Number of the publication. */
+        uint64_t publication;
+    } RPIGRAFX_SHARED_FRAME_T;
+
     /* main.c */
-    void rpigrafx_init() __attribute__((constructor));
+    RPIGRAFX_CONTEXT_T* rpigrafx_create_context();
+    RPIGRAFX_CONTEXT_T* rpigrafx_create_context_with_backend(const char *name);
+    void rpigrafx_destroy_context(RPIGRAFX_CONTEXT_T *ctx);
+    const char* rpigrafx_get_backend_name(RPIGRAFX_CONTEXT_T *ctx);
+    int rpigrafx_get_num_cameras(RPIGRAFX_CONTEXT_T *ctx);
+    void rpigrafx_set_pool_config(RPIGRAFX_CONTEXT_T *ctx, const RPIGRAFX_POOL_CONFIG_T *config);
+    void rpigrafx_get_pool_stats(RPIGRAFX_CONTEXT_T *ctx, RPIGRAFX_POOL_STATS_T *stats);
+    void rpigrafx_set_resize_threads(RPIGRAFX_CONTEXT_T *ctx, const int num);
+    void rpigrafx_init();
     void rpigrafx_finalize() __attribute__((destructor));
 
-    /* dispmanx.c */
+    /* stats.c */
+    int rpigrafx_get_stats(RPIGRAFX_CONTEXT_T *ctx, RPIGRAFX_STATS_T *stats);
+    void rpigrafx_reset_stats(RPIGRAFX_CONTEXT_T *ctx);
+    const char* rpigrafx_get_stage_name(const RPIGRAFX_STAGE_T stage);
+    const char* rpigrafx_get_counter_name(const RPIGRAFX_COUNTER_T counter);
+
+    /* display.c */
+    RPIGRAFX_DISPLAY_T* rpigrafx_open_display(RPIGRAFX_CONTEXT_T *ctx, const int display_num);
+    void rpigrafx_close_display(RPIGRAFX_DISPLAY_T *disp);
+    void rpigrafx_display_get_screen_size(RPIGRAFX_DISPLAY_T *disp, int *width, int *height);
+    RPIGRAFX_ELEMENT_T rpigrafx_display_draw_box(RPIGRAFX_DISPLAY_T *disp, const int x_start, const int y_start, const int x_end, const int y_end, const int border_width, const RPIGRAFX_COLOR_T color);
+    RPIGRAFX_ELEMENT_T rpigrafx_display_render_image(RPIGRAFX_DISPLAY_T *disp, void *image, const int x, const int y, const int width, const int height);
+    RPIGRAFX_ELEMENT_T rpigrafx_display_render_image_scale(RPIGRAFX_DISPLAY_T *disp, void *p, const int x, const int y, const int width, const int height, const int width_scaled, const int height_scaled);
+    void rpigrafx_display_commit_drawings(RPIGRAFX_DISPLAY_T *disp);
+    void rpigrafx_display_commit_drawings_async(RPIGRAFX_DISPLAY_T *disp);
+    int rpigrafx_display_wait_drawings(RPIGRAFX_DISPLAY_T *disp, const int timeout_ms);
+    int rpigrafx_display_poll_drawings(RPIGRAFX_DISPLAY_T *disp);
+    void rpigrafx_display_remove_all_elements(RPIGRAFX_DISPLAY_T *disp);
+    void rpigrafx_display_set_layer(RPIGRAFX_DISPLAY_T *disp, const int layer);
+    void rpigrafx_display_set_alpha(RPIGRAFX_DISPLAY_T *disp, const RPIGRAFX_ALPHA_T alpha, const int opacity);
+    void rpigrafx_display_set_transform(RPIGRAFX_DISPLAY_T *disp, const RPIGRAFX_TRANSFORM_T transform);
+    void rpigrafx_display_set_tile_size(RPIGRAFX_DISPLAY_T *disp, const int width, const int height);
+    RPIGRAFX_SURFACE_T* rpigrafx_display_create_surface(RPIGRAFX_DISPLAY_T *disp, const RPIGRAFX_FORMAT_T format, const int width, const int height, const int x, const int y, const int width_scaled, const int height_scaled);
+    void rpigrafx_destroy_surface(RPIGRAFX_SURFACE_T *surf);
+    void rpigrafx_surface_write(RPIGRAFX_SURFACE_T *surf, void *p);
+    void rpigrafx_surface_write_rows(RPIGRAFX_SURFACE_T *surf, void *p, const int y, const int height);
+    void rpigrafx_surface_move(RPIGRAFX_SURFACE_T *surf, const int x, const int y, const int width_scaled, const int height_scaled);
+    void rpigrafx_surface_set_visible(RPIGRAFX_SURFACE_T *surf, const int visible);
+    void rpigrafx_surface_set_layer(RPIGRAFX_SURFACE_T *surf, const int layer);
+    void rpigrafx_surface_set_alpha(RPIGRAFX_SURFACE_T *surf, const RPIGRAFX_ALPHA_T alpha, const int opacity);
+    void rpigrafx_surface_set_transform(RPIGRAFX_SURFACE_T *surf, const RPIGRAFX_TRANSFORM_T transform);
+    void rpigrafx_surface_set_clip(RPIGRAFX_SURFACE_T *surf, const int x, const int y, const int width, const int height);
+    void rpigrafx_surface_reset_clip(RPIGRAFX_SURFACE_T *surf);
+
+    /* display.c: on the default display */
     void rpigrafx_get_screen_size(int *width, int *height);
     RPIGRAFX_ELEMENT_T rpigrafx_draw_box(const int x_start, const int y_start, const int x_end, const int y_end, const int border_width, const RPIGRAFX_COLOR_T color);
     RPIGRAFX_ELEMENT_T rpigrafx_render_image(void *image, const int x, const int y, const int width, const int height);
     RPIGRAFX_ELEMENT_T rpigrafx_render_image_scale(void *p, const int x, const int y, const int width, const int height, const int width_scaled, const int height_scaled);
     void rpigrafx_commit_drawings();
+    void rpigrafx_commit_drawings_async();
+    int rpigrafx_wait_drawings(const int timeout_ms);
+    int rpigrafx_poll_drawings();
     void rpigrafx_remove_all_elements();
+    void rpigrafx_set_layer(const int layer);
+    void rpigrafx_set_alpha(const RPIGRAFX_ALPHA_T alpha, const int opacity);
+    void rpigrafx_set_transform(const RPIGRAFX_TRANSFORM_T transform);
+    void rpigrafx_set_tile_size(const int width, const int height);
+
+    /* overlay.c */
+    RPIGRAFX_OVERLAY_T* rpigrafx_display_create_overlay(RPIGRAFX_DISPLAY_T *disp, const int width, const int height, const int x, const int y, const int width_scaled, const int height_scaled);
+    void rpigrafx_destroy_overlay(RPIGRAFX_OVERLAY_T *ov);
+    void rpigrafx_overlay_set_visible(RPIGRAFX_OVERLAY_T *ov, const int visible);
+    void rpigrafx_overlay_set_layer(RPIGRAFX_OVERLAY_T *ov, const int layer);
+    void rpigrafx_overlay_set_alpha(RPIGRAFX_OVERLAY_T *ov, const RPIGRAFX_ALPHA_T alpha, const int opacity);
+    void rpigrafx_overlay_draw_boxes(RPIGRAFX_OVERLAY_T *ov, const RPIGRAFX_BOX_T *boxes, const int num);
+    void rpigrafx_overlay_draw_labels(RPIGRAFX_OVERLAY_T *ov, const RPIGRAFX_LABEL_T *labels, const int num);
+    void rpigrafx_overlay_set_font(RPIGRAFX_OVERLAY_T *ov, const RPIGRAFX_FONT_T *font);
+
+    /* text.c */
+    RPIGRAFX_FONT_T* rpigrafx_load_font(const char *path);
+    void rpigrafx_destroy_font(RPIGRAFX_FONT_T *font);
+    void rpigrafx_font_measure_text(const RPIGRAFX_FONT_T *font, const char *text, const int scale, int *width, int *height);
+
+    /* record.c */
+    RPIGRAFX_RECORDER_T* rpigrafx_create_recorder(const char *path, const int64_t size);
+    void rpigrafx_destroy_recorder(RPIGRAFX_RECORDER_T *rec);
+    void rpigrafx_recorder_write_frame(RPIGRAFX_RECORDER_T *rec, RPIGRAFX_FRAME_T *frame);
+
+    /* motion.c */
+    RPIGRAFX_MOTION_DETECTOR_T* rpigrafx_create_motion_detector(const int tiles_x, const int tiles_y, const int threshold);
+    void rpigrafx_destroy_motion_detector(RPIGRAFX_MOTION_DETECTOR_T *det);
+    int rpigrafx_motion_detector_update(RPIGRAFX_MOTION_DETECTOR_T *det, RPIGRAFX_FRAME_T *frame);
+    int rpigrafx_motion_detector_update_image(RPIGRAFX_MOTION_DETECTOR_T *det, const void *data, const RPIGRAFX_FORMAT_T format, const int width, const int height, const int stride);
+    float rpigrafx_motion_detector_get_score(RPIGRAFX_MOTION_DETECTOR_T *det);
+    int rpigrafx_motion_detector_get_num_changed(RPIGRAFX_MOTION_DETECTOR_T *det);
+    const uint8_t* rpigrafx_motion_detector_get_changed_tiles(RPIGRAFX_MOTION_DETECTOR_T *det);
+    void rpigrafx_motion_detector_get_tile_rect(RPIGRAFX_MOTION_DETECTOR_T *det, const int tx, const int ty, RPIGRAFX_RECT_T *rect);
+
+    /* tensor.c */
+    size_t rpigrafx_get_tensor_size(const RPIGRAFX_TENSOR_CONFIG_T *config, const int width, const int height);
+    void rpigrafx_image_to_tensor(RPIGRAFX_CONTEXT_T *ctx, const void *data, const int width, const int height, const int stride, const RPIGRAFX_TENSOR_CONFIG_T *config, void *tensor);
+    void rpigrafx_frame_to_tensor(RPIGRAFX_FRAME_T *frame, const RPIGRAFX_RECT_T *rect, const RPIGRAFX_TENSOR_CONFIG_T *config, void *tensor);
+
+    /* shm.c */
+    RPIGRAFX_PUBLISHER_T* rpigrafx_create_publisher(const char *name, const int width, const int height, const RPIGRAFX_FORMAT_T format, const int num_slots);
+    void rpigrafx_destroy_publisher(RPIGRAFX_PUBLISHER_T *pub);
+    void* rpigrafx_publisher_begin_frame(RPIGRAFX_PUBLISHER_T *pub);
+    void rpigrafx_publisher_end_frame(RPIGRAFX_PUBLISHER_T *pub, const int64_t timestamp, const int64_t receive_time, const uint64_t sequence);
+    void rpigrafx_publisher_write_frame(RPIGRAFX_PUBLISHER_T *pub, RPIGRAFX_FRAME_T *frame);
+    RPIGRAFX_SUBSCRIBER_T* rpigrafx_open_subscriber(const char *name);
+    void rpigrafx_close_subscriber(RPIGRAFX_SUBSCRIBER_T *sub);
+    void rpigrafx_subscriber_get_frame_size(RPIGRAFX_SUBSCRIBER_T *sub, int *width, int *height, RPIGRAFX_FORMAT_T *format);
+    int rpigrafx_subscriber_get_next_frame(RPIGRAFX_SUBSCRIBER_T *sub, RPIGRAFX_SHARED_FRAME_T *frame, const int timeout_ms);
+    int rpigrafx_subscriber_get_latest_frame(RPIGRAFX_SUBSCRIBER_T *sub, RPIGRAFX_SHARED_FRAME_T *frame, const int timeout_ms);
+    int rpigrafx_subscriber_is_frame_valid(RPIGRAFX_SUBSCRIBER_T *sub, const RPIGRAFX_SHARED_FRAME_T *frame);
+
+    /* camera.c */
+    RPIGRAFX_CAMERA_T* rpigrafx_open_camera(RPIGRAFX_CONTEXT_T *ctx, const int camera_num);
+    void rpigrafx_close_camera(RPIGRAFX_CAMERA_T *cam);
+    void rpigrafx_camera_set_camera_num(RPIGRAFX_CAMERA_T *cam, const int camera_num);
+    void rpigrafx_camera_set_video_mode(RPIGRAFX_CAMERA_T *cam, const int width, const int height, const int fps, const int sensor_mode);
+    void rpigrafx_camera_set_still_mode(RPIGRAFX_CAMERA_T *cam);
+    void rpigrafx_camera_set_frame_format(RPIGRAFX_CAMERA_T *cam, const RPIGRAFX_FORMAT_T format);
+    void rpigrafx_camera_get_frame_full_size(RPIGRAFX_CAMERA_T *cam, int *widthp, int *heightp);
+    void rpigrafx_camera_set_frame_size(RPIGRAFX_CAMERA_T *cam, const int width, const int height);
+    void rpigrafx_camera_ignite_capture(RPIGRAFX_CAMERA_T *cam);
+    void rpigrafx_camera_start_preview(RPIGRAFX_CAMERA_T *cam, RPIGRAFX_DISPLAY_T *disp, const int x, const int y, const int width, const int height, const int layer, const int alpha);
+    void rpigrafx_camera_stop_preview(RPIGRAFX_CAMERA_T *cam);
+    RPIGRAFX_ELEMENT_T rpigrafx_camera_display_frame(RPIGRAFX_CAMERA_T *cam, RPIGRAFX_DISPLAY_T *disp, const int x, const int y, const int width, const int height);
+    void* rpigrafx_camera_get_frame(RPIGRAFX_CAMERA_T *cam);
+    RPIGRAFX_FRAME_T* rpigrafx_camera_get_frame_handle(RPIGRAFX_CAMERA_T *cam);
+    RPIGRAFX_STREAM_T* rpigrafx_create_stream(RPIGRAFX_CAMERA_T *cam, const int width, const int height, const RPIGRAFX_FORMAT_T format);
+    void rpigrafx_destroy_stream(RPIGRAFX_STREAM_T *stream);
+    RPIGRAFX_FRAME_T* rpigrafx_get_stream_frame(RPIGRAFX_FRAME_T *frame, RPIGRAFX_STREAM_T *stream);
+    RPIGRAFX_STREAM_T* rpigrafx_create_roi_stream(RPIGRAFX_CAMERA_T *cam, const int width, const int height, const RPIGRAFX_FORMAT_T format, const int max_rois);
+    void rpigrafx_get_roi_frames(RPIGRAFX_FRAME_T *frame, RPIGRAFX_STREAM_T *stream, const RPIGRAFX_RECT_T *rois, const int num, RPIGRAFX_FRAME_T **frames);
+    void rpigrafx_stream_set_resizer(RPIGRAFX_STREAM_T *stream, const RPIGRAFX_RESIZER_T resizer, const RPIGRAFX_FILTER_T filter);
+    void rpigrafx_camera_set_resizer(RPIGRAFX_CAMERA_T *cam, const RPIGRAFX_RESIZER_T resizer, const RPIGRAFX_FILTER_T filter);
+    void rpigrafx_camera_set_recorder(RPIGRAFX_CAMERA_T *cam, RPIGRAFX_RECORDER_T *rec);
+    void rpigrafx_camera_set_motion_detector(RPIGRAFX_CAMERA_T *cam, RPIGRAFX_MOTION_DETECTOR_T *det);
+    void rpigrafx_camera_set_publisher(RPIGRAFX_CAMERA_T *cam, RPIGRAFX_PUBLISHER_T *pub);
+    void rpigrafx_camera_set_capture_buffer_num(RPIGRAFX_CAMERA_T *cam, const int num);
+    void rpigrafx_camera_start_capture(RPIGRAFX_CAMERA_T *cam);
+    void rpigrafx_camera_stop_capture(RPIGRAFX_CAMERA_T *cam);
+    RPIGRAFX_FRAME_T* rpigrafx_camera_get_next_frame(RPIGRAFX_CAMERA_T *cam, const int timeout_ms);
+    RPIGRAFX_FRAME_T* rpigrafx_camera_get_latest_frame(RPIGRAFX_CAMERA_T *cam);
+    RPIGRAFX_FRAME_T* rpigrafx_acquire_frame(RPIGRAFX_FRAME_T *frame);
+    void rpigrafx_release_frame(RPIGRAFX_FRAME_T *frame);
+    void* rpigrafx_frame_get_data(RPIGRAFX_FRAME_T *frame);
+    int rpigrafx_frame_get_width(RPIGRAFX_FRAME_T *frame);
+    int rpigrafx_frame_get_height(RPIGRAFX_FRAME_T *frame);
+    int rpigrafx_frame_get_stride(RPIGRAFX_FRAME_T *frame);
+    int rpigrafx_frame_get_num_planes(RPIGRAFX_FRAME_T *frame);
+    void* rpigrafx_frame_get_plane_data(RPIGRAFX_FRAME_T *frame, const int plane);
+    int rpigrafx_frame_get_plane_stride(RPIGRAFX_FRAME_T *frame, const int plane);
+    RPIGRAFX_FORMAT_T rpigrafx_frame_get_format(RPIGRAFX_FRAME_T *frame);
+    int64_t rpigrafx_frame_get_timestamp(RPIGRAFX_FRAME_T *frame);
+    int64_t rpigrafx_frame_get_receive_time(RPIGRAFX_FRAME_T *frame);
+    uint64_t rpigrafx_frame_get_sequence(RPIGRAFX_FRAME_T *frame);
+    int rpigrafx_frame_get_dropped(RPIGRAFX_FRAME_T *frame);
 
-    /* mmal.c */
+    /* camera.c: on the default camera */
     void rpigrafx_set_camera_num(const int camera_num);
+    void rpigrafx_set_video_mode(const int width, const int height, const int fps, const int sensor_mode);
+    void rpigrafx_set_still_mode();
     void rpigrafx_set_frame_format(const RPIGRAFX_FORMAT_T format);
     void rpigrafx_get_frame_full_size(int *widthp, int *heightp);
     void rpigrafx_set_frame_size(const int width, const int height);
+    void rpigrafx_set_resizer(const RPIGRAFX_RESIZER_T resizer, const RPIGRAFX_FILTER_T filter);
+    void rpigrafx_set_recorder(RPIGRAFX_RECORDER_T *rec);
+    void rpigrafx_set_motion_detector(RPIGRAFX_MOTION_DETECTOR_T *det);
+    void rpigrafx_set_publisher(RPIGRAFX_PUBLISHER_T *pub);
     void rpigrafx_ignite_capture();
     RPIGRAFX_ELEMENT_T rpigrafx_display_frame(const int x, const int y, const int width, const int height);
+    void rpigrafx_start_preview(const int x, const int y, const int width, const int height, const int layer, const int alpha);
+    void rpigrafx_stop_preview();
     void* rpigrafx_get_frame();
+    RPIGRAFX_FRAME_T* rpigrafx_get_frame_handle();
+    void rpigrafx_set_capture_buffer_num(const int num);
+    void rpigrafx_start_capture();
+    void rpigrafx_stop_capture();
+    RPIGRAFX_FRAME_T* rpigrafx_get_next_frame(const int timeout_ms);
+    RPIGRAFX_FRAME_T* rpigrafx_get_latest_frame();
 
 #endif /* RPIGRAFX_H */
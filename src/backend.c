@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "local/backend.h"
+#include "local/error.h"
+
+/* The first one is the default. */
+static const struct local_rpigrafx_backend *backends[] = {
+#ifdef HAVE_VC
+    &local_rpigrafx_backend_vc,
+#endif
+    &local_rpigrafx_backend_soft,
+    NULL
+};
+
+/*
+ * Look up a backend by name.
+ * NULL means the one named by RPIGRAFX_BACKEND, or the default.
+ */
+const struct local_rpigrafx_backend* local_rpigrafx_find_backend(const char *name)
+{
+    int i;
+
+    if (name == NULL)
+        name = getenv("RPIGRAFX_BACKEND");
+    if (name == NULL || name[0] == '\0')
+        return backends[0];
+    for (i = 0; backends[i] != NULL; i ++)
+        if (!strcmp(backends[i]->name, name))
+            return backends[i];
+    error_and_exit("Unknown backend: %s\n", name);
+}
+
+int local_rpigrafx_getenv_int(const char *name, const int def)
+{
+    const char *s = getenv(name);
+    char *end = NULL;
+    long val;
+
+    if (s == NULL || s[0] == '\0')
+        return def;
+    val = strtol(s, &end, 0);
+    if (*end != '\0')
+        error_and_exit("%s is not an integer: %s\n", name, s);
+    return val;
+}
+
+/* Parse a size of the form WIDTHxHEIGHT. The values are kept if name is not set. */
+void local_rpigrafx_getenv_size(const char *name, int *width, int *height)
+{
+    const char *s = getenv(name);
+
+    if (s == NULL || s[0] == '\0')
+        return;
+    if (sscanf(s, "%dx%d", width, height) != 2 || *width <= 0 || *height <= 0)
+        error_and_exit("%s is not a size of WIDTHxHEIGHT: %s\n", name, s);
+}
@@ -0,0 +1,1235 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include "rpigrafx.h"
+#include "local/backend.h"
+#include "local/camera.h"
+#include "local/context.h"
+#include "local/draw.h"
+#include "local/error.h"
+#include "local/stats.h"
+#include "local/sync.h"
+#include "local/workers.h"
+
+
+/* Allocate descriptors for a pool of num buffers of cam. */
+struct rpigrafx_frame* local_rpigrafx_alloc_frames(struct rpigrafx_camera *cam, const int num)
+{
+    struct rpigrafx_frame *fs = NULL;
+    int i;
+
+    fs = calloc(num, sizeof(*fs));
+    if (fs == NULL)
+        error_and_exit("Failed to allocate %d frame descriptors\n", num);
+    for (i = 0; i < num; i ++)
+        fs[i].camera = cam;
+    return fs;
+}
+
+void local_rpigrafx_free_frames(struct rpigrafx_frame *fs, const int num)
+{
+    int i;
+
+    for (i = 0; i < num; i ++)
+        if (fs[i].refcount != 0)
+            error_and_exit("Frame %p is not released yet: %d\n", &fs[i], fs[i].refcount);
+    free(fs);
+}
+
+/*
+ * Layout of an image of width x height as the camera and the resizers write
+ * it: rows are aligned to 32 pixels and the height to 16.
+ * Returns the size of the buffer.
+ */
+int local_rpigrafx_frame_layout(const RPIGRAFX_FORMAT_T format, const int width, const int height, int *num_planes, int *offsets, int *strides)
+{
+    const int w = ALIGN_UP(width, 32), h = ALIGN_UP(height, 16);
+
+    offsets[0] = 0;
+    switch (format) {
+        case RPIGRAFX_FORMAT_RGBA32:
+            *num_planes = 1;
+            strides[0] = w * 4;
+            return w * 4 * h;
+        case RPIGRAFX_FORMAT_RGB24:
+        case RPIGRAFX_FORMAT_BGR24:
+            *num_planes = 1;
+            strides[0] = w * 3;
+            return w * 3 * h;
+        case RPIGRAFX_FORMAT_GRAY8:
+            /* The Y plane of I420. */
+            *num_planes = 1;
+            strides[0] = w;
+            return w * h * 3 / 2;
+        case RPIGRAFX_FORMAT_I420:
+            *num_planes = 3;
+            strides[0] = w;
+            offsets[1] = w * h;
+            strides[1] = w / 2;
+            offsets[2] = w * h + (w / 2) * (h / 2);
+            strides[2] = w / 2;
+            return w * h * 3 / 2;
+        case RPIGRAFX_FORMAT_NV12:
+            *num_planes = 2;
+            strides[0] = w;
+            offsets[1] = w * h;
+            strides[1] = w;
+            return w * h * 3 / 2;
+        default:
+            error_and_exit("Unknown format: %d\n", format);
+    }
+}
+
+/* Fill the metadata of a frame just produced, with one reference. */
+static struct rpigrafx_frame* init_frame(struct rpigrafx_frame *f, const int width, const int height,
+                                         const RPIGRAFX_FORMAT_T format, struct rpigrafx_stream *stream)
+{
+    f->refcount = 1;
+    if (stream == NULL) {
+        const int in_use = __sync_add_and_fetch(&f->camera->frames_in_use, 1);
+        int high = f->camera->frames_high, prev;
+
+        /* The capture thread and users race here; only a larger value may be stored. */
+        while (in_use > high && (prev = __sync_val_compare_and_swap(&f->camera->frames_high, high, in_use)) != high)
+            high = prev;
+    }
+    f->width  = width;
+    f->height = height;
+    f->format = format;
+    local_rpigrafx_frame_layout(format, width, height, &f->num_planes, f->plane_offset, f->plane_stride);
+    f->stream = stream;
+    return f;
+}
+
+static void unref_frame(struct rpigrafx_frame *f)
+{
+    int i;
+
+    if (__sync_sub_and_fetch(&f->refcount, 1) != 0)
+        return;
+    for (i = 0; i < MAX_STREAMS; i ++) {
+        if (f->resized[i] != NULL)
+            unref_frame(f->resized[i]);
+        f->resized[i] = NULL;
+    }
+    if (f->stream == NULL) {
+        __sync_sub_and_fetch(&f->camera->frames_in_use, 1);
+        STATS_COUNT(f->camera->ctx, RPIGRAFX_COUNTER_BUFFERS_RECYCLED, 1);
+    }
+    if (f->stream != NULL && f->stream->resizer == RPIGRAFX_RESIZER_CPU)
+        local_rpigrafx_cpu_stream_release(f);
+    else
+        f->camera->ops->release(f);
+}
+
+/* Create the resizer of stream, of the backend or of cpu_stream.c. */
+static void create_resizer(struct rpigrafx_stream *stream, const int buffer_num)
+{
+    struct rpigrafx_camera *cam = stream->camera;
+
+    if (stream->resizer == RPIGRAFX_RESIZER_CPU)
+        local_rpigrafx_cpu_stream_create(stream, buffer_num, stream->filter,
+                                         local_rpigrafx_workers_num(local_rpigrafx_get_workers(cam->ctx)));
+    else
+        cam->ops->stream_create(stream, buffer_num);
+}
+
+static void destroy_resizer(struct rpigrafx_stream *stream)
+{
+    if (stream->resizer == RPIGRAFX_RESIZER_CPU)
+        local_rpigrafx_cpu_stream_destroy(stream);
+    else
+        stream->camera->ops->stream_destroy(stream);
+}
+
+/*
+ * Run the resizer of stream on a captured frame.
+ * If crop is not NULL, only that part of the frame is resized.
+ */
+static struct rpigrafx_frame* resize_frame(struct rpigrafx_stream *stream, struct rpigrafx_frame *src, const RPIGRAFX_RECT_T *crop)
+{
+    struct rpigrafx_frame *f = NULL;
+    STATS_START(t);
+
+    if (stream->resizer == RPIGRAFX_RESIZER_CPU)
+        f = local_rpigrafx_cpu_stream_resize(stream, src, crop, local_rpigrafx_get_workers(stream->camera->ctx));
+    else
+        f = stream->camera->ops->stream_resize(stream, src, crop);
+    STATS_STAGE(stream->camera->ctx, RPIGRAFX_STAGE_RESIZE, t);
+    init_frame(f, stream->width, stream->height, stream->format, stream);
+    f->timestamp = src->timestamp;
+    f->receive_time = src->receive_time;
+    f->sequence = src->sequence;
+    f->dropped = src->dropped;
+    return f;
+}
+
+/*
+ * Returns the frame of stream made from a captured frame, without taking a
+ * reference.  The result is cached in the captured frame.
+ */
+static struct rpigrafx_frame* stream_frame(struct rpigrafx_frame *src, struct rpigrafx_stream *stream)
+{
+    struct rpigrafx_camera *cam = stream->camera;
+    struct rpigrafx_frame *f = NULL;
+
+    if (src->stream != NULL)
+        error_and_exit("Frame %p is not a captured frame\n", src);
+    if (stream->is_roi)
+        error_and_exit("Stream %p is an ROI stream\n", stream);
+
+    pthread_mutex_lock(&cam->stream_mutex);
+    if (src->resized[stream->index] == NULL)
+        src->resized[stream->index] = resize_frame(stream, src, NULL);
+    f = src->resized[stream->index];
+    pthread_mutex_unlock(&cam->stream_mutex);
+    return f;
+}
+
+/* The frame descriptors of the stream are left to the caller. */
+static void destroy_stream(struct rpigrafx_stream *stream)
+{
+    struct rpigrafx_camera *cam = stream->camera;
+
+    destroy_resizer(stream);
+    cam->streams[stream->index] = NULL;
+    if (stream == cam->default_stream)
+        cam->default_stream = NULL;
+    free(stream);
+}
+
+static struct rpigrafx_stream* create_stream(struct rpigrafx_camera *cam, const int width, const int height, const RPIGRAFX_FORMAT_T format, const int max_rois,
+                                             const RPIGRAFX_RESIZER_T resizer, const RPIGRAFX_FILTER_T filter)
+{
+    struct rpigrafx_stream *stream = NULL;
+    int i;
+
+    if (cam->is_capture_running)
+        error_and_exit("Cannot create a stream while async capture is running\n");
+    if (format <= RPIGRAFX_FORMAT_MIN || format >= RPIGRAFX_FORMAT_MAX)
+        error_and_exit("Unknown format: %d\n", format);
+    if (resizer <= RPIGRAFX_RESIZER_MIN || resizer >= RPIGRAFX_RESIZER_MAX)
+        error_and_exit("Unknown resizer: %d\n", resizer);
+    if (filter <= RPIGRAFX_FILTER_MIN || filter >= RPIGRAFX_FILTER_MAX)
+        error_and_exit("Unknown filter: %d\n", filter);
+
+    for (i = 0; i < MAX_STREAMS; i ++)
+        if (cam->streams[i] == NULL)
+            break;
+    if (i == MAX_STREAMS)
+        error_and_exit("Too many streams: %d\n", MAX_STREAMS);
+
+    stream = calloc(1, sizeof(*stream));
+    if (stream == NULL)
+        error_and_exit("Failed to allocate a stream\n");
+    stream->camera = cam;
+    stream->index = i;
+    stream->width = width;
+    stream->height = height;
+    stream->format = format;
+    stream->is_roi = max_rois > 0;
+    stream->resizer = resizer;
+    stream->filter = filter;
+
+    create_resizer(stream, max_rois);
+
+    cam->streams[i] = stream;
+    return stream;
+}
+
+/* Forget the frame of stream cached for the current synchronous capture. */
+static void forget_stream_frame(struct rpigrafx_stream *stream)
+{
+    struct rpigrafx_frame *f = stream->camera->frame_full;
+
+    if (f == NULL)
+        return;
+    if (f->resized[stream->index] != NULL)
+        unref_frame(f->resized[stream->index]);
+    f->resized[stream->index] = NULL;
+}
+
+/* Number a frame just captured. */
+static void sequence_frame(struct rpigrafx_camera *cam, struct rpigrafx_frame *f)
+{
+    f->sequence = cam->capture_seq ++;
+    f->dropped = 0;
+}
+
+/*
+ * Count the frames skipped since the previous frame handed out to the
+ * user, on f and on its resized frames made so far.
+ * Async capture must call this with capture_mutex held.
+ */
+static void deliver_frame(struct rpigrafx_camera *cam, struct rpigrafx_frame *f)
+{
+    int i;
+
+    f->dropped = f->sequence - cam->deliver_seq;
+    cam->deliver_seq = f->sequence + 1;
+    for (i = 0; i < MAX_STREAMS; i ++)
+        if (f->resized[i] != NULL)
+            f->resized[i]->dropped = f->dropped;
+}
+
+/*
+ * Record a captured frame being handed out, and compare it to the previous
+ * one and publish it as the frame of the default stream if there is one,
+ * as rpigrafx_camera_get_frame() returns.
+ */
+static void observe_frame(struct rpigrafx_camera *cam, struct rpigrafx_frame *f)
+{
+    struct rpigrafx_frame *sf = f;
+
+    if (cam->recorder != NULL)
+        rpigrafx_recorder_write_frame(cam->recorder, f);
+    if (cam->default_stream != NULL && (cam->motion_detector != NULL || cam->publisher != NULL))
+        sf = stream_frame(f, cam->default_stream);
+    if (cam->motion_detector != NULL)
+        rpigrafx_motion_detector_update(cam->motion_detector, sf);
+    if (cam->publisher != NULL)
+        rpigrafx_publisher_write_frame(cam->publisher, sf);
+}
+
+static void release_frame_full(struct rpigrafx_camera *cam)
+{
+    if (cam->frame_full != NULL)
+        unref_frame(cam->frame_full);
+    cam->frame_full = NULL;
+}
+
+static void get_frame_full(struct rpigrafx_camera *cam)
+{
+    struct rpigrafx_frame *f = NULL;
+
+    if (cam->is_capture_running)
+        error_and_exit("Synchronous capture is not available while async capture is running\n");
+    if (cam->is_frame_full_ready)
+        return;
+    if (!cam->is_capture_ignited)
+        rpigrafx_camera_ignite_capture(cam);
+
+    cam->ops->queue_buffers(cam);
+    {
+        STATS_START(t);
+        f = cam->ops->get_full(cam, 1);
+        STATS_STAGE(cam->ctx, RPIGRAFX_STAGE_CAPTURE_WAIT, t);
+    }
+    STATS_COUNT(cam->ctx, RPIGRAFX_COUNTER_FRAMES_CAPTURED, 1);
+    cam->frame_full = init_frame(f, cam->frame_full_width, cam->frame_full_height, RPIGRAFX_FORMAT_RGBA32, NULL);
+    sequence_frame(cam, f);
+    deliver_frame(cam, f);
+    cam->is_frame_full_ready = 1;
+    observe_frame(cam, f);
+}
+
+/*
+ * Called by the backend, possibly on its own thread, when a capture buffer
+ * gets full or is released. Never call the backend from here.
+ */
+void local_rpigrafx_camera_event(struct rpigrafx_camera *cam)
+{
+    pthread_mutex_lock(&cam->capture_mutex);
+    cam->is_capture_event = 1;
+    pthread_cond_signal(&cam->capture_cond);
+    pthread_mutex_unlock(&cam->capture_mutex);
+}
+
+/* Must be called with capture_mutex held. */
+static struct rpigrafx_frame* pop_ready_frame(struct rpigrafx_camera *cam)
+{
+    struct rpigrafx_frame *f;
+
+    if (cam->ready_frames_num == 0)
+        return NULL;
+    f = cam->ready_frames[cam->ready_frames_head];
+    cam->ready_frames_head = (cam->ready_frames_head + 1) % cam->ready_frames_len;
+    cam->ready_frames_num --;
+    return f;
+}
+
+/* Must be called with capture_mutex held. */
+static void push_ready_frame(struct rpigrafx_camera *cam, struct rpigrafx_frame *f)
+{
+    cam->ready_frames[(cam->ready_frames_head + cam->ready_frames_num) % cam->ready_frames_len] = f;
+    cam->ready_frames_num ++;
+    pthread_cond_broadcast(&cam->frame_cond);
+}
+
+/* Every buffer is taken: recycle the oldest unconsumed frame. */
+static void drop_oldest_ready_frame(struct rpigrafx_camera *cam)
+{
+    struct rpigrafx_frame *f = NULL;
+
+    pthread_mutex_lock(&cam->capture_mutex);
+    f = pop_ready_frame(cam);
+    pthread_mutex_unlock(&cam->capture_mutex);
+    if (f != NULL) {
+        STATS_COUNT(cam->ctx, RPIGRAFX_COUNTER_FRAMES_DROPPED, 1);
+        unref_frame(f);
+    }
+}
+
+static void* capture_thread_main(void *arg)
+{
+    struct rpigrafx_camera *cam = arg;
+    struct rpigrafx_frame *f = NULL;
+    int num_queued, i;
+    _Bool is_capture_pending = 0;
+
+    pthread_mutex_lock(&cam->capture_mutex);
+    while (cam->is_capture_running) {
+        cam->is_capture_event = 0;
+        pthread_mutex_unlock(&cam->capture_mutex);
+
+        /* Buffers must be released without capture_mutex held: see local_rpigrafx_camera_event. */
+        while ((f = cam->ops->get_full(cam, 0)) != NULL) {
+            is_capture_pending = 0;
+            STATS_COUNT(cam->ctx, RPIGRAFX_COUNTER_FRAMES_CAPTURED, 1);
+            init_frame(f, cam->frame_full_width, cam->frame_full_height, RPIGRAFX_FORMAT_RGBA32, NULL);
+            sequence_frame(cam, f);
+            for (i = 0; i < MAX_STREAMS; i ++)
+                if (cam->streams[i] != NULL && !cam->streams[i]->is_roi)
+                    stream_frame(f, cam->streams[i]);
+            pthread_mutex_lock(&cam->capture_mutex);
+            push_ready_frame(cam, f);
+            pthread_mutex_unlock(&cam->capture_mutex);
+        }
+        num_queued = cam->ops->queue_buffers(cam);
+
+        if (cam->is_video_mode) {
+            /* The video port fills the queued buffers by itself. */
+            if (num_queued == 0)
+                drop_oldest_ready_frame(cam);
+        } else if (!is_capture_pending) {
+            if (num_queued > 0) {
+                cam->ops->trigger(cam);
+                is_capture_pending = 1;
+            } else
+                drop_oldest_ready_frame(cam);
+        }
+
+        pthread_mutex_lock(&cam->capture_mutex);
+        while (cam->is_capture_running && !cam->is_capture_event)
+            pthread_cond_wait(&cam->capture_cond, &cam->capture_mutex);
+    }
+    pthread_mutex_unlock(&cam->capture_mutex);
+
+    return NULL;
+}
+
+
+/* Query the cameras connected. Must be called with ctx->mutex held. */
+void local_rpigrafx_query_cameras(RPIGRAFX_CONTEXT_T *ctx)
+{
+    if (ctx->num_cameras >= 0)
+        return;
+    ctx->backend->camera->query_cameras(ctx);
+}
+
+RPIGRAFX_CAMERA_T* rpigrafx_open_camera(RPIGRAFX_CONTEXT_T *ctx, const int camera_num)
+{
+    struct rpigrafx_camera *cam = NULL;
+
+    pthread_mutex_lock(&ctx->mutex);
+    local_rpigrafx_query_cameras(ctx);
+    if (ctx->num_cameras <= 0)
+        error_and_exit("No cameras found: %d\n", ctx->num_cameras);
+    if (camera_num < 0 || camera_num >= ctx->num_cameras)
+        error_and_exit("Invalid camera number: %d\n", camera_num);
+    if (ctx->cameras[camera_num] != NULL)
+        error_and_exit("Camera %d is already opened\n", camera_num);
+
+    cam = calloc(1, sizeof(*cam));
+    if (cam == NULL)
+        error_and_exit("Failed to allocate a camera\n");
+    ctx->cameras[camera_num] = cam;
+    pthread_mutex_unlock(&ctx->mutex);
+
+    cam->ctx = ctx;
+    cam->ops = ctx->backend->camera;
+    cam->camera_num = camera_num;
+    cam->frame_encoding = RPIGRAFX_FORMAT_RGBA32;
+    cam->frame_resizer = RPIGRAFX_RESIZER_ISP;
+    cam->frame_filter = RPIGRAFX_FILTER_BILINEAR;
+    cam->capture_buffer_num = 3;
+    pthread_mutex_lock(&ctx->mutex);
+    local_rpigrafx_camera_reserve_pools(cam, &ctx->pool_config);
+    pthread_mutex_unlock(&ctx->mutex);
+    pthread_mutex_init(&cam->stream_mutex, NULL);
+    pthread_mutex_init(&cam->capture_mutex, NULL);
+
+    /* Frames are captured at the native resolution of the sensor. */
+    cam->frame_full_width  = ctx->camera_info[camera_num].max_width;
+    cam->frame_full_height = ctx->camera_info[camera_num].max_height;
+
+    cam->ops->open(cam);
+
+    cam->frame_width  = cam->frame_full_width;
+    cam->frame_height = cam->frame_full_height;
+
+    return cam;
+}
+
+/*
+ * Exit with an error if the user still holds a frame of cam or of its
+ * streams, since their buffers are about to be freed by caller.
+ */
+static void check_frames_released(struct rpigrafx_camera *cam, const char *caller)
+{
+    struct rpigrafx_stream *stream = NULL;
+    int i, j;
+
+    for (i = 0; i < cam->frames_len; i ++)
+        if (cam->frames[i].refcount != 0)
+            error_and_exit("%s: frame %p is still held; release all frames first\n", caller, &cam->frames[i]);
+    for (i = 0; i < MAX_STREAMS; i ++) {
+        stream = cam->streams[i];
+        if (stream == NULL)
+            continue;
+        for (j = 0; j < stream->frames_len; j ++)
+            if (stream->frames[j].refcount != 0)
+                error_and_exit("%s: frame %p of stream %p is still held; release all frames first\n",
+                               caller, &stream->frames[j], stream);
+    }
+}
+
+/* Every frame taken from cam must have been released. */
+void rpigrafx_close_camera(RPIGRAFX_CAMERA_T *cam)
+{
+    RPIGRAFX_CONTEXT_T *ctx = cam->ctx;
+    struct rpigrafx_frame *fs = NULL;
+    int i;
+
+    if (cam->is_capture_running)
+        rpigrafx_camera_stop_capture(cam);
+    rpigrafx_camera_stop_preview(cam);
+    release_frame_full(cam);
+    check_frames_released(cam, "rpigrafx_close_camera");
+    for (i = 0; i < MAX_STREAMS; i ++) {
+        if (cam->streams[i] == NULL)
+            continue;
+        fs = cam->streams[i]->frames;
+        destroy_stream(cam->streams[i]);
+        free(fs);
+    }
+
+    cam->ops->close(cam);
+    free(cam->frames);
+
+    pthread_mutex_destroy(&cam->stream_mutex);
+    pthread_mutex_destroy(&cam->capture_mutex);
+
+    pthread_mutex_lock(&ctx->mutex);
+    ctx->cameras[cam->camera_num] = NULL;
+    pthread_mutex_unlock(&ctx->mutex);
+    free(cam);
+}
+
+
+void rpigrafx_camera_set_camera_num(RPIGRAFX_CAMERA_T *cam, const int camera_num)
+{
+    RPIGRAFX_CONTEXT_T *ctx = cam->ctx;
+
+    if (cam->is_capture_running)
+        error_and_exit("Cannot change the camera while async capture is running\n");
+
+    pthread_mutex_lock(&ctx->mutex);
+    if (camera_num < 0 || camera_num >= ctx->num_cameras)
+        error_and_exit("Invalid camera number: %d\n", camera_num);
+    if (ctx->cameras[camera_num] != NULL && ctx->cameras[camera_num] != cam)
+        error_and_exit("Camera %d is already opened\n", camera_num);
+    ctx->cameras[cam->camera_num] = NULL;
+    ctx->cameras[camera_num] = cam;
+    pthread_mutex_unlock(&ctx->mutex);
+
+    /* The capture buffers are reallocated for the new size. */
+    release_frame_full(cam);
+    cam->is_capture_ignited = cam->is_frame_full_ready = 0;
+    cam->camera_num = camera_num;
+    /* Video mode keeps the size given to rpigrafx_camera_set_video_mode(). */
+    if (!cam->is_video_mode) {
+        cam->frame_full_width  = ctx->camera_info[camera_num].max_width;
+        cam->frame_full_height = ctx->camera_info[camera_num].max_height;
+    }
+    cam->ops->set_camera_num(cam, camera_num);
+
+    rpigrafx_camera_set_frame_size(cam, cam->frame_width, cam->frame_height);
+}
+
+static void set_capture_mode(struct rpigrafx_camera *cam, const _Bool is_video_mode,
+                             const int width, const int height, const int fps, const int sensor_mode)
+{
+    if (cam->is_capture_running)
+        error_and_exit("Cannot change the capture mode while async capture is running\n");
+
+    release_frame_full(cam);
+    cam->is_capture_ignited = cam->is_frame_full_ready = 0;
+    cam->is_video_mode = is_video_mode;
+    cam->frame_full_width  = width;
+    cam->frame_full_height = height;
+    cam->video_fps = fps;
+    cam->sensor_mode = sensor_mode;
+    cam->ops->set_capture_mode(cam);
+
+    rpigrafx_camera_set_frame_size(cam, cam->frame_width, cam->frame_height);
+}
+
+/*
+ * Stream captured frames of width x height continuously from the video
+ * port at fps frames per second, instead of triggering each capture on the
+ * still port.  sensor_mode selects the sensor mode as raspivid's -md does;
+ * 0 lets the camera choose one from the size and the frame rate.
+ * rpigrafx_camera_ignite_capture() then means to take the next frame after
+ * it, and async capture keeps every queued buffer filled.
+ */
+void rpigrafx_camera_set_video_mode(RPIGRAFX_CAMERA_T *cam, const int width, const int height, const int fps, const int sensor_mode)
+{
+    if (width <= 0 || height <= 0)
+        error_and_exit("Invalid video size: %dx%d\n", width, height);
+    if (fps <= 0)
+        error_and_exit("Invalid frame rate: %d\n", fps);
+    if (sensor_mode < 0)
+        error_and_exit("Invalid sensor mode: %d\n", sensor_mode);
+    set_capture_mode(cam, 1, width, height, fps, sensor_mode);
+}
+
+/* Go back to triggered captures of the full sensor size on the still port, e.g. for a snapshot. */
+void rpigrafx_camera_set_still_mode(RPIGRAFX_CAMERA_T *cam)
+{
+    RPIGRAFX_CONTEXT_T *ctx = cam->ctx;
+
+    set_capture_mode(cam, 0, ctx->camera_info[cam->camera_num].max_width, ctx->camera_info[cam->camera_num].max_height, 0, 0);
+}
+
+/*
+ * Set the format of the frames of the default stream.
+ * Captured frames stay RGBA32; other formats are converted by the resizer.
+ */
+void rpigrafx_camera_set_frame_format(RPIGRAFX_CAMERA_T *cam, const RPIGRAFX_FORMAT_T format)
+{
+    if (format <= RPIGRAFX_FORMAT_MIN || format >= RPIGRAFX_FORMAT_MAX)
+        error_and_exit("Unknown format: %d\n", format);
+    cam->frame_encoding = format;
+    rpigrafx_camera_set_frame_size(cam, cam->frame_width, cam->frame_height);
+}
+
+void rpigrafx_camera_get_frame_full_size(RPIGRAFX_CAMERA_T *cam, int *widthp, int *heightp)
+{
+    *widthp  = cam->frame_full_width;
+    *heightp = cam->frame_full_height;
+}
+
+void rpigrafx_camera_set_frame_size(RPIGRAFX_CAMERA_T *cam, const int width, const int height)
+{
+    cam->frame_width  = width;
+    cam->frame_height = height;
+
+    if (cam->default_stream != NULL)
+        rpigrafx_destroy_stream(cam->default_stream);
+    if (cam->frame_width == cam->frame_full_width && cam->frame_height == cam->frame_full_height
+            && cam->frame_encoding == RPIGRAFX_FORMAT_RGBA32)
+        return;
+
+    cam->default_stream = create_stream(cam, cam->frame_width, cam->frame_height, cam->frame_encoding, 0,
+                                        cam->frame_resizer, cam->frame_filter);
+}
+
+
+void rpigrafx_camera_ignite_capture(RPIGRAFX_CAMERA_T *cam)
+{
+    cam->ops->trigger(cam);
+    release_frame_full(cam);
+    cam->is_capture_ignited = 1;
+    cam->is_frame_full_ready = 0;
+}
+
+/*
+ * Show the preview output of the camera at x, y, width x height of disp,
+ * tunneled to the display without passing through the ARM, unlike
+ * rpigrafx_camera_display_frame().  Drawings are on the layer set by
+ * rpigrafx_display_set_layer() (5 by default), so a lower layer keeps them
+ * on top of the preview.
+ * alpha is 0 (transparent) to 255 (opaque).
+ * Calling this again moves the preview.
+ */
+void rpigrafx_camera_start_preview(RPIGRAFX_CAMERA_T *cam, RPIGRAFX_DISPLAY_T *disp, const int x, const int y, const int width, const int height, const int layer, const int alpha)
+{
+    const RPIGRAFX_RECT_T dst = {x, y, width, height};
+    void *display = NULL;
+    int display_num;
+
+    if (width <= 0 || height <= 0)
+        error_and_exit("Invalid preview size: %dx%d\n", width, height);
+    if (alpha < 0 || alpha > 255)
+        error_and_exit("Invalid alpha: %d\n", alpha);
+
+    rpigrafx_camera_stop_preview(cam);
+    display = local_rpigrafx_display_get_backend(disp, &display_num);
+    cam->ops->start_preview(cam, display, display_num, &dst, layer, alpha);
+    cam->preview_display = disp;
+}
+
+void rpigrafx_camera_stop_preview(RPIGRAFX_CAMERA_T *cam)
+{
+    if (cam->preview_display == NULL)
+        return;
+    cam->ops->stop_preview(cam);
+    cam->preview_display = NULL;
+}
+
+RPIGRAFX_ELEMENT_T rpigrafx_camera_display_frame(RPIGRAFX_CAMERA_T *cam, RPIGRAFX_DISPLAY_T *disp, const int x, const int y, const int width, const int height)
+{
+    get_frame_full(cam);
+    return rpigrafx_display_render_image_scale(disp, cam->frame_full->data, x, y, cam->frame_full_width, cam->frame_full_height, width, height);
+}
+
+void* rpigrafx_camera_get_frame(RPIGRAFX_CAMERA_T *cam)
+{
+    get_frame_full(cam);
+
+    if (cam->default_stream == NULL)
+        return cam->frame_full->data;
+    return stream_frame(cam->frame_full, cam->default_stream)->data;
+}
+
+/*
+ * Create a stream of frames resized to width x height.
+ * Streams can be created and destroyed only while async capture is stopped.
+ */
+RPIGRAFX_STREAM_T* rpigrafx_create_stream(RPIGRAFX_CAMERA_T *cam, const int width, const int height, const RPIGRAFX_FORMAT_T format)
+{
+    return create_stream(cam, width, height, format, 0, RPIGRAFX_RESIZER_ISP, RPIGRAFX_FILTER_BILINEAR);
+}
+
+/*
+ * Create a stream which resizes regions of captured frames to
+ * width x height with rpigrafx_get_roi_frames().  Up to max_rois of its
+ * frames can be held at the same time.
+ */
+RPIGRAFX_STREAM_T* rpigrafx_create_roi_stream(RPIGRAFX_CAMERA_T *cam, const int width, const int height, const RPIGRAFX_FORMAT_T format, const int max_rois)
+{
+    if (max_rois <= 0)
+        error_and_exit("Invalid number of ROIs: %d\n", max_rois);
+    return create_stream(cam, width, height, format, max_rois, RPIGRAFX_RESIZER_ISP, RPIGRAFX_FILTER_BILINEAR);
+}
+
+void rpigrafx_destroy_stream(RPIGRAFX_STREAM_T *stream)
+{
+    struct rpigrafx_camera *cam = stream->camera;
+    struct rpigrafx_frame *fs = stream->frames;
+    const int fs_len = stream->frames_len;
+
+    if (cam->is_capture_running)
+        error_and_exit("Cannot destroy a stream while async capture is running\n");
+
+    forget_stream_frame(stream);
+    destroy_stream(stream);
+    local_rpigrafx_free_frames(fs, fs_len);
+}
+
+/* Returns a new reference to the frame of stream made from a captured frame. */
+RPIGRAFX_FRAME_T* rpigrafx_get_stream_frame(RPIGRAFX_FRAME_T *frame, RPIGRAFX_STREAM_T *stream)
+{
+    return rpigrafx_acquire_frame(stream_frame(frame, stream));
+}
+
+/*
+ * Crop num regions of a captured frame and resize each of them to the size
+ * of the ROI stream, one resizer pass each.  frames[i] gets a new reference to
+ * the result for rois[i].
+ */
+void rpigrafx_get_roi_frames(RPIGRAFX_FRAME_T *frame, RPIGRAFX_STREAM_T *stream, const RPIGRAFX_RECT_T *rois, const int num, RPIGRAFX_FRAME_T **frames)
+{
+    struct rpigrafx_camera *cam = stream->camera;
+    int i, num_free = 0;
+
+    if (frame->stream != NULL)
+        error_and_exit("Frame %p is not a captured frame\n", frame);
+    if (!stream->is_roi)
+        error_and_exit("Stream %p is not an ROI stream\n", stream);
+    for (i = 0; i < num; i ++)
+        if (rois[i].x < 0 || rois[i].y < 0 || rois[i].width <= 0 || rois[i].height <= 0
+                || rois[i].x + rois[i].width > frame->width || rois[i].y + rois[i].height > frame->height)
+            error_and_exit("ROI %d is out of the frame: %d,%d+%dx%d\n", i,
+                           rois[i].x, rois[i].y, rois[i].width, rois[i].height);
+
+    pthread_mutex_lock(&cam->stream_mutex);
+    /* Waiting for more buffers than are free would never return. */
+    for (i = 0; i < stream->frames_len; i ++)
+        if (stream->frames[i].refcount == 0)
+            num_free ++;
+    if (num > num_free)
+        error_and_exit("Too many ROIs: %d; %d frames of the stream are free\n", num, num_free);
+    for (i = 0; i < num; i ++)
+        frames[i] = resize_frame(stream, frame, &rois[i]);
+    pthread_mutex_unlock(&cam->stream_mutex);
+}
+
+
+void rpigrafx_camera_set_capture_buffer_num(RPIGRAFX_CAMERA_T *cam, const int num)
+{
+    if (cam->is_capture_running)
+        error_and_exit("Cannot change the number of buffers while capturing\n");
+    if (num < 2)
+        error_and_exit("At least 2 buffers are needed for async capture: %d\n", num);
+    cam->capture_buffer_num = num;
+}
+
+/* The capture buffers are allocated by the next rpigrafx_camera_start_capture(). */
+void local_rpigrafx_camera_reserve_pools(RPIGRAFX_CAMERA_T *cam, const RPIGRAFX_POOL_CONFIG_T *config)
+{
+    if (config->frame_buffers > 0)
+        cam->capture_buffer_num = config->frame_buffers;
+}
+
+/* Add the size and the high-water mark of the capture buffers of the camera to stats. */
+void local_rpigrafx_camera_get_pool_stats(RPIGRAFX_CAMERA_T *cam, RPIGRAFX_POOL_STATS_T *stats)
+{
+    if (cam->capture_buffer_num > stats->size.frame_buffers)
+        stats->size.frame_buffers = cam->capture_buffer_num;
+    if (cam->frames_high > stats->high.frame_buffers)
+        stats->high.frame_buffers = cam->frames_high;
+}
+
+/* Recreate the resizer of stream with at least buffer_num buffers. */
+static void grow_stream(struct rpigrafx_stream *stream, const int buffer_num)
+{
+    struct rpigrafx_frame *fs = stream->frames;
+    const int fs_len = stream->frames_len;
+
+    destroy_resizer(stream);
+    local_rpigrafx_free_frames(fs, fs_len);
+    create_resizer(stream, buffer_num);
+}
+
+/*
+ * Resize the frames of stream with resizer, and with filter if it is
+ * RPIGRAFX_RESIZER_CPU.  Frames of the stream must not be held, and async
+ * capture must be stopped.
+ */
+void rpigrafx_stream_set_resizer(RPIGRAFX_STREAM_T *stream, const RPIGRAFX_RESIZER_T resizer, const RPIGRAFX_FILTER_T filter)
+{
+    if (resizer <= RPIGRAFX_RESIZER_MIN || resizer >= RPIGRAFX_RESIZER_MAX)
+        error_and_exit("Unknown resizer: %d\n", resizer);
+    if (filter <= RPIGRAFX_FILTER_MIN || filter >= RPIGRAFX_FILTER_MAX)
+        error_and_exit("Unknown filter: %d\n", filter);
+    if (stream->camera->is_capture_running)
+        error_and_exit("Cannot change the resizer while async capture is running\n");
+
+    forget_stream_frame(stream);
+    destroy_resizer(stream);
+    local_rpigrafx_free_frames(stream->frames, stream->frames_len);
+    stream->resizer = resizer;
+    stream->filter = filter;
+    /* ROI streams keep the number of their frames. */
+    create_resizer(stream, stream->frames_len);
+}
+
+/* The resizer of the default stream, which rpigrafx_camera_set_frame_size() makes. */
+void rpigrafx_camera_set_resizer(RPIGRAFX_CAMERA_T *cam, const RPIGRAFX_RESIZER_T resizer, const RPIGRAFX_FILTER_T filter)
+{
+    if (cam->default_stream != NULL)
+        rpigrafx_stream_set_resizer(cam->default_stream, resizer, filter);
+    else if (resizer <= RPIGRAFX_RESIZER_MIN || resizer >= RPIGRAFX_RESIZER_MAX)
+        error_and_exit("Unknown resizer: %d\n", resizer);
+    else if (filter <= RPIGRAFX_FILTER_MIN || filter >= RPIGRAFX_FILTER_MAX)
+        error_and_exit("Unknown filter: %d\n", filter);
+    cam->frame_resizer = resizer;
+    cam->frame_filter = filter;
+}
+
+/*
+ * Write every captured frame handed out from now on to rec, at the full
+ * resolution whatever the streams are.  NULL stops recording.  Frames
+ * recycled unseen are not recorded.
+ */
+void rpigrafx_camera_set_recorder(RPIGRAFX_CAMERA_T *cam, RPIGRAFX_RECORDER_T *rec)
+{
+    if (cam->is_capture_running)
+        error_and_exit("Cannot change the recorder while async capture is running\n");
+    cam->recorder = rec;
+}
+
+/*
+ * Compare every frame handed out from now on to the previous one with det,
+ * whose results are then those of the last frame.  NULL stops it.
+ */
+void rpigrafx_camera_set_motion_detector(RPIGRAFX_CAMERA_T *cam, RPIGRAFX_MOTION_DETECTOR_T *det)
+{
+    if (cam->is_capture_running)
+        error_and_exit("Cannot change the motion detector while async capture is running\n");
+    cam->motion_detector = det;
+}
+
+/*
+ * Publish every frame handed out from now on to pub, for processes which
+ * subscribe to it.  The frames must have the size and format of pub.
+ * NULL stops it.
+ */
+void rpigrafx_camera_set_publisher(RPIGRAFX_CAMERA_T *cam, RPIGRAFX_PUBLISHER_T *pub)
+{
+    if (cam->is_capture_running)
+        error_and_exit("Cannot change the publisher while async capture is running\n");
+    cam->publisher = pub;
+}
+
+void rpigrafx_camera_start_capture(RPIGRAFX_CAMERA_T *cam)
+{
+    int i;
+
+    if (cam->is_capture_running)
+        error_and_exit("Async capture is already running\n");
+
+    /* Drop whatever the synchronous path holds. */
+    release_frame_full(cam);
+    cam->is_capture_ignited = cam->is_frame_full_ready = 0;
+
+    cam->ops->set_buffer_num(cam, cam->capture_buffer_num);
+    /*
+     * Each captured frame in flight holds a frame of every stream, so fewer
+     * buffers in a stream would stall the capture thread.
+     */
+    for (i = 0; i < MAX_STREAMS; i ++)
+        if (cam->streams[i] != NULL && !cam->streams[i]->is_roi && cam->streams[i]->frames_len < cam->frames_len)
+            grow_stream(cam->streams[i], cam->frames_len);
+
+    cam->ready_frames = calloc(cam->frames_len, sizeof(*cam->ready_frames));
+    if (cam->ready_frames == NULL)
+        error_and_exit("Failed to allocate frame ring of %d entries\n", cam->frames_len);
+    cam->ready_frames_len = cam->frames_len;
+    cam->ready_frames_head = cam->ready_frames_num = 0;
+
+    local_rpigrafx_init_cond_monotonic(&cam->capture_cond);
+    local_rpigrafx_init_cond_monotonic(&cam->frame_cond);
+    cam->is_capture_running = 1;
+    cam->is_capture_event = 1;
+    cam->ops->set_event_callback(cam, 1);
+    if (pthread_create(&cam->capture_thread, NULL, capture_thread_main, cam))
+        error_and_exit("Failed to create capture thread\n");
+}
+
+/*
+ * Frames not taken yet are recycled.  Every frame taken must have been
+ * released, since the capture buffers are freed.
+ */
+void rpigrafx_camera_stop_capture(RPIGRAFX_CAMERA_T *cam)
+{
+    struct rpigrafx_frame *f = NULL;
+
+    if (!cam->is_capture_running)
+        return;
+
+    pthread_mutex_lock(&cam->capture_mutex);
+    cam->is_capture_running = 0;
+    pthread_cond_signal(&cam->capture_cond);
+    pthread_mutex_unlock(&cam->capture_mutex);
+    pthread_join(cam->capture_thread, NULL);
+    cam->ops->set_event_callback(cam, 0);
+
+    for (; ; ) {
+        pthread_mutex_lock(&cam->capture_mutex);
+        f = pop_ready_frame(cam);
+        pthread_mutex_unlock(&cam->capture_mutex);
+        if (f == NULL)
+            break;
+        unref_frame(f);
+    }
+    check_frames_released(cam, "rpigrafx_camera_stop_capture");
+
+    cam->ops->set_buffer_num(cam, 0);
+
+    free(cam->ready_frames);
+    cam->ready_frames = NULL;
+    cam->ready_frames_len = cam->ready_frames_head = cam->ready_frames_num = 0;
+    pthread_cond_destroy(&cam->capture_cond);
+    pthread_cond_destroy(&cam->frame_cond);
+}
+
+/*
+ * Wait for a frame to arrive.
+ * Negative timeout_ms means waiting forever.
+ * Must be called with capture_mutex held.
+ */
+static int wait_ready_frame(struct rpigrafx_camera *cam, const int timeout_ms)
+{
+    struct timespec deadline;
+
+    if (timeout_ms >= 0)
+        local_rpigrafx_deadline_ms(&deadline, timeout_ms);
+    while (cam->ready_frames_num == 0) {
+        if (timeout_ms < 0)
+            pthread_cond_wait(&cam->frame_cond, &cam->capture_mutex);
+        else if (pthread_cond_timedwait(&cam->frame_cond, &cam->capture_mutex, &deadline) == ETIMEDOUT)
+            return cam->ready_frames_num != 0;
+    }
+    return 1;
+}
+
+/* Returns the oldest frame not taken yet, or NULL on timeout. */
+RPIGRAFX_FRAME_T* rpigrafx_camera_get_next_frame(RPIGRAFX_CAMERA_T *cam, const int timeout_ms)
+{
+    struct rpigrafx_frame *f = NULL;
+    STATS_START(t);
+
+    if (!cam->is_capture_running)
+        error_and_exit("Async capture is not running\n");
+
+    pthread_mutex_lock(&cam->capture_mutex);
+    if (wait_ready_frame(cam, timeout_ms)) {
+        f = pop_ready_frame(cam);
+        deliver_frame(cam, f);
+    }
+    pthread_mutex_unlock(&cam->capture_mutex);
+    STATS_STAGE(cam->ctx, RPIGRAFX_STAGE_CAPTURE_WAIT, t);
+    if (f != NULL)
+        observe_frame(cam, f);
+    return f;
+}
+
+/* Returns the newest frame and recycles the older ones. */
+RPIGRAFX_FRAME_T* rpigrafx_camera_get_latest_frame(RPIGRAFX_CAMERA_T *cam)
+{
+    struct rpigrafx_frame *f = NULL, *stale = NULL;
+    STATS_START(t);
+
+    if (!cam->is_capture_running)
+        error_and_exit("Async capture is not running\n");
+
+    for (; ; ) {
+        pthread_mutex_lock(&cam->capture_mutex);
+        wait_ready_frame(cam, -1);
+        if (cam->ready_frames_num == 1) {
+            f = pop_ready_frame(cam);
+            deliver_frame(cam, f);
+        } else
+            stale = pop_ready_frame(cam);
+        pthread_mutex_unlock(&cam->capture_mutex);
+        if (f != NULL) {
+            STATS_STAGE(cam->ctx, RPIGRAFX_STAGE_CAPTURE_WAIT, t);
+            observe_frame(cam, f);
+            return f;
+        }
+        STATS_COUNT(cam->ctx, RPIGRAFX_COUNTER_FRAMES_DROPPED, 1);
+        unref_frame(stale);
+    }
+}
+
+/*
+ * Returns a new reference to the current frame of the synchronous path.
+ * Unlike the pointer returned by rpigrafx_camera_get_frame(), the frame stays
+ * valid across rpigrafx_camera_ignite_capture() until it is released.
+ */
+RPIGRAFX_FRAME_T* rpigrafx_camera_get_frame_handle(RPIGRAFX_CAMERA_T *cam)
+{
+    get_frame_full(cam);
+    if (cam->default_stream == NULL)
+        return rpigrafx_acquire_frame(cam->frame_full);
+    return rpigrafx_get_stream_frame(cam->frame_full, cam->default_stream);
+}
+
+RPIGRAFX_FRAME_T* rpigrafx_acquire_frame(RPIGRAFX_FRAME_T *frame)
+{
+    __sync_add_and_fetch(&frame->refcount, 1);
+    return frame;
+}
+
+void rpigrafx_release_frame(RPIGRAFX_FRAME_T *frame)
+{
+    unref_frame(frame);
+}
+
+void* rpigrafx_frame_get_data(RPIGRAFX_FRAME_T *frame)
+{
+    return frame->data;
+}
+
+int rpigrafx_frame_get_width(RPIGRAFX_FRAME_T *frame)
+{
+    return frame->width;
+}
+
+int rpigrafx_frame_get_height(RPIGRAFX_FRAME_T *frame)
+{
+    return frame->height;
+}
+
+/* Bytes per row of the first plane. */
+int rpigrafx_frame_get_stride(RPIGRAFX_FRAME_T *frame)
+{
+    return frame->plane_stride[0];
+}
+
+int rpigrafx_frame_get_num_planes(RPIGRAFX_FRAME_T *frame)
+{
+    return frame->num_planes;
+}
+
+void* rpigrafx_frame_get_plane_data(RPIGRAFX_FRAME_T *frame, const int plane)
+{
+    if (plane < 0 || plane >= frame->num_planes)
+        error_and_exit("Invalid plane: %d\n", plane);
+    return (uint8_t*) frame->data + frame->plane_offset[plane];
+}
+
+int rpigrafx_frame_get_plane_stride(RPIGRAFX_FRAME_T *frame, const int plane)
+{
+    if (plane < 0 || plane >= frame->num_planes)
+        error_and_exit("Invalid plane: %d\n", plane);
+    return frame->plane_stride[plane];
+}
+
+RPIGRAFX_FORMAT_T rpigrafx_frame_get_format(RPIGRAFX_FRAME_T *frame)
+{
+    return frame->format;
+}
+
+/* Presentation timestamp in microseconds given by the camera. */
+int64_t rpigrafx_frame_get_timestamp(RPIGRAFX_FRAME_T *frame)
+{
+    return frame->timestamp;
+}
+
+/*
+ * Host time of CLOCK_MONOTONIC in nanoseconds when the captured buffer
+ * came back from the camera, before any queueing in the library.
+ */
+int64_t rpigrafx_frame_get_receive_time(RPIGRAFX_FRAME_T *frame)
+{
+    return frame->receive_time;
+}
+
+/* Sequence number of the capture, counted from 0 for each camera. */
+uint64_t rpigrafx_frame_get_sequence(RPIGRAFX_FRAME_T *frame)
+{
+    return frame->sequence;
+}
+
+/*
+ * Number of frames captured since the previous frame handed out and
+ * recycled before the user took them, i.e. the gap in the sequence
+ * numbers.  Non-zero when the consumer falls behind async capture.
+ */
+int rpigrafx_frame_get_dropped(RPIGRAFX_FRAME_T *frame)
+{
+    return frame->dropped;
+}
+
+
+/* Functions on the default camera. */
+
+void rpigrafx_set_camera_num(const int camera_num)
+{
+    rpigrafx_camera_set_camera_num(local_rpigrafx_default_camera(), camera_num);
+}
+
+void rpigrafx_set_video_mode(const int width, const int height, const int fps, const int sensor_mode)
+{
+    rpigrafx_camera_set_video_mode(local_rpigrafx_default_camera(), width, height, fps, sensor_mode);
+}
+
+void rpigrafx_set_still_mode()
+{
+    rpigrafx_camera_set_still_mode(local_rpigrafx_default_camera());
+}
+
+void rpigrafx_set_frame_format(const RPIGRAFX_FORMAT_T format)
+{
+    rpigrafx_camera_set_frame_format(local_rpigrafx_default_camera(), format);
+}
+
+void rpigrafx_get_frame_full_size(int *widthp, int *heightp)
+{
+    rpigrafx_camera_get_frame_full_size(local_rpigrafx_default_camera(), widthp, heightp);
+}
+
+void rpigrafx_set_frame_size(const int width, const int height)
+{
+    rpigrafx_camera_set_frame_size(local_rpigrafx_default_camera(), width, height);
+}
+
+void rpigrafx_set_resizer(const RPIGRAFX_RESIZER_T resizer, const RPIGRAFX_FILTER_T filter)
+{
+    rpigrafx_camera_set_resizer(local_rpigrafx_default_camera(), resizer, filter);
+}
+
+void rpigrafx_set_recorder(RPIGRAFX_RECORDER_T *rec)
+{
+    rpigrafx_camera_set_recorder(local_rpigrafx_default_camera(), rec);
+}
+
+void rpigrafx_set_motion_detector(RPIGRAFX_MOTION_DETECTOR_T *det)
+{
+    rpigrafx_camera_set_motion_detector(local_rpigrafx_default_camera(), det);
+}
+
+void rpigrafx_set_publisher(RPIGRAFX_PUBLISHER_T *pub)
+{
+    rpigrafx_camera_set_publisher(local_rpigrafx_default_camera(), pub);
+}
+
+void rpigrafx_ignite_capture()
+{
+    rpigrafx_camera_ignite_capture(local_rpigrafx_default_camera());
+}
+
+RPIGRAFX_ELEMENT_T rpigrafx_display_frame(const int x, const int y, const int width, const int height)
+{
+    return rpigrafx_camera_display_frame(local_rpigrafx_default_camera(), local_rpigrafx_default_display(), x, y, width, height);
+}
+
+void rpigrafx_start_preview(const int x, const int y, const int width, const int height, const int layer, const int alpha)
+{
+    rpigrafx_camera_start_preview(local_rpigrafx_default_camera(), local_rpigrafx_default_display(), x, y, width, height, layer, alpha);
+}
+
+void rpigrafx_stop_preview()
+{
+    rpigrafx_camera_stop_preview(local_rpigrafx_default_camera());
+}
+
+void* rpigrafx_get_frame()
+{
+    return rpigrafx_camera_get_frame(local_rpigrafx_default_camera());
+}
+
+RPIGRAFX_FRAME_T* rpigrafx_get_frame_handle()
+{
+    return rpigrafx_camera_get_frame_handle(local_rpigrafx_default_camera());
+}
+
+void rpigrafx_set_capture_buffer_num(const int num)
+{
+    rpigrafx_camera_set_capture_buffer_num(local_rpigrafx_default_camera(), num);
+}
+
+void rpigrafx_start_capture()
+{
+    rpigrafx_camera_start_capture(local_rpigrafx_default_camera());
+}
+
+void rpigrafx_stop_capture()
+{
+    rpigrafx_camera_stop_capture(local_rpigrafx_default_camera());
+}
+
+RPIGRAFX_FRAME_T* rpigrafx_get_next_frame(const int timeout_ms)
+{
+    return rpigrafx_camera_get_next_frame(local_rpigrafx_default_camera(), timeout_ms);
+}
+
+RPIGRAFX_FRAME_T* rpigrafx_get_latest_frame()
+{
+    return rpigrafx_camera_get_latest_frame(local_rpigrafx_default_camera());
+}
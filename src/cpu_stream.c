@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "rpigrafx.h"
+#include "local/camera.h"
+#include "local/error.h"
+#include "local/resize.h"
+#include "local/sync.h"
+#include "local/workers.h"
+
+/*
+ * Streams resized on the CPU.
+ * The frames of the stream are buffers of the heap, and a resizer of
+ * resize.c writes them directly; the captured frame is only read.
+ */
+
+#define STREAM_BUFFER_NUM 3
+
+struct cpu_stream {
+    /* Used by frames of the stream; 0 means free. */
+    _Bool *is_used;
+    RPIGRAFX_FILTER_T filter;
+    struct local_rpigrafx_resizer *resizer;
+    int num_bands;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+
+static void* alloc_buffer(const int size)
+{
+    void *p = NULL;
+
+    /* Rows are 32-byte aligned; keep the base aligned as well for SIMD. */
+    if (posix_memalign(&p, 32, size))
+        error_and_exit("Failed to allocate %d bytes of buffer\n", size);
+    return p;
+}
+
+static void create_resizer(struct rpigrafx_stream *stream, const int num_bands)
+{
+    struct cpu_stream *cs = stream->priv;
+    struct rpigrafx_camera *cam = stream->camera;
+
+    if (cs->resizer != NULL)
+        local_rpigrafx_destroy_resizer(cs->resizer);
+    cs->resizer = local_rpigrafx_create_resizer(cs->filter, stream->format, stream->width, stream->height,
+                                                cam->frame_full_width, cam->frame_full_height, num_bands);
+    cs->num_bands = num_bands;
+}
+
+/* The rows are split into num_bands bands, which should be the number of workers. */
+void local_rpigrafx_cpu_stream_create(struct rpigrafx_stream *stream, const int buffer_num, const RPIGRAFX_FILTER_T filter, const int num_bands)
+{
+    struct cpu_stream *cs = NULL;
+    int num_planes, offsets[MAX_PLANES], strides[MAX_PLANES];
+    int size, i;
+
+    cs = calloc(1, sizeof(*cs));
+    if (cs == NULL)
+        error_and_exit("Failed to allocate a stream\n");
+    stream->priv = cs;
+    cs->filter = filter;
+
+    stream->frames_len = buffer_num > STREAM_BUFFER_NUM ? buffer_num : STREAM_BUFFER_NUM;
+    stream->frames = local_rpigrafx_alloc_frames(stream->camera, stream->frames_len);
+    cs->is_used = calloc(stream->frames_len, sizeof(*cs->is_used));
+    if (cs->is_used == NULL)
+        error_and_exit("Failed to allocate %d buffer states\n", stream->frames_len);
+    size = local_rpigrafx_frame_layout(stream->format, stream->width, stream->height, &num_planes, offsets, strides);
+    for (i = 0; i < stream->frames_len; i ++) {
+        stream->frames[i].buffer = alloc_buffer(size);
+        stream->frames[i].data = stream->frames[i].buffer;
+    }
+    create_resizer(stream, num_bands);
+    pthread_mutex_init(&cs->mutex, NULL);
+    local_rpigrafx_init_cond_monotonic(&cs->cond);
+}
+
+void local_rpigrafx_cpu_stream_destroy(struct rpigrafx_stream *stream)
+{
+    struct cpu_stream *cs = stream->priv;
+    int i;
+
+    for (i = 0; i < stream->frames_len; i ++)
+        free(stream->frames[i].buffer);
+    free(cs->is_used);
+    local_rpigrafx_destroy_resizer(cs->resizer);
+    pthread_cond_destroy(&cs->cond);
+    pthread_mutex_destroy(&cs->mutex);
+    free(cs);
+    stream->priv = NULL;
+}
+
+/*
+ * Resize src, or crop of it if not NULL, into a free frame of the stream
+ * on workers, waiting for one if all of them are held.
+ */
+struct rpigrafx_frame* local_rpigrafx_cpu_stream_resize(struct rpigrafx_stream *stream, struct rpigrafx_frame *src, const RPIGRAFX_RECT_T *crop,
+                                                        struct local_rpigrafx_workers *workers)
+{
+    struct cpu_stream *cs = stream->priv;
+    const RPIGRAFX_RECT_T whole = {0, 0, src->width, src->height};
+    struct rpigrafx_frame *f = NULL;
+    int i;
+
+    pthread_mutex_lock(&cs->mutex);
+    for (; ; ) {
+        for (i = 0; i < stream->frames_len; i ++)
+            if (!cs->is_used[i])
+                break;
+        if (i < stream->frames_len)
+            break;
+        pthread_cond_wait(&cs->cond, &cs->mutex);
+    }
+    cs->is_used[i] = 1;
+    pthread_mutex_unlock(&cs->mutex);
+
+    /* The number of the workers has been changed. */
+    if (local_rpigrafx_workers_num(workers) != cs->num_bands)
+        create_resizer(stream, local_rpigrafx_workers_num(workers));
+
+    f = &stream->frames[i];
+    local_rpigrafx_resize(cs->resizer, workers, f->data, src->data, src->plane_stride[0], crop != NULL ? crop : &whole);
+    return f;
+}
+
+void local_rpigrafx_cpu_stream_release(struct rpigrafx_frame *f)
+{
+    struct rpigrafx_stream *stream = f->stream;
+    struct cpu_stream *cs = stream->priv;
+
+    pthread_mutex_lock(&cs->mutex);
+    cs->is_used[f - stream->frames] = 0;
+    pthread_cond_broadcast(&cs->cond);
+    pthread_mutex_unlock(&cs->mutex);
+}
@@ -0,0 +1,1063 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include "rpigrafx.h"
+#include "local/backend.h"
+#include "local/camera.h"
+#include "local/context.h"
+#include "local/draw.h"
+#include "local/error.h"
+#include "local/stats.h"
+#include "local/sync.h"
+
+
+/* Free resources which are not reused for this number of commits are deleted. */
+#define RESOURCE_IDLE_COMMITS 8
+
+/*
+ * Default layer of elements, above the preview of raspistill on layer 2.
+ * https://github.com/raspberrypi/userland/blob/master/host_applications/linux/apps/raspicam/RaspiPreview.h
+ */
+#define DEFAULT_LAYER 5
+
+/* Handles of the display backend are non-zero. */
+#define NO_HANDLE 0
+
+/*
+ * Default size of the tiles which larger images are split into, as
+ * dispmanx does not take resources larger than 512x512.
+ * The width is a multiple of 32 so that each tile starts on a 32-byte
+ * boundary of the rows of the image.
+ */
+#define DEFAULT_TILE_SIZE 512
+
+/* Element added by the immediate-mode functions and the resource it shows. */
+struct element_entry {
+    uint32_t element;
+    uint32_t resource;
+};
+
+/*
+ * Resources kept for reuse.
+ * A resource is looked up by format and size; any free resource which
+ * is large enough (but not too large) is reused, and the src rect of the
+ * element selects the part which is written.
+ * A resource released in an update may be shown until the update is
+ * completed by the backend, so it is retired first and becomes free when
+ * that update completes.
+ */
+enum resource_state {
+    RESOURCE_FREE = 0,
+    RESOURCE_USED,
+    RESOURCE_RETIRED
+};
+
+struct resource_entry {
+    uint32_t handle;
+    RPIGRAFX_FORMAT_T format;
+    int width, height;
+    enum resource_state state;
+    /* Update sequence numbers. */
+    unsigned last_used, retired_at;
+};
+
+/* Part of a surface which has its own resource and element. */
+struct surface_tile {
+    uint32_t resource;
+    /* NO_HANDLE while hidden. */
+    uint32_t element;
+    /* In the surface. */
+    RPIGRAFX_RECT_T rect;
+};
+
+/*
+ * Retained-mode surface.
+ * The resources and the elements stay alive across commits; pixels,
+ * position and visibility are changed in place.
+ */
+struct rpigrafx_surface {
+    struct rpigrafx_display *disp;
+    struct surface_tile *tiles;
+    int tiles_len;
+    int width, height;
+    RPIGRAFX_FORMAT_T format;
+    int x, y, width_scaled, height_scaled;
+    struct local_rpigrafx_element_attr attr;
+    /* Part of the screen the element is cut to. */
+    RPIGRAFX_RECT_T clip;
+    _Bool is_visible, is_clipped;
+    struct rpigrafx_surface *prev, *next;
+};
+
+struct rpigrafx_display {
+    RPIGRAFX_CONTEXT_T *ctx;
+    const struct local_rpigrafx_display_ops *ops;
+    int display_num;
+
+    /* List of graphic elements. */
+    struct element_entry *elements;
+    int elements_len;
+    int elements_next_idx;
+
+    struct resource_entry *resources;
+    int resources_len;
+    /* Resources which have a handle. */
+    int resources_num;
+
+    /*
+     * Sequence number of the update being built and of the last update
+     * completed. Updates complete in the order they are submitted, and at
+     * most one submitted update is in flight.
+     */
+    unsigned update_seq, completed_seq;
+    pthread_mutex_t commit_mutex;
+    pthread_cond_t commit_cond;
+
+    struct rpigrafx_surface *surfaces;
+
+    /* Of the elements of the immediate-mode functions and of new surfaces. */
+    struct local_rpigrafx_element_attr attr;
+    int tile_width, tile_height;
+
+    /* Temporary memory for image which is to be written to a resource. */
+    void *image;
+    int image_size;
+    /*
+     * Rows of a tile at the pitch of its resource, which the backend copies
+     * them with; sized for a tile by rpigrafx_display_set_tile_size().
+     */
+    void *staging;
+    int staging_size;
+
+    /*
+     * The tables above are sized up front by local_rpigrafx_display_reserve_pools()
+     * and grow while drawing only if they are too small; pool_grows counts that.
+     */
+    int elements_high, resources_high, image_size_high;
+    int pool_grows;
+
+    /* Screen resolution returned by the backend. */
+    int screen_width, screen_height;
+
+    /* Handles of the backend. */
+    void *display;
+    void *update;
+};
+
+static void resize_elements(struct rpigrafx_display *disp, const int len)
+{
+    disp->elements_len = len;
+    disp->elements = realloc(disp->elements, disp->elements_len * sizeof(*disp->elements));
+    if (disp->elements == NULL) {
+        error_and_exit("Failed to realloc %d bytes of memory\n", disp->elements_len * sizeof(*disp->elements));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void resize_resources(struct rpigrafx_display *disp, const int len)
+{
+    const int old_len = disp->resources_len;
+
+    disp->resources_len = len;
+    disp->resources = realloc(disp->resources, disp->resources_len * sizeof(*disp->resources));
+    if (disp->resources == NULL)
+        error_and_exit("Failed to realloc %d bytes of memory\n", disp->resources_len * sizeof(*disp->resources));
+    memset(&disp->resources[old_len], 0, (len - old_len) * sizeof(*disp->resources));
+}
+
+static void resize_image(struct rpigrafx_display *disp, const int size)
+{
+    disp->image_size = size;
+    disp->image = realloc(disp->image, disp->image_size);
+    if (disp->image == NULL) {
+        error_and_exit("Failed to realloc %d bytes of memory\n", disp->image_size);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void resize_staging(struct rpigrafx_display *disp, const int size)
+{
+    disp->staging_size = size;
+    disp->staging = realloc(disp->staging, disp->staging_size);
+    if (disp->staging == NULL)
+        error_and_exit("Failed to realloc %d bytes of memory\n", disp->staging_size);
+}
+
+static void register_element(struct rpigrafx_display *disp, const RPIGRAFX_ELEMENT_T element, const uint32_t resource)
+{
+    if (disp->elements_next_idx >= disp->elements_len) {
+        disp->pool_grows ++;
+        resize_elements(disp, disp->elements_len + 100);
+    }
+    disp->elements[disp->elements_next_idx].element = element;
+    disp->elements[disp->elements_next_idx].resource = resource;
+    disp->elements_next_idx ++;
+    if (disp->elements_next_idx > disp->elements_high)
+        disp->elements_high = disp->elements_next_idx;
+}
+
+/* Bytes per pixel of the formats which can be shown. */
+static int format_bpp(const RPIGRAFX_FORMAT_T format)
+{
+    switch (format) {
+        case RPIGRAFX_FORMAT_RGBA32:
+            return 4;
+        case RPIGRAFX_FORMAT_RGB24:
+        case RPIGRAFX_FORMAT_BGR24:
+            return 3;
+        default:
+            error_and_exit("Format %d cannot be shown\n", format);
+    }
+}
+
+static uint32_t acquire_resource(struct rpigrafx_display *disp, const RPIGRAFX_FORMAT_T format, const int width, const int height)
+{
+    struct resource_entry *r = NULL, *best = NULL;
+    int i;
+
+    format_bpp(format);
+
+    for (i = 0; i < disp->resources_len; i ++) {
+        r = &disp->resources[i];
+        if (r->state != RESOURCE_FREE || r->handle == NO_HANDLE || r->format != format)
+            continue;
+        if (r->width < width || r->height < height || r->width > width * 2 || r->height > height * 2)
+            continue;
+        if (best == NULL || r->width * r->height < best->width * best->height)
+            best = r;
+    }
+
+    if (best != NULL)
+        STATS_COUNT(disp->ctx, RPIGRAFX_COUNTER_RESOURCES_REUSED, 1);
+    else {
+        STATS_COUNT(disp->ctx, RPIGRAFX_COUNTER_RESOURCES_CREATED, 1);
+        for (i = 0; i < disp->resources_len; i ++)
+            if (disp->resources[i].handle == NO_HANDLE)
+                break;
+        if (i == disp->resources_len) {
+            disp->pool_grows ++;
+            resize_resources(disp, disp->resources_len + 100);
+        }
+        best = &disp->resources[i];
+        best->format = format;
+        best->width = ALIGN_UP(width, 32);
+        best->height = ALIGN_UP(height, 16);
+        best->handle = disp->ops->resource_create(disp->display, format, best->width, best->height);
+        disp->resources_num ++;
+        if (disp->resources_num > disp->resources_high)
+            disp->resources_high = disp->resources_num;
+    }
+
+    best->state = RESOURCE_USED;
+    best->last_used = disp->update_seq;
+    return best->handle;
+}
+
+static struct resource_entry* find_resource(struct rpigrafx_display *disp, const uint32_t resource)
+{
+    int i;
+
+    for (i = 0; i < disp->resources_len; i ++)
+        if (disp->resources[i].handle == resource)
+            return &disp->resources[i];
+    error_and_exit("Unknown resource: 0x%08x\n", resource);
+}
+
+static void release_resource(struct rpigrafx_display *disp, const uint32_t resource)
+{
+    struct resource_entry *r = find_resource(disp, resource);
+
+    r->state = RESOURCE_RETIRED;
+    r->retired_at = disp->update_seq;
+}
+
+/* Free retired resources of completed updates and delete idle ones. */
+static void recycle_resources(struct rpigrafx_display *disp)
+{
+    struct resource_entry *r = NULL;
+    unsigned completed_seq;
+    int i;
+
+    pthread_mutex_lock(&disp->commit_mutex);
+    completed_seq = disp->completed_seq;
+    pthread_mutex_unlock(&disp->commit_mutex);
+
+    for (i = 0; i < disp->resources_len; i ++) {
+        r = &disp->resources[i];
+        if (r->state == RESOURCE_RETIRED) {
+            if ((int) (completed_seq - r->retired_at) >= 0) {
+                r->state = RESOURCE_FREE;
+                r->last_used = disp->update_seq;
+            }
+        } else if (r->state == RESOURCE_FREE && r->handle != NO_HANDLE
+                   && disp->update_seq - r->last_used > RESOURCE_IDLE_COMMITS) {
+            disp->ops->resource_delete(disp->display, r->handle);
+            r->handle = NO_HANDLE;
+            disp->resources_num --;
+        }
+    }
+}
+
+/* Write rows y to y + height - 1. p points to row 0 of the image. */
+static void write_resource(struct rpigrafx_display *disp, const uint32_t resource, const RPIGRAFX_FORMAT_T format, const int pitch, void *p, const int width, const int y, const int height)
+{
+    STATS_START(t);
+
+    disp->ops->resource_write(disp->display, resource, format, pitch, p, width, y, height);
+    STATS_STAGE(disp->ctx, RPIGRAFX_STAGE_RESOURCE_WRITE, t);
+}
+
+/* Bytes per row of a resource of width pixels. */
+static int resource_pitch(const RPIGRAFX_FORMAT_T format, const int width)
+{
+    return ALIGN_UP(width * format_bpp(format), 32);
+}
+
+/*
+ * Write rows y to y + height - 1 of an image to the resource of the tile
+ * in it, if any of them are in the tile.
+ * p points to row 0 of the image, whose rows are aligned to 32 bytes.
+ * The backend copies the rows with the pitch of the resource, which is of
+ * its own width; unless the image has that pitch, the rows of the tile are
+ * first copied at that pitch.
+ */
+static void write_tile(struct rpigrafx_display *disp, const uint32_t resource, const RPIGRAFX_FORMAT_T format, void *p, const int image_width, const RPIGRAFX_RECT_T *tile, const int y, const int height)
+{
+    const int bpp = format_bpp(format);
+    const int pitch = resource_pitch(format, image_width);
+    const int dst_pitch = resource_pitch(format, find_resource(disp, resource)->width);
+    const int y_start = y > tile->y ? y : tile->y;
+    const int y_end = y + height < tile->y + tile->height ? y + height : tile->y + tile->height;
+    uint8_t *src = (uint8_t*) p + tile->y * pitch + tile->x * bpp;
+    uint8_t *dst = NULL;
+    int i;
+
+    if (y_start >= y_end)
+        return;
+    if (pitch != dst_pitch) {
+        /* Rows of the tile above y_start are not written, and are left as they are. */
+        if ((y_end - tile->y) * dst_pitch > disp->staging_size) {
+            disp->pool_grows ++;
+            resize_staging(disp, (y_end - tile->y) * dst_pitch);
+        }
+        dst = disp->staging;
+        for (i = y_start - tile->y; i < y_end - tile->y; i ++)
+            memcpy(dst + i * dst_pitch, src + i * pitch, tile->width * bpp);
+        src = dst;
+    }
+    write_resource(disp, resource, format, dst_pitch, src, tile->width, y_start - tile->y, y_end - y_start);
+}
+
+/*
+ * The part of dst where the tile of an image of width x height is shown
+ * when the whole image is shown at dst with the transform.
+ * Returns 0 if the tile is scaled down to nothing.
+ */
+static int tile_dst_rect(const RPIGRAFX_RECT_T *tile, const int width, const int height, const RPIGRAFX_RECT_T *dst, const RPIGRAFX_TRANSFORM_T transform, RPIGRAFX_RECT_T *tile_dst)
+{
+    /* The tile and the image after the transform. */
+    int x, y, w = tile->width, h = tile->height;
+    int image_w = width, image_h = height;
+    int x_end, y_end;
+
+    switch (transform) {
+        case RPIGRAFX_TRANSFORM_NONE:
+        default:
+            x = tile->x;
+            y = tile->y;
+            break;
+        case RPIGRAFX_TRANSFORM_ROT90:
+            x = height - tile->y - tile->height;
+            y = tile->x;
+            break;
+        case RPIGRAFX_TRANSFORM_ROT180:
+            x = width - tile->x - tile->width;
+            y = height - tile->y - tile->height;
+            break;
+        case RPIGRAFX_TRANSFORM_ROT270:
+            x = tile->y;
+            y = width - tile->x - tile->width;
+            break;
+        case RPIGRAFX_TRANSFORM_FLIP_H:
+            x = width - tile->x - tile->width;
+            y = tile->y;
+            break;
+        case RPIGRAFX_TRANSFORM_FLIP_V:
+            x = tile->x;
+            y = height - tile->y - tile->height;
+            break;
+    }
+    if (transform == RPIGRAFX_TRANSFORM_ROT90 || transform == RPIGRAFX_TRANSFORM_ROT270) {
+        w = tile->height;
+        h = tile->width;
+        image_w = height;
+        image_h = width;
+    }
+
+    /* Adjacent tiles share their edges, so the tiles cover dst exactly. */
+    x_end = dst->x + (int64_t) (x + w) * dst->width / image_w;
+    y_end = dst->y + (int64_t) (y + h) * dst->height / image_h;
+    tile_dst->x = dst->x + (int64_t) x * dst->width / image_w;
+    tile_dst->y = dst->y + (int64_t) y * dst->height / image_h;
+    tile_dst->width = x_end - tile_dst->x;
+    tile_dst->height = y_end - tile_dst->y;
+    return tile_dst->width > 0 && tile_dst->height > 0;
+}
+
+static void remove_all_elements(struct rpigrafx_display *disp)
+{
+    int i;
+    for (i = 0; i < disp->elements_next_idx; i ++) {
+        disp->ops->element_remove(disp->display, disp->update, disp->elements[i].element);
+        release_resource(disp, disp->elements[i].resource);
+    }
+    disp->elements_next_idx = 0;
+}
+
+static void* use_image(struct rpigrafx_display *disp, const int size)
+{
+    if (size > disp->image_size) {
+        disp->pool_grows ++;
+        resize_image(disp, size);
+    }
+    if (size > disp->image_size_high)
+        disp->image_size_high = size;
+    return disp->image;
+}
+
+/*
+ * Grow the pools of the display to the sizes of config, so that drawing
+ * does not allocate.  Pools are never shrunk; 0 leaves a pool as it is.
+ */
+void local_rpigrafx_display_reserve_pools(RPIGRAFX_DISPLAY_T *disp, const RPIGRAFX_POOL_CONFIG_T *config)
+{
+    if (config->element_slots > disp->elements_len)
+        resize_elements(disp, config->element_slots);
+    if (config->resource_slots > disp->resources_len)
+        resize_resources(disp, config->resource_slots);
+    if (config->image_bytes > disp->image_size)
+        resize_image(disp, config->image_bytes);
+}
+
+/* Add the sizes and the high-water marks of the pools of the display to stats. */
+void local_rpigrafx_display_get_pool_stats(RPIGRAFX_DISPLAY_T *disp, RPIGRAFX_POOL_STATS_T *stats)
+{
+    if (disp->elements_len > stats->size.element_slots)
+        stats->size.element_slots = disp->elements_len;
+    if (disp->resources_len > stats->size.resource_slots)
+        stats->size.resource_slots = disp->resources_len;
+    if (disp->image_size > stats->size.image_bytes)
+        stats->size.image_bytes = disp->image_size;
+    if (disp->elements_high > stats->high.element_slots)
+        stats->high.element_slots = disp->elements_high;
+    if (disp->resources_high > stats->high.resource_slots)
+        stats->high.resource_slots = disp->resources_high;
+    if (disp->image_size_high > stats->high.image_bytes)
+        stats->high.image_bytes = disp->image_size_high;
+    stats->grows += disp->pool_grows;
+}
+
+RPIGRAFX_DISPLAY_T* rpigrafx_open_display(RPIGRAFX_CONTEXT_T *ctx, const int display_num)
+{
+    struct rpigrafx_display *disp = NULL;
+
+    if (display_num < 0 || display_num >= MAX_DISPLAYS)
+        error_and_exit("Invalid display number: %d\n", display_num);
+
+    pthread_mutex_lock(&ctx->mutex);
+    if (ctx->displays[display_num] != NULL)
+        error_and_exit("Display %d is already opened\n", display_num);
+    disp = calloc(1, sizeof(*disp));
+    if (disp == NULL)
+        error_and_exit("Failed to allocate a display\n");
+    ctx->displays[display_num] = disp;
+    pthread_mutex_unlock(&ctx->mutex);
+
+    disp->ctx = ctx;
+    disp->ops = ctx->backend->display;
+    disp->display_num = display_num;
+    disp->update_seq = 1;
+    disp->completed_seq = 0;
+    disp->attr.layer = DEFAULT_LAYER;
+    disp->attr.alpha = RPIGRAFX_ALPHA_SOURCE;
+    disp->attr.opacity = 255;
+    disp->attr.transform = RPIGRAFX_TRANSFORM_NONE;
+    disp->tile_width = disp->tile_height = DEFAULT_TILE_SIZE;
+    local_rpigrafx_getenv_size("RPIGRAFX_TILE_SIZE", &disp->tile_width, &disp->tile_height);
+    rpigrafx_display_set_tile_size(disp, disp->tile_width, disp->tile_height);
+    pthread_mutex_init(&disp->commit_mutex, NULL);
+    local_rpigrafx_init_cond_monotonic(&disp->commit_cond);
+
+    pthread_mutex_lock(&ctx->mutex);
+    local_rpigrafx_display_reserve_pools(disp, &ctx->pool_config);
+    pthread_mutex_unlock(&ctx->mutex);
+
+    disp->display = disp->ops->open(display_num, &disp->screen_width, &disp->screen_height);
+    disp->update = disp->ops->update_start(disp->display);
+
+    return disp;
+}
+
+void rpigrafx_close_display(RPIGRAFX_DISPLAY_T *disp)
+{
+    RPIGRAFX_CONTEXT_T *ctx = disp->ctx;
+    int i;
+
+    pthread_mutex_lock(&ctx->mutex);
+    for (i = 0; i < MAX_CAMERAS; i ++)
+        if (ctx->cameras[i] != NULL && ctx->cameras[i]->preview_display == disp)
+            rpigrafx_camera_stop_preview(ctx->cameras[i]);
+    pthread_mutex_unlock(&ctx->mutex);
+
+    /* No way to cancel update? */
+    rpigrafx_display_wait_drawings(disp, -1);
+    remove_all_elements(disp);
+    while (disp->surfaces != NULL)
+        rpigrafx_destroy_surface(disp->surfaces);
+    disp->ops->update_submit_sync(disp->display, disp->update);
+
+    for (i = 0; i < disp->resources_len; i ++)
+        if (disp->resources[i].handle != NO_HANDLE)
+            disp->ops->resource_delete(disp->display, disp->resources[i].handle);
+
+    free(disp->image);
+    free(disp->staging);
+    free(disp->elements);
+    free(disp->resources);
+    pthread_cond_destroy(&disp->commit_cond);
+    pthread_mutex_destroy(&disp->commit_mutex);
+
+    disp->ops->close(disp->display);
+
+    pthread_mutex_lock(&ctx->mutex);
+    ctx->displays[disp->display_num] = NULL;
+    pthread_mutex_unlock(&ctx->mutex);
+    free(disp);
+}
+
+
+/* For the camera backend to show its preview on the same display. */
+void* local_rpigrafx_display_get_backend(RPIGRAFX_DISPLAY_T *disp, int *display_num)
+{
+    *display_num = disp->display_num;
+    return disp->display;
+}
+
+void rpigrafx_display_get_screen_size(RPIGRAFX_DISPLAY_T *disp, int *width, int *height)
+{
+    *width = disp->screen_width;
+    *height = disp->screen_height;
+}
+
+RPIGRAFX_ELEMENT_T rpigrafx_display_draw_box(RPIGRAFX_DISPLAY_T *disp, const int x_start, const int y_start, const int width, const int height, const int border, const RPIGRAFX_COLOR_T color)
+{
+    const int border_width = border <= width / 2 ? border : width / 2;
+    const int border_height = border <= height / 2 ? border : height / 2;
+    /* Rows are written with a pitch aligned to 32 bytes. */
+    const int stride = ALIGN_UP(width, 8);
+    uint32_t *p = use_image(disp, stride * height * sizeof(*p));
+    uint32_t val_color, val_transp;
+
+    local_rpigrafx_choose_color(&val_color, color, RPIGRAFX_FORMAT_RGBA32);
+    local_rpigrafx_choose_color(&val_transp, RPIGRAFX_COLOR_TRANSPARENT, RPIGRAFX_FORMAT_RGBA32);
+
+    local_rpigrafx_fill_rgba32(p, stride, width, height,
+            border_width, border_height, width - 2 * border_width, height - 2 * border_height, val_transp);
+    local_rpigrafx_outline_rgba32(p, stride, width, height, 0, 0, width, height, border, val_color);
+
+    return rpigrafx_display_render_image(disp, p, x_start, y_start, width, height);
+}
+
+/* Render an image of RGBA32. */
+RPIGRAFX_ELEMENT_T rpigrafx_display_render_image(RPIGRAFX_DISPLAY_T *disp, void *p, const int x, const int y, const int width, const int height)
+{
+    return rpigrafx_display_render_image_scale(disp, p, x, y, width, height, width, height);
+}
+
+/*
+ * Render an image of RGBA32 with scaling.
+ * The resource comes from the pool of the display and goes back there when
+ * the element is removed.
+ * An image larger than the tile size is shown as a tile per resource and
+ * element; the element of the top-left tile is returned.
+ */
+RPIGRAFX_ELEMENT_T rpigrafx_display_render_image_scale(RPIGRAFX_DISPLAY_T *disp, void *p, const int x, const int y, const int width, const int height, const int width_scaled, const int height_scaled)
+{
+    const RPIGRAFX_RECT_T dst_rect = {x, y, width_scaled, height_scaled};
+    RPIGRAFX_RECT_T tile, tile_dst, src_rect = {0, 0, 0, 0};
+    uint32_t element, resource, first_element = NO_HANDLE;
+
+    for (tile.y = 0; tile.y < height; tile.y += disp->tile_height) {
+        tile.height = height - tile.y < disp->tile_height ? height - tile.y : disp->tile_height;
+        for (tile.x = 0; tile.x < width; tile.x += disp->tile_width) {
+            tile.width = width - tile.x < disp->tile_width ? width - tile.x : disp->tile_width;
+            src_rect.width = tile.width;
+            src_rect.height = tile.height;
+            if (!tile_dst_rect(&tile, width, height, &dst_rect, disp->attr.transform, &tile_dst))
+                continue;
+            resource = acquire_resource(disp, RPIGRAFX_FORMAT_RGBA32, tile.width, tile.height);
+            write_tile(disp, resource, RPIGRAFX_FORMAT_RGBA32, p, width, &tile, 0, height);
+
+            element = disp->ops->element_add(disp->display, disp->update, &disp->attr, &tile_dst, resource, &src_rect);
+            register_element(disp, element, resource);
+            if (first_element == NO_HANDLE)
+                first_element = element;
+        }
+    }
+    return first_element;
+}
+
+static void start_update(struct rpigrafx_display *disp)
+{
+    disp->update_seq ++;
+    recycle_resources(disp);
+    disp->update = disp->ops->update_start(disp->display);
+}
+
+/* Blocks until the drawings are on the screen. */
+void rpigrafx_display_commit_drawings(RPIGRAFX_DISPLAY_T *disp)
+{
+    /* The callback of an async commit counts completions; let it run first. */
+    rpigrafx_display_wait_drawings(disp, -1);
+    STATS_ELEMENTS(disp->ctx, disp->elements_next_idx);
+    {
+        STATS_START(t);
+        disp->ops->update_submit_sync(disp->display, disp->update);
+        STATS_STAGE(disp->ctx, RPIGRAFX_STAGE_VSYNC_WAIT, t);
+    }
+    pthread_mutex_lock(&disp->commit_mutex);
+    disp->completed_seq = disp->update_seq;
+    pthread_mutex_unlock(&disp->commit_mutex);
+    start_update(disp);
+}
+
+/* Called by the backend on its own thread when an update is on the screen. */
+static void update_callback(void *arg)
+{
+    struct rpigrafx_display *disp = arg;
+
+    pthread_mutex_lock(&disp->commit_mutex);
+    disp->completed_seq ++;
+    pthread_cond_broadcast(&disp->commit_cond);
+    pthread_mutex_unlock(&disp->commit_mutex);
+}
+
+/*
+ * Submits the drawings and returns without waiting for vsync, so that
+ * the next frame can be drawn while this one is being shown.
+ * If the previous async commit is still in flight, waits for it first.
+ */
+void rpigrafx_display_commit_drawings_async(RPIGRAFX_DISPLAY_T *disp)
+{
+    rpigrafx_display_wait_drawings(disp, -1);
+    STATS_ELEMENTS(disp->ctx, disp->elements_next_idx);
+    disp->ops->update_submit(disp->display, disp->update, update_callback, disp);
+    start_update(disp);
+}
+
+/*
+ * Waits for the committed drawings to be on the screen.
+ * Returns non-zero if they are, or 0 on timeout.
+ * timeout_ms < 0 means to wait forever.
+ */
+int rpigrafx_display_wait_drawings(RPIGRAFX_DISPLAY_T *disp, const int timeout_ms)
+{
+    struct timespec deadline;
+    int done;
+    STATS_START(t);
+
+    if (timeout_ms >= 0)
+        local_rpigrafx_deadline_ms(&deadline, timeout_ms);
+    pthread_mutex_lock(&disp->commit_mutex);
+    done = disp->completed_seq == disp->update_seq - 1;
+    while (disp->completed_seq != disp->update_seq - 1) {
+        if (timeout_ms < 0)
+            pthread_cond_wait(&disp->commit_cond, &disp->commit_mutex);
+        else if (pthread_cond_timedwait(&disp->commit_cond, &disp->commit_mutex, &deadline) == ETIMEDOUT)
+            break;
+    }
+    /* Only the time actually blocked counts. */
+    if (!done)
+        STATS_STAGE(disp->ctx, RPIGRAFX_STAGE_VSYNC_WAIT, t);
+    done = disp->completed_seq == disp->update_seq - 1;
+    pthread_mutex_unlock(&disp->commit_mutex);
+    return done;
+}
+
+/* Returns non-zero if no committed drawings are in flight. */
+int rpigrafx_display_poll_drawings(RPIGRAFX_DISPLAY_T *disp)
+{
+    int done;
+
+    pthread_mutex_lock(&disp->commit_mutex);
+    done = disp->completed_seq == disp->update_seq - 1;
+    pthread_mutex_unlock(&disp->commit_mutex);
+    return done;
+}
+
+void rpigrafx_display_remove_all_elements(RPIGRAFX_DISPLAY_T *disp)
+{
+    remove_all_elements(disp);
+}
+
+static void check_alpha(const RPIGRAFX_ALPHA_T alpha, const int opacity)
+{
+    if (alpha <= RPIGRAFX_ALPHA_MIN || alpha >= RPIGRAFX_ALPHA_MAX)
+        error_and_exit("Unknown alpha: %d\n", alpha);
+    if (opacity < 0 || opacity > 255)
+        error_and_exit("Invalid opacity: %d\n", opacity);
+}
+
+static void check_transform(const RPIGRAFX_TRANSFORM_T transform)
+{
+    if (transform <= RPIGRAFX_TRANSFORM_MIN || transform >= RPIGRAFX_TRANSFORM_MAX)
+        error_and_exit("Unknown transform: %d\n", transform);
+}
+
+/*
+ * The layer, alpha and transform of the elements which are drawn from now
+ * on and of the surfaces which are created from now on.
+ * Elements on higher layers are shown over those on lower ones.
+ */
+void rpigrafx_display_set_layer(RPIGRAFX_DISPLAY_T *disp, const int layer)
+{
+    disp->attr.layer = layer;
+}
+
+/* opacity is 0 (transparent) to 255 (opaque). */
+void rpigrafx_display_set_alpha(RPIGRAFX_DISPLAY_T *disp, const RPIGRAFX_ALPHA_T alpha, const int opacity)
+{
+    check_alpha(alpha, opacity);
+    disp->attr.alpha = alpha;
+    disp->attr.opacity = opacity;
+}
+
+void rpigrafx_display_set_transform(RPIGRAFX_DISPLAY_T *disp, const RPIGRAFX_TRANSFORM_T transform)
+{
+    check_transform(transform);
+    disp->attr.transform = transform;
+}
+
+/*
+ * Size of the tiles which the images drawn from now on and the surfaces
+ * created from now on are split into.  The width is a multiple of 32.
+ */
+void rpigrafx_display_set_tile_size(RPIGRAFX_DISPLAY_T *disp, const int width, const int height)
+{
+    /* Resources of a tile are at most this large; RGBA32 has the most bytes per pixel. */
+    const int staging_size = resource_pitch(RPIGRAFX_FORMAT_RGBA32, width) * ALIGN_UP(height, 16);
+
+    if (width <= 0 || width % 32 != 0 || height <= 0)
+        error_and_exit("Invalid tile size: %dx%d\n", width, height);
+    disp->tile_width = width;
+    disp->tile_height = height;
+    if (staging_size > disp->staging_size)
+        resize_staging(disp, staging_size);
+}
+
+
+/*
+ * Cut dst to clip and src to the part which is shown there.
+ * Each side of dst shows a side of src which depends on the transform;
+ * e.g. the left side of dst shows the bottom of src rotated by 90 degrees.
+ * Returns 0 if nothing is left.
+ */
+static int clip_rects(const RPIGRAFX_RECT_T *clip, const RPIGRAFX_TRANSFORM_T transform, RPIGRAFX_RECT_T *dst, RPIGRAFX_RECT_T *src)
+{
+    /* Sides are left, top, right and bottom. */
+    static const int sides[RPIGRAFX_TRANSFORM_MAX][4] = {
+        [RPIGRAFX_TRANSFORM_NONE]   = {0, 1, 2, 3},
+        [RPIGRAFX_TRANSFORM_ROT90]  = {3, 0, 1, 2},
+        [RPIGRAFX_TRANSFORM_ROT180] = {2, 3, 0, 1},
+        [RPIGRAFX_TRANSFORM_ROT270] = {1, 2, 3, 0},
+        [RPIGRAFX_TRANSFORM_FLIP_H] = {2, 1, 0, 3},
+        [RPIGRAFX_TRANSFORM_FLIP_V] = {0, 3, 2, 1},
+    };
+    int dst_cut[4], src_cut[4] = {0, 0, 0, 0};
+    int i, side;
+
+    dst_cut[0] = clip->x - dst->x;
+    dst_cut[1] = clip->y - dst->y;
+    dst_cut[2] = (dst->x + dst->width) - (clip->x + clip->width);
+    dst_cut[3] = (dst->y + dst->height) - (clip->y + clip->height);
+    for (i = 0; i < 4; i ++) {
+        if (dst_cut[i] < 0)
+            dst_cut[i] = 0;
+        side = sides[transform][i];
+        src_cut[side] = (int64_t) dst_cut[i] * (side % 2 == 0 ? src->width : src->height)
+                        / (i % 2 == 0 ? dst->width : dst->height);
+    }
+
+    dst->x += dst_cut[0];
+    dst->y += dst_cut[1];
+    dst->width -= dst_cut[0] + dst_cut[2];
+    dst->height -= dst_cut[1] + dst_cut[3];
+    src->x += src_cut[0];
+    src->y += src_cut[1];
+    src->width -= src_cut[0] + src_cut[2];
+    src->height -= src_cut[1] + src_cut[3];
+    return dst->width > 0 && dst->height > 0 && src->width > 0 && src->height > 0;
+}
+
+/*
+ * Bring the elements of the surface in line with its attributes: add them,
+ * remove them or change them in place.  The resources are never written
+ * here.  An element is added again only if is_readd, for the alpha mode.
+ */
+static void update_surface_element(struct rpigrafx_surface *surf, const int is_readd)
+{
+    struct rpigrafx_display *disp = surf->disp;
+    const RPIGRAFX_RECT_T surf_dst_rect = {surf->x, surf->y, surf->width_scaled, surf->height_scaled};
+    int i;
+
+    for (i = 0; i < surf->tiles_len; i ++) {
+        struct surface_tile *tile = &surf->tiles[i];
+        RPIGRAFX_RECT_T src_rect = {0, 0, tile->rect.width, tile->rect.height};
+        RPIGRAFX_RECT_T dst_rect;
+        int is_shown = surf->is_visible;
+
+        if (is_shown)
+            is_shown = tile_dst_rect(&tile->rect, surf->width, surf->height, &surf_dst_rect, surf->attr.transform, &dst_rect);
+        if (is_shown && surf->is_clipped)
+            is_shown = clip_rects(&surf->clip, surf->attr.transform, &dst_rect, &src_rect);
+        if (tile->element != NO_HANDLE && (!is_shown || is_readd)) {
+            disp->ops->element_remove(disp->display, disp->update, tile->element);
+            tile->element = NO_HANDLE;
+        }
+        if (!is_shown)
+            continue;
+        if (tile->element == NO_HANDLE)
+            tile->element = disp->ops->element_add(disp->display, disp->update, &surf->attr, &dst_rect, tile->resource, &src_rect);
+        else
+            disp->ops->element_change(disp->display, disp->update, tile->element, &surf->attr, &dst_rect, &src_rect);
+    }
+}
+
+/*
+ * Create a surface of width x height shown at (x, y) scaled to
+ * width_scaled x height_scaled.  Its pixels are undefined until written.
+ * Changes to surfaces take effect on the next commit.
+ */
+RPIGRAFX_SURFACE_T* rpigrafx_display_create_surface(RPIGRAFX_DISPLAY_T *disp, const RPIGRAFX_FORMAT_T format, const int width, const int height, const int x, const int y, const int width_scaled, const int height_scaled)
+{
+    struct rpigrafx_surface *surf = NULL;
+    const int tiles_x = (width + disp->tile_width - 1) / disp->tile_width;
+    const int tiles_y = (height + disp->tile_height - 1) / disp->tile_height;
+    int i;
+
+    surf = calloc(1, sizeof(*surf));
+    if (surf == NULL)
+        error_and_exit("Failed to allocate a surface\n");
+    surf->disp = disp;
+    surf->format = format;
+    surf->width = width;
+    surf->height = height;
+    surf->x = x;
+    surf->y = y;
+    surf->width_scaled = width_scaled;
+    surf->height_scaled = height_scaled;
+    surf->attr = disp->attr;
+    surf->is_visible = 1;
+    surf->tiles_len = tiles_x * tiles_y;
+    surf->tiles = malloc(surf->tiles_len * sizeof(*surf->tiles));
+    if (surf->tiles == NULL)
+        error_and_exit("Failed to allocate %d tiles\n", surf->tiles_len);
+    for (i = 0; i < surf->tiles_len; i ++) {
+        struct surface_tile *tile = &surf->tiles[i];
+
+        tile->rect.x = i % tiles_x * disp->tile_width;
+        tile->rect.y = i / tiles_x * disp->tile_height;
+        tile->rect.width = width - tile->rect.x < disp->tile_width ? width - tile->rect.x : disp->tile_width;
+        tile->rect.height = height - tile->rect.y < disp->tile_height ? height - tile->rect.y : disp->tile_height;
+        tile->element = NO_HANDLE;
+        tile->resource = acquire_resource(disp, format, tile->rect.width, tile->rect.height);
+    }
+    update_surface_element(surf, 0);
+
+    surf->next = disp->surfaces;
+    if (disp->surfaces != NULL)
+        disp->surfaces->prev = surf;
+    disp->surfaces = surf;
+    return surf;
+}
+
+void rpigrafx_destroy_surface(RPIGRAFX_SURFACE_T *surf)
+{
+    struct rpigrafx_display *disp = surf->disp;
+    int i;
+
+    for (i = 0; i < surf->tiles_len; i ++) {
+        if (surf->tiles[i].element != NO_HANDLE)
+            disp->ops->element_remove(disp->display, disp->update, surf->tiles[i].element);
+        release_resource(disp, surf->tiles[i].resource);
+    }
+    free(surf->tiles);
+
+    if (surf->prev != NULL)
+        surf->prev->next = surf->next;
+    else
+        disp->surfaces = surf->next;
+    if (surf->next != NULL)
+        surf->next->prev = surf->prev;
+    free(surf);
+}
+
+/* Replace the pixels of the surface. The image has the size of the surface. */
+void rpigrafx_surface_write(RPIGRAFX_SURFACE_T *surf, void *p)
+{
+    rpigrafx_surface_write_rows(surf, p, 0, surf->height);
+}
+
+/*
+ * Replace rows y to y + height - 1 of the surface.
+ * p points to row 0 of an image which has the size of the surface.
+ */
+void rpigrafx_surface_write_rows(RPIGRAFX_SURFACE_T *surf, void *p, const int y, const int height)
+{
+    int i;
+
+    if (y < 0 || height <= 0 || y + height > surf->height)
+        error_and_exit("Invalid rows: %d+%d\n", y, height);
+    /* Only the tiles which have some of the rows are written. */
+    for (i = 0; i < surf->tiles_len; i ++)
+        write_tile(surf->disp, surf->tiles[i].resource, surf->format, p, surf->width, &surf->tiles[i].rect, y, height);
+}
+
+void rpigrafx_surface_move(RPIGRAFX_SURFACE_T *surf, const int x, const int y, const int width_scaled, const int height_scaled)
+{
+    surf->x = x;
+    surf->y = y;
+    surf->width_scaled = width_scaled;
+    surf->height_scaled = height_scaled;
+    update_surface_element(surf, 0);
+}
+
+/* A hidden surface keeps its resource, so showing it again needs no write. */
+void rpigrafx_surface_set_visible(RPIGRAFX_SURFACE_T *surf, const int visible)
+{
+    surf->is_visible = !!visible;
+    update_surface_element(surf, 0);
+}
+
+/*
+ * The attributes below are changed on the element in place, without
+ * writing the resource, except that a change of the alpha mode adds the
+ * element again as dispmanx cannot change it.
+ */
+void rpigrafx_surface_set_layer(RPIGRAFX_SURFACE_T *surf, const int layer)
+{
+    surf->attr.layer = layer;
+    update_surface_element(surf, 0);
+}
+
+void rpigrafx_surface_set_alpha(RPIGRAFX_SURFACE_T *surf, const RPIGRAFX_ALPHA_T alpha, const int opacity)
+{
+    const int is_readd = alpha != surf->attr.alpha;
+
+    check_alpha(alpha, opacity);
+    surf->attr.alpha = alpha;
+    surf->attr.opacity = opacity;
+    update_surface_element(surf, is_readd);
+}
+
+void rpigrafx_surface_set_transform(RPIGRAFX_SURFACE_T *surf, const RPIGRAFX_TRANSFORM_T transform)
+{
+    check_transform(transform);
+    surf->attr.transform = transform;
+    update_surface_element(surf, 0);
+}
+
+/* Show only the part of the surface in the rect of the screen. */
+void rpigrafx_surface_set_clip(RPIGRAFX_SURFACE_T *surf, const int x, const int y, const int width, const int height)
+{
+    const RPIGRAFX_RECT_T clip = {x, y, width, height};
+
+    surf->clip = clip;
+    surf->is_clipped = 1;
+    update_surface_element(surf, 0);
+}
+
+void rpigrafx_surface_reset_clip(RPIGRAFX_SURFACE_T *surf)
+{
+    surf->is_clipped = 0;
+    update_surface_element(surf, 0);
+}
+
+
+/* Functions on the default display. */
+
+void rpigrafx_get_screen_size(int *width, int *height)
+{
+    rpigrafx_display_get_screen_size(local_rpigrafx_default_display(), width, height);
+}
+
+RPIGRAFX_ELEMENT_T rpigrafx_draw_box(const int x_start, const int y_start, const int width, const int height, const int border, const RPIGRAFX_COLOR_T color)
+{
+    return rpigrafx_display_draw_box(local_rpigrafx_default_display(), x_start, y_start, width, height, border, color);
+}
+
+RPIGRAFX_ELEMENT_T rpigrafx_render_image(void *p, const int x, const int y, const int width, const int height)
+{
+    return rpigrafx_display_render_image(local_rpigrafx_default_display(), p, x, y, width, height);
+}
+
+RPIGRAFX_ELEMENT_T rpigrafx_render_image_scale(void *p, const int x, const int y, const int width, const int height, const int width_scaled, const int height_scaled)
+{
+    return rpigrafx_display_render_image_scale(local_rpigrafx_default_display(), p, x, y, width, height, width_scaled, height_scaled);
+}
+
+void rpigrafx_commit_drawings()
+{
+    rpigrafx_display_commit_drawings(local_rpigrafx_default_display());
+}
+
+void rpigrafx_commit_drawings_async()
+{
+    rpigrafx_display_commit_drawings_async(local_rpigrafx_default_display());
+}
+
+int rpigrafx_wait_drawings(const int timeout_ms)
+{
+    return rpigrafx_display_wait_drawings(local_rpigrafx_default_display(), timeout_ms);
+}
+
+int rpigrafx_poll_drawings()
+{
+    return rpigrafx_display_poll_drawings(local_rpigrafx_default_display());
+}
+
+void rpigrafx_remove_all_elements()
+{
+    rpigrafx_display_remove_all_elements(local_rpigrafx_default_display());
+}
+
+void rpigrafx_set_layer(const int layer)
+{
+    rpigrafx_display_set_layer(local_rpigrafx_default_display(), layer);
+}
+
+void rpigrafx_set_alpha(const RPIGRAFX_ALPHA_T alpha, const int opacity)
+{
+    rpigrafx_display_set_alpha(local_rpigrafx_default_display(), alpha, opacity);
+}
+
+void rpigrafx_set_transform(const RPIGRAFX_TRANSFORM_T transform)
+{
+    rpigrafx_display_set_transform(local_rpigrafx_default_display(), transform);
+}
+
+void rpigrafx_set_tile_size(const int width, const int height)
+{
+    rpigrafx_display_set_tile_size(local_rpigrafx_default_display(), width, height);
+}
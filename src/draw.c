@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#ifdef HAVE_NEON
+#ifndef __aarch64__
+#include <sys/auxv.h>
+#endif
+#endif
+#include "rpigrafx.h"
+#include "local/draw.h"
+#include "local/error.h"
+
+
+/* Byte order in memory is R, G, B, A. */
+static const uint32_t palette_rgba32[RPIGRAFX_COLOR_MAX - 1] = {
+    0xff000000,
+    0xff0000ff,
+    0xff00ff00,
+    0xff00ffff,
+    0xffff0000,
+    0xffff00ff,
+    0xffffff00,
+    0xffffffff,
+    0x00000000
+};
+
+void local_rpigrafx_fill_span_rgba32_scalar(uint32_t *p, const int n, const uint32_t val)
+{
+    int i;
+
+    for (i = 0; i < n; i ++)
+        p[i] = val;
+}
+
+void local_rpigrafx_swap_rb_rgba32_scalar(uint32_t *dst, const uint32_t *src, const int n)
+{
+    uint32_t v;
+    int i;
+
+    for (i = 0; i < n; i ++) {
+        v = src[i];
+        dst[i] = (v & 0xff00ff00) | ((v >> 16) & 0xff) | ((v & 0xff) << 16);
+    }
+}
+
+void local_rpigrafx_rgba32_to_rgb24_scalar(uint8_t *dst, const uint32_t *src, const int n)
+{
+    const uint8_t *s = (const uint8_t*) src;
+    int i;
+
+    for (i = 0; i < n; i ++) {
+        dst[i * 3 + 0] = s[i * 4 + 0];
+        dst[i * 3 + 1] = s[i * 4 + 1];
+        dst[i * 3 + 2] = s[i * 4 + 2];
+    }
+}
+
+void local_rpigrafx_rgb24_to_rgba32_scalar(uint32_t *dst, const uint8_t *src, const int n)
+{
+    uint8_t *d = (uint8_t*) dst;
+    int i;
+
+    for (i = 0; i < n; i ++) {
+        d[i * 4 + 0] = src[i * 3 + 0];
+        d[i * 4 + 1] = src[i * 3 + 1];
+        d[i * 4 + 2] = src[i * 3 + 2];
+        d[i * 4 + 3] = 0xff;
+    }
+}
+
+void local_rpigrafx_lerp_rows_rgba32_scalar(uint32_t *dst, const uint32_t *a, const uint32_t *b, const int weight, const int n)
+{
+    const uint8_t *s0 = (const uint8_t*) a, *s1 = (const uint8_t*) b;
+    uint8_t *d = (uint8_t*) dst;
+    int i;
+
+    for (i = 0; i < n * 4; i ++)
+        d[i] = (s0[i] * (256 - weight) + s1[i] * weight + 128) >> 8;
+}
+
+void local_rpigrafx_sum_cells_rgba32_scalar(uint32_t *sums, const uint32_t *src, const int num_cells)
+{
+    const uint8_t *s = (const uint8_t*) src;
+    uint32_t sum;
+    int i, j;
+
+    for (i = 0; i < num_cells; i ++) {
+        sum = 0;
+        for (j = 0; j < 8; j ++, s += 4)
+            sum += s[0] + 2 * s[1] + s[2];
+        sums[i] += sum;
+    }
+}
+
+void local_rpigrafx_sum_cells_gray8_scalar(uint32_t *sums, const uint8_t *src, const int num_cells)
+{
+    uint32_t sum;
+    int i, j;
+
+    for (i = 0; i < num_cells; i ++) {
+        sum = 0;
+        for (j = 0; j < 8; j ++)
+            sum += *src ++;
+        sums[i] += sum;
+    }
+}
+
+uint32_t local_rpigrafx_sad_u8_scalar(const uint8_t *a, const uint8_t *b, const int n)
+{
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < n; i ++)
+        sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    return sum;
+}
+
+static inline float scale_value(const struct local_rpigrafx_tensor_params *p, const uint8_t v, const int c)
+{
+    const float f = v * p->scale[c];
+
+    return f + p->offset[c];
+}
+
+static inline uint8_t quantize(const float v, const uint8_t flip)
+{
+    return (uint8_t) (int) ((v < 0 ? 0 : v > 255 ? 255 : v) + 0.5f) ^ flip;
+}
+
+void local_rpigrafx_rgba32_to_planar_f32_scalar(float *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    const uint8_t *s = (const uint8_t*) src;
+    int i, c;
+
+    for (i = 0; i < n; i ++)
+        for (c = 0; c < 3; c ++)
+            dst[c][i] = scale_value(p, s[i * 4 + c], c);
+}
+
+void local_rpigrafx_rgba32_to_packed_f32_scalar(float *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    const uint8_t *s = (const uint8_t*) src;
+    const int r = p->swap_rb ? 2 : 0, b = 2 - r;
+    int i;
+
+    for (i = 0; i < n; i ++) {
+        dst[i * 3 + r] = scale_value(p, s[i * 4 + 0], 0);
+        dst[i * 3 + 1] = scale_value(p, s[i * 4 + 1], 1);
+        dst[i * 3 + b] = scale_value(p, s[i * 4 + 2], 2);
+    }
+}
+
+void local_rpigrafx_rgba32_to_planar_u8_scalar(uint8_t *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    const uint8_t *s = (const uint8_t*) src;
+    int i, c;
+
+    for (i = 0; i < n; i ++)
+        for (c = 0; c < 3; c ++)
+            dst[c][i] = quantize(scale_value(p, s[i * 4 + c], c), p->flip);
+}
+
+void local_rpigrafx_rgba32_to_packed_u8_scalar(uint8_t *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    const uint8_t *s = (const uint8_t*) src;
+    const int r = p->swap_rb ? 2 : 0, b = 2 - r;
+    int i;
+
+    for (i = 0; i < n; i ++) {
+        dst[i * 3 + r] = quantize(scale_value(p, s[i * 4 + 0], 0), p->flip);
+        dst[i * 3 + 1] = quantize(scale_value(p, s[i * 4 + 1], 1), p->flip);
+        dst[i * 3 + b] = quantize(scale_value(p, s[i * 4 + 2], 2), p->flip);
+    }
+}
+
+const struct local_rpigrafx_draw_kernels local_rpigrafx_draw_kernels_scalar = {
+    .name = "scalar",
+    .fill_span_rgba32 = local_rpigrafx_fill_span_rgba32_scalar,
+    .swap_rb_rgba32 = local_rpigrafx_swap_rb_rgba32_scalar,
+    .rgba32_to_rgb24 = local_rpigrafx_rgba32_to_rgb24_scalar,
+    .rgb24_to_rgba32 = local_rpigrafx_rgb24_to_rgba32_scalar,
+    .lerp_rows_rgba32 = local_rpigrafx_lerp_rows_rgba32_scalar,
+    .sum_cells_rgba32 = local_rpigrafx_sum_cells_rgba32_scalar,
+    .sum_cells_gray8 = local_rpigrafx_sum_cells_gray8_scalar,
+    .sad_u8 = local_rpigrafx_sad_u8_scalar,
+    .rgba32_to_planar_f32 = local_rpigrafx_rgba32_to_planar_f32_scalar,
+    .rgba32_to_packed_f32 = local_rpigrafx_rgba32_to_packed_f32_scalar,
+    .rgba32_to_planar_u8 = local_rpigrafx_rgba32_to_planar_u8_scalar,
+    .rgba32_to_packed_u8 = local_rpigrafx_rgba32_to_packed_u8_scalar
+};
+
+static struct local_rpigrafx_draw_kernels kernels;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+#ifdef HAVE_NEON
+static int cpu_has_neon()
+{
+#ifdef __aarch64__
+    return 1;
+#else
+    /* HWCAP_NEON of asm/hwcap.h. */
+    return (getauxval(AT_HWCAP) & (1 << 12)) != 0;
+#endif
+}
+#endif
+
+static void use_kernels(const struct local_rpigrafx_draw_kernels *k)
+{
+    const struct local_rpigrafx_draw_kernels *s = &local_rpigrafx_draw_kernels_scalar;
+
+    kernels.name = k->name;
+    kernels.fill_span_rgba32 = k->fill_span_rgba32 != NULL ? k->fill_span_rgba32 : s->fill_span_rgba32;
+    kernels.swap_rb_rgba32 = k->swap_rb_rgba32 != NULL ? k->swap_rb_rgba32 : s->swap_rb_rgba32;
+    kernels.rgba32_to_rgb24 = k->rgba32_to_rgb24 != NULL ? k->rgba32_to_rgb24 : s->rgba32_to_rgb24;
+    kernels.rgb24_to_rgba32 = k->rgb24_to_rgba32 != NULL ? k->rgb24_to_rgba32 : s->rgb24_to_rgba32;
+    kernels.lerp_rows_rgba32 = k->lerp_rows_rgba32 != NULL ? k->lerp_rows_rgba32 : s->lerp_rows_rgba32;
+    kernels.sum_cells_rgba32 = k->sum_cells_rgba32 != NULL ? k->sum_cells_rgba32 : s->sum_cells_rgba32;
+    kernels.sum_cells_gray8 = k->sum_cells_gray8 != NULL ? k->sum_cells_gray8 : s->sum_cells_gray8;
+    kernels.sad_u8 = k->sad_u8 != NULL ? k->sad_u8 : s->sad_u8;
+    kernels.rgba32_to_planar_f32 = k->rgba32_to_planar_f32 != NULL ? k->rgba32_to_planar_f32 : s->rgba32_to_planar_f32;
+    kernels.rgba32_to_packed_f32 = k->rgba32_to_packed_f32 != NULL ? k->rgba32_to_packed_f32 : s->rgba32_to_packed_f32;
+    kernels.rgba32_to_planar_u8 = k->rgba32_to_planar_u8 != NULL ? k->rgba32_to_planar_u8 : s->rgba32_to_planar_u8;
+    kernels.rgba32_to_packed_u8 = k->rgba32_to_packed_u8 != NULL ? k->rgba32_to_packed_u8 : s->rgba32_to_packed_u8;
+}
+
+/*
+ * Pick the best kernels the CPU runs.
+ * RPIGRAFX_DRAW_KERNELS=scalar forces the scalar ones, e.g. to compare.
+ */
+static void select_kernels()
+{
+    const char *env = getenv("RPIGRAFX_DRAW_KERNELS");
+    const struct local_rpigrafx_draw_kernels *candidates[3];
+    int num = 0, i;
+
+#ifdef HAVE_NEON
+    if (cpu_has_neon())
+        candidates[num++] = &local_rpigrafx_draw_kernels_neon;
+#endif
+#ifdef __SSE2__
+    candidates[num++] = &local_rpigrafx_draw_kernels_sse2;
+#endif
+    candidates[num++] = &local_rpigrafx_draw_kernels_scalar;
+
+    for (i = 0; i < num; i ++)
+        if (env == NULL || !strcmp(env, candidates[i]->name))
+            break;
+    if (i == num)
+        error_and_exit("RPIGRAFX_DRAW_KERNELS: %s is not available\n", env);
+    use_kernels(candidates[i]);
+}
+
+static const struct local_rpigrafx_draw_kernels* get_kernels()
+{
+    pthread_once(&kernels_once, select_kernels);
+    return &kernels;
+}
+
+const char* local_rpigrafx_draw_kernels_name()
+{
+    return get_kernels()->name;
+}
+
+void local_rpigrafx_fill_span_rgba32(uint32_t *p, const int n, const uint32_t val)
+{
+    get_kernels()->fill_span_rgba32(p, n, val);
+}
+
+void local_rpigrafx_swap_rb_rgba32(uint32_t *dst, const uint32_t *src, const int n)
+{
+    get_kernels()->swap_rb_rgba32(dst, src, n);
+}
+
+void local_rpigrafx_rgba32_to_rgb24(uint8_t *dst, const uint32_t *src, const int n)
+{
+    get_kernels()->rgba32_to_rgb24(dst, src, n);
+}
+
+void local_rpigrafx_rgb24_to_rgba32(uint32_t *dst, const uint8_t *src, const int n)
+{
+    get_kernels()->rgb24_to_rgba32(dst, src, n);
+}
+
+/* weight 0 is a copy of a, which the kernels need not handle. */
+void local_rpigrafx_lerp_rows_rgba32(uint32_t *dst, const uint32_t *a, const uint32_t *b, const int weight, const int n)
+{
+    if (weight == 0)
+        memcpy(dst, a, n * 4);
+    else
+        get_kernels()->lerp_rows_rgba32(dst, a, b, weight, n);
+}
+
+void local_rpigrafx_sum_cells_rgba32(uint32_t *sums, const uint32_t *src, const int num_cells)
+{
+    get_kernels()->sum_cells_rgba32(sums, src, num_cells);
+}
+
+void local_rpigrafx_sum_cells_gray8(uint32_t *sums, const uint8_t *src, const int num_cells)
+{
+    get_kernels()->sum_cells_gray8(sums, src, num_cells);
+}
+
+uint32_t local_rpigrafx_sad_u8(const uint8_t *a, const uint8_t *b, const int n)
+{
+    return get_kernels()->sad_u8(a, b, n);
+}
+
+void local_rpigrafx_rgba32_to_planar_f32(float *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    get_kernels()->rgba32_to_planar_f32(dst, src, p, n);
+}
+
+void local_rpigrafx_rgba32_to_packed_f32(float *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    get_kernels()->rgba32_to_packed_f32(dst, src, p, n);
+}
+
+void local_rpigrafx_rgba32_to_planar_u8(uint8_t *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    get_kernels()->rgba32_to_planar_u8(dst, src, p, n);
+}
+
+void local_rpigrafx_rgba32_to_packed_u8(uint8_t *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    get_kernels()->rgba32_to_packed_u8(dst, src, p, n);
+}
+
+void local_rpigrafx_choose_color(void *valp, const RPIGRAFX_COLOR_T color, const RPIGRAFX_FORMAT_T format)
+{
+    if (color <= RPIGRAFX_COLOR_MIN || color >= RPIGRAFX_COLOR_MAX)
+        error_and_exit("Invalid color: %d\n", color);
+    if (format != RPIGRAFX_FORMAT_RGBA32)
+        error_and_exit("format must be RGBA32 for now\n");
+    * (uint32_t*) valp = palette_rgba32[color - 1];
+}
+
+void local_rpigrafx_fill_rgba32(uint32_t *p, const int stride, const int width, const int height, const int x, const int y, const int w, const int h, const uint32_t val)
+{
+    const int x0 = x < 0 ? 0 : x, y0 = y < 0 ? 0 : y;
+    const int x1 = x + w > width ? width : x + w, y1 = y + h > height ? height : y + h;
+    const struct local_rpigrafx_draw_kernels *k = get_kernels();
+    int j;
+
+    if (x0 >= x1)
+        return;
+    for (j = y0; j < y1; j ++)
+        k->fill_span_rgba32(p + j * stride + x0, x1 - x0, val);
+}
+
+/* Only the border pixels are touched. */
+void local_rpigrafx_outline_rgba32(uint32_t *p, const int stride, const int width, const int height, const int x, const int y, const int w, const int h, const int border, const uint32_t val)
+{
+    const int bw = border <= w / 2 ? border : w / 2;
+    const int bh = border <= h / 2 ? border : h / 2;
+
+    local_rpigrafx_fill_rgba32(p, stride, width, height, x, y, w, bh, val);
+    local_rpigrafx_fill_rgba32(p, stride, width, height, x, y + h - bh, w, bh, val);
+    local_rpigrafx_fill_rgba32(p, stride, width, height, x, y + bh, bw, h - 2 * bh, val);
+    local_rpigrafx_fill_rgba32(p, stride, width, height, x + w - bw, y + bh, bw, h - 2 * bh, val);
+}
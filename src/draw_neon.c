@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+/*
+ * Built with NEON_CFLAGS. Only called when the CPU has NEON, so nothing
+ * else may live in this file.
+ */
+
+#include <stdint.h>
+#include <arm_neon.h>
+#include "local/draw.h"
+
+
+static void fill_span_rgba32_neon(uint32_t *p, const int n, const uint32_t val)
+{
+    const uint32x4_t v = vdupq_n_u32(val);
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        vst1q_u32(p + i +  0, v);
+        vst1q_u32(p + i +  4, v);
+        vst1q_u32(p + i +  8, v);
+        vst1q_u32(p + i + 12, v);
+    }
+    for (; i + 4 <= n; i += 4)
+        vst1q_u32(p + i, v);
+    local_rpigrafx_fill_span_rgba32_scalar(p + i, n - i, val);
+}
+
+static void swap_rb_rgba32_neon(uint32_t *dst, const uint32_t *src, const int n)
+{
+    uint8x16x4_t v;
+    uint8x16_t t;
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        v = vld4q_u8((const uint8_t*) (src + i));
+        t = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = t;
+        vst4q_u8((uint8_t*) (dst + i), v);
+    }
+    local_rpigrafx_swap_rb_rgba32_scalar(dst + i, src + i, n - i);
+}
+
+static void rgba32_to_rgb24_neon(uint8_t *dst, const uint32_t *src, const int n)
+{
+    uint8x16x4_t v;
+    uint8x16x3_t w;
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        v = vld4q_u8((const uint8_t*) (src + i));
+        w.val[0] = v.val[0];
+        w.val[1] = v.val[1];
+        w.val[2] = v.val[2];
+        vst3q_u8(dst + i * 3, w);
+    }
+    local_rpigrafx_rgba32_to_rgb24_scalar(dst + i * 3, src + i, n - i);
+}
+
+static void rgb24_to_rgba32_neon(uint32_t *dst, const uint8_t *src, const int n)
+{
+    uint8x16x3_t w;
+    uint8x16x4_t v;
+    int i;
+
+    v.val[3] = vdupq_n_u8(0xff);
+    for (i = 0; i + 16 <= n; i += 16) {
+        w = vld3q_u8(src + i * 3);
+        v.val[0] = w.val[0];
+        v.val[1] = w.val[1];
+        v.val[2] = w.val[2];
+        vst4q_u8((uint8_t*) (dst + i), v);
+    }
+    local_rpigrafx_rgb24_to_rgba32_scalar(dst + i, src + i * 3, n - i);
+}
+
+static void lerp_rows_rgba32_neon(uint32_t *dst, const uint32_t *a, const uint32_t *b, const int weight, const int n)
+{
+    const uint8x8_t wa = vdup_n_u8(256 - weight), wb = vdup_n_u8(weight);
+    uint8x16_t va, vb;
+    uint16x8_t lo, hi;
+    int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        va = vld1q_u8((const uint8_t*) (a + i));
+        vb = vld1q_u8((const uint8_t*) (b + i));
+        lo = vmlal_u8(vmull_u8(vget_low_u8(va), wa), vget_low_u8(vb), wb);
+        hi = vmlal_u8(vmull_u8(vget_high_u8(va), wa), vget_high_u8(vb), wb);
+        vst1q_u8((uint8_t*) (dst + i), vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+    }
+    local_rpigrafx_lerp_rows_rgba32_scalar(dst + i, a + i, b + i, weight, n - i);
+}
+
+static void sum_cells_rgba32_neon(uint32_t *sums, const uint32_t *src, const int num_cells)
+{
+    uint8x8x4_t v;
+    uint16x8_t s;
+    uint32x2_t t;
+    int i;
+
+    /* At most 4 * 255 per pixel, so the pixels of a cell are summed in 16 bits. */
+    for (i = 0; i < num_cells; i ++) {
+        v = vld4_u8((const uint8_t*) (src + i * 8));
+        s = vaddq_u16(vaddl_u8(v.val[0], v.val[2]), vshll_n_u8(v.val[1], 1));
+        t = vpadd_u32(vget_low_u32(vpaddlq_u16(s)), vget_high_u32(vpaddlq_u16(s)));
+        sums[i] += vget_lane_u32(vpadd_u32(t, t), 0);
+    }
+}
+
+static void sum_cells_gray8_neon(uint32_t *sums, const uint8_t *src, const int num_cells)
+{
+    uint64x1_t s;
+    int i;
+
+    for (i = 0; i < num_cells; i ++) {
+        s = vpaddl_u32(vpaddl_u16(vpaddl_u8(vld1_u8(src + i * 8))));
+        sums[i] += (uint32_t) vget_lane_u64(s, 0);
+    }
+}
+
+static uint32_t sad_u8_neon(const uint8_t *a, const uint8_t *b, const int n)
+{
+    uint32x4_t s = vdupq_n_u32(0);
+    uint64x2_t t;
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16)
+        s = vpadalq_u16(s, vpaddlq_u8(vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i))));
+    t = vpaddlq_u32(s);
+    return (uint32_t) (vgetq_lane_u64(t, 0) + vgetq_lane_u64(t, 1))
+           + local_rpigrafx_sad_u8_scalar(a + i, b + i, n - i);
+}
+
+/* Half of 8 values of a channel as floats, scaled. */
+static inline float32x4_t scale_neon(const uint16x4_t v, const float scale, const float offset)
+{
+    return vaddq_f32(vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(v)), scale), vdupq_n_f32(offset));
+}
+
+/* Round and saturate to 0 to 255. */
+static inline uint16x4_t quantize_neon(const float32x4_t v)
+{
+    const float32x4_t c = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0)), vdupq_n_f32(255));
+
+    return vmovn_u32(vcvtq_u32_f32(vaddq_f32(c, vdupq_n_f32(0.5f))));
+}
+
+static inline uint8x8_t scale_u8_neon(const uint8x8_t v, const struct local_rpigrafx_tensor_params *p, const int c)
+{
+    const uint16x8_t w = vmovl_u8(v);
+    const uint16x4_t lo = quantize_neon(scale_neon(vget_low_u16(w), p->scale[c], p->offset[c]));
+    const uint16x4_t hi = quantize_neon(scale_neon(vget_high_u16(w), p->scale[c], p->offset[c]));
+
+    return veor_u8(vmovn_u16(vcombine_u16(lo, hi)), vdup_n_u8(p->flip));
+}
+
+static void rgba32_to_planar_f32_neon(float *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    uint8x8x4_t v;
+    uint16x8_t w;
+    int i, c;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        v = vld4_u8((const uint8_t*) (src + i));
+        for (c = 0; c < 3; c ++) {
+            w = vmovl_u8(v.val[c]);
+            vst1q_f32(dst[c] + i, scale_neon(vget_low_u16(w), p->scale[c], p->offset[c]));
+            vst1q_f32(dst[c] + i + 4, scale_neon(vget_high_u16(w), p->scale[c], p->offset[c]));
+        }
+    }
+    local_rpigrafx_rgba32_to_planar_f32_scalar((float *const[3]) {dst[0] + i, dst[1] + i, dst[2] + i}, src + i, p, n - i);
+}
+
+static void rgba32_to_packed_f32_neon(float *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    const int r = p->swap_rb ? 2 : 0, b = 2 - r;
+    uint8x8x4_t v;
+    float32x4x3_t lo, hi;
+    uint16x8_t w;
+    int i, c;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        v = vld4_u8((const uint8_t*) (src + i));
+        for (c = 0; c < 3; c ++) {
+            w = vmovl_u8(v.val[c]);
+            lo.val[c == 0 ? r : c == 2 ? b : 1] = scale_neon(vget_low_u16(w), p->scale[c], p->offset[c]);
+            hi.val[c == 0 ? r : c == 2 ? b : 1] = scale_neon(vget_high_u16(w), p->scale[c], p->offset[c]);
+        }
+        vst3q_f32(dst + i * 3, lo);
+        vst3q_f32(dst + i * 3 + 12, hi);
+    }
+    local_rpigrafx_rgba32_to_packed_f32_scalar(dst + i * 3, src + i, p, n - i);
+}
+
+static void rgba32_to_planar_u8_neon(uint8_t *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    uint8x8x4_t v;
+    int i, c;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        v = vld4_u8((const uint8_t*) (src + i));
+        for (c = 0; c < 3; c ++)
+            vst1_u8(dst[c] + i, scale_u8_neon(v.val[c], p, c));
+    }
+    local_rpigrafx_rgba32_to_planar_u8_scalar((uint8_t *const[3]) {dst[0] + i, dst[1] + i, dst[2] + i}, src + i, p, n - i);
+}
+
+static void rgba32_to_packed_u8_neon(uint8_t *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    const int r = p->swap_rb ? 2 : 0, b = 2 - r;
+    uint8x8x4_t v;
+    uint8x8x3_t w;
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        v = vld4_u8((const uint8_t*) (src + i));
+        w.val[r] = scale_u8_neon(v.val[0], p, 0);
+        w.val[1] = scale_u8_neon(v.val[1], p, 1);
+        w.val[b] = scale_u8_neon(v.val[2], p, 2);
+        vst3_u8(dst + i * 3, w);
+    }
+    local_rpigrafx_rgba32_to_packed_u8_scalar(dst + i * 3, src + i, p, n - i);
+}
+
+const struct local_rpigrafx_draw_kernels local_rpigrafx_draw_kernels_neon = {
+    .name = "neon",
+    .fill_span_rgba32 = fill_span_rgba32_neon,
+    .swap_rb_rgba32 = swap_rb_rgba32_neon,
+    .rgba32_to_rgb24 = rgba32_to_rgb24_neon,
+    .rgb24_to_rgba32 = rgb24_to_rgba32_neon,
+    .lerp_rows_rgba32 = lerp_rows_rgba32_neon,
+    .sum_cells_rgba32 = sum_cells_rgba32_neon,
+    .sum_cells_gray8 = sum_cells_gray8_neon,
+    .sad_u8 = sad_u8_neon,
+    .rgba32_to_planar_f32 = rgba32_to_planar_f32_neon,
+    .rgba32_to_packed_f32 = rgba32_to_packed_f32_neon,
+    .rgba32_to_planar_u8 = rgba32_to_planar_u8_neon,
+    .rgba32_to_packed_u8 = rgba32_to_packed_u8_neon
+};
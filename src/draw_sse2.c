@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdint.h>
+#include "local/draw.h"
+
+#ifdef __SSE2__
+
+#include <emmintrin.h>
+
+
+static void fill_span_rgba32_sse2(uint32_t *p, const int n, const uint32_t val)
+{
+    const __m128i v = _mm_set1_epi32((int) val);
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        _mm_storeu_si128((__m128i*) (p + i +  0), v);
+        _mm_storeu_si128((__m128i*) (p + i +  4), v);
+        _mm_storeu_si128((__m128i*) (p + i +  8), v);
+        _mm_storeu_si128((__m128i*) (p + i + 12), v);
+    }
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_si128((__m128i*) (p + i), v);
+    local_rpigrafx_fill_span_rgba32_scalar(p + i, n - i, val);
+}
+
+static void swap_rb_rgba32_sse2(uint32_t *dst, const uint32_t *src, const int n)
+{
+    const __m128i mask_ga = _mm_set1_epi32((int) 0xff00ff00);
+    const __m128i mask_lo = _mm_set1_epi32(0xff);
+    __m128i v, r, b;
+    int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        v = _mm_loadu_si128((const __m128i*) (src + i));
+        r = _mm_slli_epi32(_mm_and_si128(v, mask_lo), 16);
+        b = _mm_and_si128(_mm_srli_epi32(v, 16), mask_lo);
+        v = _mm_or_si128(_mm_and_si128(v, mask_ga), _mm_or_si128(r, b));
+        _mm_storeu_si128((__m128i*) (dst + i), v);
+    }
+    local_rpigrafx_swap_rb_rgba32_scalar(dst + i, src + i, n - i);
+}
+
+static void lerp_rows_rgba32_sse2(uint32_t *dst, const uint32_t *a, const uint32_t *b, const int weight, const int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wa = _mm_set1_epi16(256 - weight), wb = _mm_set1_epi16(weight);
+    const __m128i round = _mm_set1_epi16(128);
+    __m128i va, vb, lo, hi;
+    int i;
+
+    /* At most 255 * 256 + 128, which fits in 16 bits unsigned. */
+    for (i = 0; i + 4 <= n; i += 4) {
+        va = _mm_loadu_si128((const __m128i*) (a + i));
+        vb = _mm_loadu_si128((const __m128i*) (b + i));
+        lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa), _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+        hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa), _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_packus_epi16(lo, hi));
+    }
+    local_rpigrafx_lerp_rows_rgba32_scalar(dst + i, a + i, b + i, weight, n - i);
+}
+
+static void sum_cells_rgba32_sse2(uint32_t *sums, const uint32_t *src, const int num_cells)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask_rgb = _mm_set1_epi32(0x00ffffff), mask_g = _mm_set1_epi32(0x0000ff00);
+    __m128i v0, v1, s;
+    int i;
+
+    /* Each half of a SAD against zero sums the bytes of two pixels; G is added twice. */
+    for (i = 0; i < num_cells; i ++) {
+        v0 = _mm_loadu_si128((const __m128i*) (src + i * 8));
+        v1 = _mm_loadu_si128((const __m128i*) (src + i * 8 + 4));
+        s = _mm_add_epi64(_mm_sad_epu8(_mm_and_si128(v0, mask_rgb), zero), _mm_sad_epu8(_mm_and_si128(v0, mask_g), zero));
+        s = _mm_add_epi64(s, _mm_sad_epu8(_mm_and_si128(v1, mask_rgb), zero));
+        s = _mm_add_epi64(s, _mm_sad_epu8(_mm_and_si128(v1, mask_g), zero));
+        sums[i] += _mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(_mm_srli_si128(s, 8));
+    }
+}
+
+static void sum_cells_gray8_sse2(uint32_t *sums, const uint8_t *src, const int num_cells)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i s;
+    int i;
+
+    for (i = 0; i + 2 <= num_cells; i += 2) {
+        s = _mm_sad_epu8(_mm_loadu_si128((const __m128i*) (src + i * 8)), zero);
+        sums[i] += _mm_cvtsi128_si32(s);
+        sums[i + 1] += _mm_cvtsi128_si32(_mm_srli_si128(s, 8));
+    }
+    local_rpigrafx_sum_cells_gray8_scalar(sums + i, src + i * 8, num_cells - i);
+}
+
+static uint32_t sad_u8_sse2(const uint8_t *a, const uint8_t *b, const int n)
+{
+    __m128i s = _mm_setzero_si128();
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16)
+        s = _mm_add_epi64(s, _mm_sad_epu8(_mm_loadu_si128((const __m128i*) (a + i)),
+                                          _mm_loadu_si128((const __m128i*) (b + i))));
+    return _mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(_mm_srli_si128(s, 8))
+           + local_rpigrafx_sad_u8_scalar(a + i, b + i, n - i);
+}
+
+/* Channel c of 4 pixels as floats. */
+static inline __m128 channel_sse2(const __m128i v, const int c)
+{
+    return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 8 * c), _mm_set1_epi32(0xff)));
+}
+
+static inline __m128 scale_sse2(const __m128 f, const __m128 scale, const __m128 offset)
+{
+    return _mm_add_ps(_mm_mul_ps(f, scale), offset);
+}
+
+/* Round and saturate to 0 to 255 as int32. */
+static inline __m128i quantize_sse2(const __m128 v)
+{
+    const __m128 c = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255));
+
+    return _mm_cvttps_epi32(_mm_add_ps(c, _mm_set1_ps(0.5f)));
+}
+
+static void rgba32_to_planar_f32_sse2(float *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    __m128 scale[3], offset[3];
+    __m128i v;
+    int i, c;
+
+    for (c = 0; c < 3; c ++) {
+        scale[c] = _mm_set1_ps(p->scale[c]);
+        offset[c] = _mm_set1_ps(p->offset[c]);
+    }
+    for (i = 0; i + 4 <= n; i += 4) {
+        v = _mm_loadu_si128((const __m128i*) (src + i));
+        for (c = 0; c < 3; c ++)
+            _mm_storeu_ps(dst[c] + i, scale_sse2(channel_sse2(v, c), scale[c], offset[c]));
+    }
+    local_rpigrafx_rgba32_to_planar_f32_scalar((float *const[3]) {dst[0] + i, dst[1] + i, dst[2] + i}, src + i, p, n - i);
+}
+
+/* The channels of 4 pixels are transposed into 12 packed elements. */
+static void rgba32_to_packed_f32_sse2(float *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    const int r = p->swap_rb ? 2 : 0, b = 2 - r;
+    __m128 scale[3], offset[3], f[3], t0, t1;
+    __m128i v;
+    int i, c;
+
+    for (c = 0; c < 3; c ++) {
+        scale[c] = _mm_set1_ps(p->scale[c]);
+        offset[c] = _mm_set1_ps(p->offset[c]);
+    }
+    for (i = 0; i + 4 <= n; i += 4) {
+        v = _mm_loadu_si128((const __m128i*) (src + i));
+        /* f[0], f[1], f[2] are the channels in the order of the tensor. */
+        f[r] = scale_sse2(channel_sse2(v, 0), scale[0], offset[0]);
+        f[1] = scale_sse2(channel_sse2(v, 1), scale[1], offset[1]);
+        f[b] = scale_sse2(channel_sse2(v, 2), scale[2], offset[2]);
+        t0 = _mm_unpacklo_ps(f[0], f[1]);
+        t1 = _mm_unpacklo_ps(f[2], f[0]);
+        _mm_storeu_ps(dst + i * 3, _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 0, 1, 0)));
+        t0 = _mm_unpacklo_ps(f[1], f[2]);
+        t1 = _mm_unpackhi_ps(f[0], f[1]);
+        _mm_storeu_ps(dst + i * 3 + 4, _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 3, 2)));
+        t0 = _mm_unpackhi_ps(f[2], f[0]);
+        t1 = _mm_unpackhi_ps(f[1], f[2]);
+        _mm_storeu_ps(dst + i * 3 + 8, _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 0)));
+    }
+    local_rpigrafx_rgba32_to_packed_f32_scalar(dst + i * 3, src + i, p, n - i);
+}
+
+/* Channel c of 16 pixels from src, quantized. */
+static inline __m128i quantize_channel_sse2(const __m128i *v, const struct local_rpigrafx_tensor_params *p, const int c)
+{
+    const __m128 scale = _mm_set1_ps(p->scale[c]), offset = _mm_set1_ps(p->offset[c]);
+    __m128i q[4];
+    int k;
+
+    for (k = 0; k < 4; k ++)
+        q[k] = quantize_sse2(scale_sse2(channel_sse2(v[k], c), scale, offset));
+    return _mm_xor_si128(_mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3])),
+                         _mm_set1_epi8((char) p->flip));
+}
+
+static void rgba32_to_planar_u8_sse2(uint8_t *const *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    __m128i v[4];
+    int i, c, k;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        for (k = 0; k < 4; k ++)
+            v[k] = _mm_loadu_si128((const __m128i*) (src + i + k * 4));
+        for (c = 0; c < 3; c ++)
+            _mm_storeu_si128((__m128i*) (dst[c] + i), quantize_channel_sse2(v, p, c));
+    }
+    local_rpigrafx_rgba32_to_planar_u8_scalar((uint8_t *const[3]) {dst[0] + i, dst[1] + i, dst[2] + i}, src + i, p, n - i);
+}
+
+/* Interleaving bytes into 24 bits needs byte shuffles (SSSE3), so only the quantization is in SIMD. */
+static void rgba32_to_packed_u8_sse2(uint8_t *dst, const uint32_t *src, const struct local_rpigrafx_tensor_params *p, const int n)
+{
+    const int r = p->swap_rb ? 2 : 0, b = 2 - r;
+    uint8_t planes[3][16] __attribute__((aligned(16)));
+    __m128i v[4];
+    uint8_t *d = NULL;
+    int i, k;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        for (k = 0; k < 4; k ++)
+            v[k] = _mm_loadu_si128((const __m128i*) (src + i + k * 4));
+        _mm_store_si128((__m128i*) planes[r], quantize_channel_sse2(v, p, 0));
+        _mm_store_si128((__m128i*) planes[1], quantize_channel_sse2(v, p, 1));
+        _mm_store_si128((__m128i*) planes[b], quantize_channel_sse2(v, p, 2));
+        d = dst + i * 3;
+        for (k = 0; k < 16; k ++, d += 3) {
+            d[0] = planes[0][k];
+            d[1] = planes[1][k];
+            d[2] = planes[2][k];
+        }
+    }
+    local_rpigrafx_rgba32_to_packed_u8_scalar(dst + i * 3, src + i, p, n - i);
+}
+
+/* Packing to and from 24 bits needs byte shuffles (SSSE3); use the scalar ones. */
+const struct local_rpigrafx_draw_kernels local_rpigrafx_draw_kernels_sse2 = {
+    .name = "sse2",
+    .fill_span_rgba32 = fill_span_rgba32_sse2,
+    .swap_rb_rgba32 = swap_rb_rgba32_sse2,
+    .rgba32_to_rgb24 = NULL,
+    .rgb24_to_rgba32 = NULL,
+    .lerp_rows_rgba32 = lerp_rows_rgba32_sse2,
+    .sum_cells_rgba32 = sum_cells_rgba32_sse2,
+    .sum_cells_gray8 = sum_cells_gray8_sse2,
+    .sad_u8 = sad_u8_sse2,
+    .rgba32_to_planar_f32 = rgba32_to_planar_f32_sse2,
+    .rgba32_to_packed_f32 = rgba32_to_packed_f32_sse2,
+    .rgba32_to_planar_u8 = rgba32_to_planar_u8_sse2,
+    .rgba32_to_packed_u8 = rgba32_to_packed_u8_sse2
+};
+
+#endif /* __SSE2__ */
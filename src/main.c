@@ -7,48 +7,230 @@
  * software. If not, contact the copyright holder above.
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "rpigrafx.h"
-#include "local/init_finalize.h"
+#include "local/backend.h"
+#include "local/context.h"
 #include "local/error.h"
+#include "local/stats.h"
+#include "local/workers.h"
 
-struct called called = {
-    .main = 0,
-    .dispmanx = 0,
-    .mmal = 0
-};
+/* Protects everything below. */
+static pthread_mutex_t main_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-void rpigrafx_init()
+static int called_main = 0;
+
+/*
+ * The context behind the functions without an explicit object.
+ * It is created on the first use and its camera and display are opened
+ * on the first use of each.
+ */
+static RPIGRAFX_CONTEXT_T *default_context = NULL;
+static RPIGRAFX_CAMERA_T *default_camera = NULL;
+static RPIGRAFX_DISPLAY_T *default_display = NULL;
+
+
+/* Must be called with main_mutex held. */
+static void init_default_context()
 {
-    if (called.main != 0) {
-        called.main ++;
+    if (default_context != NULL)
         return;
+    default_context = rpigrafx_create_context();
+    /* Balanced by rpigrafx_finalize(), which is called at exit. */
+    called_main ++;
+}
+
+RPIGRAFX_CAMERA_T* local_rpigrafx_default_camera()
+{
+    pthread_mutex_lock(&main_mutex);
+    init_default_context();
+    if (default_camera == NULL)
+        default_camera = rpigrafx_open_camera(default_context, 0);
+    pthread_mutex_unlock(&main_mutex);
+    return default_camera;
+}
+
+RPIGRAFX_DISPLAY_T* local_rpigrafx_default_display()
+{
+    pthread_mutex_lock(&main_mutex);
+    init_default_context();
+    if (default_display == NULL)
+        default_display = rpigrafx_open_display(default_context, 0);
+    pthread_mutex_unlock(&main_mutex);
+    return default_display;
+}
+
+
+/*
+ * Create a context on the backend named name, or on the one named by the
+ * RPIGRAFX_BACKEND environment variable if name is NULL.
+ * "vc" drives MMAL and dispmanx and is the default if it is built;
+ * "soft" emulates them on the CPU.
+ */
+RPIGRAFX_CONTEXT_T* rpigrafx_create_context_with_backend(const char *name)
+{
+    RPIGRAFX_CONTEXT_T *ctx = NULL;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL)
+        error_and_exit("Failed to allocate a context\n");
+    ctx->backend = local_rpigrafx_find_backend(name);
+    pthread_mutex_init(&ctx->mutex, NULL);
+    ctx->num_cameras = -1;
+    ctx->resize_threads = local_rpigrafx_getenv_int("RPIGRAFX_RESIZE_THREADS", sysconf(_SC_NPROCESSORS_ONLN));
+    if (ctx->resize_threads < 1)
+        ctx->resize_threads = 1;
+#ifdef RPIGRAFX_STATS
+    local_rpigrafx_stats_init(ctx);
+#endif
+
+    ctx->backend->init();
+
+    return ctx;
+}
+
+RPIGRAFX_CONTEXT_T* rpigrafx_create_context()
+{
+    return rpigrafx_create_context_with_backend(NULL);
+}
+
+/* Close the cameras and the displays left opened, then free ctx. */
+void rpigrafx_destroy_context(RPIGRAFX_CONTEXT_T *ctx)
+{
+    int i;
+
+    for (i = 0; i < MAX_CAMERAS; i ++)
+        if (ctx->cameras[i] != NULL)
+            rpigrafx_close_camera(ctx->cameras[i]);
+    for (i = 0; i < MAX_DISPLAYS; i ++)
+        if (ctx->displays[i] != NULL)
+            rpigrafx_close_display(ctx->displays[i]);
+    if (ctx->workers != NULL)
+        local_rpigrafx_destroy_workers(ctx->workers);
+    ctx->backend->deinit();
+#ifdef RPIGRAFX_STATS
+    local_rpigrafx_stats_deinit(ctx);
+#endif
+    pthread_mutex_destroy(&ctx->mutex);
+    free(ctx);
+}
+
+const char* rpigrafx_get_backend_name(RPIGRAFX_CONTEXT_T *ctx)
+{
+    return ctx->backend->name;
+}
+
+int rpigrafx_get_num_cameras(RPIGRAFX_CONTEXT_T *ctx)
+{
+    int num;
+
+    pthread_mutex_lock(&ctx->mutex);
+    local_rpigrafx_query_cameras(ctx);
+    num = ctx->num_cameras;
+    pthread_mutex_unlock(&ctx->mutex);
+    return num;
+}
+
+/*
+ * Size the pools of the cameras and the displays opened from now on and
+ * grow those of the opened ones.  Call it while setting up, not while the
+ * displays are drawn on.
+ */
+void rpigrafx_set_pool_config(RPIGRAFX_CONTEXT_T *ctx, const RPIGRAFX_POOL_CONFIG_T *config)
+{
+    int i;
+
+    if (config->frame_buffers < 0 || config->frame_buffers == 1 || config->element_slots < 0
+            || config->resource_slots < 0 || config->image_bytes < 0)
+        error_and_exit("Invalid pool config\n");
+    pthread_mutex_lock(&ctx->mutex);
+    ctx->pool_config = *config;
+    for (i = 0; i < MAX_CAMERAS; i ++)
+        if (ctx->cameras[i] != NULL)
+            local_rpigrafx_camera_reserve_pools(ctx->cameras[i], config);
+    for (i = 0; i < MAX_DISPLAYS; i ++)
+        if (ctx->displays[i] != NULL)
+            local_rpigrafx_display_reserve_pools(ctx->displays[i], config);
+    pthread_mutex_unlock(&ctx->mutex);
+}
+
+/* High-water marks of the pools, to size them with rpigrafx_set_pool_config(). */
+void rpigrafx_get_pool_stats(RPIGRAFX_CONTEXT_T *ctx, RPIGRAFX_POOL_STATS_T *stats)
+{
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&ctx->mutex);
+    for (i = 0; i < MAX_CAMERAS; i ++)
+        if (ctx->cameras[i] != NULL)
+            local_rpigrafx_camera_get_pool_stats(ctx->cameras[i], stats);
+    for (i = 0; i < MAX_DISPLAYS; i ++)
+        if (ctx->displays[i] != NULL)
+            local_rpigrafx_display_get_pool_stats(ctx->displays[i], stats);
+    pthread_mutex_unlock(&ctx->mutex);
+}
+
+/*
+ * Number of threads of the CPU resizer, including the one which asks for
+ * the frame.  It defaults to RPIGRAFX_RESIZE_THREADS or to the number of
+ * CPUs online.  Call it while no frame is resized.
+ */
+void rpigrafx_set_resize_threads(RPIGRAFX_CONTEXT_T *ctx, const int num)
+{
+    if (num < 1)
+        error_and_exit("Invalid number of resize threads: %d\n", num);
+    pthread_mutex_lock(&ctx->mutex);
+    ctx->resize_threads = num;
+    if (ctx->workers != NULL && local_rpigrafx_workers_num(ctx->workers) != num) {
+        local_rpigrafx_destroy_workers(ctx->workers);
+        ctx->workers = NULL;
     }
+    pthread_mutex_unlock(&ctx->mutex);
+}
 
-    local_rpigrafx_dispmanx_init();
-    local_rpigrafx_mmal_init();
+struct local_rpigrafx_workers* local_rpigrafx_get_workers(RPIGRAFX_CONTEXT_T *ctx)
+{
+    struct local_rpigrafx_workers *w = NULL;
 
-    if (called.dispmanx <= 0)
-        error_and_exit("called.dispmanx is 0 or negative: %d\n", called.dispmanx);
-    if (called.mmal <= 0)
-        error_and_exit("called.mmal is 0 or negative: %d\n", called.mmal);
+    pthread_mutex_lock(&ctx->mutex);
+    if (ctx->workers == NULL)
+        ctx->workers = local_rpigrafx_create_workers(ctx->resize_threads);
+    w = ctx->workers;
+    pthread_mutex_unlock(&ctx->mutex);
+    return w;
+}
 
-    called.main ++;
+
+/* Open the default display and camera in advance. */
+void rpigrafx_init()
+{
+    pthread_mutex_lock(&main_mutex);
+    init_default_context();
+    called_main ++;
+    pthread_mutex_unlock(&main_mutex);
+
+    local_rpigrafx_default_display();
+    local_rpigrafx_default_camera();
 }
 
 void rpigrafx_finalize()
 {
-    if (called.main != 1) {
-        called.main --;
+    RPIGRAFX_CONTEXT_T *ctx = NULL;
+
+    pthread_mutex_lock(&main_mutex);
+    if (called_main == 0 || -- called_main != 0) {
+        pthread_mutex_unlock(&main_mutex);
         return;
     }
+    ctx = default_context;
+    default_context = NULL;
+    default_camera = NULL;
+    default_display = NULL;
+    pthread_mutex_unlock(&main_mutex);
 
-    local_rpigrafx_mmal_finalize();
-    local_rpigrafx_dispmanx_finalize();
-
-    if (called.mmal != 0)
-        error_and_exit("called.mmal is not 0: %d\n", called.mmal);
-    if (called.dispmanx != 0)
-        error_and_exit("called.dispmanx is not 0: %d\n", called.dispmanx);
-
-    called.main --;
+    if (ctx != NULL)
+        rpigrafx_destroy_context(ctx);
 }
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "rpigrafx.h"
+#include "local/camera.h"
+#include "local/draw.h"
+#include "local/error.h"
+
+/*
+ * Change detection between consecutive frames.
+ * Each frame is reduced to a signature of the mean luma of its cells of
+ * CELL_SIZE x CELL_SIZE pixels, approximated as (R + 2G + B) / 4 for RGB
+ * and taken from the Y plane otherwise.  The signature is compared to the
+ * one of the previous frame cell by cell, and the sums of absolute
+ * differences are gathered over a grid of tiles_x x tiles_y tiles.  A tile
+ * changed if the mean difference of its cells is above threshold levels.
+ * Pixels right of and below the last whole cell are not looked at.
+ */
+
+#define CELL_SIZE 8
+
+struct rpigrafx_motion_detector {
+    int tiles_x, tiles_y, threshold;
+
+    /* Signatures of the current and of the previous frame, cells_x x cells_y. */
+    int cells_x, cells_y;
+    uint8_t *signature, *prev_signature;
+    _Bool has_prev;
+    /* Sums of a row of cells. */
+    uint32_t *sums;
+
+    /* Results of the last frame. */
+    int width, height;
+    uint8_t *changed;
+    int num_changed;
+    float score;
+};
+
+
+RPIGRAFX_MOTION_DETECTOR_T* rpigrafx_create_motion_detector(const int tiles_x, const int tiles_y, const int threshold)
+{
+    struct rpigrafx_motion_detector *det = NULL;
+
+    if (tiles_x <= 0 || tiles_y <= 0)
+        error_and_exit("Invalid number of tiles: %dx%d\n", tiles_x, tiles_y);
+    if (threshold < 0 || threshold > 255)
+        error_and_exit("Invalid threshold: %d\n", threshold);
+
+    det = calloc(1, sizeof(*det));
+    if (det == NULL)
+        error_and_exit("Failed to allocate a motion detector\n");
+    det->changed = calloc(tiles_x * tiles_y, sizeof(*det->changed));
+    if (det->changed == NULL)
+        error_and_exit("Failed to allocate %dx%d tiles\n", tiles_x, tiles_y);
+    det->tiles_x = tiles_x;
+    det->tiles_y = tiles_y;
+    det->threshold = threshold;
+    return det;
+}
+
+void rpigrafx_destroy_motion_detector(RPIGRAFX_MOTION_DETECTOR_T *det)
+{
+    free(det->signature);
+    free(det->prev_signature);
+    free(det->sums);
+    free(det->changed);
+    free(det);
+}
+
+/* Forget the previous frame and size the signatures for a frame of width x height. */
+static void reset(struct rpigrafx_motion_detector *det, const int width, const int height)
+{
+    const int cells_x = width / CELL_SIZE, cells_y = height / CELL_SIZE;
+
+    if (cells_x < det->tiles_x || cells_y < det->tiles_y)
+        error_and_exit("Frame of %dx%d is too small for %dx%d tiles\n", width, height, det->tiles_x, det->tiles_y);
+
+    free(det->signature);
+    free(det->prev_signature);
+    free(det->sums);
+    det->signature = malloc(cells_x * cells_y);
+    det->prev_signature = malloc(cells_x * cells_y);
+    det->sums = malloc(cells_x * sizeof(*det->sums));
+    if (det->signature == NULL || det->prev_signature == NULL || det->sums == NULL)
+        error_and_exit("Failed to allocate a signature of %dx%d cells\n", cells_x, cells_y);
+    det->cells_x = cells_x;
+    det->cells_y = cells_y;
+    det->has_prev = 0;
+}
+
+/* Sum the luma weights of a row of cells of a frame of RGB24 or BGR24. */
+static void sum_cells_rgb24(uint32_t *sums, const uint8_t *s, const int num_cells)
+{
+    uint32_t sum;
+    int i, j;
+
+    for (i = 0; i < num_cells; i ++) {
+        sum = 0;
+        for (j = 0; j < CELL_SIZE; j ++, s += 3)
+            sum += s[0] + 2 * s[1] + s[2];
+        sums[i] += sum;
+    }
+}
+
+static void make_signature(struct rpigrafx_motion_detector *det, const uint8_t *data, const RPIGRAFX_FORMAT_T format, const int stride)
+{
+    /* Sums of a cell are at most 4 * 255 or 255 per pixel. */
+    const int shift = format == RPIGRAFX_FORMAT_RGBA32 || format == RPIGRAFX_FORMAT_RGB24
+                      || format == RPIGRAFX_FORMAT_BGR24 ? 8 : 6;
+    const uint8_t *row = NULL;
+    uint8_t *sig = NULL;
+    int cx, cy, y;
+
+    for (cy = 0; cy < det->cells_y; cy ++) {
+        memset(det->sums, 0, det->cells_x * sizeof(*det->sums));
+        for (y = 0; y < CELL_SIZE; y ++) {
+            row = data + (cy * CELL_SIZE + y) * stride;
+            switch (format) {
+                case RPIGRAFX_FORMAT_RGBA32:
+                    local_rpigrafx_sum_cells_rgba32(det->sums, (const uint32_t*) row, det->cells_x);
+                    break;
+                case RPIGRAFX_FORMAT_RGB24:
+                case RPIGRAFX_FORMAT_BGR24:
+                    sum_cells_rgb24(det->sums, row, det->cells_x);
+                    break;
+                default:
+                    local_rpigrafx_sum_cells_gray8(det->sums, row, det->cells_x);
+                    break;
+            }
+        }
+        sig = det->signature + cy * det->cells_x;
+        for (cx = 0; cx < det->cells_x; cx ++)
+            sig[cx] = (det->sums[cx] + (1 << (shift - 1))) >> shift;
+    }
+}
+
+static void compare_signatures(struct rpigrafx_motion_detector *det)
+{
+    const int cells_x = det->cells_x, cells_y = det->cells_y;
+    int tx, ty, cx0, cx1, cy0, cy1, cy;
+    uint32_t sad, total = 0;
+
+    det->num_changed = 0;
+    for (ty = 0; ty < det->tiles_y; ty ++) {
+        cy0 = ty * cells_y / det->tiles_y;
+        cy1 = (ty + 1) * cells_y / det->tiles_y;
+        for (tx = 0; tx < det->tiles_x; tx ++) {
+            cx0 = tx * cells_x / det->tiles_x;
+            cx1 = (tx + 1) * cells_x / det->tiles_x;
+            sad = 0;
+            for (cy = cy0; cy < cy1; cy ++)
+                sad += local_rpigrafx_sad_u8(det->signature + cy * cells_x + cx0,
+                                             det->prev_signature + cy * cells_x + cx0, cx1 - cx0);
+            total += sad;
+            det->changed[ty * det->tiles_x + tx] = sad > (uint32_t) (det->threshold * (cx1 - cx0) * (cy1 - cy0));
+            det->num_changed += det->changed[ty * det->tiles_x + tx];
+        }
+    }
+    det->score = (float) total / (cells_x * cells_y);
+}
+
+/*
+ * Compare an image to the previous one given to det, and return the number
+ * of tiles which changed.  stride is in bytes; for I420 and NV12 data is the
+ * Y plane.  The first image and one of another size than the previous
+ * one count as changed everywhere, with a score of 255.
+ */
+int rpigrafx_motion_detector_update_image(RPIGRAFX_MOTION_DETECTOR_T *det, const void *data, const RPIGRAFX_FORMAT_T format, const int width, const int height, const int stride)
+{
+    uint8_t *tmp = NULL;
+
+    if (format <= RPIGRAFX_FORMAT_MIN || format >= RPIGRAFX_FORMAT_MAX)
+        error_and_exit("Unknown format: %d\n", format);
+    if (width != det->width || height != det->height || det->signature == NULL)
+        reset(det, width, height);
+
+    det->width = width;
+    det->height = height;
+    make_signature(det, data, format, stride);
+    if (det->has_prev)
+        compare_signatures(det);
+    else {
+        memset(det->changed, 1, det->tiles_x * det->tiles_y);
+        det->num_changed = det->tiles_x * det->tiles_y;
+        det->score = 255;
+    }
+    tmp = det->prev_signature;
+    det->prev_signature = det->signature;
+    det->signature = tmp;
+    det->has_prev = 1;
+    return det->num_changed;
+}
+
+int rpigrafx_motion_detector_update(RPIGRAFX_MOTION_DETECTOR_T *det, RPIGRAFX_FRAME_T *frame)
+{
+    return rpigrafx_motion_detector_update_image(det, (const uint8_t*) frame->data + frame->plane_offset[0],
+                                                 frame->format, frame->width, frame->height, frame->plane_stride[0]);
+}
+
+/* Mean absolute difference of the luma of the cells in levels, 0 to 255. */
+float rpigrafx_motion_detector_get_score(RPIGRAFX_MOTION_DETECTOR_T *det)
+{
+    return det->score;
+}
+
+int rpigrafx_motion_detector_get_num_changed(RPIGRAFX_MOTION_DETECTOR_T *det)
+{
+    return det->num_changed;
+}
+
+/* tiles_x x tiles_y flags, row by row, non-zero for the tiles which changed. */
+const uint8_t* rpigrafx_motion_detector_get_changed_tiles(RPIGRAFX_MOTION_DETECTOR_T *det)
+{
+    return det->changed;
+}
+
+/*
+ * The region of the last frame covered by tile (tx, ty), for restricting the
+ * work to it.  The tiles at the right and bottom edges take the pixels left
+ * out of the cells.
+ */
+void rpigrafx_motion_detector_get_tile_rect(RPIGRAFX_MOTION_DETECTOR_T *det, const int tx, const int ty, RPIGRAFX_RECT_T *rect)
+{
+    int x1, y1;
+
+    if (det->signature == NULL)
+        error_and_exit("No frame was given to the motion detector yet\n");
+    if (tx < 0 || tx >= det->tiles_x || ty < 0 || ty >= det->tiles_y)
+        error_and_exit("Tile %d,%d is out of %dx%d\n", tx, ty, det->tiles_x, det->tiles_y);
+    rect->x = tx * det->cells_x / det->tiles_x * CELL_SIZE;
+    rect->y = ty * det->cells_y / det->tiles_y * CELL_SIZE;
+    x1 = tx == det->tiles_x - 1 ? det->width : (tx + 1) * det->cells_x / det->tiles_x * CELL_SIZE;
+    y1 = ty == det->tiles_y - 1 ? det->height : (ty + 1) * det->cells_y / det->tiles_y * CELL_SIZE;
+    rect->width = x1 - rect->x;
+    rect->height = y1 - rect->y;
+}
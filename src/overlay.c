@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rpigrafx.h"
+#include "local/draw.h"
+#include "local/error.h"
+#include "local/text.h"
+
+
+/* Label drawn last time and the layout of its text. */
+struct label_entry {
+    /* label.text points to text. */
+    RPIGRAFX_LABEL_T label;
+    char *text;
+    int text_size;
+    struct local_rpigrafx_glyph_pos *glyphs;
+    int glyphs_len, glyphs_num;
+    /* Of the text, after scaling. */
+    int width, height;
+};
+
+/*
+ * Overlay: boxes and labels rasterized into one surface, labels on top.
+ * The image is kept on the CPU side and only the rows which changed since
+ * the last draw are written to the resource.
+ */
+struct rpigrafx_overlay {
+    RPIGRAFX_SURFACE_T *surf;
+    int width, height;
+    /*
+     * In pixels, with rows aligned to 32 bytes as rpigrafx_surface_write()
+     * takes them; not the pitch of the resource, which the surface
+     * converts to.
+     */
+    int stride;
+    uint32_t *image;
+
+    /* Boxes drawn last time. */
+    RPIGRAFX_BOX_T *boxes;
+    int boxes_len;
+    int boxes_num;
+
+    const struct rpigrafx_font *font;
+    struct label_entry *labels;
+    int labels_len;
+    int labels_num;
+};
+
+static int box_equal(const RPIGRAFX_BOX_T *a, const RPIGRAFX_BOX_T *b)
+{
+    return a->x == b->x && a->y == b->y && a->width == b->width && a->height == b->height
+            && a->border == b->border && a->color == b->color;
+}
+
+static int label_equal(const struct label_entry *e, const RPIGRAFX_LABEL_T *b)
+{
+    const RPIGRAFX_LABEL_T *a = &e->label;
+
+    return a->x == b->x && a->y == b->y && a->scale == b->scale
+            && a->color == b->color && a->background == b->background && !strcmp(a->text, b->text);
+}
+
+/* Extend rows [*y0, *y1) with rows y to y + height - 1. */
+static void add_rows(const struct rpigrafx_overlay *ov, const int y, const int height, int *y0, int *y1)
+{
+    const int top = y < 0 ? 0 : y;
+    const int bottom = y + height > ov->height ? ov->height : y + height;
+
+    if (top >= bottom)
+        return;
+    if (top < *y0)
+        *y0 = top;
+    if (bottom > *y1)
+        *y1 = bottom;
+}
+
+/* Draw the part of the box in rows [y0, y1). */
+static void draw_outline(struct rpigrafx_overlay *ov, const RPIGRAFX_BOX_T *box, const int y0, const int y1)
+{
+    uint32_t val;
+
+    local_rpigrafx_choose_color(&val, box->color, RPIGRAFX_FORMAT_RGBA32);
+    local_rpigrafx_outline_rgba32(ov->image + y0 * ov->stride, ov->stride, ov->width, y1 - y0,
+            box->x, box->y - y0, box->width, box->height, box->border, val);
+}
+
+/* Draw the part of the label in rows [y0, y1) from its cached layout. */
+static void draw_label(struct rpigrafx_overlay *ov, const struct label_entry *e, const int y0, const int y1)
+{
+    const RPIGRAFX_LABEL_T *l = &e->label;
+    uint32_t *p = ov->image + y0 * ov->stride;
+    uint32_t val;
+    int i;
+
+    if (l->background != RPIGRAFX_COLOR_TRANSPARENT) {
+        local_rpigrafx_choose_color(&val, l->background, RPIGRAFX_FORMAT_RGBA32);
+        local_rpigrafx_fill_rgba32(p, ov->stride, ov->width, y1 - y0, l->x, l->y - y0, e->width, e->height, val);
+    }
+    local_rpigrafx_choose_color(&val, l->color, RPIGRAFX_FORMAT_RGBA32);
+    for (i = 0; i < e->glyphs_num; i ++)
+        local_rpigrafx_draw_glyph_rgba32(p, ov->stride, ov->width, y1 - y0, ov->font, e->glyphs[i].glyph,
+                l->x + e->glyphs[i].x * l->scale, l->y - y0 + e->glyphs[i].y * l->scale, l->scale, val);
+}
+
+/* Redraw rows [y0, y1) from scratch and write them to the resource. */
+static void rebuild_rows(struct rpigrafx_overlay *ov, const int y0, const int y1)
+{
+    const RPIGRAFX_BOX_T *box = NULL;
+    const struct label_entry *e = NULL;
+    int i;
+
+    if (y0 >= y1)
+        return;
+    /* Transparent is 0x00000000. */
+    memset(ov->image + y0 * ov->stride, 0, (y1 - y0) * ov->stride * sizeof(*ov->image));
+    for (i = 0; i < ov->boxes_num; i ++) {
+        box = &ov->boxes[i];
+        if (box->y < y1 && box->y + box->height > y0)
+            draw_outline(ov, box, y0, y1);
+    }
+    for (i = 0; i < ov->labels_num; i ++) {
+        e = &ov->labels[i];
+        if (e->label.y < y1 && e->label.y + e->height > y0)
+            draw_label(ov, e, y0, y1);
+    }
+    rpigrafx_surface_write_rows(ov->surf, ov->image, y0, y1 - y0);
+}
+
+/* Lay the text of the label out with the font of the overlay. */
+static void layout_label(struct rpigrafx_overlay *ov, struct label_entry *e)
+{
+    int width, height;
+
+    e->glyphs_num = local_rpigrafx_layout_text(ov->font, e->text, &e->glyphs, &e->glyphs_len, &width, &height);
+    e->width = width * e->label.scale;
+    e->height = height * e->label.scale;
+}
+
+/* Copy label into e, laying it out again only if its text or scale changed. */
+static void save_label(struct rpigrafx_overlay *ov, struct label_entry *e, const RPIGRAFX_LABEL_T *label)
+{
+    const int size = strlen(label->text) + 1;
+    const int is_same_layout = e->text != NULL && e->label.scale == label->scale && !strcmp(e->text, label->text);
+
+    if (size > e->text_size) {
+        e->text_size = size;
+        e->text = realloc(e->text, e->text_size);
+        if (e->text == NULL)
+            error_and_exit("Failed to realloc %d bytes of memory\n", e->text_size);
+    }
+    memcpy(e->text, label->text, size);
+    e->label = *label;
+    e->label.text = e->text;
+    if (!is_same_layout)
+        layout_label(ov, e);
+}
+
+/*
+ * Create an overlay of width x height shown at (x, y) scaled to
+ * width_scaled x height_scaled. It is transparent at first.
+ * Overlays must be destroyed before their display is closed.
+ */
+RPIGRAFX_OVERLAY_T* rpigrafx_display_create_overlay(RPIGRAFX_DISPLAY_T *disp, const int width, const int height, const int x, const int y, const int width_scaled, const int height_scaled)
+{
+    struct rpigrafx_overlay *ov = NULL;
+
+    ov = calloc(1, sizeof(*ov));
+    if (ov == NULL)
+        error_and_exit("Failed to allocate an overlay\n");
+    ov->width = width;
+    ov->height = height;
+    ov->stride = ALIGN_UP(width, 8);
+    /* Transparent is 0x00000000. */
+    ov->image = calloc(ov->stride * height, sizeof(*ov->image));
+    if (ov->image == NULL)
+        error_and_exit("Failed to allocate %d bytes of memory\n", ov->stride * height * sizeof(*ov->image));
+    ov->font = local_rpigrafx_get_font(NULL);
+    ov->surf = rpigrafx_display_create_surface(disp, RPIGRAFX_FORMAT_RGBA32, width, height, x, y, width_scaled, height_scaled);
+    rpigrafx_surface_write(ov->surf, ov->image);
+    return ov;
+}
+
+void rpigrafx_destroy_overlay(RPIGRAFX_OVERLAY_T *ov)
+{
+    int i;
+
+    rpigrafx_destroy_surface(ov->surf);
+    for (i = 0; i < ov->labels_len; i ++) {
+        free(ov->labels[i].text);
+        free(ov->labels[i].glyphs);
+    }
+    free(ov->labels);
+    free(ov->boxes);
+    free(ov->image);
+    free(ov);
+}
+
+void rpigrafx_overlay_set_visible(RPIGRAFX_OVERLAY_T *ov, const int visible)
+{
+    rpigrafx_surface_set_visible(ov->surf, visible);
+}
+
+void rpigrafx_overlay_set_layer(RPIGRAFX_OVERLAY_T *ov, const int layer)
+{
+    rpigrafx_surface_set_layer(ov->surf, layer);
+}
+
+void rpigrafx_overlay_set_alpha(RPIGRAFX_OVERLAY_T *ov, const RPIGRAFX_ALPHA_T alpha, const int opacity)
+{
+    rpigrafx_surface_set_alpha(ov->surf, alpha, opacity);
+}
+
+/*
+ * Replace the boxes on the overlay with num boxes.
+ * Boxes are drawn in order, so later ones are on top.
+ * Only the rows spanned by boxes which differ from last time (at the same
+ * index) are rebuilt: they are cleared and what is in them is drawn again,
+ * and just those rows are written to the resource.
+ */
+void rpigrafx_overlay_draw_boxes(RPIGRAFX_OVERLAY_T *ov, const RPIGRAFX_BOX_T *boxes, const int num)
+{
+    int y0 = ov->height, y1 = 0;
+    int i;
+
+    for (i = 0; i < ov->boxes_num || i < num; i ++) {
+        if (i < ov->boxes_num && i < num && box_equal(&ov->boxes[i], &boxes[i]))
+            continue;
+        if (i < ov->boxes_num)
+            add_rows(ov, ov->boxes[i].y, ov->boxes[i].height, &y0, &y1);
+        if (i < num)
+            add_rows(ov, boxes[i].y, boxes[i].height, &y0, &y1);
+    }
+
+    if (num > ov->boxes_len) {
+        ov->boxes_len = num;
+        ov->boxes = realloc(ov->boxes, ov->boxes_len * sizeof(*ov->boxes));
+        if (ov->boxes == NULL)
+            error_and_exit("Failed to realloc %d bytes of memory\n", ov->boxes_len * sizeof(*ov->boxes));
+    }
+    memcpy(ov->boxes, boxes, num * sizeof(*boxes));
+    ov->boxes_num = num;
+    rebuild_rows(ov, y0, y1);
+}
+
+/*
+ * Replace the labels on the overlay with num labels, drawn in order over
+ * the boxes.  As with boxes, only the rows of the labels which differ from
+ * last time (at the same index) are rebuilt.  The layout of the text of
+ * each index is cached, so that moving a label or changing its colors
+ * does not lay it out again.
+ */
+void rpigrafx_overlay_draw_labels(RPIGRAFX_OVERLAY_T *ov, const RPIGRAFX_LABEL_T *labels, const int num)
+{
+    struct label_entry *e = NULL;
+    int y0 = ov->height, y1 = 0;
+    int i;
+
+    for (i = 0; i < num; i ++)
+        if (labels[i].scale <= 0)
+            error_and_exit("Invalid scale of label %d: %d\n", i, labels[i].scale);
+    if (num > ov->labels_len) {
+        ov->labels = realloc(ov->labels, num * sizeof(*ov->labels));
+        if (ov->labels == NULL)
+            error_and_exit("Failed to realloc %d bytes of memory\n", num * sizeof(*ov->labels));
+        memset(&ov->labels[ov->labels_len], 0, (num - ov->labels_len) * sizeof(*ov->labels));
+        ov->labels_len = num;
+    }
+
+    for (i = 0; i < ov->labels_num || i < num; i ++) {
+        e = &ov->labels[i];
+        if (i < ov->labels_num && i < num && label_equal(e, &labels[i]))
+            continue;
+        if (i < ov->labels_num)
+            add_rows(ov, e->label.y, e->height, &y0, &y1);
+        if (i < num) {
+            save_label(ov, e, &labels[i]);
+            add_rows(ov, e->label.y, e->height, &y0, &y1);
+        }
+    }
+    ov->labels_num = num;
+    rebuild_rows(ov, y0, y1);
+}
+
+/* Use font, or the built-in one if NULL, for the labels. The font must outlive the overlay. */
+void rpigrafx_overlay_set_font(RPIGRAFX_OVERLAY_T *ov, const RPIGRAFX_FONT_T *font)
+{
+    int y0 = ov->height, y1 = 0;
+    int i;
+
+    for (i = 0; i < ov->labels_num; i ++)
+        add_rows(ov, ov->labels[i].label.y, ov->labels[i].height, &y0, &y1);
+    ov->font = local_rpigrafx_get_font(font);
+    /* Entries beyond labels_num keep their layouts for reuse as well. */
+    for (i = 0; i < ov->labels_len; i ++)
+        if (ov->labels[i].text != NULL)
+            layout_label(ov, &ov->labels[i]);
+    for (i = 0; i < ov->labels_num; i ++)
+        add_rows(ov, ov->labels[i].label.y, ov->labels[i].height, &y0, &y1);
+    rebuild_rows(ov, y0, y1);
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rpigrafx.h"
+#include "local/camera.h"
+#include "local/draw.h"
+#include "local/error.h"
+#include "local/record.h"
+
+/*
+ * Recording of frames into a ring in a memory-mapped file.
+ * The file is allocated and mapped once, so writing a frame is a copy into
+ * the mapping and the kernel writes the pages back by itself.  When the
+ * ring is full the oldest frames are overwritten.
+ *
+ * The file is a header of HEADER_SIZE bytes followed by the ring.  Records
+ * are a struct record followed by the planes of the frame as
+ * local_rpigrafx_frame_layout() lays them out, and never wrap around the
+ * end of the ring; a pad record fills the rest of the ring instead.
+ * Offsets into the ring only grow; the position of offset is
+ * offset % ring_size.
+ */
+
+#define HEADER_SIZE 4096
+#define RECORD_ALIGN 64
+#define FILE_MAGIC "RPGXREC"
+#define FILE_VERSION 1
+#define RECORD_MAGIC 0x52435246
+#define PAD_MAGIC 0x44415046
+
+struct file_header {
+    char magic[8];
+    uint32_t version, header_size;
+    uint64_t ring_size;
+    /* End of the newest record and start of the oldest one. */
+    uint64_t head, tail;
+    uint64_t num_frames;
+};
+
+struct record {
+    uint32_t magic;
+    /* Of the whole record, a multiple of RECORD_ALIGN. */
+    uint32_t size;
+    int32_t width, height, format, num_planes;
+    int32_t plane_offset[MAX_PLANES], plane_stride[MAX_PLANES];
+    int64_t timestamp, receive_time;
+    uint64_t sequence;
+    uint32_t data_size, reserved;
+};
+
+#define RECORD_HEADER_SIZE ALIGN_UP(sizeof(struct record), RECORD_ALIGN)
+
+struct rpigrafx_recorder {
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    struct file_header *header;
+    uint8_t *ring;
+    /* Serializes the writers. */
+    pthread_mutex_t mutex;
+};
+
+struct local_rpigrafx_recording {
+    uint8_t *map;
+    size_t map_size;
+    /* Records of the frames from the oldest one. */
+    const struct record **frames;
+    int frames_len;
+};
+
+
+/*
+ * Create a recorder which keeps the last frames which fit in size bytes of
+ * the file at path.  The file is created or truncated and allocated now.
+ */
+RPIGRAFX_RECORDER_T* rpigrafx_create_recorder(const char *path, const int64_t size)
+{
+    struct rpigrafx_recorder *rec = NULL;
+    int err;
+
+    if (size <= HEADER_SIZE + (int64_t) RECORD_HEADER_SIZE)
+        error_and_exit("Recording of %lld bytes is too small\n", (long long) size);
+
+    rec = calloc(1, sizeof(*rec));
+    if (rec == NULL)
+        error_and_exit("Failed to allocate a recorder\n");
+    rec->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (rec->fd == -1)
+        error_and_exit("Failed to open %s\n", path);
+    rec->map_size = HEADER_SIZE + (size - HEADER_SIZE) / RECORD_ALIGN * RECORD_ALIGN;
+    /*
+     * Allocate the blocks now, so that a full disk does not fault in the
+     * middle of a frame.  posix_fallocate() returns the error instead of
+     * setting errno; only file systems which cannot preallocate fall back
+     * to a sparse file.
+     */
+    err = posix_fallocate(rec->fd, 0, rec->map_size);
+    if (err == EOPNOTSUPP || err == EINVAL) {
+        if (ftruncate(rec->fd, rec->map_size))
+            error_and_exit("Failed to truncate %s to %zu bytes\n", path, rec->map_size);
+    } else if (err != 0)
+        error_and_exit("Failed to allocate %zu bytes of %s\n", rec->map_size, path);
+    rec->map = mmap(NULL, rec->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, rec->fd, 0);
+    if (rec->map == MAP_FAILED)
+        error_and_exit("Failed to map %s\n", path);
+
+    rec->header = (struct file_header*) rec->map;
+    rec->ring = rec->map + HEADER_SIZE;
+    memcpy(rec->header->magic, FILE_MAGIC, sizeof(rec->header->magic));
+    rec->header->version = FILE_VERSION;
+    rec->header->header_size = HEADER_SIZE;
+    rec->header->ring_size = rec->map_size - HEADER_SIZE;
+    pthread_mutex_init(&rec->mutex, NULL);
+    return rec;
+}
+
+void rpigrafx_destroy_recorder(RPIGRAFX_RECORDER_T *rec)
+{
+    msync(rec->map, rec->map_size, MS_SYNC);
+    munmap(rec->map, rec->map_size);
+    close(rec->fd);
+    pthread_mutex_destroy(&rec->mutex);
+    free(rec);
+}
+
+/* Drop the oldest records until size bytes are free after the head. */
+static void make_room(struct rpigrafx_recorder *rec, const uint64_t size)
+{
+    struct file_header *h = rec->header;
+    const struct record *r = NULL;
+
+    while (h->head + size - h->tail > h->ring_size) {
+        r = (const struct record*) (rec->ring + h->tail % h->ring_size);
+        if (r->magic == RECORD_MAGIC)
+            h->num_frames --;
+        h->tail += r->size;
+    }
+}
+
+/* Append a copy of frame, overwriting the oldest frames if the ring is full. */
+void rpigrafx_recorder_write_frame(RPIGRAFX_RECORDER_T *rec, RPIGRAFX_FRAME_T *frame)
+{
+    struct file_header *h = rec->header;
+    struct record *r = NULL;
+    int num_planes, offsets[MAX_PLANES], strides[MAX_PLANES], i;
+    uint64_t pos, size, pad;
+    int data_size;
+
+    data_size = local_rpigrafx_frame_layout(frame->format, frame->width, frame->height, &num_planes, offsets, strides);
+    size = RECORD_HEADER_SIZE + ALIGN_UP((uint64_t) data_size, RECORD_ALIGN);
+    if (size > h->ring_size)
+        error_and_exit("Frame of %d bytes does not fit in the recording\n", data_size);
+
+    pthread_mutex_lock(&rec->mutex);
+    pos = h->head % h->ring_size;
+    if (pos + size > h->ring_size) {
+        pad = h->ring_size - pos;
+        make_room(rec, pad + size);
+        r = (struct record*) (rec->ring + pos);
+        r->magic = PAD_MAGIC;
+        r->size = pad;
+        h->head += pad;
+        pos = 0;
+    } else
+        make_room(rec, size);
+
+    r = (struct record*) (rec->ring + pos);
+    memcpy(rec->ring + pos + RECORD_HEADER_SIZE, frame->data, data_size);
+    r->size = size;
+    r->width = frame->width;
+    r->height = frame->height;
+    r->format = frame->format;
+    r->num_planes = num_planes;
+    for (i = 0; i < MAX_PLANES; i ++) {
+        r->plane_offset[i] = i < num_planes ? offsets[i] : 0;
+        r->plane_stride[i] = i < num_planes ? strides[i] : 0;
+    }
+    r->timestamp = frame->timestamp;
+    r->receive_time = frame->receive_time;
+    r->sequence = frame->sequence;
+    r->data_size = data_size;
+    r->magic = RECORD_MAGIC;
+    /* The record is complete before the head covers it. */
+    __sync_synchronize();
+    h->head += size;
+    h->num_frames ++;
+    pthread_mutex_unlock(&rec->mutex);
+}
+
+
+struct local_rpigrafx_recording* local_rpigrafx_open_recording(const char *path)
+{
+    struct local_rpigrafx_recording *r = NULL;
+    const struct file_header *h = NULL;
+    const struct record *rec = NULL;
+    struct stat st;
+    uint64_t offset;
+    int fd;
+
+    r = calloc(1, sizeof(*r));
+    if (r == NULL)
+        error_and_exit("Failed to allocate a recording\n");
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+        error_and_exit("Failed to open %s\n", path);
+    if (fstat(fd, &st) || st.st_size < HEADER_SIZE)
+        error_and_exit("%s is not a recording\n", path);
+    r->map_size = st.st_size;
+    r->map = mmap(NULL, r->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (r->map == MAP_FAILED)
+        error_and_exit("Failed to map %s\n", path);
+    close(fd);
+
+    h = (const struct file_header*) r->map;
+    if (memcmp(h->magic, FILE_MAGIC, sizeof(h->magic)) || h->version != FILE_VERSION
+            || h->header_size != HEADER_SIZE || h->ring_size != r->map_size - HEADER_SIZE)
+        error_and_exit("%s is not a recording of this version\n", path);
+
+    r->frames = malloc((h->num_frames > 0 ? h->num_frames : 1) * sizeof(*r->frames));
+    if (r->frames == NULL)
+        error_and_exit("Failed to allocate the index of %llu frames\n", (unsigned long long) h->num_frames);
+    for (offset = h->tail; offset < h->head; offset += rec->size) {
+        rec = (const struct record*) (r->map + HEADER_SIZE + offset % h->ring_size);
+        if ((rec->magic != RECORD_MAGIC && rec->magic != PAD_MAGIC) || rec->size == 0
+                || (uint64_t) r->frames_len >= h->num_frames)
+            error_and_exit("%s is corrupted at %llu\n", path, (unsigned long long) offset);
+        if (rec->magic == RECORD_MAGIC)
+            r->frames[r->frames_len ++] = rec;
+    }
+    return r;
+}
+
+void local_rpigrafx_close_recording(struct local_rpigrafx_recording *r)
+{
+    munmap(r->map, r->map_size);
+    free(r->frames);
+    free(r);
+}
+
+int local_rpigrafx_recording_num_frames(const struct local_rpigrafx_recording *r)
+{
+    return r->frames_len;
+}
+
+void local_rpigrafx_recording_get_frame(const struct local_rpigrafx_recording *r, const int i, struct local_rpigrafx_recorded_frame *f)
+{
+    const struct record *rec = r->frames[i];
+
+    f->width = rec->width;
+    f->height = rec->height;
+    f->format = rec->format;
+    f->timestamp = rec->timestamp;
+    f->data = (const uint8_t*) rec + RECORD_HEADER_SIZE;
+    f->size = rec->data_size;
+}
@@ -0,0 +1,508 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rpigrafx.h"
+#include "local/camera.h"
+#include "local/draw.h"
+#include "local/error.h"
+#include "local/resize.h"
+#include "local/workers.h"
+
+/*
+ * Resizing and format conversion on the CPU, for the backends which have no
+ * ISP and for the streams which use the CPU resizer.  Images are RGBA32 with
+ * R at the lowest address.
+ * The filters are in fixed point.  The rows of the destination are split
+ * into bands which the workers resize and convert independently; each band
+ * has its own scratch rows, and the tables are shared.
+ */
+
+/* Weights of the area filter sum to this. */
+#define AREA_ONE (1 << 14)
+/* Bits dropped from the vertical sums of the area filter before the horizontal pass. */
+#define AREA_SHIFT 7
+
+/* Source span of a destination pixel of the area filter. */
+struct area_span {
+    int start, count;
+    /* Into the weights of the axis. */
+    int offset;
+};
+
+struct band {
+    /* RGBA32 rows of the band before conversion, unless the format is RGBA32. */
+    uint8_t *rgba;
+    /* Horizontally interpolated source rows of the bilinear filter and their y. */
+    uint32_t *rows[2];
+    int rows_y[2];
+    /* Vertical sums of the area filter. */
+    uint32_t *sums;
+};
+
+struct local_rpigrafx_resizer {
+    RPIGRAFX_FILTER_T filter;
+    RPIGRAFX_FORMAT_T format;
+    int dst_width, dst_height;
+    int src_max_width, src_max_height;
+
+    /* Source region the tables are made for. */
+    RPIGRAFX_RECT_T table_rect;
+    /* Nearest: source x and y.  Bilinear: 16.16 source positions. */
+    int32_t *xs, *ys;
+    /* Area. */
+    struct area_span *x_spans, *y_spans;
+    uint16_t *x_weights, *y_weights;
+
+    int num_bands, rgba_stride, band_rows;
+    struct band *bands;
+
+    /* Layout of the destination. */
+    int num_planes, offsets[MAX_PLANES], strides[MAX_PLANES];
+
+    /* Arguments of the job being run. */
+    uint8_t *dst;
+    const uint8_t *src;
+    int src_stride;
+};
+
+
+static void* alloc_scratch(const size_t size)
+{
+    void *p = NULL;
+
+    /* Aligned for the SIMD kernels. */
+    if (posix_memalign(&p, 32, size))
+        error_and_exit("Failed to allocate %zu bytes of resizer scratch\n", size);
+    return p;
+}
+
+static void* realloc_table(void *p, const size_t size)
+{
+    p = realloc(p, size);
+    if (p == NULL)
+        error_and_exit("Failed to allocate %zu bytes of resizer tables\n", size);
+    return p;
+}
+
+/* Grow the tables and the scratch which depend on the size of the source. */
+static void reserve_source(struct local_rpigrafx_resizer *rs, const int src_width, const int src_height)
+{
+    int i;
+
+    if (src_width <= rs->src_max_width && src_height <= rs->src_max_height && rs->xs != NULL)
+        return;
+    if (src_width > rs->src_max_width)
+        rs->src_max_width = src_width;
+    if (src_height > rs->src_max_height)
+        rs->src_max_height = src_height;
+
+    rs->xs = realloc_table(rs->xs, rs->dst_width * sizeof(*rs->xs));
+    rs->ys = realloc_table(rs->ys, rs->dst_height * sizeof(*rs->ys));
+    if (rs->filter != RPIGRAFX_FILTER_AREA)
+        return;
+    rs->x_spans = realloc_table(rs->x_spans, rs->dst_width * sizeof(*rs->x_spans));
+    rs->y_spans = realloc_table(rs->y_spans, rs->dst_height * sizeof(*rs->y_spans));
+    /* A destination pixel overlaps at most one source pixel more than it covers. */
+    rs->x_weights = realloc_table(rs->x_weights, (rs->src_max_width + rs->dst_width) * sizeof(*rs->x_weights));
+    rs->y_weights = realloc_table(rs->y_weights, (rs->src_max_height + rs->dst_height) * sizeof(*rs->y_weights));
+    for (i = 0; i < rs->num_bands; i ++) {
+        free(rs->bands[i].sums);
+        rs->bands[i].sums = alloc_scratch(rs->src_max_width * 4 * sizeof(uint32_t));
+    }
+}
+
+struct local_rpigrafx_resizer* local_rpigrafx_create_resizer(const RPIGRAFX_FILTER_T filter, const RPIGRAFX_FORMAT_T format,
+                                                             const int dst_width, const int dst_height,
+                                                             const int src_max_width, const int src_max_height, const int num_bands)
+{
+    struct local_rpigrafx_resizer *rs = NULL;
+    int i;
+
+    if (filter <= RPIGRAFX_FILTER_MIN || filter >= RPIGRAFX_FILTER_MAX)
+        error_and_exit("Unknown filter: %d\n", filter);
+    if (dst_width <= 0 || dst_height <= 0 || num_bands <= 0)
+        error_and_exit("Invalid resizer of %dx%d in %d bands\n", dst_width, dst_height, num_bands);
+
+    rs = calloc(1, sizeof(*rs));
+    if (rs == NULL)
+        error_and_exit("Failed to allocate a resizer\n");
+    rs->filter = filter;
+    rs->format = format;
+    rs->dst_width = dst_width;
+    rs->dst_height = dst_height;
+    local_rpigrafx_frame_layout(format, dst_width, dst_height, &rs->num_planes, rs->offsets, rs->strides);
+    /* Bands start at even rows for the chroma of 2x2 blocks. */
+    rs->num_bands = num_bands < (dst_height + 1) / 2 ? num_bands : (dst_height + 1) / 2;
+    rs->band_rows = (dst_height + rs->num_bands - 1) / rs->num_bands + 2;
+    rs->rgba_stride = ALIGN_UP(dst_width, 32) * 4;
+
+    rs->bands = calloc(rs->num_bands, sizeof(*rs->bands));
+    if (rs->bands == NULL)
+        error_and_exit("Failed to allocate %d bands\n", rs->num_bands);
+    for (i = 0; i < rs->num_bands; i ++) {
+        if (format != RPIGRAFX_FORMAT_RGBA32)
+            rs->bands[i].rgba = alloc_scratch(rs->rgba_stride * rs->band_rows);
+        if (filter == RPIGRAFX_FILTER_BILINEAR) {
+            rs->bands[i].rows[0] = alloc_scratch(rs->rgba_stride);
+            rs->bands[i].rows[1] = alloc_scratch(rs->rgba_stride);
+        }
+    }
+    reserve_source(rs, src_max_width, src_max_height);
+    return rs;
+}
+
+void local_rpigrafx_destroy_resizer(struct local_rpigrafx_resizer *rs)
+{
+    int i;
+
+    for (i = 0; i < rs->num_bands; i ++) {
+        free(rs->bands[i].rgba);
+        free(rs->bands[i].rows[0]);
+        free(rs->bands[i].rows[1]);
+        free(rs->bands[i].sums);
+    }
+    free(rs->bands);
+    free(rs->xs);
+    free(rs->ys);
+    free(rs->x_spans);
+    free(rs->y_spans);
+    free(rs->x_weights);
+    free(rs->y_weights);
+    free(rs);
+}
+
+/* The source pixel whose center is the nearest to that of each destination pixel. */
+static void make_nearest(int32_t *pos, const int dst_len, const int src_start, const int src_len)
+{
+    int i;
+
+    for (i = 0; i < dst_len; i ++)
+        pos[i] = src_start + (int) (((int64_t) (2 * i + 1) * src_len) / (2 * dst_len));
+}
+
+/* Source positions of the destination pixels in 16.16 fixed point. */
+static void make_positions(int32_t *pos, const int dst_len, const int src_start, const int src_len)
+{
+    int64_t p;
+    int i;
+
+    for (i = 0; i < dst_len; i ++) {
+        /* Pixel centers map to pixel centers, without accumulating the rounding of a step. */
+        p = (((int64_t) (2 * i + 1) * src_len << 16) + dst_len) / (2 * dst_len) - (1 << 15);
+        if (p < 0)
+            p = 0;
+        if (p > (int64_t) (src_len - 1) << 16)
+            p = (int64_t) (src_len - 1) << 16;
+        /* To the 1/256 pixels of the weights. */
+        pos[i] = ((p + 128) & ~0xff) + ((int64_t) src_start << 16);
+    }
+}
+
+/*
+ * Destination pixel i covers [i * src_len, (i + 1) * src_len) and source
+ * pixel j covers [j * dst_len, (j + 1) * dst_len), in units of 1 / dst_len
+ * source pixels.  The weights are the overlaps, rounded so that those of
+ * each destination pixel sum to AREA_ONE exactly.
+ */
+static void make_area(struct area_span *spans, uint16_t *weights, const int dst_len, const int src_start, const int src_len)
+{
+    int64_t lo, hi, a, b;
+    int i, j, n = 0;
+
+    for (i = 0; i < dst_len; i ++) {
+        lo = (int64_t) i * src_len;
+        hi = lo + src_len;
+        spans[i].start = src_start + (int) (lo / dst_len);
+        spans[i].offset = n;
+        for (j = lo / dst_len; (int64_t) j * dst_len < hi; j ++) {
+            a = (int64_t) j * dst_len > lo ? (int64_t) j * dst_len : lo;
+            b = (int64_t) (j + 1) * dst_len < hi ? (int64_t) (j + 1) * dst_len : hi;
+            weights[n ++] = ((b - lo) * AREA_ONE + src_len / 2) / src_len - ((a - lo) * AREA_ONE + src_len / 2) / src_len;
+        }
+        spans[i].count = n - spans[i].offset;
+    }
+}
+
+static void make_tables(struct local_rpigrafx_resizer *rs, const RPIGRAFX_RECT_T *r)
+{
+    if (!memcmp(&rs->table_rect, r, sizeof(*r)))
+        return;
+    rs->table_rect = *r;
+    switch (rs->filter) {
+        case RPIGRAFX_FILTER_NEAREST:
+            make_nearest(rs->xs, rs->dst_width, r->x, r->width);
+            make_nearest(rs->ys, rs->dst_height, r->y, r->height);
+            break;
+        case RPIGRAFX_FILTER_BILINEAR:
+            make_positions(rs->xs, rs->dst_width, r->x, r->width);
+            make_positions(rs->ys, rs->dst_height, r->y, r->height);
+            break;
+        case RPIGRAFX_FILTER_AREA:
+            make_area(rs->x_spans, rs->x_weights, rs->dst_width, r->x, r->width);
+            make_area(rs->y_spans, rs->y_weights, rs->dst_height, r->y, r->height);
+            break;
+        default:
+            error_and_exit("Unknown filter: %d\n", rs->filter);
+    }
+}
+
+static void nearest_rows(struct local_rpigrafx_resizer *rs, uint8_t *out, const int out_stride, const int y0, const int y1)
+{
+    const int32_t *xs = rs->xs;
+    const uint32_t *s;
+    uint32_t *d;
+    int x, y;
+
+    for (y = y0; y < y1; y ++) {
+        s = (const uint32_t*) (rs->src + rs->ys[y] * rs->src_stride);
+        d = (uint32_t*) (out + (y - y0) * out_stride);
+        for (x = 0; x < rs->dst_width; x ++)
+            d[x] = s[xs[x]];
+    }
+}
+
+/* Interpolate source row sy horizontally. */
+static void bilinear_row(struct local_rpigrafx_resizer *rs, uint8_t *d, const int sy)
+{
+    const uint8_t *s = rs->src + sy * rs->src_stride;
+    const int x_last = rs->table_rect.x + rs->table_rect.width - 1;
+    int x, c, x0, x1, fx;
+
+    for (x = 0; x < rs->dst_width; x ++) {
+        x0 = rs->xs[x] >> 16;
+        x1 = x0 < x_last ? x0 + 1 : x0;
+        fx = (rs->xs[x] >> 8) & 0xff;
+        for (c = 0; c < 4; c ++)
+            d[x * 4 + c] = (s[x0 * 4 + c] * (256 - fx) + s[x1 * 4 + c] * fx + 128) >> 8;
+    }
+}
+
+/*
+ * The weight of the lower row is 0 on the last source row, which is not
+ * interpolated then.  Rows go down, so the lower row of a destination row
+ * is usually the upper one of the next.
+ */
+static void bilinear_rows(struct local_rpigrafx_resizer *rs, struct band *b, uint8_t *out, const int out_stride, const int y0, const int y1)
+{
+    uint32_t *t;
+    int y, sy, fy;
+
+    b->rows_y[0] = b->rows_y[1] = -1;
+    for (y = y0; y < y1; y ++) {
+        sy = rs->ys[y] >> 16;
+        fy = (rs->ys[y] >> 8) & 0xff;
+        if (b->rows_y[0] != sy) {
+            if (b->rows_y[1] == sy) {
+                t = b->rows[0];
+                b->rows[0] = b->rows[1];
+                b->rows[1] = t;
+                b->rows_y[1] = b->rows_y[0];
+            } else
+                bilinear_row(rs, (uint8_t*) b->rows[0], sy);
+            b->rows_y[0] = sy;
+        }
+        if (fy != 0 && b->rows_y[1] != sy + 1) {
+            bilinear_row(rs, (uint8_t*) b->rows[1], sy + 1);
+            b->rows_y[1] = sy + 1;
+        }
+        local_rpigrafx_lerp_rows_rgba32((uint32_t*) (out + (y - y0) * out_stride), b->rows[0], b->rows[1], fy, rs->dst_width);
+    }
+}
+
+static void area_rows(struct local_rpigrafx_resizer *rs, struct band *b, uint8_t *out, const int out_stride, const int y0, const int y1)
+{
+    const int n = rs->table_rect.width * 4;
+    const struct area_span *xsp, *ysp;
+    const uint16_t *w;
+    const uint8_t *s;
+    uint32_t *sums = b->sums, *p;
+    uint32_t v[4];
+    uint8_t *d;
+    int x, y, i, j, c;
+
+    for (y = y0; y < y1; y ++) {
+        ysp = &rs->y_spans[y];
+        memset(sums, 0, n * sizeof(*sums));
+        for (j = 0; j < ysp->count; j ++) {
+            s = rs->src + (ysp->start + j) * rs->src_stride + rs->table_rect.x * 4;
+            for (i = 0; i < n; i ++)
+                sums[i] += rs->y_weights[ysp->offset + j] * s[i];
+        }
+        /* Fits in 16 bits, so that the horizontal sums fit in 32. */
+        for (i = 0; i < n; i ++)
+            sums[i] = (sums[i] + (1 << (AREA_SHIFT - 1))) >> AREA_SHIFT;
+
+        d = out + (y - y0) * out_stride;
+        for (x = 0; x < rs->dst_width; x ++) {
+            xsp = &rs->x_spans[x];
+            w = &rs->x_weights[xsp->offset];
+            p = sums + (xsp->start - rs->table_rect.x) * 4;
+            v[0] = v[1] = v[2] = v[3] = 0;
+            for (j = 0; j < xsp->count; j ++)
+                for (c = 0; c < 4; c ++)
+                    v[c] += w[j] * p[j * 4 + c];
+            for (c = 0; c < 4; c ++)
+                d[x * 4 + c] = (v[c] + (1 << (27 - AREA_SHIFT))) >> (28 - AREA_SHIFT);
+        }
+    }
+}
+
+static void resize_band(void *arg, const int band, const int num_bands)
+{
+    struct local_rpigrafx_resizer *rs = arg;
+    struct band *b = &rs->bands[band];
+    const int y0 = (rs->dst_height * band / num_bands) & ~1;
+    const int y1 = band == num_bands - 1 ? rs->dst_height : (rs->dst_height * (band + 1) / num_bands) & ~1;
+    int offsets[MAX_PLANES], i;
+    uint8_t *out;
+    int out_stride;
+
+    if (rs->format == RPIGRAFX_FORMAT_RGBA32) {
+        out = rs->dst + y0 * rs->strides[0];
+        out_stride = rs->strides[0];
+    } else {
+        out = b->rgba;
+        out_stride = rs->rgba_stride;
+    }
+
+    switch (rs->filter) {
+        case RPIGRAFX_FILTER_NEAREST:
+            nearest_rows(rs, out, out_stride, y0, y1);
+            break;
+        case RPIGRAFX_FILTER_BILINEAR:
+            bilinear_rows(rs, b, out, out_stride, y0, y1);
+            break;
+        case RPIGRAFX_FILTER_AREA:
+            area_rows(rs, b, out, out_stride, y0, y1);
+            break;
+        default:
+            error_and_exit("Unknown filter: %d\n", rs->filter);
+    }
+
+    if (rs->format == RPIGRAFX_FORMAT_RGBA32)
+        return;
+    /* The chroma planes are subsampled by 2 vertically, and y0 is even. */
+    offsets[0] = 0;
+    for (i = 1; i < rs->num_planes; i ++)
+        offsets[i] = rs->offsets[i] + y0 / 2 * rs->strides[i] - y0 * rs->strides[0];
+    local_rpigrafx_convert_rgba32(rs->dst + y0 * rs->strides[0], rs->format, offsets, rs->strides,
+                                  out, out_stride, rs->dst_width, y1 - y0);
+}
+
+/*
+ * Resize src_rect of src into dst, which is laid out as
+ * local_rpigrafx_frame_layout() gives, on workers.
+ * Calls on one resizer must not overlap.
+ */
+void local_rpigrafx_resize(struct local_rpigrafx_resizer *rs, struct local_rpigrafx_workers *workers,
+                           uint8_t *dst, const uint8_t *src, const int src_stride, const RPIGRAFX_RECT_T *src_rect)
+{
+    reserve_source(rs, src_rect->width, src_rect->height);
+    make_tables(rs, src_rect);
+    rs->dst = dst;
+    rs->src = src;
+    rs->src_stride = src_stride;
+    local_rpigrafx_workers_run(workers, resize_band, rs, rs->num_bands);
+}
+
+/* BT.601 limited range, as the ISP produces. */
+static inline uint8_t rgb_to_y(const int r, const int g, const int b)
+{
+    return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+static inline uint8_t rgb_to_u(const int r, const int g, const int b)
+{
+    return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+static inline uint8_t rgb_to_v(const int r, const int g, const int b)
+{
+    return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+static void convert_luma(uint8_t *dst, const int dst_stride, const uint8_t *src, const int src_stride, const int width, const int height)
+{
+    const uint8_t *s;
+    int x, y;
+
+    for (y = 0; y < height; y ++) {
+        s = src + y * src_stride;
+        for (x = 0; x < width; x ++)
+            dst[y * dst_stride + x] = rgb_to_y(s[x * 4 + 0], s[x * 4 + 1], s[x * 4 + 2]);
+    }
+}
+
+/*
+ * Chroma of 2x2 blocks.  u and v are advanced by step bytes per sample,
+ * so that NV12 can interleave them.
+ */
+static void convert_chroma(uint8_t *u, uint8_t *v, const int dst_stride, const int step,
+                           const uint8_t *src, const int src_stride, const int width, const int height)
+{
+    const uint8_t *s0, *s1;
+    int x, y, x1, r, g, b;
+
+    for (y = 0; y < height; y += 2) {
+        s0 = src + y * src_stride;
+        s1 = y + 1 < height ? s0 + src_stride : s0;
+        for (x = 0; x < width; x += 2) {
+            x1 = x + 1 < width ? x + 1 : x;
+            r = (s0[x * 4 + 0] + s0[x1 * 4 + 0] + s1[x * 4 + 0] + s1[x1 * 4 + 0] + 2) >> 2;
+            g = (s0[x * 4 + 1] + s0[x1 * 4 + 1] + s1[x * 4 + 1] + s1[x1 * 4 + 1] + 2) >> 2;
+            b = (s0[x * 4 + 2] + s0[x1 * 4 + 2] + s1[x * 4 + 2] + s1[x1 * 4 + 2] + 2) >> 2;
+            u[(y / 2) * dst_stride + (x / 2) * step] = rgb_to_u(r, g, b);
+            v[(y / 2) * dst_stride + (x / 2) * step] = rgb_to_v(r, g, b);
+        }
+    }
+}
+
+/*
+ * Convert an RGBA32 image to format.
+ * dst is laid out by offsets and strides as local_rpigrafx_frame_layout() gives.
+ * src is clobbered for BGR24.
+ */
+void local_rpigrafx_convert_rgba32(uint8_t *dst, const RPIGRAFX_FORMAT_T format, const int *offsets, const int *strides,
+                                   uint8_t *src, const int src_stride, const int width, const int height)
+{
+    int y;
+
+    switch (format) {
+        case RPIGRAFX_FORMAT_RGBA32:
+            for (y = 0; y < height; y ++)
+                memcpy(dst + y * strides[0], src + y * src_stride, width * 4);
+            break;
+        case RPIGRAFX_FORMAT_RGB24:
+            for (y = 0; y < height; y ++)
+                local_rpigrafx_rgba32_to_rgb24(dst + y * strides[0], (const uint32_t*) (src + y * src_stride), width);
+            break;
+        case RPIGRAFX_FORMAT_BGR24:
+            for (y = 0; y < height; y ++) {
+                local_rpigrafx_swap_rb_rgba32((uint32_t*) (src + y * src_stride), (uint32_t*) (src + y * src_stride), width);
+                local_rpigrafx_rgba32_to_rgb24(dst + y * strides[0], (const uint32_t*) (src + y * src_stride), width);
+            }
+            break;
+        case RPIGRAFX_FORMAT_GRAY8:
+            convert_luma(dst, strides[0], src, src_stride, width, height);
+            break;
+        case RPIGRAFX_FORMAT_I420:
+            convert_luma(dst, strides[0], src, src_stride, width, height);
+            convert_chroma(dst + offsets[1], dst + offsets[2], strides[1], 1, src, src_stride, width, height);
+            break;
+        case RPIGRAFX_FORMAT_NV12:
+            convert_luma(dst, strides[0], src, src_stride, width, height);
+            convert_chroma(dst + offsets[1], dst + offsets[1] + 1, strides[1], 2, src, src_stride, width, height);
+            break;
+        default:
+            error_and_exit("Unknown format: %d\n", format);
+    }
+}
@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "rpigrafx.h"
+#include "local/camera.h"
+#include "local/draw.h"
+#include "local/error.h"
+#include "local/sync.h"
+
+/*
+ * Sharing of frames with other processes through a ring of slots in a
+ * POSIX shared memory object.
+ * The publisher writes publication n into slot n % num_slots under a
+ * sequence counter per slot, which is 2n + 1 while the slot is being
+ * written and 2n + 2 once it holds publication n, and then sets
+ * num_published to n + 1.  Subscribers read without locks: they check
+ * the counter of a slot before and after reading it, and hand out
+ * pointers into the mapping, which stay valid until the publisher comes
+ * around the ring to the same slot again.
+ * Subscribers which have seen everything sleep on a futex which the
+ * publisher bumps after each publication, and which it wakes only if
+ * someone sleeps on it.
+ */
+
+#define MAGIC "RPGXSHM"
+#define VERSION 1
+#define PAGE_SIZE_MIN 4096
+#define CACHE_LINE 64
+
+struct ring_header {
+    char magic[8];
+    uint32_t version;
+    /* Of the header and of the slot table, and of the data of each slot. */
+    uint32_t header_size, slot_size;
+    uint32_t num_slots;
+    int32_t width, height, format, num_planes;
+    int32_t plane_offset[MAX_PLANES], plane_stride[MAX_PLANES];
+    int32_t data_size;
+
+    uint64_t num_published __attribute__((aligned(CACHE_LINE)));
+    uint32_t futex, num_waiters;
+};
+
+struct ring_slot {
+    uint64_t seq;
+    int64_t timestamp, receive_time;
+    uint64_t sequence;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct ring {
+    char *name;
+    int fd;
+    /* Header and slot table, and the data of the slots. */
+    struct ring_header *header;
+    size_t header_map_size;
+    struct ring_slot *slots;
+    uint8_t *data;
+    size_t data_map_size;
+};
+
+struct rpigrafx_publisher {
+    struct ring ring;
+    /* Publication being written by rpigrafx_publisher_begin_frame(), or -1. */
+    int64_t writing;
+};
+
+struct rpigrafx_subscriber {
+    struct ring ring;
+    /* Number of the next publication not read yet. */
+    uint64_t next;
+};
+
+
+static long futex(uint32_t *addr, const int op, const uint32_t val, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+static char* dup_name(const char *name)
+{
+    char *s = NULL;
+
+    if (name[0] != '/' || strchr(name + 1, '/') != NULL)
+        error_and_exit("Shared memory name must be /NAME: %s\n", name);
+    s = strdup(name);
+    if (s == NULL)
+        error_and_exit("Failed to allocate a name\n");
+    return s;
+}
+
+/* Map the header and slot table read-write and the data with prot. */
+static void map_ring(struct ring *r, const size_t header_size, const size_t data_size, const int prot)
+{
+    r->header_map_size = header_size;
+    r->header = mmap(NULL, header_size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+    if (r->header == MAP_FAILED)
+        error_and_exit("Failed to map the header of %s\n", r->name);
+    r->slots = (struct ring_slot*) ((uint8_t*) r->header + ALIGN_UP(sizeof(struct ring_header), CACHE_LINE));
+    r->data_map_size = data_size;
+    r->data = mmap(NULL, data_size, prot, MAP_SHARED | (prot & PROT_WRITE ? MAP_POPULATE : 0), r->fd, header_size);
+    if (r->data == MAP_FAILED)
+        error_and_exit("Failed to map the slots of %s\n", r->name);
+}
+
+static void unmap_ring(struct ring *r)
+{
+    munmap(r->data, r->data_map_size);
+    munmap(r->header, r->header_map_size);
+    close(r->fd);
+    free(r->name);
+}
+
+
+/*
+ * Create the shared memory object name, of the form /NAME, with a ring of
+ * num_slots frames of width x height in format, replacing any object of
+ * that name.  Subscribers can read a frame until num_slots - 1 frames
+ * more have been published.
+ */
+RPIGRAFX_PUBLISHER_T* rpigrafx_create_publisher(const char *name, const int width, const int height, const RPIGRAFX_FORMAT_T format, const int num_slots)
+{
+    struct rpigrafx_publisher *pub = NULL;
+    struct ring_header *h = NULL;
+    int num_planes, offsets[MAX_PLANES], strides[MAX_PLANES], data_size, i;
+    size_t header_size, slot_size;
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    if (width <= 0 || height <= 0)
+        error_and_exit("Invalid frame size: %dx%d\n", width, height);
+    if (num_slots < 2)
+        error_and_exit("Ring needs 2 slots at least: %d\n", num_slots);
+    if (page_size < PAGE_SIZE_MIN)
+        page_size = PAGE_SIZE_MIN;
+    data_size = local_rpigrafx_frame_layout(format, width, height, &num_planes, offsets, strides);
+    header_size = ALIGN_UP(ALIGN_UP(sizeof(struct ring_header), CACHE_LINE) + num_slots * sizeof(struct ring_slot),
+                           (size_t) page_size);
+    slot_size = ALIGN_UP((size_t) data_size, (size_t) page_size);
+
+    pub = calloc(1, sizeof(*pub));
+    if (pub == NULL)
+        error_and_exit("Failed to allocate a publisher\n");
+    pub->ring.name = dup_name(name);
+    pub->writing = -1;
+    shm_unlink(name);
+    pub->ring.fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (pub->ring.fd == -1)
+        error_and_exit("Failed to create %s\n", name);
+    if (ftruncate(pub->ring.fd, header_size + slot_size * num_slots))
+        error_and_exit("Failed to allocate %zu bytes of %s\n", header_size + slot_size * num_slots, name);
+    map_ring(&pub->ring, header_size, slot_size * num_slots, PROT_READ | PROT_WRITE);
+
+    h = pub->ring.header;
+    h->version = VERSION;
+    h->header_size = header_size;
+    h->slot_size = slot_size;
+    h->num_slots = num_slots;
+    h->width = width;
+    h->height = height;
+    h->format = format;
+    h->num_planes = num_planes;
+    for (i = 0; i < MAX_PLANES; i ++) {
+        h->plane_offset[i] = i < num_planes ? offsets[i] : 0;
+        h->plane_stride[i] = i < num_planes ? strides[i] : 0;
+    }
+    h->data_size = data_size;
+    /* Subscribers check the magic last. */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(h->magic, MAGIC, sizeof(h->magic));
+    return pub;
+}
+
+/* Subscribers keep their mapping of the ring; the name is removed. */
+void rpigrafx_destroy_publisher(RPIGRAFX_PUBLISHER_T *pub)
+{
+    shm_unlink(pub->ring.name);
+    unmap_ring(&pub->ring);
+    free(pub);
+}
+
+/*
+ * Returns the buffer of the next frame, to be written in place and
+ * published by rpigrafx_publisher_end_frame().  It has the layout of the
+ * frames of the camera.
+ */
+void* rpigrafx_publisher_begin_frame(RPIGRAFX_PUBLISHER_T *pub)
+{
+    struct ring_header *h = pub->ring.header;
+    const uint64_t n = h->num_published;
+
+    if (pub->writing >= 0)
+        error_and_exit("A frame is already being written\n");
+    pub->writing = n;
+    __atomic_store_n(&pub->ring.slots[n % h->num_slots].seq, 2 * n + 1, __ATOMIC_RELAXED);
+    /* The slot is marked before its data changes. */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return pub->ring.data + (n % h->num_slots) * h->slot_size;
+}
+
+/* receive_time is CLOCK_MONOTONIC in nanoseconds, which every process shares. */
+void rpigrafx_publisher_end_frame(RPIGRAFX_PUBLISHER_T *pub, const int64_t timestamp, const int64_t receive_time, const uint64_t sequence)
+{
+    struct ring_header *h = pub->ring.header;
+    struct ring_slot *slot = NULL;
+    uint64_t n;
+
+    if (pub->writing < 0)
+        error_and_exit("No frame is being written\n");
+    n = pub->writing;
+    slot = &pub->ring.slots[n % h->num_slots];
+    slot->timestamp = timestamp;
+    slot->receive_time = receive_time;
+    slot->sequence = sequence;
+    __atomic_store_n(&slot->seq, 2 * n + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&h->num_published, n + 1, __ATOMIC_RELEASE);
+    pub->writing = -1;
+
+    __atomic_add_fetch(&h->futex, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&h->num_waiters, __ATOMIC_SEQ_CST) != 0)
+        futex(&h->futex, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+/* Publish a copy of frame, which must have the size and format of the ring. */
+void rpigrafx_publisher_write_frame(RPIGRAFX_PUBLISHER_T *pub, RPIGRAFX_FRAME_T *frame)
+{
+    const struct ring_header *h = pub->ring.header;
+
+    if (frame->width != h->width || frame->height != h->height || (int) frame->format != h->format)
+        error_and_exit("Frame of %dx%d in format %d does not fit a ring of %dx%d in format %d\n",
+                       frame->width, frame->height, frame->format, h->width, h->height, h->format);
+    memcpy(rpigrafx_publisher_begin_frame(pub), frame->data, h->data_size);
+    rpigrafx_publisher_end_frame(pub, frame->timestamp, frame->receive_time, frame->sequence);
+}
+
+
+RPIGRAFX_SUBSCRIBER_T* rpigrafx_open_subscriber(const char *name)
+{
+    struct rpigrafx_subscriber *sub = NULL;
+    struct ring_header h;
+    struct stat st;
+
+    sub = calloc(1, sizeof(*sub));
+    if (sub == NULL)
+        error_and_exit("Failed to allocate a subscriber\n");
+    sub->ring.name = dup_name(name);
+    sub->ring.fd = shm_open(name, O_RDWR, 0);
+    if (sub->ring.fd == -1)
+        error_and_exit("Failed to open %s\n", name);
+    if (fstat(sub->ring.fd, &st) || (size_t) st.st_size < sizeof(h)
+            || pread(sub->ring.fd, &h, sizeof(h), 0) != (ssize_t) sizeof(h)
+            || memcmp(h.magic, MAGIC, sizeof(h.magic)) || h.version != VERSION
+            || (off_t) h.header_size + (off_t) h.slot_size * h.num_slots != st.st_size)
+        error_and_exit("%s is not a frame ring of this version\n", name);
+    map_ring(&sub->ring, h.header_size, (size_t) h.slot_size * h.num_slots, PROT_READ);
+    /* Only frames published from now on. */
+    sub->next = __atomic_load_n(&sub->ring.header->num_published, __ATOMIC_ACQUIRE);
+    return sub;
+}
+
+void rpigrafx_close_subscriber(RPIGRAFX_SUBSCRIBER_T *sub)
+{
+    unmap_ring(&sub->ring);
+    free(sub);
+}
+
+void rpigrafx_subscriber_get_frame_size(RPIGRAFX_SUBSCRIBER_T *sub, int *width, int *height, RPIGRAFX_FORMAT_T *format)
+{
+    *width = sub->ring.header->width;
+    *height = sub->ring.header->height;
+    *format = sub->ring.header->format;
+}
+
+/*
+ * Wait until more than num frames have been published.
+ * Returns the number published, or num on timeout.
+ */
+static uint64_t wait_published(struct ring_header *h, const uint64_t num, const int timeout_ms)
+{
+    struct timespec deadline, rel;
+    uint64_t n;
+    uint32_t f;
+    int64_t left;
+
+    if (timeout_ms >= 0)
+        local_rpigrafx_deadline_ms(&deadline, timeout_ms);
+    for (; ; ) {
+        if ((n = __atomic_load_n(&h->num_published, __ATOMIC_ACQUIRE)) > num)
+            return n;
+        if (timeout_ms == 0)
+            return num;
+        __atomic_add_fetch(&h->num_waiters, 1, __ATOMIC_SEQ_CST);
+        f = __atomic_load_n(&h->futex, __ATOMIC_SEQ_CST);
+        /* A publication after this check changes the futex, and the wait returns at once. */
+        if ((n = __atomic_load_n(&h->num_published, __ATOMIC_ACQUIRE)) > num) {
+            __atomic_sub_fetch(&h->num_waiters, 1, __ATOMIC_SEQ_CST);
+            return n;
+        }
+        if (timeout_ms < 0)
+            futex(&h->futex, FUTEX_WAIT, f, NULL);
+        else {
+            left = (int64_t) (deadline.tv_sec * 1000000000LL + deadline.tv_nsec) - local_rpigrafx_now_ns();
+            if (left <= 0) {
+                __atomic_sub_fetch(&h->num_waiters, 1, __ATOMIC_SEQ_CST);
+                return num;
+            }
+            rel.tv_sec = left / 1000000000;
+            rel.tv_nsec = left % 1000000000;
+            futex(&h->futex, FUTEX_WAIT, f, &rel);
+        }
+        __atomic_sub_fetch(&h->num_waiters, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+/* Read publication n into frame; returns 0 if its slot has been reused. */
+static int read_slot(struct rpigrafx_subscriber *sub, const uint64_t n, RPIGRAFX_SHARED_FRAME_T *frame)
+{
+    const struct ring_header *h = sub->ring.header;
+    const struct ring_slot *slot = &sub->ring.slots[n % h->num_slots];
+    int i;
+
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != 2 * n + 2)
+        return 0;
+    frame->timestamp = slot->timestamp;
+    frame->receive_time = slot->receive_time;
+    frame->sequence = slot->sequence;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != 2 * n + 2)
+        return 0;
+
+    frame->data = sub->ring.data + (n % h->num_slots) * h->slot_size;
+    frame->width = h->width;
+    frame->height = h->height;
+    frame->format = h->format;
+    frame->num_planes = h->num_planes;
+    for (i = 0; i < MAX_PLANES; i ++) {
+        frame->plane_offset[i] = h->plane_offset[i];
+        frame->plane_stride[i] = h->plane_stride[i];
+    }
+    frame->publication = n;
+    return 1;
+}
+
+/*
+ * Take the oldest frame not read yet which is still in the ring, waiting up
+ * to timeout_ms (-1 for ever) for one.  Returns 0 on timeout.
+ * frame->dropped counts the frames which were overwritten before being read.
+ */
+int rpigrafx_subscriber_get_next_frame(RPIGRAFX_SUBSCRIBER_T *sub, RPIGRAFX_SHARED_FRAME_T *frame, const int timeout_ms)
+{
+    const uint64_t num_slots = sub->ring.header->num_slots;
+    uint64_t published, n;
+
+    published = wait_published(sub->ring.header, sub->next, timeout_ms);
+    if (published == sub->next)
+        return 0;
+    /* The oldest slot may be being rewritten; fall forward until a read holds. */
+    for (n = published > num_slots - 1 + sub->next ? published - (num_slots - 1) : sub->next; !read_slot(sub, n, frame); n ++)
+        ;
+    frame->dropped = n - sub->next;
+    sub->next = n + 1;
+    return 1;
+}
+
+/* Take the newest frame, waiting up to timeout_ms for one not read yet. */
+int rpigrafx_subscriber_get_latest_frame(RPIGRAFX_SUBSCRIBER_T *sub, RPIGRAFX_SHARED_FRAME_T *frame, const int timeout_ms)
+{
+    uint64_t published;
+
+    for (; ; ) {
+        published = wait_published(sub->ring.header, sub->next, timeout_ms);
+        if (published == sub->next)
+            return 0;
+        if (read_slot(sub, published - 1, frame))
+            break;
+    }
+    frame->dropped = published - 1 - sub->next;
+    sub->next = published;
+    return 1;
+}
+
+/*
+ * Whether the data of frame is still intact.  Check after using the data,
+ * since the publisher does not wait for subscribers.
+ */
+int rpigrafx_subscriber_is_frame_valid(RPIGRAFX_SUBSCRIBER_T *sub, const RPIGRAFX_SHARED_FRAME_T *frame)
+{
+    const struct ring_slot *slot = &sub->ring.slots[frame->publication % sub->ring.header->num_slots];
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == 2 * frame->publication + 2;
+}
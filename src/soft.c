@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include "local/backend.h"
+#include "local/soft.h"
+
+static void soft_init()
+{
+}
+
+static void soft_deinit()
+{
+}
+
+/* Camera and display emulated on the CPU, for hosts without a VideoCore. */
+const struct local_rpigrafx_backend local_rpigrafx_backend_soft = {
+    .name = "soft",
+    .init = soft_init,
+    .deinit = soft_deinit,
+    .camera = &local_rpigrafx_soft_camera_ops,
+    .display = &local_rpigrafx_soft_display_ops,
+};
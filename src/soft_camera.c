@@ -0,0 +1,688 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "rpigrafx.h"
+#include "local/camera.h"
+#include "local/context.h"
+#include "local/draw.h"
+#include "local/error.h"
+#include "local/record.h"
+#include "local/soft.h"
+#include "local/sync.h"
+
+/*
+ * Camera emulated on the CPU.
+ * A producer thread renders a frame into a queued buffer for each trigger,
+ * at most RPIGRAFX_SOFT_CAMERA_FPS (default 30, 0 for no limit) frames per
+ * second.  In video mode it renders at the frame rate of the mode into
+ * whatever buffer is queued without triggers, and a frame is lost if none
+ * is, as on the video port; the sensor mode is ignored.  The picture is a
+ * moving test pattern, or the PPM (P6) image RPIGRAFX_SOFT_CAMERA_FILE
+ * tiled over the frame.
+ * RPIGRAFX_SOFT_CAMERA_SIZE=WIDTHxHEIGHT sets the sensor size.
+ *
+ * RPIGRAFX_SOFT_CAMERA_REPLAY names a file written by
+ * rpigrafx_create_recorder() to replay instead, over and over.  The sensor
+ * size is that of its first frame, frames of another size are skipped, and
+ * the frames keep their recorded timestamps.  They come at the recorded
+ * pace unless RPIGRAFX_SOFT_CAMERA_FPS is set.
+ *
+ * The preview is rendered by another thread at the same frame rate and
+ * composited by the soft display as vc.ril.video_render would do.  The
+ * routing of the preview port of each open camera is written to the file
+ * RPIGRAFX_SOFT_TOPOLOGY on each change, one line per camera:
+ *
+ *     camera 0 preview -> video_render display 0 dst 0,0,640x480 layer 2 alpha 255
+ *     camera 1 preview -> null_sink
+ */
+
+#define DEFAULT_BUFFER_NUM 3
+
+enum buffer_state {
+    BUFFER_FREE = 0,
+    /* Waiting to be filled. */
+    BUFFER_QUEUED,
+    /* Filled and waiting for get_full. */
+    BUFFER_FULL,
+    /* Returned by get_full and not released yet. */
+    BUFFER_HELD
+};
+
+struct soft_camera {
+    struct rpigrafx_camera *cam;
+
+    /* Capture buffers; cam->frames are their descriptors. */
+    enum buffer_state *states;
+    int *full_fifo;
+    int full_head, full_num;
+    int buffer_size;
+
+    /* fps is default_fps in still mode and the frame rate of the mode in video mode. */
+    int fps, default_fps;
+    _Bool is_video;
+    unsigned frame_count;
+    struct timespec next_time;
+
+    /* Source image, or NULL for the test pattern. */
+    uint8_t *image;
+    int image_width, image_height;
+
+    /* Recording replayed instead, or NULL. */
+    struct local_rpigrafx_recording *replay;
+    int replay_index;
+    /* Frames follow the recorded timestamps, from replay_start_ts at replay_start_us. */
+    _Bool is_replay_timed;
+    int64_t replay_start_us, replay_start_ts, replay_last_ts;
+
+    pthread_t thread;
+    /* Protects everything above. */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int num_triggers;
+    _Bool is_running, is_producing, is_event_enabled;
+
+    /*
+     * Preview, written only while its thread is stopped; preview_display to
+     * preview_dst are also under open_cameras_mutex for write_topology().
+     */
+    pthread_t preview_thread;
+    void *preview_display;
+    int preview_display_num, preview_layer, preview_alpha;
+    RPIGRAFX_RECT_T preview_dst;
+    uint8_t *preview_buf;
+    /* Protected by mutex. */
+    _Bool is_previewing;
+
+    /* Link of open_cameras. */
+    struct soft_camera *next;
+};
+
+/* Open cameras of all contexts, for RPIGRAFX_SOFT_TOPOLOGY. */
+static struct soft_camera *open_cameras = NULL;
+static pthread_mutex_t open_cameras_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void* alloc_buffer(const int size)
+{
+    void *p = NULL;
+
+    /* Rows are 32-byte aligned; keep the base aligned as well for SIMD. */
+    if (posix_memalign(&p, 32, size))
+        error_and_exit("Failed to allocate %d bytes of buffer\n", size);
+    return p;
+}
+
+static void load_ppm(struct soft_camera *sc, const char *path)
+{
+    FILE *fp = NULL;
+    int maxval, i;
+    uint8_t *rgb = NULL;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+        error_and_exit("Failed to open %s\n", path);
+    if (fscanf(fp, "P6 %d %d %d", &sc->image_width, &sc->image_height, &maxval) != 3
+            || fgetc(fp) == EOF || sc->image_width <= 0 || sc->image_height <= 0 || maxval != 255)
+        error_and_exit("%s is not a PPM (P6) image of 8-bit depth\n", path);
+
+    rgb = malloc(sc->image_width * sc->image_height * 3);
+    sc->image = malloc(sc->image_width * sc->image_height * 4);
+    if (rgb == NULL || sc->image == NULL)
+        error_and_exit("Failed to allocate an image of %dx%d\n", sc->image_width, sc->image_height);
+    if (fread(rgb, 3, sc->image_width * sc->image_height, fp) != (size_t) (sc->image_width * sc->image_height))
+        error_and_exit("%s is truncated\n", path);
+    for (i = 0; i < sc->image_height; i ++)
+        local_rpigrafx_rgb24_to_rgba32((uint32_t*) (sc->image + i * sc->image_width * 4),
+                                       rgb + i * sc->image_width * 3, sc->image_width);
+    free(rgb);
+    fclose(fp);
+}
+
+/* Render frame n of width x height into p with stride bytes per row. */
+static void render(struct soft_camera *sc, uint8_t *p, const int stride, const int width, const int height, const unsigned n)
+{
+    const int box = height / 4, bx = (int) ((n * 8) % (unsigned) (width + box)) - box, by = (height - box) / 2;
+    uint8_t *d;
+    const uint8_t *s;
+    int x, y, sx;
+
+    for (y = 0; y < height; y ++) {
+        d = p + y * stride;
+        if (sc->image != NULL) {
+            s = sc->image + (y % sc->image_height) * sc->image_width * 4;
+            for (x = 0; x < width; x += sx) {
+                sx = width - x < sc->image_width ? width - x : sc->image_width;
+                memcpy(d + x * 4, s, sx * 4);
+            }
+            continue;
+        }
+        for (x = 0; x < width; x ++) {
+            d[x * 4 + 0] = x * 255 / width;
+            d[x * 4 + 1] = y * 255 / height;
+            d[x * 4 + 2] = n;
+            d[x * 4 + 3] = 0xff;
+        }
+        if (y >= by && y < by + box)
+            for (x = bx < 0 ? 0 : bx; x < bx + box && x < width; x ++)
+                *(uint32_t*) (d + x * 4) = 0xffffffff;
+    }
+}
+
+static int64_t now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Sleep until the time of the next frame. */
+static void pace(struct soft_camera *sc)
+{
+    struct timespec now;
+
+    if (sc->fps <= 0)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > sc->next_time.tv_sec
+            || (now.tv_sec == sc->next_time.tv_sec && now.tv_nsec >= sc->next_time.tv_nsec))
+        sc->next_time = now;
+    else
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sc->next_time, NULL))
+            ;
+    sc->next_time.tv_nsec += 1000000000 / sc->fps;
+    if (sc->next_time.tv_nsec >= 1000000000) {
+        sc->next_time.tv_sec ++;
+        sc->next_time.tv_nsec -= 1000000000;
+    }
+}
+
+/* Sleep until the time of the recorded frame which has timestamp ts. */
+static void pace_replay(struct soft_camera *sc, const int64_t ts)
+{
+    struct timespec next;
+    int64_t t;
+
+    /* Start over at the first frame and at a loop. */
+    if (sc->replay_start_us == 0 || ts < sc->replay_last_ts) {
+        sc->replay_start_us = now_us();
+        sc->replay_start_ts = ts;
+    }
+    sc->replay_last_ts = ts;
+    t = sc->replay_start_us + (ts - sc->replay_start_ts);
+    next.tv_sec = t / 1000000;
+    next.tv_nsec = t % 1000000 * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL))
+        ;
+}
+
+/* Copy the next recorded frame of the size of the captured frames into f. */
+static void replay(struct soft_camera *sc, struct rpigrafx_frame *f)
+{
+    struct rpigrafx_camera *cam = sc->cam;
+    struct local_rpigrafx_recorded_frame rf;
+    const int num = local_rpigrafx_recording_num_frames(sc->replay);
+    int i;
+
+    for (i = 0; i < num; i ++) {
+        local_rpigrafx_recording_get_frame(sc->replay, sc->replay_index, &rf);
+        sc->replay_index = (sc->replay_index + 1) % num;
+        if (rf.width == cam->frame_full_width && rf.height == cam->frame_full_height
+                && rf.format == RPIGRAFX_FORMAT_RGBA32)
+            break;
+    }
+    if (i == num)
+        error_and_exit("No frame of %dx%d to replay\n", cam->frame_full_width, cam->frame_full_height);
+
+    if (sc->is_replay_timed)
+        pace_replay(sc, rf.timestamp);
+    else
+        pace(sc);
+    f->timestamp = rf.timestamp;
+    memcpy(f->buffer, rf.data, rf.size < sc->buffer_size ? rf.size : sc->buffer_size);
+}
+
+/* Must be called with sc->mutex held. Returns -1 if no buffer is queued. */
+static int find_queued(struct soft_camera *sc)
+{
+    int i;
+
+    for (i = 0; i < sc->cam->frames_len; i ++)
+        if (sc->states[i] == BUFFER_QUEUED)
+            return i;
+    return -1;
+}
+
+static void* producer_main(void *arg)
+{
+    struct soft_camera *sc = arg;
+    struct rpigrafx_camera *cam = sc->cam;
+    struct rpigrafx_frame *f = NULL;
+    int i = -1;
+    _Bool is_event;
+
+    pthread_mutex_lock(&sc->mutex);
+    for (; ; ) {
+        while (sc->is_running && ((!sc->is_video && sc->num_triggers == 0) || (i = find_queued(sc)) < 0))
+            pthread_cond_wait(&sc->cond, &sc->mutex);
+        if (!sc->is_running)
+            break;
+        if (!sc->is_video)
+            sc->num_triggers --;
+        sc->is_producing = 1;
+        f = &cam->frames[i];
+        pthread_mutex_unlock(&sc->mutex);
+
+        if (sc->replay != NULL)
+            replay(sc, f);
+        else {
+            pace(sc);
+            /* Like the start of the exposure on a sensor. */
+            f->timestamp = now_us();
+            render(sc, f->buffer, ALIGN_UP(cam->frame_full_width, 32) * 4,
+                   cam->frame_full_width, cam->frame_full_height, sc->frame_count ++);
+        }
+        f->receive_time = local_rpigrafx_now_ns();
+
+        pthread_mutex_lock(&sc->mutex);
+        sc->is_producing = 0;
+        is_event = 0;
+        /* The buffer is dropped if it was taken back while being filled. */
+        if (sc->states[i] == BUFFER_QUEUED) {
+            sc->states[i] = BUFFER_FULL;
+            sc->full_fifo[(sc->full_head + sc->full_num) % cam->frames_len] = i;
+            sc->full_num ++;
+            is_event = sc->is_event_enabled;
+        }
+        pthread_cond_broadcast(&sc->cond);
+        if (is_event) {
+            pthread_mutex_unlock(&sc->mutex);
+            local_rpigrafx_camera_event(cam);
+            pthread_mutex_lock(&sc->mutex);
+        }
+    }
+    pthread_mutex_unlock(&sc->mutex);
+
+    return NULL;
+}
+
+/* Must be called with sc->mutex held and the producer idle. */
+static void alloc_buffers(struct soft_camera *sc, const int num)
+{
+    struct rpigrafx_camera *cam = sc->cam;
+    int num_planes, offsets[MAX_PLANES], strides[MAX_PLANES];
+    int i;
+
+    sc->buffer_size = local_rpigrafx_frame_layout(RPIGRAFX_FORMAT_RGBA32, cam->frame_full_width, cam->frame_full_height,
+                                                  &num_planes, offsets, strides);
+    cam->frames = local_rpigrafx_alloc_frames(cam, num);
+    cam->frames_len = num;
+    sc->states = calloc(num, sizeof(*sc->states));
+    sc->full_fifo = calloc(num, sizeof(*sc->full_fifo));
+    if (sc->states == NULL || sc->full_fifo == NULL)
+        error_and_exit("Failed to allocate %d buffer states\n", num);
+    sc->full_head = sc->full_num = 0;
+    for (i = 0; i < num; i ++) {
+        cam->frames[i].buffer = alloc_buffer(sc->buffer_size);
+        cam->frames[i].data = cam->frames[i].buffer;
+    }
+}
+
+/* Must be called with sc->mutex held and the producer idle. */
+static void free_buffers(struct soft_camera *sc)
+{
+    struct rpigrafx_camera *cam = sc->cam;
+    int i;
+
+    for (i = 0; i < cam->frames_len; i ++)
+        free(cam->frames[i].buffer);
+    free(sc->states);
+    free(sc->full_fifo);
+    sc->states = NULL;
+    sc->full_fifo = NULL;
+}
+
+/* Must be called with open_cameras_mutex held. */
+static void write_topology()
+{
+    const char *path = getenv("RPIGRAFX_SOFT_TOPOLOGY");
+    const struct soft_camera *sc = NULL;
+    const RPIGRAFX_RECT_T *dst = NULL;
+    FILE *fp = NULL;
+
+    if (path == NULL || path[0] == '\0')
+        return;
+    fp = fopen(path, "w");
+    if (fp == NULL)
+        error_and_exit("Failed to open %s\n", path);
+    for (sc = open_cameras; sc != NULL; sc = sc->next) {
+        dst = &sc->preview_dst;
+        if (sc->preview_display != NULL)
+            fprintf(fp, "camera %d preview -> video_render display %d dst %d,%d,%dx%d layer %d alpha %d\n",
+                    sc->cam->camera_num, sc->preview_display_num, dst->x, dst->y, dst->width, dst->height,
+                    sc->preview_layer, sc->preview_alpha);
+        else
+            fprintf(fp, "camera %d preview -> null_sink\n", sc->cam->camera_num);
+    }
+    fclose(fp);
+}
+
+static void soft_query_cameras(RPIGRAFX_CONTEXT_T *ctx)
+{
+    const char *path = getenv("RPIGRAFX_SOFT_CAMERA_REPLAY");
+    struct local_rpigrafx_recording *r = NULL;
+    struct local_rpigrafx_recorded_frame rf;
+    int width = 2592, height = 1944;
+
+    if (path != NULL && path[0] != '\0') {
+        r = local_rpigrafx_open_recording(path);
+        if (local_rpigrafx_recording_num_frames(r) == 0)
+            error_and_exit("%s has no frames\n", path);
+        local_rpigrafx_recording_get_frame(r, 0, &rf);
+        width = rf.width;
+        height = rf.height;
+        local_rpigrafx_close_recording(r);
+    } else
+        local_rpigrafx_getenv_size("RPIGRAFX_SOFT_CAMERA_SIZE", &width, &height);
+    ctx->camera_info[0].max_width = width;
+    ctx->camera_info[0].max_height = height;
+    ctx->num_cameras = 1;
+}
+
+static void soft_open(struct rpigrafx_camera *cam)
+{
+    struct soft_camera *sc = NULL;
+    const char *path = getenv("RPIGRAFX_SOFT_CAMERA_FILE");
+    const char *replay_path = getenv("RPIGRAFX_SOFT_CAMERA_REPLAY");
+    const char *fps = getenv("RPIGRAFX_SOFT_CAMERA_FPS");
+
+    sc = calloc(1, sizeof(*sc));
+    if (sc == NULL)
+        error_and_exit("Failed to allocate a camera\n");
+    cam->priv = sc;
+    sc->cam = cam;
+    sc->fps = sc->default_fps = local_rpigrafx_getenv_int("RPIGRAFX_SOFT_CAMERA_FPS", 30);
+    if (replay_path != NULL && replay_path[0] != '\0') {
+        sc->replay = local_rpigrafx_open_recording(replay_path);
+        sc->is_replay_timed = fps == NULL || fps[0] == '\0';
+    } else if (path != NULL && path[0] != '\0')
+        load_ppm(sc, path);
+
+    pthread_mutex_init(&sc->mutex, NULL);
+    local_rpigrafx_init_cond_monotonic(&sc->cond);
+    alloc_buffers(sc, DEFAULT_BUFFER_NUM);
+
+    sc->is_running = 1;
+    if (pthread_create(&sc->thread, NULL, producer_main, sc))
+        error_and_exit("Failed to create camera thread\n");
+
+    pthread_mutex_lock(&open_cameras_mutex);
+    sc->next = open_cameras;
+    open_cameras = sc;
+    write_topology();
+    pthread_mutex_unlock(&open_cameras_mutex);
+}
+
+static void soft_close(struct rpigrafx_camera *cam)
+{
+    struct soft_camera *sc = cam->priv;
+    struct soft_camera **p = NULL;
+
+    pthread_mutex_lock(&open_cameras_mutex);
+    for (p = &open_cameras; *p != sc; p = &(*p)->next)
+        ;
+    *p = sc->next;
+    write_topology();
+    pthread_mutex_unlock(&open_cameras_mutex);
+
+    pthread_mutex_lock(&sc->mutex);
+    sc->is_running = 0;
+    pthread_cond_broadcast(&sc->cond);
+    pthread_mutex_unlock(&sc->mutex);
+    pthread_join(sc->thread, NULL);
+
+    /* cam->frames are freed by camera.c; only the payloads are ours. */
+    free_buffers(sc);
+    pthread_cond_destroy(&sc->cond);
+    pthread_mutex_destroy(&sc->mutex);
+    free(sc->image);
+    if (sc->replay != NULL)
+        local_rpigrafx_close_recording(sc->replay);
+    free(sc);
+    cam->priv = NULL;
+}
+
+/* Apply the capture mode of cam and reallocate num buffers of the current size. */
+static void reconfigure(struct rpigrafx_camera *cam, const int num)
+{
+    struct soft_camera *sc = cam->priv;
+
+    pthread_mutex_lock(&sc->mutex);
+    /* Take back the queued buffers, like disabling the port does. */
+    while (sc->is_producing)
+        pthread_cond_wait(&sc->cond, &sc->mutex);
+    sc->num_triggers = 0;
+    sc->is_video = cam->is_video_mode;
+    sc->fps = cam->is_video_mode ? cam->video_fps : sc->default_fps;
+    free_buffers(sc);
+    local_rpigrafx_free_frames(cam->frames, cam->frames_len);
+    alloc_buffers(sc, num);
+    pthread_mutex_unlock(&sc->mutex);
+}
+
+/* Streams resize from whatever size the captured frames have. */
+static void soft_set_camera_num(struct rpigrafx_camera *cam, const int camera_num)
+{
+    (void) camera_num;
+    reconfigure(cam, cam->frames_len);
+}
+
+static void soft_set_capture_mode(struct rpigrafx_camera *cam)
+{
+    reconfigure(cam, cam->frames_len);
+}
+
+static void soft_set_buffer_num(struct rpigrafx_camera *cam, const int num)
+{
+    reconfigure(cam, num == 0 ? DEFAULT_BUFFER_NUM : num);
+}
+
+static void soft_set_event_callback(struct rpigrafx_camera *cam, const int enable)
+{
+    struct soft_camera *sc = cam->priv;
+
+    pthread_mutex_lock(&sc->mutex);
+    sc->is_event_enabled = enable;
+    pthread_mutex_unlock(&sc->mutex);
+}
+
+static int soft_queue_buffers(struct rpigrafx_camera *cam)
+{
+    struct soft_camera *sc = cam->priv;
+    int i, num = 0;
+
+    pthread_mutex_lock(&sc->mutex);
+    for (i = 0; i < cam->frames_len; i ++) {
+        if (sc->states[i] == BUFFER_FREE)
+            sc->states[i] = BUFFER_QUEUED;
+        if (sc->states[i] == BUFFER_QUEUED)
+            num ++;
+    }
+    pthread_cond_broadcast(&sc->cond);
+    pthread_mutex_unlock(&sc->mutex);
+    return num;
+}
+
+static void soft_trigger(struct rpigrafx_camera *cam)
+{
+    struct soft_camera *sc = cam->priv;
+
+    pthread_mutex_lock(&sc->mutex);
+    if (sc->is_video) {
+        /* Requeue the frames captured so far. */
+        for (; sc->full_num > 0; sc->full_num --) {
+            sc->states[sc->full_fifo[sc->full_head]] = BUFFER_QUEUED;
+            sc->full_head = (sc->full_head + 1) % cam->frames_len;
+        }
+    } else
+        sc->num_triggers ++;
+    pthread_cond_broadcast(&sc->cond);
+    pthread_mutex_unlock(&sc->mutex);
+}
+
+static struct rpigrafx_frame* soft_get_full(struct rpigrafx_camera *cam, const int wait)
+{
+    struct soft_camera *sc = cam->priv;
+    int i;
+
+    pthread_mutex_lock(&sc->mutex);
+    while (sc->full_num == 0) {
+        if (!wait) {
+            pthread_mutex_unlock(&sc->mutex);
+            return NULL;
+        }
+        pthread_cond_wait(&sc->cond, &sc->mutex);
+    }
+    i = sc->full_fifo[sc->full_head];
+    sc->full_head = (sc->full_head + 1) % cam->frames_len;
+    sc->full_num --;
+    sc->states[i] = BUFFER_HELD;
+    pthread_mutex_unlock(&sc->mutex);
+    return &cam->frames[i];
+}
+
+static void soft_release(struct rpigrafx_frame *f)
+{
+    struct rpigrafx_camera *cam = f->camera;
+    struct soft_camera *sc = cam->priv;
+    _Bool is_event;
+
+    if (f->stream != NULL) {
+        local_rpigrafx_cpu_stream_release(f);
+        return;
+    }
+
+    pthread_mutex_lock(&sc->mutex);
+    sc->states[f - cam->frames] = BUFFER_FREE;
+    is_event = sc->is_event_enabled;
+    pthread_mutex_unlock(&sc->mutex);
+    if (is_event)
+        local_rpigrafx_camera_event(cam);
+}
+
+/* The ISP is emulated by a bilinear resizer in the thread which asks for the frame. */
+static void soft_stream_create(struct rpigrafx_stream *stream, const int buffer_num)
+{
+    local_rpigrafx_cpu_stream_create(stream, buffer_num, RPIGRAFX_FILTER_BILINEAR, 1);
+}
+
+static void soft_stream_destroy(struct rpigrafx_stream *stream)
+{
+    local_rpigrafx_cpu_stream_destroy(stream);
+}
+
+static struct rpigrafx_frame* soft_stream_resize(struct rpigrafx_stream *stream, struct rpigrafx_frame *src, const RPIGRAFX_RECT_T *crop)
+{
+    return local_rpigrafx_cpu_stream_resize(stream, src, crop, NULL);
+}
+
+static void* preview_main(void *arg)
+{
+    struct soft_camera *sc = arg;
+    const RPIGRAFX_RECT_T *dst = &sc->preview_dst;
+    const int stride = dst->width * 4;
+    struct timespec next;
+    unsigned n = 0;
+    int fps;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    pthread_mutex_lock(&sc->mutex);
+    while (sc->is_previewing) {
+        fps = sc->fps > 0 ? sc->fps : 30;
+        pthread_mutex_unlock(&sc->mutex);
+
+        render(sc, sc->preview_buf, stride, dst->width, dst->height, n ++);
+        local_rpigrafx_soft_display_set_preview(sc->preview_display, sc->preview_buf, stride,
+                                                dst, sc->preview_layer, sc->preview_alpha);
+
+        next.tv_nsec += 1000000000 / fps;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_sec ++;
+            next.tv_nsec -= 1000000000;
+        }
+        pthread_mutex_lock(&sc->mutex);
+        while (sc->is_previewing && pthread_cond_timedwait(&sc->cond, &sc->mutex, &next) == 0)
+            ;
+    }
+    pthread_mutex_unlock(&sc->mutex);
+
+    return NULL;
+}
+
+static void soft_start_preview(struct rpigrafx_camera *cam, void *display, const int display_num,
+                               const RPIGRAFX_RECT_T *dst, const int layer, const int alpha)
+{
+    struct soft_camera *sc = cam->priv;
+
+    pthread_mutex_lock(&open_cameras_mutex);
+    sc->preview_display = display;
+    sc->preview_display_num = display_num;
+    sc->preview_dst = *dst;
+    sc->preview_layer = layer;
+    sc->preview_alpha = alpha;
+    write_topology();
+    pthread_mutex_unlock(&open_cameras_mutex);
+
+    sc->preview_buf = alloc_buffer(dst->width * dst->height * 4);
+    sc->is_previewing = 1;
+    if (pthread_create(&sc->preview_thread, NULL, preview_main, sc))
+        error_and_exit("Failed to create preview thread\n");
+}
+
+static void soft_stop_preview(struct rpigrafx_camera *cam)
+{
+    struct soft_camera *sc = cam->priv;
+
+    pthread_mutex_lock(&sc->mutex);
+    sc->is_previewing = 0;
+    pthread_cond_broadcast(&sc->cond);
+    pthread_mutex_unlock(&sc->mutex);
+    pthread_join(sc->preview_thread, NULL);
+
+    local_rpigrafx_soft_display_clear_preview(sc->preview_display);
+    free(sc->preview_buf);
+    sc->preview_buf = NULL;
+    pthread_mutex_lock(&open_cameras_mutex);
+    sc->preview_display = NULL;
+    write_topology();
+    pthread_mutex_unlock(&open_cameras_mutex);
+}
+
+const struct local_rpigrafx_camera_ops local_rpigrafx_soft_camera_ops = {
+    .query_cameras = soft_query_cameras,
+    .open = soft_open,
+    .close = soft_close,
+    .set_camera_num = soft_set_camera_num,
+    .set_capture_mode = soft_set_capture_mode,
+    .set_buffer_num = soft_set_buffer_num,
+    .set_event_callback = soft_set_event_callback,
+    .queue_buffers = soft_queue_buffers,
+    .trigger = soft_trigger,
+    .get_full = soft_get_full,
+    .release = soft_release,
+    .stream_create = soft_stream_create,
+    .stream_destroy = soft_stream_destroy,
+    .stream_resize = soft_stream_resize,
+    .start_preview = soft_start_preview,
+    .stop_preview = soft_stop_preview,
+};
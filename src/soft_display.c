@@ -0,0 +1,742 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "rpigrafx.h"
+#include "local/draw.h"
+#include "local/error.h"
+#include "local/soft.h"
+#include "local/sync.h"
+
+/*
+ * Display emulated on the CPU.
+ * Elements are composited into a framebuffer of RPIGRAFX_SOFT_DISPLAY_SIZE
+ * (WIDTHxHEIGHT, default 1920x1080) by a vsync thread which runs at
+ * RPIGRAFX_SOFT_DISPLAY_HZ (default 60, 0 to complete updates at once).
+ * If RPIGRAFX_SOFT_DISPLAY_DUMP is set, every composited frame is written
+ * to the PPM file named by it as a printf format of the frame number,
+ * e.g. "/tmp/frame%05d.ppm".
+ * The preview of a soft camera is shown like the output of
+ * vc.ril.video_render: an opaque layer with a fixed alpha which is
+ * recomposited whenever a new preview frame arrives.
+ * Resources are limited to MAX_RESOURCE_SIZE on each side like those of
+ * dispmanx, so that the tiling of larger images is exercised.
+ */
+
+#define MAX_RESOURCE_SIZE 512
+
+struct soft_resource {
+    uint32_t handle;
+    RPIGRAFX_FORMAT_T format;
+    int width, height, stride, bpp;
+    uint8_t *data;
+    struct soft_resource *next;
+};
+
+struct soft_element {
+    uint32_t handle;
+    struct local_rpigrafx_element_attr attr;
+    RPIGRAFX_RECT_T dst, src;
+    struct soft_resource *resource;
+};
+
+enum op_type {
+    OP_ADD,
+    OP_REMOVE,
+    OP_CHANGE
+};
+
+struct soft_op {
+    enum op_type type;
+    uint32_t element, resource;
+    struct local_rpigrafx_element_attr attr;
+    RPIGRAFX_RECT_T dst, src;
+};
+
+struct soft_update {
+    struct soft_op *ops;
+    int ops_len, ops_num;
+    void (*callback)(void *arg);
+    void *arg;
+    _Bool is_sync, is_done;
+    struct soft_update *next;
+};
+
+/* Image given by local_rpigrafx_soft_display_set_preview(). */
+struct soft_preview {
+    _Bool is_shown, is_dirty;
+    RPIGRAFX_RECT_T dst;
+    int layer, alpha;
+    /* RGBA32 of dst.width x dst.height. */
+    uint8_t *data;
+};
+
+struct soft_display {
+    int width, height;
+    /* RGBA32 of width x height. */
+    uint8_t *framebuffer;
+    int hz;
+    const char *dump;
+    unsigned frame_count;
+
+    /* Shown on the screen, sorted by layer. */
+    struct soft_element *elements;
+    int elements_len, elements_num;
+    struct soft_resource *resources;
+    uint32_t next_handle;
+    struct soft_preview preview;
+    struct local_rpigrafx_soft_display_counts counts;
+
+    /* Submitted and not applied yet, in the order of submission. */
+    struct soft_update *submitted, **submitted_tail;
+    /* Applied updates kept with their ops for the next ones. */
+    struct soft_update *free_updates;
+
+    pthread_t thread;
+    /* Protects everything above. */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    _Bool is_running;
+};
+
+
+static int format_bpp(const RPIGRAFX_FORMAT_T format)
+{
+    switch (format) {
+        case RPIGRAFX_FORMAT_RGBA32:
+            return 4;
+        case RPIGRAFX_FORMAT_RGB24:
+        case RPIGRAFX_FORMAT_BGR24:
+            return 3;
+        default:
+            error_and_exit("Unknown format: %d\n", format);
+    }
+}
+
+/* Must be called with sd->mutex held. */
+static struct soft_resource* find_resource(struct soft_display *sd, const uint32_t handle)
+{
+    struct soft_resource *r = NULL;
+
+    for (r = sd->resources; r != NULL; r = r->next)
+        if (r->handle == handle)
+            return r;
+    error_and_exit("Unknown resource: 0x%08x\n", handle);
+}
+
+/* Must be called with sd->mutex held. */
+static int find_element(struct soft_display *sd, const uint32_t handle)
+{
+    int i;
+
+    for (i = 0; i < sd->elements_num; i ++)
+        if (sd->elements[i].handle == handle)
+            return i;
+    error_and_exit("Unknown element: 0x%08x\n", handle);
+}
+
+/* Must be called with sd->mutex held. Elements of the same layer stay in the order added. */
+static void insert_element(struct soft_display *sd, const struct soft_element *e)
+{
+    int i;
+
+    if (sd->elements_num >= sd->elements_len) {
+        sd->elements_len += 100;
+        sd->elements = realloc(sd->elements, sd->elements_len * sizeof(*sd->elements));
+        if (sd->elements == NULL)
+            error_and_exit("Failed to realloc %d bytes of memory\n", sd->elements_len * sizeof(*sd->elements));
+    }
+    for (i = sd->elements_num; i > 0 && sd->elements[i - 1].attr.layer > e->attr.layer; i --)
+        sd->elements[i] = sd->elements[i - 1];
+    sd->elements[i] = *e;
+    sd->elements_num ++;
+}
+
+/* Must be called with sd->mutex held. */
+static void remove_element(struct soft_display *sd, const int i)
+{
+    memmove(&sd->elements[i], &sd->elements[i + 1], (sd->elements_num - i - 1) * sizeof(*sd->elements));
+    sd->elements_num --;
+}
+
+/* Must be called with sd->mutex held. */
+static void apply_op(struct soft_display *sd, const struct soft_op *op)
+{
+    struct soft_element e;
+    int i;
+
+    switch (op->type) {
+        case OP_ADD:
+            e.handle = op->element;
+            e.attr = op->attr;
+            e.dst = op->dst;
+            e.src = op->src;
+            e.resource = find_resource(sd, op->resource);
+            insert_element(sd, &e);
+            break;
+        case OP_REMOVE:
+            remove_element(sd, find_element(sd, op->element));
+            break;
+        case OP_CHANGE:
+            i = find_element(sd, op->element);
+            e = sd->elements[i];
+            e.attr.layer = op->attr.layer;
+            e.attr.opacity = op->attr.opacity;
+            e.attr.transform = op->attr.transform;
+            e.dst = op->dst;
+            e.src = op->src;
+            /* A changed layer goes on top of the layer, as dispmanx does. */
+            if (e.attr.layer != sd->elements[i].attr.layer) {
+                remove_element(sd, i);
+                insert_element(sd, &e);
+            } else
+                sd->elements[i] = e;
+            break;
+    }
+}
+
+/*
+ * Pixel (tx, ty) of the transformed image comes from (*sx, *sy) of src,
+ * relative to the origin of src.
+ */
+static void transform_pixel(const RPIGRAFX_TRANSFORM_T transform, const RPIGRAFX_RECT_T *src, const int tx, const int ty, int *sx, int *sy)
+{
+    switch (transform) {
+        case RPIGRAFX_TRANSFORM_ROT90:
+            *sx = ty;
+            *sy = src->height - 1 - tx;
+            break;
+        case RPIGRAFX_TRANSFORM_ROT180:
+            *sx = src->width - 1 - tx;
+            *sy = src->height - 1 - ty;
+            break;
+        case RPIGRAFX_TRANSFORM_ROT270:
+            *sx = src->width - 1 - ty;
+            *sy = tx;
+            break;
+        case RPIGRAFX_TRANSFORM_FLIP_H:
+            *sx = src->width - 1 - tx;
+            *sy = ty;
+            break;
+        case RPIGRAFX_TRANSFORM_FLIP_V:
+            *sx = tx;
+            *sy = src->height - 1 - ty;
+            break;
+        default:
+            *sx = tx;
+            *sy = ty;
+            break;
+    }
+}
+
+/* Nearest-neighbour scaling and blending by the alpha of the source and the opacity. */
+static void composite_element(struct soft_display *sd, const struct soft_element *e)
+{
+    const struct soft_resource *r = e->resource;
+    const RPIGRAFX_TRANSFORM_T transform = e->attr.transform;
+    const _Bool is_swapped = transform == RPIGRAFX_TRANSFORM_ROT90 || transform == RPIGRAFX_TRANSFORM_ROT270;
+    /* Size of the transformed image. */
+    const int tw = is_swapped ? e->src.height : e->src.width, th = is_swapped ? e->src.width : e->src.height;
+    const _Bool is_source_alpha = e->attr.alpha == RPIGRAFX_ALPHA_SOURCE && r->format == RPIGRAFX_FORMAT_RGBA32;
+    const int opacity = e->attr.opacity;
+    const int x0 = e->dst.x < 0 ? 0 : e->dst.x, y0 = e->dst.y < 0 ? 0 : e->dst.y;
+    const int x1 = e->dst.x + e->dst.width > sd->width ? sd->width : e->dst.x + e->dst.width;
+    const int y1 = e->dst.y + e->dst.height > sd->height ? sd->height : e->dst.y + e->dst.height;
+    const uint8_t *s;
+    uint8_t *d, rgb[3];
+    int x, y, tx, ty, sx, sy, a, c;
+
+    for (y = y0; y < y1; y ++) {
+        ty = (y - e->dst.y) * th / e->dst.height;
+        d = sd->framebuffer + (y * sd->width + x0) * 4;
+        for (x = x0; x < x1; x ++, d += 4) {
+            tx = (x - e->dst.x) * tw / e->dst.width;
+            transform_pixel(transform, &e->src, tx, ty, &sx, &sy);
+            s = r->data + (e->src.y + sy) * r->stride + (e->src.x + sx) * r->bpp;
+            if (r->format == RPIGRAFX_FORMAT_BGR24) {
+                rgb[0] = s[2];
+                rgb[1] = s[1];
+                rgb[2] = s[0];
+            } else
+                memcpy(rgb, s, 3);
+            a = is_source_alpha ? (s[3] * opacity + 127) / 255 : opacity;
+            for (c = 0; c < 3; c ++)
+                d[c] = (rgb[c] * a + d[c] * (255 - a) + 127) / 255;
+        }
+    }
+}
+
+/* The preview is cropped to the screen and blended with its fixed alpha. */
+static void composite_preview(struct soft_display *sd)
+{
+    const struct soft_preview *p = &sd->preview;
+    const int x0 = p->dst.x < 0 ? 0 : p->dst.x, y0 = p->dst.y < 0 ? 0 : p->dst.y;
+    const int x1 = p->dst.x + p->dst.width > sd->width ? sd->width : p->dst.x + p->dst.width;
+    const int y1 = p->dst.y + p->dst.height > sd->height ? sd->height : p->dst.y + p->dst.height;
+    const uint8_t *s;
+    uint8_t *d;
+    int x, y, c;
+
+    for (y = y0; y < y1; y ++) {
+        s = p->data + ((y - p->dst.y) * p->dst.width + (x0 - p->dst.x)) * 4;
+        d = sd->framebuffer + (y * sd->width + x0) * 4;
+        for (x = x0; x < x1; x ++, s += 4, d += 4)
+            for (c = 0; c < 3; c ++)
+                d[c] = (s[c] * p->alpha + d[c] * (255 - p->alpha) + 127) / 255;
+    }
+}
+
+/* Must be called with sd->mutex held. */
+static void composite(struct soft_display *sd)
+{
+    _Bool is_preview_pending = sd->preview.is_shown;
+    int i;
+
+    local_rpigrafx_fill_span_rgba32((uint32_t*) sd->framebuffer, sd->width * sd->height, 0xff000000);
+    for (i = 0; i < sd->elements_num; i ++) {
+        if (is_preview_pending && sd->elements[i].attr.layer > sd->preview.layer) {
+            composite_preview(sd);
+            is_preview_pending = 0;
+        }
+        composite_element(sd, &sd->elements[i]);
+    }
+    if (is_preview_pending)
+        composite_preview(sd);
+    sd->preview.is_dirty = 0;
+}
+
+static void dump_framebuffer(struct soft_display *sd)
+{
+    char path[4096];
+    FILE *fp = NULL;
+    uint8_t *row = NULL;
+    int y;
+
+    snprintf(path, sizeof(path), sd->dump, sd->frame_count);
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+        error_and_exit("Failed to open %s\n", path);
+    row = malloc(sd->width * 3);
+    if (row == NULL)
+        error_and_exit("Failed to allocate %d bytes of memory\n", sd->width * 3);
+    fprintf(fp, "P6\n%d %d\n255\n", sd->width, sd->height);
+    for (y = 0; y < sd->height; y ++) {
+        local_rpigrafx_rgba32_to_rgb24(row, (uint32_t*) (sd->framebuffer + y * sd->width * 4), sd->width);
+        if (fwrite(row, 3, sd->width, fp) != (size_t) sd->width)
+            error_and_exit("Failed to write to %s\n", path);
+    }
+    free(row);
+    fclose(fp);
+}
+
+static void free_update(struct soft_display *sd, struct soft_update *u)
+{
+    pthread_mutex_lock(&sd->mutex);
+    u->ops_num = 0;
+    u->is_sync = u->is_done = 0;
+    u->next = sd->free_updates;
+    sd->free_updates = u;
+    pthread_mutex_unlock(&sd->mutex);
+}
+
+/* Sleep until the next vsync. */
+static void wait_vsync(struct soft_display *sd, struct timespec *next)
+{
+    next->tv_nsec += 1000000000 / sd->hz;
+    if (next->tv_nsec >= 1000000000) {
+        next->tv_sec ++;
+        next->tv_nsec -= 1000000000;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL))
+        ;
+}
+
+static void* vsync_main(void *arg)
+{
+    struct soft_display *sd = arg;
+    struct soft_update *list = NULL, *u = NULL, *done = NULL, **done_tail = &done;
+    struct timespec next;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    pthread_mutex_lock(&sd->mutex);
+    for (; ; ) {
+        if (sd->hz > 0) {
+            pthread_mutex_unlock(&sd->mutex);
+            wait_vsync(sd, &next);
+            pthread_mutex_lock(&sd->mutex);
+        } else
+            while (sd->is_running && sd->submitted == NULL && !sd->preview.is_dirty)
+                pthread_cond_wait(&sd->cond, &sd->mutex);
+        if (!sd->is_running)
+            break;
+        if (sd->submitted == NULL && !sd->preview.is_dirty)
+            continue;
+
+        list = sd->submitted;
+        sd->submitted = NULL;
+        sd->submitted_tail = &sd->submitted;
+        for (u = list; u != NULL; u = u->next)
+            for (i = 0; i < u->ops_num; i ++)
+                apply_op(sd, &u->ops[i]);
+        composite(sd);
+        if (sd->dump != NULL)
+            dump_framebuffer(sd);
+        sd->frame_count ++;
+
+        /* Synchronous updates are freed by their submitters. */
+        done = NULL;
+        done_tail = &done;
+        while (list != NULL) {
+            u = list;
+            list = u->next;
+            u->next = NULL;
+            if (u->is_sync)
+                u->is_done = 1;
+            else {
+                *done_tail = u;
+                done_tail = &u->next;
+            }
+        }
+        pthread_cond_broadcast(&sd->cond);
+
+        pthread_mutex_unlock(&sd->mutex);
+        while (done != NULL) {
+            u = done;
+            done = u->next;
+            u->callback(u->arg);
+            free_update(sd, u);
+        }
+        pthread_mutex_lock(&sd->mutex);
+    }
+    pthread_mutex_unlock(&sd->mutex);
+
+    return NULL;
+}
+
+static void* soft_open(const int display_num, int *width, int *height)
+{
+    struct soft_display *sd = NULL;
+
+    (void) display_num;
+    sd = calloc(1, sizeof(*sd));
+    if (sd == NULL)
+        error_and_exit("Failed to allocate a display\n");
+    sd->width = 1920;
+    sd->height = 1080;
+    local_rpigrafx_getenv_size("RPIGRAFX_SOFT_DISPLAY_SIZE", &sd->width, &sd->height);
+    sd->hz = local_rpigrafx_getenv_int("RPIGRAFX_SOFT_DISPLAY_HZ", 60);
+    sd->dump = getenv("RPIGRAFX_SOFT_DISPLAY_DUMP");
+    if (sd->dump != NULL && sd->dump[0] == '\0')
+        sd->dump = NULL;
+    sd->framebuffer = malloc(sd->width * sd->height * 4);
+    if (sd->framebuffer == NULL)
+        error_and_exit("Failed to allocate a framebuffer of %dx%d\n", sd->width, sd->height);
+    sd->next_handle = 1;
+    sd->submitted_tail = &sd->submitted;
+
+    pthread_mutex_init(&sd->mutex, NULL);
+    local_rpigrafx_init_cond_monotonic(&sd->cond);
+    sd->is_running = 1;
+    if (pthread_create(&sd->thread, NULL, vsync_main, sd))
+        error_and_exit("Failed to create vsync thread\n");
+
+    *width = sd->width;
+    *height = sd->height;
+    return sd;
+}
+
+static void soft_close(void *display)
+{
+    struct soft_display *sd = display;
+    struct soft_resource *r = NULL;
+    struct soft_update *u = NULL;
+
+    pthread_mutex_lock(&sd->mutex);
+    sd->is_running = 0;
+    pthread_cond_broadcast(&sd->cond);
+    pthread_mutex_unlock(&sd->mutex);
+    pthread_join(sd->thread, NULL);
+
+    if (sd->submitted != NULL)
+        error_and_exit("Display is closed with updates in flight\n");
+    while (sd->free_updates != NULL) {
+        u = sd->free_updates;
+        sd->free_updates = u->next;
+        free(u->ops);
+        free(u);
+    }
+    while (sd->resources != NULL) {
+        r = sd->resources;
+        sd->resources = r->next;
+        free(r->data);
+        free(r);
+    }
+    free(sd->elements);
+    free(sd->preview.data);
+    free(sd->framebuffer);
+    pthread_cond_destroy(&sd->cond);
+    pthread_mutex_destroy(&sd->mutex);
+    free(sd);
+}
+
+static uint32_t soft_resource_create(void *display, const RPIGRAFX_FORMAT_T format, const int width, const int height)
+{
+    struct soft_display *sd = display;
+    struct soft_resource *r = NULL;
+
+    /* As dispmanx does; larger images are tiled by display.c. */
+    if (width > MAX_RESOURCE_SIZE || height > MAX_RESOURCE_SIZE)
+        error_and_exit("Resource of %dx%d is too large\n", width, height);
+    r = calloc(1, sizeof(*r));
+    if (r == NULL)
+        error_and_exit("Failed to allocate a resource\n");
+    r->format = format;
+    r->width = width;
+    r->height = height;
+    r->bpp = format_bpp(format);
+    /* Rows of a dispmanx resource are aligned to 32 bytes. */
+    r->stride = ALIGN_UP(width * r->bpp, 32);
+    r->data = calloc(height, r->stride);
+    if (r->data == NULL)
+        error_and_exit("Failed to allocate a resource of %dx%d\n", width, height);
+
+    pthread_mutex_lock(&sd->mutex);
+    r->handle = sd->next_handle ++;
+    r->next = sd->resources;
+    sd->resources = r;
+    sd->counts.resources_created ++;
+    pthread_mutex_unlock(&sd->mutex);
+    return r->handle;
+}
+
+static void soft_resource_delete(void *display, const uint32_t resource)
+{
+    struct soft_display *sd = display;
+    struct soft_resource **rp = NULL, *r = NULL;
+
+    pthread_mutex_lock(&sd->mutex);
+    for (rp = &sd->resources; *rp != NULL; rp = &(*rp)->next)
+        if ((*rp)->handle == resource)
+            break;
+    if (*rp == NULL)
+        error_and_exit("Unknown resource: 0x%08x\n", resource);
+    r = *rp;
+    *rp = r->next;
+    sd->counts.resources_deleted ++;
+    pthread_mutex_unlock(&sd->mutex);
+
+    free(r->data);
+    free(r);
+}
+
+static void soft_resource_write(void *display, const uint32_t resource, const RPIGRAFX_FORMAT_T format, const int pitch, void *p, const int width, const int y, const int height)
+{
+    struct soft_display *sd = display;
+    struct soft_resource *r = NULL;
+    int i;
+
+    pthread_mutex_lock(&sd->mutex);
+    r = find_resource(sd, resource);
+    if (format != r->format || width > r->width || y < 0 || y + height > r->height)
+        error_and_exit("Invalid write to resource 0x%08x\n", resource);
+    /* dispmanx takes the rows at the pitch of the resource and no other. */
+    if (pitch != r->stride)
+        error_and_exit("Pitch %d of a write to resource 0x%08x is not its pitch %d\n", pitch, resource, r->stride);
+    for (i = y; i < y + height; i ++)
+        memcpy(r->data + i * r->stride, (uint8_t*) p + i * pitch, width * r->bpp);
+    sd->counts.resource_writes ++;
+    pthread_mutex_unlock(&sd->mutex);
+}
+
+static void* soft_update_start(void *display)
+{
+    struct soft_display *sd = display;
+    struct soft_update *u = NULL;
+
+    pthread_mutex_lock(&sd->mutex);
+    u = sd->free_updates;
+    if (u != NULL)
+        sd->free_updates = u->next;
+    pthread_mutex_unlock(&sd->mutex);
+    if (u != NULL) {
+        u->next = NULL;
+        return u;
+    }
+    u = calloc(1, sizeof(*u));
+    if (u == NULL)
+        error_and_exit("Failed to allocate an update\n");
+    return u;
+}
+
+static struct soft_op* add_op(struct soft_update *u, const enum op_type type, const uint32_t element)
+{
+    struct soft_op *op = NULL;
+
+    if (u->ops_num >= u->ops_len) {
+        u->ops_len += 100;
+        u->ops = realloc(u->ops, u->ops_len * sizeof(*u->ops));
+        if (u->ops == NULL)
+            error_and_exit("Failed to realloc %d bytes of memory\n", u->ops_len * sizeof(*u->ops));
+    }
+    op = &u->ops[u->ops_num ++];
+    op->type = type;
+    op->element = element;
+    return op;
+}
+
+static void submit(struct soft_display *sd, struct soft_update *u)
+{
+    pthread_mutex_lock(&sd->mutex);
+    *sd->submitted_tail = u;
+    sd->submitted_tail = &u->next;
+    sd->counts.updates ++;
+    pthread_cond_broadcast(&sd->cond);
+    pthread_mutex_unlock(&sd->mutex);
+}
+
+static void soft_update_submit(void *display, void *update, void (*callback)(void *arg), void *arg)
+{
+    struct soft_update *u = update;
+
+    u->callback = callback;
+    u->arg = arg;
+    submit(display, u);
+}
+
+static void soft_update_submit_sync(void *display, void *update)
+{
+    struct soft_display *sd = display;
+    struct soft_update *u = update;
+
+    u->is_sync = 1;
+    submit(sd, u);
+    pthread_mutex_lock(&sd->mutex);
+    while (!u->is_done)
+        pthread_cond_wait(&sd->cond, &sd->mutex);
+    pthread_mutex_unlock(&sd->mutex);
+    free_update(sd, u);
+}
+
+static uint32_t soft_element_add(void *display, void *update, const struct local_rpigrafx_element_attr *attr, const RPIGRAFX_RECT_T *dst, const uint32_t resource, const RPIGRAFX_RECT_T *src)
+{
+    struct soft_display *sd = display;
+    struct soft_op *op = NULL;
+    uint32_t element;
+
+    if (dst->width <= 0 || dst->height <= 0 || src->width <= 0 || src->height <= 0)
+        error_and_exit("Invalid element rect\n");
+    pthread_mutex_lock(&sd->mutex);
+    element = sd->next_handle ++;
+    pthread_mutex_unlock(&sd->mutex);
+
+    op = add_op(update, OP_ADD, element);
+    op->attr = *attr;
+    op->dst = *dst;
+    op->src = *src;
+    op->resource = resource;
+    return element;
+}
+
+static void soft_element_remove(void *display, void *update, const uint32_t element)
+{
+    (void) display;
+    add_op(update, OP_REMOVE, element);
+}
+
+static void soft_element_change(void *display, void *update, const uint32_t element, const struct local_rpigrafx_element_attr *attr, const RPIGRAFX_RECT_T *dst, const RPIGRAFX_RECT_T *src)
+{
+    struct soft_op *op = NULL;
+
+    (void) display;
+    if (dst->width <= 0 || dst->height <= 0 || src->width <= 0 || src->height <= 0)
+        error_and_exit("Invalid element rect\n");
+    op = add_op(update, OP_CHANGE, element);
+    op->attr = *attr;
+    op->dst = *dst;
+    op->src = *src;
+}
+
+/*
+ * Show a preview frame of RGBA32 of dst->width x dst->height with pitch
+ * stride on layer with alpha (0 to 255), as vc.ril.video_render does for
+ * each frame tunneled to it.
+ */
+void local_rpigrafx_soft_display_set_preview(void *display, const void *p, const int stride,
+                                             const RPIGRAFX_RECT_T *dst, const int layer, const int alpha)
+{
+    struct soft_display *sd = display;
+    struct soft_preview *pv = &sd->preview;
+    int y;
+
+    pthread_mutex_lock(&sd->mutex);
+    if (pv->data == NULL || pv->dst.width != dst->width || pv->dst.height != dst->height) {
+        free(pv->data);
+        pv->data = malloc(dst->width * dst->height * 4);
+        if (pv->data == NULL)
+            error_and_exit("Failed to allocate a preview of %dx%d\n", dst->width, dst->height);
+    }
+    for (y = 0; y < dst->height; y ++)
+        memcpy(pv->data + y * dst->width * 4, (const uint8_t*) p + y * stride, dst->width * 4);
+    pv->dst = *dst;
+    pv->layer = layer;
+    pv->alpha = alpha;
+    pv->is_shown = pv->is_dirty = 1;
+    pthread_cond_broadcast(&sd->cond);
+    pthread_mutex_unlock(&sd->mutex);
+}
+
+void local_rpigrafx_soft_display_clear_preview(void *display)
+{
+    struct soft_display *sd = display;
+
+    pthread_mutex_lock(&sd->mutex);
+    sd->preview.is_shown = 0;
+    sd->preview.is_dirty = 1;
+    pthread_cond_broadcast(&sd->cond);
+    pthread_mutex_unlock(&sd->mutex);
+}
+
+/* Calls counted since the display was opened. */
+void local_rpigrafx_soft_display_get_counts(void *display, struct local_rpigrafx_soft_display_counts *counts)
+{
+    struct soft_display *sd = display;
+
+    pthread_mutex_lock(&sd->mutex);
+    *counts = sd->counts;
+    pthread_mutex_unlock(&sd->mutex);
+}
+
+/* Copy the framebuffer of the last update on the screen, RGBA32 of the screen size. */
+void local_rpigrafx_soft_display_read_framebuffer(void *display, void *p)
+{
+    struct soft_display *sd = display;
+
+    pthread_mutex_lock(&sd->mutex);
+    memcpy(p, sd->framebuffer, sd->width * sd->height * 4);
+    pthread_mutex_unlock(&sd->mutex);
+}
+
+const struct local_rpigrafx_display_ops local_rpigrafx_soft_display_ops = {
+    .open = soft_open,
+    .close = soft_close,
+    .resource_create = soft_resource_create,
+    .resource_delete = soft_resource_delete,
+    .resource_write = soft_resource_write,
+    .update_start = soft_update_start,
+    .update_submit = soft_update_submit,
+    .update_submit_sync = soft_update_submit_sync,
+    .element_add = soft_element_add,
+    .element_remove = soft_element_remove,
+    .element_change = soft_element_change,
+};
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "rpigrafx.h"
+#include "local/backend.h"
+#include "local/context.h"
+#include "local/error.h"
+#include "local/stats.h"
+#include "local/sync.h"
+
+
+static const char *stage_names[RPIGRAFX_STAGE_MAX] = {
+    [RPIGRAFX_STAGE_CAPTURE_WAIT]   = "capture_wait",
+    [RPIGRAFX_STAGE_RESIZE]         = "resize",
+    [RPIGRAFX_STAGE_RESOURCE_WRITE] = "resource_write",
+    [RPIGRAFX_STAGE_VSYNC_WAIT]     = "vsync_wait",
+};
+
+static const char *counter_names[RPIGRAFX_COUNTER_MAX] = {
+    [RPIGRAFX_COUNTER_FRAMES_CAPTURED]   = "frames_captured",
+    [RPIGRAFX_COUNTER_FRAMES_DROPPED]    = "frames_dropped",
+    [RPIGRAFX_COUNTER_BUFFERS_RECYCLED]  = "buffers_recycled",
+    [RPIGRAFX_COUNTER_RESOURCES_CREATED] = "resources_created",
+    [RPIGRAFX_COUNTER_RESOURCES_REUSED]  = "resources_reused",
+    [RPIGRAFX_COUNTER_COMMITS]           = "commits",
+    [RPIGRAFX_COUNTER_ELEMENTS]          = "elements",
+};
+
+const char* rpigrafx_get_stage_name(const RPIGRAFX_STAGE_T stage)
+{
+    if (stage <= RPIGRAFX_STAGE_MIN || stage >= RPIGRAFX_STAGE_MAX)
+        error_and_exit("Unknown stage: %d\n", stage);
+    return stage_names[stage];
+}
+
+const char* rpigrafx_get_counter_name(const RPIGRAFX_COUNTER_T counter)
+{
+    if (counter <= RPIGRAFX_COUNTER_MIN || counter >= RPIGRAFX_COUNTER_MAX)
+        error_and_exit("Unknown counter: %d\n", counter);
+    return counter_names[counter];
+}
+
+#ifdef RPIGRAFX_STATS
+
+static void clear_stats(RPIGRAFX_STATS_T *s)
+{
+    int i;
+
+    memset(s, 0, sizeof(*s));
+    for (i = 0; i < RPIGRAFX_STAGE_MAX; i ++)
+        s->stages[i].min_ns = UINT64_MAX;
+}
+
+/*
+ * RPIGRAFX_TRACE_FILE names a file to write the stages to as Chrome
+ * trace events (chrome://tracing, Perfetto), and RPIGRAFX_STATS_INTERVAL_MS
+ * enables summaries to stderr.
+ */
+void local_rpigrafx_stats_init(RPIGRAFX_CONTEXT_T *ctx)
+{
+    struct local_rpigrafx_stats *st = &ctx->stats;
+    const char *path = getenv("RPIGRAFX_TRACE_FILE");
+
+    pthread_mutex_init(&st->mutex, NULL);
+    clear_stats(&st->s);
+    st->trace = NULL;
+    st->num_trace_events = 0;
+    if (path != NULL && path[0] != '\0') {
+        st->trace = fopen(path, "w");
+        if (st->trace == NULL)
+            error_and_exit("Failed to open %s\n", path);
+        /* The viewers accept the array without the closing bracket if we crash. */
+        fprintf(st->trace, "[");
+    }
+    st->dump_interval_ns = (int64_t) local_rpigrafx_getenv_int("RPIGRAFX_STATS_INTERVAL_MS", 0) * 1000000;
+    st->last_dump_ns = local_rpigrafx_now_ns();
+}
+
+void local_rpigrafx_stats_deinit(RPIGRAFX_CONTEXT_T *ctx)
+{
+    struct local_rpigrafx_stats *st = &ctx->stats;
+
+    if (st->trace != NULL) {
+        fprintf(st->trace, "\n]\n");
+        fclose(st->trace);
+        st->trace = NULL;
+    }
+    pthread_mutex_destroy(&st->mutex);
+}
+
+/* Must be called with the mutex held. */
+static void dump_stats(const RPIGRAFX_STATS_T *s)
+{
+    const RPIGRAFX_STAGE_STATS_T *ss = NULL;
+    int i;
+
+    fprintf(stderr, "rpigrafx stats:");
+    for (i = RPIGRAFX_STAGE_MIN + 1; i < RPIGRAFX_STAGE_MAX; i ++) {
+        ss = &s->stages[i];
+        if (ss->count == 0)
+            continue;
+        fprintf(stderr, " %s %llu/%.1f/%.1fus", stage_names[i], (unsigned long long) ss->count,
+                ss->total_ns / 1e3 / ss->count, ss->max_ns / 1e3);
+    }
+    for (i = RPIGRAFX_COUNTER_MIN + 1; i < RPIGRAFX_COUNTER_MAX; i ++)
+        fprintf(stderr, " %s %llu", counter_names[i], (unsigned long long) s->counters[i]);
+    fprintf(stderr, "\n");
+}
+
+/* Must be called with the mutex held. */
+static void maybe_dump_stats(struct local_rpigrafx_stats *st, const int64_t now)
+{
+    if (st->dump_interval_ns <= 0 || now - st->last_dump_ns < st->dump_interval_ns)
+        return;
+    st->last_dump_ns = now;
+    dump_stats(&st->s);
+}
+
+void local_rpigrafx_stats_stage(RPIGRAFX_CONTEXT_T *ctx, const RPIGRAFX_STAGE_T stage, const int64_t start, const int64_t end)
+{
+    struct local_rpigrafx_stats *st = &ctx->stats;
+    RPIGRAFX_STAGE_STATS_T *ss = &st->s.stages[stage];
+    const uint64_t ns = end - start;
+    uint64_t us = ns / 1000;
+    int bucket = 0;
+
+    while (us > 1 && bucket < RPIGRAFX_STATS_HIST_BUCKETS - 1) {
+        us >>= 1;
+        bucket ++;
+    }
+
+    pthread_mutex_lock(&st->mutex);
+    ss->count ++;
+    ss->total_ns += ns;
+    if (ns < ss->min_ns)
+        ss->min_ns = ns;
+    if (ns > ss->max_ns)
+        ss->max_ns = ns;
+    ss->hist[bucket] ++;
+    if (st->trace != NULL)
+        fprintf(st->trace, "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %ld}",
+                st->num_trace_events ++ == 0 ? "" : ",", stage_names[stage], start / 1e3, ns / 1e3,
+                (int) getpid(), (long) syscall(SYS_gettid));
+    maybe_dump_stats(st, end);
+    pthread_mutex_unlock(&st->mutex);
+}
+
+void local_rpigrafx_stats_count(RPIGRAFX_CONTEXT_T *ctx, const RPIGRAFX_COUNTER_T counter, const int n)
+{
+    struct local_rpigrafx_stats *st = &ctx->stats;
+
+    pthread_mutex_lock(&st->mutex);
+    st->s.counters[counter] += n;
+    pthread_mutex_unlock(&st->mutex);
+}
+
+/* Called on each commit with the number of elements on the screen. */
+void local_rpigrafx_stats_elements(RPIGRAFX_CONTEXT_T *ctx, const int num)
+{
+    struct local_rpigrafx_stats *st = &ctx->stats;
+
+    pthread_mutex_lock(&st->mutex);
+    st->s.counters[RPIGRAFX_COUNTER_COMMITS] ++;
+    st->s.counters[RPIGRAFX_COUNTER_ELEMENTS] += num;
+    if (num > st->s.max_elements)
+        st->s.max_elements = num;
+    if (st->trace != NULL)
+        fprintf(st->trace, "%s\n{\"name\": \"elements\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": %d, \"args\": {\"elements\": %d}}",
+                st->num_trace_events ++ == 0 ? "" : ",", local_rpigrafx_now_ns() / 1e3, (int) getpid(), num);
+    pthread_mutex_unlock(&st->mutex);
+}
+
+/*
+ * Copy the statistics of ctx since it was created or reset.
+ * Returns non-zero if the library is built with --enable-stats;
+ * otherwise stats is zeroed and 0 is returned.
+ */
+int rpigrafx_get_stats(RPIGRAFX_CONTEXT_T *ctx, RPIGRAFX_STATS_T *stats)
+{
+    int i;
+
+    pthread_mutex_lock(&ctx->stats.mutex);
+    *stats = ctx->stats.s;
+    pthread_mutex_unlock(&ctx->stats.mutex);
+    for (i = 0; i < RPIGRAFX_STAGE_MAX; i ++)
+        if (stats->stages[i].count == 0)
+            stats->stages[i].min_ns = 0;
+    return 1;
+}
+
+void rpigrafx_reset_stats(RPIGRAFX_CONTEXT_T *ctx)
+{
+    pthread_mutex_lock(&ctx->stats.mutex);
+    clear_stats(&ctx->stats.s);
+    pthread_mutex_unlock(&ctx->stats.mutex);
+}
+
+#else
+
+int rpigrafx_get_stats(RPIGRAFX_CONTEXT_T *ctx, RPIGRAFX_STATS_T *stats)
+{
+    (void) ctx;
+    memset(stats, 0, sizeof(*stats));
+    return 0;
+}
+
+void rpigrafx_reset_stats(RPIGRAFX_CONTEXT_T *ctx)
+{
+    (void) ctx;
+}
+
+#endif /* RPIGRAFX_STATS */
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "rpigrafx.h"
+#include "local/camera.h"
+#include "local/context.h"
+#include "local/draw.h"
+#include "local/error.h"
+#include "local/workers.h"
+
+/*
+ * Writing RGBA32 images into tensors for inference.
+ * Each row goes through one kernel which drops alpha, reorders the
+ * channels, scales them and converts them to the element type, so the
+ * image is read once and the tensor written once.
+ */
+
+struct tensor_job {
+    const uint8_t *src;
+    int src_stride, width, height;
+    RPIGRAFX_TENSOR_LAYOUT_T layout;
+    RPIGRAFX_TENSOR_TYPE_T type;
+    /* Index in the tensor of the R, G and B channels. */
+    int channel[3];
+    struct local_rpigrafx_tensor_params params;
+    uint8_t *tensor;
+};
+
+static int element_size(const RPIGRAFX_TENSOR_TYPE_T type)
+{
+    return type == RPIGRAFX_TENSOR_TYPE_FLOAT32 ? 4 : 1;
+}
+
+static void check_config(const RPIGRAFX_TENSOR_CONFIG_T *config)
+{
+    if (config->layout <= RPIGRAFX_TENSOR_LAYOUT_MIN || config->layout >= RPIGRAFX_TENSOR_LAYOUT_MAX)
+        error_and_exit("Unknown tensor layout: %d\n", config->layout);
+    if (config->order <= RPIGRAFX_CHANNEL_ORDER_MIN || config->order >= RPIGRAFX_CHANNEL_ORDER_MAX)
+        error_and_exit("Unknown channel order: %d\n", config->order);
+    if (config->type <= RPIGRAFX_TENSOR_TYPE_MIN || config->type >= RPIGRAFX_TENSOR_TYPE_MAX)
+        error_and_exit("Unknown tensor type: %d\n", config->type);
+    if (config->threads < 0)
+        error_and_exit("Invalid number of threads: %d\n", config->threads);
+}
+
+/* Bytes of a tensor of an image of width x height. */
+size_t rpigrafx_get_tensor_size(const RPIGRAFX_TENSOR_CONFIG_T *config, const int width, const int height)
+{
+    check_config(config);
+    return (size_t) width * height * 3 * element_size(config->type);
+}
+
+static void convert_rows(const struct tensor_job *job, const int y0, const int y1)
+{
+    const int w = job->width, esize = element_size(job->type);
+    const size_t plane = (size_t) w * job->height * esize;
+    const uint32_t *src = NULL;
+    uint8_t *row = NULL;
+    void *planes[3];
+    int y, c;
+
+    for (y = y0; y < y1; y ++) {
+        src = (const uint32_t*) (job->src + y * job->src_stride);
+        if (job->layout == RPIGRAFX_TENSOR_LAYOUT_NHWC) {
+            row = job->tensor + (size_t) y * w * 3 * esize;
+            if (job->type == RPIGRAFX_TENSOR_TYPE_FLOAT32)
+                local_rpigrafx_rgba32_to_packed_f32((float*) row, src, &job->params, w);
+            else
+                local_rpigrafx_rgba32_to_packed_u8(row, src, &job->params, w);
+            continue;
+        }
+        for (c = 0; c < 3; c ++)
+            planes[c] = job->tensor + job->channel[c] * plane + (size_t) y * w * esize;
+        if (job->type == RPIGRAFX_TENSOR_TYPE_FLOAT32)
+            local_rpigrafx_rgba32_to_planar_f32((float *const*) planes, src, &job->params, w);
+        else
+            local_rpigrafx_rgba32_to_planar_u8((uint8_t *const*) planes, src, &job->params, w);
+    }
+}
+
+static void convert_band(void *arg, const int band, const int num_bands)
+{
+    const struct tensor_job *job = arg;
+
+    convert_rows(job, job->height * band / num_bands, job->height * (band + 1) / num_bands);
+}
+
+/*
+ * Write an RGBA32 image of width x height with stride bytes per row into
+ * tensor, which must hold rpigrafx_get_tensor_size() bytes.  ctx gives the
+ * worker threads and may be NULL if config->threads is 0 or 1.
+ */
+void rpigrafx_image_to_tensor(RPIGRAFX_CONTEXT_T *ctx, const void *data, const int width, const int height, const int stride, const RPIGRAFX_TENSOR_CONFIG_T *config, void *tensor)
+{
+    struct tensor_job job;
+    int c, src_c;
+
+    check_config(config);
+    if (width <= 0 || height <= 0)
+        error_and_exit("Invalid image size: %dx%d\n", width, height);
+
+    job.src = data;
+    job.src_stride = stride;
+    job.width = width;
+    job.height = height;
+    job.layout = config->layout;
+    job.type = config->type;
+    job.tensor = tensor;
+    /* The kernels take the scales of the source channels. */
+    for (c = 0; c < 3; c ++) {
+        src_c = config->order == RPIGRAFX_CHANNEL_ORDER_BGR ? 2 - c : c;
+        job.channel[src_c] = c;
+        job.params.scale[src_c] = config->scale[c];
+        job.params.offset[src_c] = config->offset[c];
+    }
+    job.params.scale[3] = job.params.offset[3] = 0;
+    job.params.swap_rb = config->order == RPIGRAFX_CHANNEL_ORDER_BGR;
+    job.params.flip = 0;
+    /* int8 is uint8 of the value plus 128 with the top bit flipped. */
+    if (config->type == RPIGRAFX_TENSOR_TYPE_INT8) {
+        for (c = 0; c < 3; c ++)
+            job.params.offset[c] += 128;
+        job.params.flip = 0x80;
+    }
+
+    if (config->threads <= 1)
+        convert_rows(&job, 0, height);
+    else {
+        if (ctx == NULL)
+            error_and_exit("A context is needed for %d threads\n", config->threads);
+        local_rpigrafx_workers_run(local_rpigrafx_get_workers(ctx), convert_band, &job,
+                                   config->threads < height ? config->threads : height);
+    }
+}
+
+/*
+ * Write rect of an RGBA32 frame, or all of it if rect is NULL, into tensor.
+ * Frames of streams and ROI streams give resized and cropped tensors.
+ */
+void rpigrafx_frame_to_tensor(RPIGRAFX_FRAME_T *frame, const RPIGRAFX_RECT_T *rect, const RPIGRAFX_TENSOR_CONFIG_T *config, void *tensor)
+{
+    const RPIGRAFX_RECT_T whole = {0, 0, frame->width, frame->height};
+    const RPIGRAFX_RECT_T *r = rect != NULL ? rect : &whole;
+
+    if (frame->format != RPIGRAFX_FORMAT_RGBA32)
+        error_and_exit("Tensors are made from RGBA32 frames only\n");
+    if (r->x < 0 || r->y < 0 || r->width <= 0 || r->height <= 0
+            || r->x + r->width > frame->width || r->y + r->height > frame->height)
+        error_and_exit("Rectangle is out of the frame: %d,%d+%dx%d\n", r->x, r->y, r->width, r->height);
+    rpigrafx_image_to_tensor(frame->camera->ctx,
+                             (const uint8_t*) frame->data + r->y * frame->plane_stride[0] + r->x * 4,
+                             r->width, r->height, frame->plane_stride[0], config, tensor);
+}
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "rpigrafx.h"
+#include "local/draw.h"
+#include "local/error.h"
+#include "local/text.h"
+
+
+/*
+ * Built-in 8x8 font of the printable ASCII characters, from the public
+ * domain font8x8_basic by Daniel Hepper.  A byte is a row and bit 0 is
+ * the leftmost pixel.
+ */
+#define BUILTIN_FIRST_CHAR 0x20
+#define BUILTIN_NUM_GLYPHS 95
+
+static const uint8_t builtin_glyphs[BUILTIN_NUM_GLYPHS][8] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, /*   */
+    {0x18, 0x3c, 0x3c, 0x18, 0x18, 0x00, 0x18, 0x00}, /* ! */
+    {0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, /* " */
+    {0x36, 0x36, 0x7f, 0x36, 0x7f, 0x36, 0x36, 0x00}, /* # */
+    {0x0c, 0x3e, 0x03, 0x1e, 0x30, 0x1f, 0x0c, 0x00}, /* $ */
+    {0x00, 0x63, 0x33, 0x18, 0x0c, 0x66, 0x63, 0x00}, /* % */
+    {0x1c, 0x36, 0x1c, 0x6e, 0x3b, 0x33, 0x6e, 0x00}, /* & */
+    {0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00}, /* ' */
+    {0x18, 0x0c, 0x06, 0x06, 0x06, 0x0c, 0x18, 0x00}, /* ( */
+    {0x06, 0x0c, 0x18, 0x18, 0x18, 0x0c, 0x06, 0x00}, /* ) */
+    {0x00, 0x66, 0x3c, 0xff, 0x3c, 0x66, 0x00, 0x00}, /* * */
+    {0x00, 0x0c, 0x0c, 0x3f, 0x0c, 0x0c, 0x00, 0x00}, /* + */
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c, 0x06}, /* , */
+    {0x00, 0x00, 0x00, 0x3f, 0x00, 0x00, 0x00, 0x00}, /* - */
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c, 0x00}, /* . */
+    {0x60, 0x30, 0x18, 0x0c, 0x06, 0x03, 0x01, 0x00}, /* / */
+    {0x3e, 0x63, 0x73, 0x7b, 0x6f, 0x67, 0x3e, 0x00}, /* 0 */
+    {0x0c, 0x0e, 0x0c, 0x0c, 0x0c, 0x0c, 0x3f, 0x00}, /* 1 */
+    {0x1e, 0x33, 0x30, 0x1c, 0x06, 0x33, 0x3f, 0x00}, /* 2 */
+    {0x1e, 0x33, 0x30, 0x1c, 0x30, 0x33, 0x1e, 0x00}, /* 3 */
+    {0x38, 0x3c, 0x36, 0x33, 0x7f, 0x30, 0x78, 0x00}, /* 4 */
+    {0x3f, 0x03, 0x1f, 0x30, 0x30, 0x33, 0x1e, 0x00}, /* 5 */
+    {0x1c, 0x06, 0x03, 0x1f, 0x33, 0x33, 0x1e, 0x00}, /* 6 */
+    {0x3f, 0x33, 0x30, 0x18, 0x0c, 0x0c, 0x0c, 0x00}, /* 7 */
+    {0x1e, 0x33, 0x33, 0x1e, 0x33, 0x33, 0x1e, 0x00}, /* 8 */
+    {0x1e, 0x33, 0x33, 0x3e, 0x30, 0x18, 0x0e, 0x00}, /* 9 */
+    {0x00, 0x0c, 0x0c, 0x00, 0x00, 0x0c, 0x0c, 0x00}, /* : */
+    {0x00, 0x0c, 0x0c, 0x00, 0x00, 0x0c, 0x0c, 0x06}, /* ; */
+    {0x18, 0x0c, 0x06, 0x03, 0x06, 0x0c, 0x18, 0x00}, /* < */
+    {0x00, 0x00, 0x3f, 0x00, 0x00, 0x3f, 0x00, 0x00}, /* = */
+    {0x06, 0x0c, 0x18, 0x30, 0x18, 0x0c, 0x06, 0x00}, /* > */
+    {0x1e, 0x33, 0x30, 0x18, 0x0c, 0x00, 0x0c, 0x00}, /* ? */
+    {0x3e, 0x63, 0x7b, 0x7b, 0x7b, 0x03, 0x1e, 0x00}, /* @ */
+    {0x0c, 0x1e, 0x33, 0x33, 0x3f, 0x33, 0x33, 0x00}, /* A */
+    {0x3f, 0x66, 0x66, 0x3e, 0x66, 0x66, 0x3f, 0x00}, /* B */
+    {0x3c, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3c, 0x00}, /* C */
+    {0x1f, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1f, 0x00}, /* D */
+    {0x7f, 0x46, 0x16, 0x1e, 0x16, 0x46, 0x7f, 0x00}, /* E */
+    {0x7f, 0x46, 0x16, 0x1e, 0x16, 0x06, 0x0f, 0x00}, /* F */
+    {0x3c, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7c, 0x00}, /* G */
+    {0x33, 0x33, 0x33, 0x3f, 0x33, 0x33, 0x33, 0x00}, /* H */
+    {0x1e, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x1e, 0x00}, /* I */
+    {0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1e, 0x00}, /* J */
+    {0x67, 0x66, 0x36, 0x1e, 0x36, 0x66, 0x67, 0x00}, /* K */
+    {0x0f, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7f, 0x00}, /* L */
+    {0x63, 0x77, 0x7f, 0x7f, 0x6b, 0x63, 0x63, 0x00}, /* M */
+    {0x63, 0x67, 0x6f, 0x7b, 0x73, 0x63, 0x63, 0x00}, /* N */
+    {0x1c, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1c, 0x00}, /* O */
+    {0x3f, 0x66, 0x66, 0x3e, 0x06, 0x06, 0x0f, 0x00}, /* P */
+    {0x1e, 0x33, 0x33, 0x33, 0x3b, 0x1e, 0x38, 0x00}, /* Q */
+    {0x3f, 0x66, 0x66, 0x3e, 0x36, 0x66, 0x67, 0x00}, /* R */
+    {0x1e, 0x33, 0x07, 0x0e, 0x38, 0x33, 0x1e, 0x00}, /* S */
+    {0x3f, 0x2d, 0x0c, 0x0c, 0x0c, 0x0c, 0x1e, 0x00}, /* T */
+    {0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3f, 0x00}, /* U */
+    {0x33, 0x33, 0x33, 0x33, 0x33, 0x1e, 0x0c, 0x00}, /* V */
+    {0x63, 0x63, 0x63, 0x6b, 0x7f, 0x77, 0x63, 0x00}, /* W */
+    {0x63, 0x63, 0x36, 0x1c, 0x1c, 0x36, 0x63, 0x00}, /* X */
+    {0x33, 0x33, 0x33, 0x1e, 0x0c, 0x0c, 0x1e, 0x00}, /* Y */
+    {0x7f, 0x63, 0x31, 0x18, 0x4c, 0x66, 0x7f, 0x00}, /* Z */
+    {0x1e, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1e, 0x00}, /* [ */
+    {0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0x40, 0x00}, /* \ */
+    {0x1e, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1e, 0x00}, /* ] */
+    {0x08, 0x1c, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00}, /* ^ */
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff}, /* _ */
+    {0x0c, 0x0c, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00}, /* ` */
+    {0x00, 0x00, 0x1e, 0x30, 0x3e, 0x33, 0x6e, 0x00}, /* a */
+    {0x07, 0x06, 0x06, 0x3e, 0x66, 0x66, 0x3b, 0x00}, /* b */
+    {0x00, 0x00, 0x1e, 0x33, 0x03, 0x33, 0x1e, 0x00}, /* c */
+    {0x38, 0x30, 0x30, 0x3e, 0x33, 0x33, 0x6e, 0x00}, /* d */
+    {0x00, 0x00, 0x1e, 0x33, 0x3f, 0x03, 0x1e, 0x00}, /* e */
+    {0x1c, 0x36, 0x06, 0x0f, 0x06, 0x06, 0x0f, 0x00}, /* f */
+    {0x00, 0x00, 0x6e, 0x33, 0x33, 0x3e, 0x30, 0x1f}, /* g */
+    {0x07, 0x06, 0x36, 0x6e, 0x66, 0x66, 0x67, 0x00}, /* h */
+    {0x0c, 0x00, 0x0e, 0x0c, 0x0c, 0x0c, 0x1e, 0x00}, /* i */
+    {0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1e}, /* j */
+    {0x07, 0x06, 0x66, 0x36, 0x1e, 0x36, 0x67, 0x00}, /* k */
+    {0x0e, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x1e, 0x00}, /* l */
+    {0x00, 0x00, 0x33, 0x7f, 0x7f, 0x6b, 0x63, 0x00}, /* m */
+    {0x00, 0x00, 0x1f, 0x33, 0x33, 0x33, 0x33, 0x00}, /* n */
+    {0x00, 0x00, 0x1e, 0x33, 0x33, 0x33, 0x1e, 0x00}, /* o */
+    {0x00, 0x00, 0x3b, 0x66, 0x66, 0x3e, 0x06, 0x0f}, /* p */
+    {0x00, 0x00, 0x6e, 0x33, 0x33, 0x3e, 0x30, 0x78}, /* q */
+    {0x00, 0x00, 0x3b, 0x6e, 0x66, 0x06, 0x0f, 0x00}, /* r */
+    {0x00, 0x00, 0x3e, 0x03, 0x1e, 0x30, 0x1f, 0x00}, /* s */
+    {0x08, 0x0c, 0x3e, 0x0c, 0x0c, 0x2c, 0x18, 0x00}, /* t */
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6e, 0x00}, /* u */
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x1e, 0x0c, 0x00}, /* v */
+    {0x00, 0x00, 0x63, 0x6b, 0x7f, 0x7f, 0x36, 0x00}, /* w */
+    {0x00, 0x00, 0x63, 0x36, 0x1c, 0x36, 0x63, 0x00}, /* x */
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x3e, 0x30, 0x1f}, /* y */
+    {0x00, 0x00, 0x3f, 0x19, 0x0c, 0x26, 0x3f, 0x00}, /* z */
+    {0x38, 0x0c, 0x0c, 0x07, 0x0c, 0x0c, 0x38, 0x00}, /* { */
+    {0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00}, /* | */
+    {0x07, 0x0c, 0x0c, 0x38, 0x0c, 0x0c, 0x07, 0x00}, /* } */
+    {0x6e, 0x3b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, /* ~ */
+};
+
+static struct rpigrafx_font builtin_font;
+static pthread_once_t builtin_font_once = PTHREAD_ONCE_INIT;
+
+#define PSF1_MAGIC 0x0436
+#define PSF1_MODE512 0x01
+#define PSF2_MAGIC 0x864ab572
+
+
+/*
+ * Rasterize num_glyphs glyphs of bitmaps into the atlas of font.
+ * Each glyph has glyph_height rows of row_bytes bytes; the leftmost
+ * pixel is bit 7 of the first byte if msb_first, or bit 0 otherwise.
+ */
+static void rasterize(struct rpigrafx_font *font, const uint8_t *bitmaps, const int row_bytes, const int msb_first)
+{
+    const uint8_t *row;
+    int i, x, y, bit;
+
+    font->atlas_width = font->num_glyphs * font->glyph_width;
+    font->atlas = malloc(font->atlas_width * font->glyph_height);
+    if (font->atlas == NULL)
+        error_and_exit("Failed to allocate an atlas of %d glyphs\n", font->num_glyphs);
+    for (i = 0; i < font->num_glyphs; i ++) {
+        for (y = 0; y < font->glyph_height; y ++) {
+            row = bitmaps + (i * font->glyph_height + y) * row_bytes;
+            for (x = 0; x < font->glyph_width; x ++) {
+                bit = msb_first ? 7 - x % 8 : x % 8;
+                font->atlas[y * font->atlas_width + i * font->glyph_width + x] = (row[x / 8] >> bit) & 1;
+            }
+        }
+    }
+}
+
+static void init_builtin_font()
+{
+    builtin_font.glyph_width = 8;
+    builtin_font.glyph_height = 8;
+    builtin_font.first_char = BUILTIN_FIRST_CHAR;
+    builtin_font.num_glyphs = BUILTIN_NUM_GLYPHS;
+    rasterize(&builtin_font, &builtin_glyphs[0][0], 1, 0);
+}
+
+/* The built-in font for NULL. */
+const struct rpigrafx_font* local_rpigrafx_get_font(const RPIGRAFX_FONT_T *font)
+{
+    if (font != NULL)
+        return font;
+    pthread_once(&builtin_font_once, init_builtin_font);
+    return &builtin_font;
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+/*
+ * Load a PC Screen Font (PSF1 or PSF2, not compressed) such as the ones in
+ * /usr/share/consolefonts.  Characters are mapped to the glyph of the same
+ * index, which is right for ASCII in the usual fonts; the Unicode table is
+ * not used.  Characters beyond the glyphs are drawn as '?', or left blank
+ * in fonts too small to have one.
+ */
+RPIGRAFX_FONT_T* rpigrafx_load_font(const char *path)
+{
+    struct rpigrafx_font *font = NULL;
+    FILE *fp = NULL;
+    uint8_t header[32], *bitmaps = NULL;
+    size_t header_size, row_bytes, size;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+        error_and_exit("Failed to open %s\n", path);
+    font = calloc(1, sizeof(*font));
+    if (font == NULL)
+        error_and_exit("Failed to allocate a font\n");
+
+    if (fread(header, 1, 4, fp) != 4)
+        error_and_exit("Failed to read %s\n", path);
+    if ((header[0] | header[1] << 8) == PSF1_MAGIC) {
+        header_size = 4;
+        font->glyph_width = 8;
+        font->glyph_height = header[3];
+        font->num_glyphs = header[2] & PSF1_MODE512 ? 512 : 256;
+    } else if (read_le32(header) == PSF2_MAGIC) {
+        if (fread(header + 4, 1, 28, fp) != 28)
+            error_and_exit("Failed to read %s\n", path);
+        header_size = read_le32(header + 8);
+        font->num_glyphs = read_le32(header + 16);
+        font->glyph_height = read_le32(header + 24);
+        font->glyph_width = read_le32(header + 28);
+        if (read_le32(header + 20) != (uint32_t) ((font->glyph_width + 7) / 8 * font->glyph_height))
+            error_and_exit("Unsupported glyph size in %s\n", path);
+    } else
+        error_and_exit("%s is not a PSF font\n", path);
+    if (font->glyph_width <= 0 || font->glyph_height <= 0 || font->num_glyphs <= 0
+            || font->glyph_width > 64 || font->glyph_height > 64 || font->num_glyphs > 65536)
+        error_and_exit("Unsupported font in %s\n", path);
+
+    row_bytes = (font->glyph_width + 7) / 8;
+    size = row_bytes * font->glyph_height * font->num_glyphs;
+    bitmaps = malloc(size);
+    if (bitmaps == NULL)
+        error_and_exit("Failed to allocate %d bytes of memory\n", (int) size);
+    if (fseek(fp, header_size, SEEK_SET) || fread(bitmaps, 1, size, fp) != size)
+        error_and_exit("Failed to read the glyphs of %s\n", path);
+    fclose(fp);
+
+    font->first_char = 0;
+    rasterize(font, bitmaps, row_bytes, 1);
+    free(bitmaps);
+    return font;
+}
+
+void rpigrafx_destroy_font(RPIGRAFX_FONT_T *font)
+{
+    free(font->atlas);
+    free(font);
+}
+
+/* Size of text drawn with font at scale. font may be NULL for the built-in one. */
+void rpigrafx_font_measure_text(const RPIGRAFX_FONT_T *font, const char *text, const int scale, int *width, int *height)
+{
+    int line_width = 0, max_width = 0, lines = 1;
+
+    font = local_rpigrafx_get_font(font);
+    for (; *text != '\0'; text ++) {
+        if (*text == '\n') {
+            lines ++;
+            line_width = 0;
+            continue;
+        }
+        line_width += font->glyph_width;
+        if (line_width > max_width)
+            max_width = line_width;
+    }
+    *width = max_width * scale;
+    *height = lines * font->glyph_height * scale;
+}
+
+/* Glyph of c, or of '?' if the font has none, or -1 if it has neither. */
+static int char_to_glyph(const struct rpigrafx_font *font, const unsigned char c)
+{
+    int i = (c == '\t' ? ' ' : c) - font->first_char;
+
+    if (i >= 0 && i < font->num_glyphs)
+        return i;
+    i = '?' - font->first_char;
+    return i >= 0 && i < font->num_glyphs ? i : -1;
+}
+
+/*
+ * Lay text out into *glyphs, which grows as needed, and return the number
+ * of glyphs.  Blanks, and characters the font cannot draw even as '?',
+ * take no glyph.  *width and *height are of the text before scaling.
+ * '\n' starts a new line.
+ */
+int local_rpigrafx_layout_text(const struct rpigrafx_font *font, const char *text,
+                               struct local_rpigrafx_glyph_pos **glyphs, int *glyphs_len, int *width, int *height)
+{
+    int num = 0, x = 0, y = 0, glyph;
+
+    *width = 0;
+    for (; *text != '\0'; text ++) {
+        if (*text == '\n') {
+            x = 0;
+            y += font->glyph_height;
+            continue;
+        }
+        if (*text != ' ' && *text != '\t' && (glyph = char_to_glyph(font, *text)) >= 0) {
+            if (num >= *glyphs_len) {
+                *glyphs_len += 100;
+                *glyphs = realloc(*glyphs, *glyphs_len * sizeof(**glyphs));
+                if (*glyphs == NULL)
+                    error_and_exit("Failed to realloc %d bytes of memory\n", *glyphs_len * sizeof(**glyphs));
+            }
+            (*glyphs)[num].glyph = glyph;
+            (*glyphs)[num].x = x;
+            (*glyphs)[num].y = y;
+            num ++;
+        }
+        x += font->glyph_width;
+        if (x > *width)
+            *width = x;
+    }
+    *height = y + font->glyph_height;
+    return num;
+}
+
+/*
+ * Draw glyph of font with its top-left at (x, y), each pixel of the atlas
+ * as a scale x scale block.  Runs of pixels in a row are filled at once.
+ */
+void local_rpigrafx_draw_glyph_rgba32(uint32_t *p, const int stride, const int width, const int height,
+                                      const struct rpigrafx_font *font, const int glyph,
+                                      const int x, const int y, const int scale, const uint32_t val)
+{
+    const uint8_t *row;
+    int gx, gy, run;
+
+    for (gy = 0; gy < font->glyph_height; gy ++) {
+        if (y + (gy + 1) * scale <= 0 || y + gy * scale >= height)
+            continue;
+        row = font->atlas + gy * font->atlas_width + glyph * font->glyph_width;
+        for (gx = 0; gx < font->glyph_width; gx += run) {
+            for (run = 0; gx + run < font->glyph_width && row[gx + run]; run ++)
+                ;
+            if (run == 0) {
+                run = 1;
+                continue;
+            }
+            local_rpigrafx_fill_rgba32(p, stride, width, height,
+                    x + gx * scale, y + gy * scale, run * scale, scale, val);
+        }
+    }
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <bcm_host.h>
+#include <pthread.h>
+#include "local/backend.h"
+#include "local/vc.h"
+
+/* bcm_host is initialized while at least one context exists. */
+static pthread_mutex_t host_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int num_contexts = 0;
+
+static void vc_init()
+{
+    pthread_mutex_lock(&host_mutex);
+    if (num_contexts ++ == 0)
+        bcm_host_init();
+    pthread_mutex_unlock(&host_mutex);
+}
+
+static void vc_deinit()
+{
+    pthread_mutex_lock(&host_mutex);
+    if (-- num_contexts == 0)
+        bcm_host_deinit();
+    pthread_mutex_unlock(&host_mutex);
+}
+
+/* MMAL and dispmanx of the VideoCore. */
+const struct local_rpigrafx_backend local_rpigrafx_backend_vc = {
+    .name = "vc",
+    .init = vc_init,
+    .deinit = vc_deinit,
+    .camera = &local_rpigrafx_vc_camera_ops,
+    .display = &local_rpigrafx_vc_display_ops,
+};
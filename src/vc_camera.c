@@ -0,0 +1,538 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <bcm_host.h>
+#include <interface/mmal/mmal.h>
+#include <interface/mmal/mmal_logging.h>
+#include <interface/mmal/util/mmal_connection.h>
+#include <interface/mmal/util/mmal_util_params.h>
+#include <interface/mmal/util/mmal_component_wrapper.h>
+#include <interface/mmal/util/mmal_default_components.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rpigrafx.h"
+#include "local/camera.h"
+#include "local/context.h"
+#include "local/error.h"
+#include "local/sync.h"
+#include "local/vc.h"
+
+
+/*
+ * Each header of the still port pool and of the ISP output pools has a frame
+ * descriptor attached through header->user_data, and frame->buffer points
+ * back to the header.
+ */
+struct vc_camera {
+    MMAL_WRAPPER_T *cpw_camera;
+    MMAL_WRAPPER_T *cpw_null;
+    /* vc.ril.video_render while the preview is shown. */
+    MMAL_WRAPPER_T *cpw_render;
+    /* The preview port to cpw_render, or to cpw_null to keep the sensor running. */
+    MMAL_CONNECTION_T *connection_preview;
+    /* Capture port: the still port, or the video port in video mode. */
+    MMAL_PORT_T *port;
+    /* Headers sent to the capture port and not returned yet. */
+    int num_in_port;
+    uint32_t buffer_num_default;
+};
+
+/* Each stream owns a vc.ril.isp instance. */
+struct vc_stream {
+    MMAL_WRAPPER_T *cpw_isp;
+};
+
+
+#define _check(x) \
+    do { \
+        int ret = (x); \
+        if (ret != MMAL_SUCCESS) \
+            error_and_exit("MMAL assertation failed: 0x%08x\n", ret); \
+    } while (0)
+
+
+static void config_port(MMAL_PORT_T *port, const MMAL_FOURCC_T encoding, const int width, const int height)
+{
+    port->format->encoding = encoding;
+    port->format->es->video.width  = VCOS_ALIGN_UP(width,  32);
+    port->format->es->video.height = VCOS_ALIGN_UP(height, 16);
+    port->format->es->video.crop.x = 0;
+    port->format->es->video.crop.y = 0;
+    port->format->es->video.crop.width  = width;
+    port->format->es->video.crop.height = height;
+    _check(mmal_port_format_commit(port));
+}
+
+/* The ISP does not output luma only; GRAY8 is the Y plane of I420. */
+static MMAL_FOURCC_T format_to_encoding(const RPIGRAFX_FORMAT_T format)
+{
+    switch (format) {
+        case RPIGRAFX_FORMAT_RGBA32:
+            return MMAL_ENCODING_RGBA;
+        case RPIGRAFX_FORMAT_RGB24:
+            return MMAL_ENCODING_RGB24;
+        case RPIGRAFX_FORMAT_BGR24:
+            return MMAL_ENCODING_BGR24;
+        case RPIGRAFX_FORMAT_I420:
+        case RPIGRAFX_FORMAT_GRAY8:
+            return MMAL_ENCODING_I420;
+        case RPIGRAFX_FORMAT_NV12:
+            return MMAL_ENCODING_NV12;
+        default:
+            error_and_exit("Unknown format: %d\n", format);
+    }
+}
+
+/*
+ * The headers are taken as soon as the wrapper signals them, so the
+ * receive time is taken here.
+ */
+static struct rpigrafx_frame* header_to_frame(MMAL_BUFFER_HEADER_T *header)
+{
+    struct rpigrafx_frame *f = header->user_data;
+
+    f->data = header->data;
+    f->timestamp = header->pts;
+    f->receive_time = local_rpigrafx_now_ns();
+    return f;
+}
+
+static MMAL_BUFFER_HEADER_T* get_full_header(MMAL_PORT_T *port)
+{
+    MMAL_BUFFER_HEADER_T *header = NULL;
+    for (; ; ) {
+        while (mmal_wrapper_buffer_get_empty(port, &header, 0) == MMAL_SUCCESS)
+            _check(mmal_port_send_buffer(port, header));
+        _check(mmal_wrapper_buffer_get_full(port, &header, MMAL_WRAPPER_FLAG_WAIT));
+        if (header->flags & (MMAL_BUFFER_HEADER_FLAG_EOS | MMAL_BUFFER_HEADER_FLAG_FRAME_END))
+            break;
+        mmal_buffer_header_release(header);
+    }
+    return header;
+}
+
+/* Attach a frame descriptor to each header of the pool of an enabled output port. */
+static struct rpigrafx_frame* attach_frames(struct rpigrafx_camera *cam, MMAL_WRAPPER_T *wrapper, MMAL_PORT_T *port, int *lenp)
+{
+    MMAL_POOL_T *pool = wrapper->output_pool[port->index];
+    struct rpigrafx_frame *fs = NULL;
+    uint32_t i;
+
+    fs = local_rpigrafx_alloc_frames(cam, pool->headers_num);
+    for (i = 0; i < pool->headers_num; i ++) {
+        fs[i].buffer = pool->header[i];
+        pool->header[i]->user_data = &fs[i];
+    }
+    *lenp = pool->headers_num;
+    return fs;
+}
+
+/* Called by the wrapper on the MMAL thread. Never call MMAL from here. */
+static void camera_wrapper_callback(MMAL_WRAPPER_T *wrapper)
+{
+    local_rpigrafx_camera_event(wrapper->user_data);
+}
+
+static void vc_query_cameras(RPIGRAFX_CONTEXT_T *ctx)
+{
+    MMAL_COMPONENT_T *cp_camera_info = NULL;
+    MMAL_PARAMETER_CAMERA_INFO_T camera_info;
+    int i;
+
+    _check(mmal_component_create(MMAL_COMPONENT_DEFAULT_CAMERA_INFO, &cp_camera_info));
+
+    camera_info.hdr.id = MMAL_PARAMETER_CAMERA_INFO;
+    camera_info.hdr.size = sizeof(camera_info);
+    _check(mmal_port_parameter_get(cp_camera_info->control, &camera_info.hdr));
+
+    if (camera_info.num_cameras > MAX_CAMERAS)
+        camera_info.num_cameras = MAX_CAMERAS;
+    for (i = 0; i < (int) camera_info.num_cameras; i ++) {
+        ctx->camera_info[i].max_width  = camera_info.cameras[i].max_width;
+        ctx->camera_info[i].max_height = camera_info.cameras[i].max_height;
+    }
+    ctx->num_cameras = camera_info.num_cameras;
+
+    _check(mmal_component_destroy(cp_camera_info));
+}
+
+static void set_camera_num(struct vc_camera *vc, const int camera_num)
+{
+    MMAL_PARAMETER_INT32_T param = {
+        {MMAL_PARAMETER_CAMERA_NUM, sizeof(param)},
+        camera_num
+    };
+    _check(mmal_port_parameter_set(vc->cpw_camera->control, &param.hdr));
+}
+
+/*
+ * Size the buffers of the camera for the largest frames of the sensor of
+ * camera_num, as raspistill does, and stamp the frames with the STC reset
+ * at the start of capture.  Must be set while the ports are disabled.
+ */
+static void set_camera_config(struct rpigrafx_camera *cam, const int camera_num)
+{
+    struct vc_camera *vc = cam->priv;
+    const int width = cam->ctx->camera_info[camera_num].max_width;
+    const int height = cam->ctx->camera_info[camera_num].max_height;
+    MMAL_PARAMETER_CAMERA_CONFIG_T param = {
+        {MMAL_PARAMETER_CAMERA_CONFIG, sizeof(param)},
+        .max_stills_w = width,
+        .max_stills_h = height,
+        .stills_yuv422 = 0,
+        .one_shot_stills = 1,
+        .max_preview_video_w = width,
+        .max_preview_video_h = height,
+        .num_preview_video_frames = 3,
+        .stills_capture_circular_buffer_height = 0,
+        .fast_preview_resume = 0,
+        .use_stc_timestamp = MMAL_PARAM_TIMESTAMP_MODE_RESET_STC
+    };
+    _check(mmal_port_parameter_set(vc->cpw_camera->control, &param.hdr));
+}
+
+/* Stop the capture port and free its buffers. */
+static void disable_capture(struct rpigrafx_camera *cam)
+{
+    struct vc_camera *vc = cam->priv;
+
+    if (cam->is_video_mode)
+        _check(mmal_port_parameter_set_boolean(vc->port, MMAL_PARAMETER_CAPTURE, 0));
+    local_rpigrafx_free_frames(cam->frames, cam->frames_len);
+    _check(mmal_wrapper_port_disable(vc->port));
+    vc->num_in_port = 0;
+}
+
+/*
+ * Configure the capture port for the current size and mode, enable it and
+ * resize the inputs of the resizers to match.  The video port starts
+ * streaming right away.
+ */
+static void enable_capture(struct rpigrafx_camera *cam)
+{
+    struct vc_camera *vc = cam->priv;
+    MMAL_PORT_T *input = NULL;
+    struct vc_stream *vs = NULL;
+    int i;
+
+    if (cam->is_video_mode) {
+        vc->port->format->es->video.frame_rate.num = cam->video_fps;
+        vc->port->format->es->video.frame_rate.den = 1;
+    }
+    config_port(vc->port, MMAL_ENCODING_RGBA, cam->frame_full_width, cam->frame_full_height);
+    _check(mmal_wrapper_port_enable(vc->port, MMAL_WRAPPER_FLAG_PAYLOAD_ALLOCATE));
+    cam->frames = attach_frames(cam, vc->cpw_camera, vc->port, &cam->frames_len);
+    if (cam->is_video_mode)
+        _check(mmal_port_parameter_set_boolean(vc->port, MMAL_PARAMETER_CAPTURE, 1));
+
+    for (i = 0; i < MAX_STREAMS; i ++) {
+        if (cam->streams[i] == NULL || cam->streams[i]->resizer != RPIGRAFX_RESIZER_ISP)
+            continue;
+        vs = cam->streams[i]->priv;
+        input = vs->cpw_isp->input[0];
+        _check(mmal_wrapper_port_disable(input));
+        config_port(input, MMAL_ENCODING_RGBA, cam->frame_full_width, cam->frame_full_height);
+        _check(mmal_wrapper_port_enable(input, 0));
+    }
+}
+
+static void vc_set_camera_num(struct rpigrafx_camera *cam, const int camera_num)
+{
+    struct vc_camera *vc = cam->priv;
+
+    disable_capture(cam);
+    _check(mmal_connection_disable(vc->connection_preview));
+    set_camera_num(vc, camera_num);
+    set_camera_config(cam, camera_num);
+    _check(mmal_connection_enable(vc->connection_preview));
+    enable_capture(cam);
+}
+
+/*
+ * The sensor mode and the frame rate of the preview port, which drives the
+ * sensor, can be changed only while the ports are disabled.
+ */
+static void vc_set_capture_mode(struct rpigrafx_camera *cam)
+{
+    struct vc_camera *vc = cam->priv;
+    MMAL_PORT_T *preview = vc->cpw_camera->output[0];
+    MMAL_PARAMETER_UINT32_T param_sensor_mode = {
+        {MMAL_PARAMETER_CAMERA_CUSTOM_SENSOR_CONFIG, sizeof(param_sensor_mode)},
+        cam->sensor_mode
+    };
+
+    disable_capture(cam);
+    _check(mmal_connection_disable(vc->connection_preview));
+    _check(mmal_port_parameter_set(vc->cpw_camera->control, &param_sensor_mode.hdr));
+    /* 0/1 lets the camera choose, as in still mode. */
+    preview->format->es->video.frame_rate.num = cam->video_fps;
+    preview->format->es->video.frame_rate.den = 1;
+    _check(mmal_port_format_commit(preview));
+    _check(mmal_connection_enable(vc->connection_preview));
+
+    /* The previous port is left disabled with its default buffer number. */
+    vc->port = vc->cpw_camera->output[cam->is_video_mode ? 1 : 2];
+    vc->port->buffer_num = vc->port->buffer_num_recommended;
+    vc->buffer_num_default = vc->port->buffer_num;
+    enable_capture(cam);
+}
+
+static void connect_preview(struct vc_camera *vc, MMAL_PORT_T *input)
+{
+    _check(mmal_connection_create(
+            &vc->connection_preview,
+            vc->cpw_camera->output[0], input,
+            MMAL_CONNECTION_FLAG_TUNNELLING | MMAL_CONNECTION_FLAG_ALLOCATION_ON_INPUT
+    ));
+    _check(mmal_connection_enable(vc->connection_preview));
+}
+
+static void vc_open(struct rpigrafx_camera *cam)
+{
+    struct vc_camera *vc = NULL;
+    MMAL_PORT_T *port = NULL;
+
+    vc = calloc(1, sizeof(*vc));
+    if (vc == NULL)
+        error_and_exit("Failed to allocate a camera\n");
+    cam->priv = vc;
+
+    _check(mmal_wrapper_create(&vc->cpw_camera, MMAL_COMPONENT_DEFAULT_CAMERA));
+    vc->cpw_camera->user_data = cam;
+    set_camera_num(vc, cam->camera_num);
+    set_camera_config(cam, cam->camera_num);
+    _check(mmal_wrapper_create(&vc->cpw_null, "vc.null_sink"));
+    connect_preview(vc, vc->cpw_null->input[0]);
+    port = vc->port = vc->cpw_camera->output[2];
+    config_port(port, MMAL_ENCODING_RGBA, cam->frame_full_width, cam->frame_full_height);
+    vc->buffer_num_default = port->buffer_num;
+    //_check(mmal_wrapper_port_enable(port, MMAL_WRAPPER_FLAG_PAYLOAD_ALLOCATE | MMAL_WRAPPER_FLAG_PAYLOAD_USE_SHARED_MEMORY));
+    _check(mmal_wrapper_port_enable(port, MMAL_WRAPPER_FLAG_PAYLOAD_ALLOCATE));
+    cam->frames = attach_frames(cam, vc->cpw_camera, port, &cam->frames_len);
+}
+
+static void vc_close(struct rpigrafx_camera *cam)
+{
+    struct vc_camera *vc = cam->priv;
+
+    if (vc->connection_preview != NULL)
+        _check(mmal_connection_destroy(vc->connection_preview));
+    if (vc->cpw_render != NULL)
+        _check(mmal_wrapper_destroy(vc->cpw_render));
+    if (vc->cpw_null != NULL)
+        _check(mmal_wrapper_destroy(vc->cpw_null));
+    if (vc->cpw_camera != NULL)
+        _check(mmal_wrapper_destroy(vc->cpw_camera));
+    free(vc);
+    cam->priv = NULL;
+}
+
+static void vc_set_buffer_num(struct rpigrafx_camera *cam, const int num)
+{
+    struct vc_camera *vc = cam->priv;
+    MMAL_PORT_T *port = vc->port;
+
+    if (cam->is_video_mode)
+        _check(mmal_port_parameter_set_boolean(port, MMAL_PARAMETER_CAPTURE, 0));
+    local_rpigrafx_free_frames(cam->frames, cam->frames_len);
+    _check(mmal_wrapper_port_disable(port));
+    vc->num_in_port = 0;
+    if (num == 0)
+        port->buffer_num = vc->buffer_num_default;
+    else
+        port->buffer_num = (uint32_t) num < port->buffer_num_min ? port->buffer_num_min : (uint32_t) num;
+    _check(mmal_wrapper_port_enable(port, MMAL_WRAPPER_FLAG_PAYLOAD_ALLOCATE));
+    cam->frames = attach_frames(cam, vc->cpw_camera, port, &cam->frames_len);
+    if (cam->is_video_mode)
+        _check(mmal_port_parameter_set_boolean(port, MMAL_PARAMETER_CAPTURE, 1));
+}
+
+static void vc_set_event_callback(struct rpigrafx_camera *cam, const int enable)
+{
+    struct vc_camera *vc = cam->priv;
+
+    vc->cpw_camera->callback = enable ? camera_wrapper_callback : NULL;
+}
+
+static int vc_queue_buffers(struct rpigrafx_camera *cam)
+{
+    struct vc_camera *vc = cam->priv;
+    MMAL_PORT_T *port = vc->port;
+    MMAL_BUFFER_HEADER_T *header = NULL;
+
+    while (mmal_wrapper_buffer_get_empty(port, &header, 0) == MMAL_SUCCESS) {
+        _check(mmal_port_send_buffer(port, header));
+        vc->num_in_port ++;
+    }
+    return vc->num_in_port;
+}
+
+static void vc_trigger(struct rpigrafx_camera *cam)
+{
+    struct vc_camera *vc = cam->priv;
+    MMAL_BUFFER_HEADER_T *header = NULL;
+
+    if (!cam->is_video_mode) {
+        _check(mmal_port_parameter_set_boolean(vc->port, MMAL_PARAMETER_CAPTURE, 1));
+        return;
+    }
+    /* Released headers are sent again by vc_queue_buffers(). */
+    while (mmal_wrapper_buffer_get_full(vc->port, &header, 0) == MMAL_SUCCESS) {
+        vc->num_in_port --;
+        mmal_buffer_header_release(header);
+    }
+}
+
+static struct rpigrafx_frame* vc_get_full(struct rpigrafx_camera *cam, const int wait)
+{
+    struct vc_camera *vc = cam->priv;
+    MMAL_PORT_T *port = vc->port;
+    MMAL_BUFFER_HEADER_T *header = NULL;
+
+    for (; ; ) {
+        if (wait) {
+            vc_queue_buffers(cam);
+            _check(mmal_wrapper_buffer_get_full(port, &header, MMAL_WRAPPER_FLAG_WAIT));
+        } else if (mmal_wrapper_buffer_get_full(port, &header, 0) != MMAL_SUCCESS)
+            return NULL;
+        vc->num_in_port --;
+        if (header->flags & (MMAL_BUFFER_HEADER_FLAG_EOS | MMAL_BUFFER_HEADER_FLAG_FRAME_END))
+            break;
+        mmal_buffer_header_release(header);
+    }
+    return header_to_frame(header);
+}
+
+static void vc_release(struct rpigrafx_frame *f)
+{
+    mmal_buffer_header_release(f->buffer);
+}
+
+static void vc_stream_create(struct rpigrafx_stream *stream, const int buffer_num)
+{
+    struct vc_camera *vc = stream->camera->priv;
+    MMAL_PORT_T *camera_output = vc->port;
+    struct vc_stream *vs = NULL;
+
+    vs = calloc(1, sizeof(*vs));
+    if (vs == NULL)
+        error_and_exit("Failed to allocate a stream\n");
+    stream->priv = vs;
+
+    _check(mmal_wrapper_create(&vs->cpw_isp, "vc.ril.isp"));
+    config_port(vs->cpw_isp->input[0], camera_output->format->encoding,
+                camera_output->format->es->video.crop.width,
+                camera_output->format->es->video.crop.height);
+    config_port(vs->cpw_isp->output[0], format_to_encoding(stream->format), stream->width, stream->height);
+    if ((uint32_t) buffer_num > vs->cpw_isp->output[0]->buffer_num)
+        vs->cpw_isp->output[0]->buffer_num = buffer_num;
+    _check(mmal_wrapper_port_enable(vs->cpw_isp->input[0], 0));
+    _check(mmal_wrapper_port_enable(vs->cpw_isp->output[0], MMAL_WRAPPER_FLAG_PAYLOAD_ALLOCATE));
+    stream->frames = attach_frames(stream->camera, vs->cpw_isp, vs->cpw_isp->output[0], &stream->frames_len);
+}
+
+static void vc_stream_destroy(struct rpigrafx_stream *stream)
+{
+    struct vc_stream *vs = stream->priv;
+
+    _check(mmal_wrapper_port_disable(vs->cpw_isp->output[0]));
+    _check(mmal_wrapper_port_disable(vs->cpw_isp->input[0]));
+    _check(mmal_wrapper_destroy(vs->cpw_isp));
+    free(vs);
+    stream->priv = NULL;
+}
+
+static struct rpigrafx_frame* vc_stream_resize(struct rpigrafx_stream *stream, struct rpigrafx_frame *src, const RPIGRAFX_RECT_T *crop)
+{
+    struct vc_stream *vs = stream->priv;
+    MMAL_PORT_T *input = vs->cpw_isp->input[0], *output = vs->cpw_isp->output[0];
+    MMAL_BUFFER_HEADER_T *header = NULL, *src_header = src->buffer;
+    MMAL_PARAMETER_CROP_T param_crop = {{MMAL_PARAMETER_CROP, sizeof(param_crop)}, {0, 0, 0, 0}};
+
+    if (crop != NULL) {
+        param_crop.rect.x = crop->x;
+        param_crop.rect.y = crop->y;
+        param_crop.rect.width = crop->width;
+        param_crop.rect.height = crop->height;
+        _check(mmal_port_parameter_set(input, &param_crop.hdr));
+    }
+
+    /* The input port has no payload of its own: feed it the captured buffer. */
+    _check(mmal_wrapper_buffer_get_empty(input, &header, MMAL_WRAPPER_FLAG_WAIT));
+    header->data = src_header->data;
+    header->length = src_header->length;
+    header->offset = src_header->offset;
+    header->flags = MMAL_BUFFER_HEADER_FLAG_FRAME_END;
+    header->pts = src_header->pts;
+    _check(mmal_port_send_buffer(input, header));
+
+    return header_to_frame(get_full_header(output));
+}
+
+/*
+ * The preview port is tunneled to vc.ril.video_render instead of the null
+ * sink, so that the frames go to the display without the ARM.
+ * display is unused; vc.ril.video_render opens the display by number.
+ */
+static void vc_start_preview(struct rpigrafx_camera *cam, void *display, const int display_num,
+                             const RPIGRAFX_RECT_T *dst, const int layer, const int alpha)
+{
+    struct vc_camera *vc = cam->priv;
+    MMAL_DISPLAYREGION_T region;
+
+    (void) display;
+    memset(&region, 0, sizeof(region));
+    region.hdr.id = MMAL_PARAMETER_DISPLAYREGION;
+    region.hdr.size = sizeof(region);
+    region.set = MMAL_DISPLAY_SET_NUM | MMAL_DISPLAY_SET_FULLSCREEN | MMAL_DISPLAY_SET_DEST_RECT
+               | MMAL_DISPLAY_SET_LAYER | MMAL_DISPLAY_SET_ALPHA;
+    region.display_num = display_num;
+    region.fullscreen = MMAL_FALSE;
+    region.dest_rect.x = dst->x;
+    region.dest_rect.y = dst->y;
+    region.dest_rect.width = dst->width;
+    region.dest_rect.height = dst->height;
+    region.layer = layer;
+    region.alpha = alpha;
+
+    _check(mmal_wrapper_create(&vc->cpw_render, MMAL_COMPONENT_DEFAULT_VIDEO_RENDERER));
+    _check(mmal_port_parameter_set(vc->cpw_render->input[0], &region.hdr));
+    _check(mmal_connection_destroy(vc->connection_preview));
+    connect_preview(vc, vc->cpw_render->input[0]);
+}
+
+static void vc_stop_preview(struct rpigrafx_camera *cam)
+{
+    struct vc_camera *vc = cam->priv;
+
+    _check(mmal_connection_destroy(vc->connection_preview));
+    _check(mmal_wrapper_destroy(vc->cpw_render));
+    vc->cpw_render = NULL;
+    connect_preview(vc, vc->cpw_null->input[0]);
+}
+
+const struct local_rpigrafx_camera_ops local_rpigrafx_vc_camera_ops = {
+    .query_cameras = vc_query_cameras,
+    .open = vc_open,
+    .close = vc_close,
+    .set_camera_num = vc_set_camera_num,
+    .set_capture_mode = vc_set_capture_mode,
+    .set_buffer_num = vc_set_buffer_num,
+    .set_event_callback = vc_set_event_callback,
+    .queue_buffers = vc_queue_buffers,
+    .trigger = vc_trigger,
+    .get_full = vc_get_full,
+    .release = vc_release,
+    .stream_create = vc_stream_create,
+    .stream_destroy = vc_stream_destroy,
+    .stream_resize = vc_stream_resize,
+    .start_preview = vc_start_preview,
+    .stop_preview = vc_stop_preview,
+};
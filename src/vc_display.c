@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <bcm_host.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "rpigrafx.h"
+#include "local/error.h"
+#include "local/vc.h"
+
+
+#ifndef ELEMENT_CHANGE_DEST_RECT
+/* From interface/vmcs_host/vc_vchi_dispmanx.h. */
+#define ELEMENT_CHANGE_LAYER          (1<<0)
+#define ELEMENT_CHANGE_OPACITY        (1<<1)
+#define ELEMENT_CHANGE_DEST_RECT      (1<<2)
+#define ELEMENT_CHANGE_SRC_RECT       (1<<3)
+#define ELEMENT_CHANGE_MASK_RESOURCE  (1<<4)
+#define ELEMENT_CHANGE_TRANSFORM      (1<<5)
+#endif
+
+struct vc_display {
+    DISPMANX_DISPLAY_HANDLE_T display;
+    /* Of the update in flight. At most one is submitted at a time. */
+    void (*callback)(void *arg);
+    void *arg;
+};
+
+/* Update handles are passed around as pointers. */
+#define UPDATE_TO_PTR(u) ((void*) (uintptr_t) (u))
+#define PTR_TO_UPDATE(p) ((DISPMANX_UPDATE_HANDLE_T) (uintptr_t) (p))
+
+#define _check(x) \
+    do { \
+        int ret = (x); \
+        if (ret) \
+            error_and_exit("Assertation failed: 0x%08x\n", ret); \
+    } while (0)
+
+static VC_IMAGE_TYPE_T format_to_image_type(const RPIGRAFX_FORMAT_T format)
+{
+    switch (format) {
+        case RPIGRAFX_FORMAT_RGBA32:
+            return VC_IMAGE_RGBA32;
+        case RPIGRAFX_FORMAT_RGB24:
+            return VC_IMAGE_RGB888;
+        case RPIGRAFX_FORMAT_BGR24:
+            return VC_IMAGE_BGR888;
+        default:
+            error_and_exit("Unknown format: %d\n", format);
+    }
+}
+
+static DISPMANX_TRANSFORM_T transform_to_dispmanx(const RPIGRAFX_TRANSFORM_T transform)
+{
+    switch (transform) {
+        case RPIGRAFX_TRANSFORM_NONE:
+            return DISPMANX_NO_ROTATE;
+        case RPIGRAFX_TRANSFORM_ROT90:
+            return DISPMANX_ROTATE_90;
+        case RPIGRAFX_TRANSFORM_ROT180:
+            return DISPMANX_ROTATE_180;
+        case RPIGRAFX_TRANSFORM_ROT270:
+            return DISPMANX_ROTATE_270;
+        case RPIGRAFX_TRANSFORM_FLIP_H:
+            return DISPMANX_FLIP_HRIZ;
+        case RPIGRAFX_TRANSFORM_FLIP_V:
+            return DISPMANX_FLIP_VERT;
+        default:
+            error_and_exit("Unknown transform: %d\n", transform);
+    }
+}
+
+/* Weird shifting trick from hello_pi/hello_dispmanx: src is in 16.16 fixed point. */
+static void set_rects(VC_RECT_T *dst_rect, VC_RECT_T *src_rect, const RPIGRAFX_RECT_T *dst, const RPIGRAFX_RECT_T *src)
+{
+    _check(vc_dispmanx_rect_set(src_rect, src->x << 16, src->y << 16, src->width << 16, src->height << 16));
+    _check(vc_dispmanx_rect_set(dst_rect, dst->x, dst->y, dst->width, dst->height));
+}
+
+static void* vc_open(const int display_num, int *width, int *height)
+{
+    struct vc_display *vd = NULL;
+    DISPMANX_MODEINFO_T info;
+
+    vd = calloc(1, sizeof(*vd));
+    if (vd == NULL)
+        error_and_exit("Failed to allocate a display\n");
+
+    /*
+     * 0 means the dispmanx impl. uses VC_DISPLAY environment value
+     * if it is set.
+     */
+    vd->display = vc_dispmanx_display_open(display_num);
+    if (vd->display == 0)
+        error_and_exit("vc_dispmanx_display_open: 0x%08x\n", vd->display);
+
+    _check(vc_dispmanx_display_get_info(vd->display, &info));
+    *width = info.width;
+    *height = info.height;
+    return vd;
+}
+
+static void vc_close(void *display)
+{
+    struct vc_display *vd = display;
+
+    _check(vc_dispmanx_display_close(vd->display));
+    free(vd);
+}
+
+static uint32_t vc_resource_create(void *display, const RPIGRAFX_FORMAT_T format, const int width, const int height)
+{
+    DISPMANX_RESOURCE_HANDLE_T resource;
+    /*
+     * This is set by vc_dispmanx_resource_create but it's always 0 (NULL) for now.
+     * We simply ignore this value.
+     */
+    uint32_t vc_image_ptr;
+
+    (void) display;
+    /* xxx: 512x512 seems to be the maximum; larger images are tiled by display.c. */
+    resource = vc_dispmanx_resource_create(format_to_image_type(format), width, height, &vc_image_ptr);
+    if (resource == 0)
+        error_and_exit("vc_dispmanx_resource_create: %d\n", resource);
+    return resource;
+}
+
+static void vc_resource_delete(void *display, const uint32_t resource)
+{
+    (void) display;
+    _check(vc_dispmanx_resource_delete(resource));
+}
+
+static void vc_resource_write(void *display, const uint32_t resource, const RPIGRAFX_FORMAT_T format, const int pitch, void *p, const int width, const int y, const int height)
+{
+    VC_RECT_T rect;
+
+    (void) display;
+    /* vcdispmanx_resource_write_data() does not see rect.x. */
+    _check(vc_dispmanx_rect_set(&rect, 0, y, width, height));
+    _check(vc_dispmanx_resource_write_data(resource, format_to_image_type(format), pitch, p, &rect));
+}
+
+static void* vc_update_start(void *display)
+{
+    DISPMANX_UPDATE_HANDLE_T update;
+
+    (void) display;
+    update = vc_dispmanx_update_start(0);
+    if (update == DISPMANX_NO_HANDLE)
+        error_and_exit("vc_dispmanx_update_start");
+    return UPDATE_TO_PTR(update);
+}
+
+/* Called by dispmanx on its own thread when an update is on the screen. */
+static void update_callback(DISPMANX_UPDATE_HANDLE_T update, void *arg)
+{
+    struct vc_display *vd = arg;
+
+    (void) update;
+    vd->callback(vd->arg);
+}
+
+static void vc_update_submit(void *display, void *update, void (*callback)(void *arg), void *arg)
+{
+    struct vc_display *vd = display;
+
+    vd->callback = callback;
+    vd->arg = arg;
+    _check(vc_dispmanx_update_submit(PTR_TO_UPDATE(update), update_callback, vd));
+}
+
+static void vc_update_submit_sync(void *display, void *update)
+{
+    (void) display;
+    _check(vc_dispmanx_update_submit_sync(PTR_TO_UPDATE(update)));
+}
+
+/*
+ * Source alpha is mixed with the opacity, so that an opacity of 255 shows
+ * the pixels as they are.  Opacity level 0 is not visible.
+ */
+static uint32_t vc_element_add(void *display, void *update, const struct local_rpigrafx_element_attr *attr, const RPIGRAFX_RECT_T *dst, const uint32_t resource, const RPIGRAFX_RECT_T *src)
+{
+    struct vc_display *vd = display;
+    VC_RECT_T src_rect, dst_rect;
+    VC_DISPMANX_ALPHA_T alpha = {
+        .flags = attr->alpha == RPIGRAFX_ALPHA_FIXED
+                 ? DISPMANX_FLAGS_ALPHA_FIXED_ALL_PIXELS
+                 : DISPMANX_FLAGS_ALPHA_FROM_SOURCE | DISPMANX_FLAGS_ALPHA_MIX,
+        .opacity = attr->opacity,
+        .mask = DISPMANX_NO_HANDLE
+    };
+    DISPMANX_ELEMENT_HANDLE_T element;
+
+    set_rects(&dst_rect, &src_rect, dst, src);
+    element = vc_dispmanx_element_add(
+            PTR_TO_UPDATE(update), vd->display,
+            attr->layer,
+            &dst_rect,
+            resource,
+            &src_rect,
+            DISPMANX_PROTECTION_NONE,
+            &alpha, NULL, transform_to_dispmanx(attr->transform));
+    if (element == 0)
+        error_and_exit("vc_dispmanx_element_add: %d\n", element);
+    return element;
+}
+
+static void vc_element_remove(void *display, void *update, const uint32_t element)
+{
+    (void) display;
+    _check(vc_dispmanx_element_remove(PTR_TO_UPDATE(update), element));
+}
+
+static void vc_element_change(void *display, void *update, const uint32_t element, const struct local_rpigrafx_element_attr *attr, const RPIGRAFX_RECT_T *dst, const RPIGRAFX_RECT_T *src)
+{
+    VC_RECT_T src_rect, dst_rect;
+
+    (void) display;
+    set_rects(&dst_rect, &src_rect, dst, src);
+    _check(vc_dispmanx_element_change_attributes(
+            PTR_TO_UPDATE(update), element,
+            ELEMENT_CHANGE_LAYER | ELEMENT_CHANGE_OPACITY | ELEMENT_CHANGE_DEST_RECT
+            | ELEMENT_CHANGE_SRC_RECT | ELEMENT_CHANGE_TRANSFORM,
+            attr->layer, attr->opacity, &dst_rect, &src_rect, DISPMANX_NO_HANDLE,
+            transform_to_dispmanx(attr->transform)));
+}
+
+const struct local_rpigrafx_display_ops local_rpigrafx_vc_display_ops = {
+    .open = vc_open,
+    .close = vc_close,
+    .resource_create = vc_resource_create,
+    .resource_delete = vc_resource_delete,
+    .resource_write = vc_resource_write,
+    .update_start = vc_update_start,
+    .update_submit = vc_update_submit,
+    .update_submit_sync = vc_update_submit_sync,
+    .element_add = vc_element_add,
+    .element_remove = vc_element_remove,
+    .element_change = vc_element_change,
+};
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "local/error.h"
+#include "local/workers.h"
+
+/*
+ * Worker threads for the CPU resizer.
+ * A job is split into bands which the threads take one by one, so the
+ * bands need not be as many as the threads.  Jobs are run one at a time.
+ */
+struct local_rpigrafx_workers {
+    int num;
+    pthread_t *threads;
+
+    /* Serializes the jobs. */
+    pthread_mutex_t run_mutex;
+
+    /* Protects everything below. */
+    pthread_mutex_t mutex;
+    pthread_cond_t start_cond, done_cond;
+    /* Incremented for each job. */
+    unsigned generation;
+    local_rpigrafx_band_fn fn;
+    void *arg;
+    int num_bands, next_band, bands_done;
+    _Bool is_exiting;
+};
+
+
+/* Run the bands left of the current job.  Must be called with mutex held. */
+static void run_bands(struct local_rpigrafx_workers *w)
+{
+    const local_rpigrafx_band_fn fn = w->fn;
+    void *arg = w->arg;
+    const int num_bands = w->num_bands;
+    int band;
+
+    while (w->next_band < num_bands) {
+        band = w->next_band ++;
+        pthread_mutex_unlock(&w->mutex);
+        fn(arg, band, num_bands);
+        pthread_mutex_lock(&w->mutex);
+        if (++ w->bands_done == num_bands)
+            pthread_cond_signal(&w->done_cond);
+    }
+}
+
+static void* worker_main(void *arg)
+{
+    struct local_rpigrafx_workers *w = arg;
+    unsigned generation;
+
+    pthread_mutex_lock(&w->mutex);
+    generation = w->generation;
+    for (; ; ) {
+        while (w->generation == generation && !w->is_exiting)
+            pthread_cond_wait(&w->start_cond, &w->mutex);
+        if (w->is_exiting)
+            break;
+        generation = w->generation;
+        run_bands(w);
+    }
+    pthread_mutex_unlock(&w->mutex);
+    return NULL;
+}
+
+struct local_rpigrafx_workers* local_rpigrafx_create_workers(const int num)
+{
+    struct local_rpigrafx_workers *w = NULL;
+    int i;
+
+    if (num < 1)
+        error_and_exit("Invalid number of threads: %d\n", num);
+    w = calloc(1, sizeof(*w));
+    if (w == NULL)
+        error_and_exit("Failed to allocate workers\n");
+    w->num = num;
+    pthread_mutex_init(&w->run_mutex, NULL);
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->start_cond, NULL);
+    pthread_cond_init(&w->done_cond, NULL);
+    if (num == 1)
+        return w;
+
+    w->threads = calloc(num - 1, sizeof(*w->threads));
+    if (w->threads == NULL)
+        error_and_exit("Failed to allocate %d threads\n", num - 1);
+    for (i = 0; i < num - 1; i ++)
+        if (pthread_create(&w->threads[i], NULL, worker_main, w))
+            error_and_exit("Failed to create worker thread %d\n", i);
+    return w;
+}
+
+void local_rpigrafx_destroy_workers(struct local_rpigrafx_workers *w)
+{
+    int i;
+
+    pthread_mutex_lock(&w->mutex);
+    w->is_exiting = 1;
+    pthread_cond_broadcast(&w->start_cond);
+    pthread_mutex_unlock(&w->mutex);
+    for (i = 0; i < w->num - 1; i ++)
+        pthread_join(w->threads[i], NULL);
+    free(w->threads);
+    pthread_cond_destroy(&w->done_cond);
+    pthread_cond_destroy(&w->start_cond);
+    pthread_mutex_destroy(&w->mutex);
+    pthread_mutex_destroy(&w->run_mutex);
+    free(w);
+}
+
+int local_rpigrafx_workers_num(const struct local_rpigrafx_workers *w)
+{
+    return w != NULL ? w->num : 1;
+}
+
+/* Run fn on each of num_bands bands and return when all of them are done. */
+void local_rpigrafx_workers_run(struct local_rpigrafx_workers *w, local_rpigrafx_band_fn fn, void *arg, const int num_bands)
+{
+    int i;
+
+    if (w == NULL || w->num == 1 || num_bands == 1) {
+        for (i = 0; i < num_bands; i ++)
+            fn(arg, i, num_bands);
+        return;
+    }
+
+    pthread_mutex_lock(&w->run_mutex);
+    pthread_mutex_lock(&w->mutex);
+    w->fn = fn;
+    w->arg = arg;
+    w->num_bands = num_bands;
+    w->next_band = w->bands_done = 0;
+    w->generation ++;
+    pthread_cond_broadcast(&w->start_cond);
+    run_bands(w);
+    while (w->bands_done < num_bands)
+        pthread_cond_wait(&w->done_cond, &w->mutex);
+    pthread_mutex_unlock(&w->mutex);
+    pthread_mutex_unlock(&w->run_mutex);
+}
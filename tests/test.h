@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "rpigrafx.h"
+
+/*
+ * Helpers of the tests run by "make check".
+ * The tests run on the soft backend, whose camera and display are set up
+ * by the environment variables below unless a test sets them first.
+ */
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, __func__, #cond); \
+            exit(EXIT_FAILURE); \
+        } \
+    } while (0)
+
+/* A context of the soft backend with a small, unpaced camera and display. */
+static inline RPIGRAFX_CONTEXT_T* test_create_context()
+{
+    setenv("RPIGRAFX_SOFT_CAMERA_SIZE", "320x240", 0);
+    setenv("RPIGRAFX_SOFT_CAMERA_FPS", "0", 0);
+    setenv("RPIGRAFX_SOFT_DISPLAY_SIZE", "320x240", 0);
+    setenv("RPIGRAFX_SOFT_DISPLAY_HZ", "0", 0);
+    return rpigrafx_create_context_with_backend("soft");
+}
+
+/* Deterministic bytes for the inputs of the tests. */
+static inline uint32_t test_random(uint32_t *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return (*state >> 8) ^ (*state << 24);
+}
+
+#endif /* TEST_H */
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include "rpigrafx.h"
+#include "test.h"
+
+/*
+ * The per-frame path allocates nothing once the pools are sized: capture,
+ * a CPU-resized stream, immediate-mode boxes, an overlay of labels and a
+ * surface, committed every frame.  The allocation functions of libc are
+ * interposed by the ones below, which count the calls made by any thread
+ * while counting is on, library threads included.
+ * Needs glibc, which exports the functions they forward to.
+ */
+
+#define NUM_WARMUP_FRAMES 10
+#define NUM_FRAMES 50
+/* Exit status of a skipped test for "make check". */
+#define EXIT_SKIP 77
+
+#ifdef __GLIBC__
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void *p, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+
+static volatile int is_counting = 0;
+static volatile int num_allocs = 0;
+
+static void count_alloc()
+{
+    if (is_counting)
+        __sync_fetch_and_add(&num_allocs, 1);
+}
+
+void* malloc(size_t size)
+{
+    count_alloc();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+    count_alloc();
+    return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void *p, size_t size)
+{
+    count_alloc();
+    return __libc_realloc(p, size);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size)
+{
+    count_alloc();
+    *p = __libc_memalign(alignment, size);
+    return *p == NULL && size != 0 ? ENOMEM : 0;
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    count_alloc();
+    return __libc_memalign(alignment, size);
+}
+
+static void draw_frame(RPIGRAFX_CAMERA_T *cam, RPIGRAFX_STREAM_T *stream, RPIGRAFX_DISPLAY_T *disp,
+                       RPIGRAFX_OVERLAY_T *ov, RPIGRAFX_SURFACE_T *surf, const int i)
+{
+    RPIGRAFX_FRAME_T *f = NULL, *resized = NULL;
+    RPIGRAFX_BOX_T boxes[4];
+    RPIGRAFX_LABEL_T label = {4, 4, NULL, 2, RPIGRAFX_COLOR_WHITE, RPIGRAFX_COLOR_BLACK};
+    char text[32];
+    int j;
+
+    f = rpigrafx_camera_get_next_frame(cam, 1000);
+    CHECK(f != NULL);
+    resized = rpigrafx_get_stream_frame(f, stream);
+    rpigrafx_surface_write(surf, rpigrafx_frame_get_data(resized));
+
+    rpigrafx_display_remove_all_elements(disp);
+    for (j = 0; j < 4; j ++)
+        rpigrafx_display_draw_box(disp, j * 30 + i % 7, 150, j * 30 + 20, 190, 2, RPIGRAFX_COLOR_RED);
+    for (j = 0; j < 4; j ++) {
+        boxes[j].x = j * 40 + i % 5;
+        boxes[j].y = 60;
+        boxes[j].width = 30;
+        boxes[j].height = 20 + j;
+        boxes[j].border = 2;
+        boxes[j].color = RPIGRAFX_COLOR_GREEN;
+    }
+    rpigrafx_overlay_draw_boxes(ov, boxes, 4);
+    /* Of the same length every frame; a longer text than ever grows its buffer. */
+    snprintf(text, sizeof(text), "frame %4d", i);
+    label.text = text;
+    rpigrafx_overlay_draw_labels(ov, &label, 1);
+    rpigrafx_display_commit_drawings(disp);
+
+    rpigrafx_release_frame(resized);
+    rpigrafx_release_frame(f);
+}
+
+int main()
+{
+    RPIGRAFX_POOL_CONFIG_T config = {4, 64, 64, 1 << 20};
+    RPIGRAFX_POOL_STATS_T stats;
+    RPIGRAFX_CONTEXT_T *ctx = test_create_context();
+    RPIGRAFX_CAMERA_T *cam = NULL;
+    RPIGRAFX_STREAM_T *stream = NULL;
+    RPIGRAFX_DISPLAY_T *disp = NULL;
+    RPIGRAFX_OVERLAY_T *ov = NULL;
+    RPIGRAFX_SURFACE_T *surf = NULL;
+    int i;
+
+    rpigrafx_set_pool_config(ctx, &config);
+    cam = rpigrafx_open_camera(ctx, 0);
+    stream = rpigrafx_create_stream(cam, 160, 120, RPIGRAFX_FORMAT_RGBA32);
+    rpigrafx_stream_set_resizer(stream, RPIGRAFX_RESIZER_CPU, RPIGRAFX_FILTER_BILINEAR);
+    disp = rpigrafx_open_display(ctx, 0);
+    ov = rpigrafx_display_create_overlay(disp, 320, 240, 0, 0, 320, 240);
+    surf = rpigrafx_display_create_surface(disp, RPIGRAFX_FORMAT_RGBA32, 160, 120, 160, 0, 160, 120);
+    rpigrafx_camera_start_capture(cam);
+
+    /* Threads, layouts and the resources of the first frames. */
+    for (i = 0; i < NUM_WARMUP_FRAMES; i ++)
+        draw_frame(cam, stream, disp, ov, surf, i);
+
+    is_counting = 1;
+    for (; i < NUM_WARMUP_FRAMES + NUM_FRAMES; i ++)
+        draw_frame(cam, stream, disp, ov, surf, i);
+    is_counting = 0;
+    if (num_allocs != 0)
+        fprintf(stderr, "%d allocations in %d frames\n", num_allocs, NUM_FRAMES);
+    CHECK(num_allocs == 0);
+
+    rpigrafx_get_pool_stats(ctx, &stats);
+    CHECK(stats.grows == 0);
+
+    rpigrafx_camera_stop_capture(cam);
+    rpigrafx_destroy_surface(surf);
+    rpigrafx_destroy_overlay(ov);
+    rpigrafx_close_display(disp);
+    rpigrafx_destroy_stream(stream);
+    rpigrafx_close_camera(cam);
+    rpigrafx_destroy_context(ctx);
+    return 0;
+}
+
+#else /* __GLIBC__ */
+
+int main()
+{
+    printf("Allocations are counted only with glibc\n");
+    return EXIT_SKIP;
+}
+
+#endif /* __GLIBC__ */
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "rpigrafx.h"
+#include "test.h"
+
+/*
+ * Async capture and the lifetime of frames.
+ * The soft camera writes the frame number into the blue channel of every
+ * pixel, so a frame whose buffer is reused too early is caught by its
+ * pixels changing.
+ */
+
+#define NUM_FRAMES 30
+
+static uint32_t frame_sum(RPIGRAFX_FRAME_T *f)
+{
+    const uint8_t *p = rpigrafx_frame_get_data(f);
+    const int stride = rpigrafx_frame_get_stride(f);
+    uint32_t sum = 0;
+    int x, y;
+
+    for (y = 0; y < rpigrafx_frame_get_height(f); y ++)
+        for (x = 0; x < rpigrafx_frame_get_width(f) * 4; x ++)
+            sum = sum * 31 + p[y * stride + x];
+    return sum;
+}
+
+/*
+ * A consumer which keeps up with a paced camera, holding up to depth - 2
+ * frames at a time, sees every frame in order and none dropped.
+ */
+static void test_no_drops(RPIGRAFX_CONTEXT_T *ctx, const int depth)
+{
+    RPIGRAFX_CAMERA_T *cam = NULL;
+    RPIGRAFX_FRAME_T *held[16], *f = NULL;
+    uint64_t seq = 0;
+    int i, num_held = 0, dropped = 0;
+
+    setenv("RPIGRAFX_SOFT_CAMERA_FPS", "50", 1);
+    cam = rpigrafx_open_camera(ctx, 0);
+    setenv("RPIGRAFX_SOFT_CAMERA_FPS", "0", 1);
+    rpigrafx_camera_set_capture_buffer_num(cam, depth);
+    rpigrafx_camera_start_capture(cam);
+
+    for (i = 0; i < NUM_FRAMES; i ++) {
+        f = rpigrafx_camera_get_next_frame(cam, 1000);
+        CHECK(f != NULL);
+        if (i == 0)
+            seq = rpigrafx_frame_get_sequence(f);
+        CHECK(rpigrafx_frame_get_sequence(f) == seq + i);
+        dropped += rpigrafx_frame_get_dropped(f);
+        if (num_held == depth - 2) {
+            rpigrafx_release_frame(held[0]);
+            memmove(&held[0], &held[1], (num_held - 1) * sizeof(*held));
+            num_held --;
+        }
+        held[num_held ++] = f;
+    }
+    CHECK(dropped == 0);
+
+    while (num_held > 0)
+        rpigrafx_release_frame(held[-- num_held]);
+    rpigrafx_camera_stop_capture(cam);
+    rpigrafx_close_camera(cam);
+}
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * A consumer which falls behind a paced camera sees gaps in the sequence
+ * numbers, each reported as the dropped count of the frame after it, and
+ * the timestamps and receive times of the frames it gets go forward.
+ */
+static void test_sequence_gaps(RPIGRAFX_CONTEXT_T *ctx)
+{
+    const struct timespec stall = {0, 80000000};
+    RPIGRAFX_CAMERA_T *cam = NULL;
+    RPIGRAFX_FRAME_T *f = NULL;
+    uint64_t prev_seq = 0;
+    int64_t prev_ts = 0, prev_recv = 0;
+    int i, dropped = 0;
+
+    setenv("RPIGRAFX_SOFT_CAMERA_FPS", "100", 1);
+    cam = rpigrafx_open_camera(ctx, 0);
+    setenv("RPIGRAFX_SOFT_CAMERA_FPS", "0", 1);
+    rpigrafx_camera_set_capture_buffer_num(cam, 3);
+    rpigrafx_camera_start_capture(cam);
+
+    for (i = 0; i < NUM_FRAMES; i ++) {
+        /* 8 frame periods with 3 buffers: some frames have to go. */
+        if (i % 5 == 4)
+            nanosleep(&stall, NULL);
+        f = rpigrafx_camera_get_next_frame(cam, 1000);
+        CHECK(f != NULL);
+        if (i == 0)
+            CHECK(rpigrafx_frame_get_dropped(f) == (int) rpigrafx_frame_get_sequence(f));
+        else {
+            CHECK(rpigrafx_frame_get_sequence(f) > prev_seq);
+            CHECK(rpigrafx_frame_get_dropped(f) == (int) (rpigrafx_frame_get_sequence(f) - prev_seq - 1));
+            CHECK(rpigrafx_frame_get_timestamp(f) > prev_ts);
+            CHECK(rpigrafx_frame_get_receive_time(f) > prev_recv);
+        }
+        /* Both are of CLOCK_MONOTONIC, and the frame is received after it is captured. */
+        CHECK(rpigrafx_frame_get_receive_time(f) >= rpigrafx_frame_get_timestamp(f) * 1000);
+        CHECK(rpigrafx_frame_get_receive_time(f) <= now_ns());
+        dropped += rpigrafx_frame_get_dropped(f);
+        prev_seq = rpigrafx_frame_get_sequence(f);
+        prev_ts = rpigrafx_frame_get_timestamp(f);
+        prev_recv = rpigrafx_frame_get_receive_time(f);
+        rpigrafx_release_frame(f);
+    }
+    CHECK(dropped > 0);
+
+    rpigrafx_camera_stop_capture(cam);
+    rpigrafx_close_camera(cam);
+}
+
+/*
+ * A held frame keeps its buffer: the buffer is not handed out again and
+ * its pixels stay until the frame is released, and then it is reused.
+ */
+static void test_async_lifetime(RPIGRAFX_CONTEXT_T *ctx)
+{
+    RPIGRAFX_CAMERA_T *cam = rpigrafx_open_camera(ctx, 0);
+    RPIGRAFX_FRAME_T *held = NULL, *f = NULL;
+    uint32_t held_sum;
+    uint64_t held_seq;
+    void *held_data = NULL;
+    int i, is_reused = 0;
+
+    rpigrafx_camera_set_capture_buffer_num(cam, 3);
+    rpigrafx_camera_start_capture(cam);
+
+    held = rpigrafx_camera_get_next_frame(cam, -1);
+    held_sum = frame_sum(held);
+    held_seq = rpigrafx_frame_get_sequence(held);
+    held_data = rpigrafx_frame_get_data(held);
+
+    /* An extra reference outlives the first one. */
+    CHECK(rpigrafx_acquire_frame(held) == held);
+    rpigrafx_release_frame(held);
+
+    for (i = 0; i < NUM_FRAMES; i ++) {
+        f = rpigrafx_camera_get_next_frame(cam, -1);
+        CHECK(rpigrafx_frame_get_data(f) != held_data);
+        CHECK(rpigrafx_frame_get_sequence(f) > held_seq);
+        rpigrafx_release_frame(f);
+    }
+    CHECK(frame_sum(held) == held_sum);
+    CHECK(rpigrafx_frame_get_sequence(held) == held_seq);
+
+    rpigrafx_release_frame(held);
+    for (i = 0; i < NUM_FRAMES && !is_reused; i ++) {
+        f = rpigrafx_camera_get_latest_frame(cam);
+        is_reused = rpigrafx_frame_get_data(f) == held_data;
+        rpigrafx_release_frame(f);
+    }
+    CHECK(is_reused);
+
+    rpigrafx_camera_stop_capture(cam);
+    rpigrafx_close_camera(cam);
+}
+
+/*
+ * A frame handle of the synchronous path stays valid across the next
+ * captures, while the pointer of rpigrafx_camera_get_frame() moves on.
+ */
+static void test_sync_lifetime(RPIGRAFX_CONTEXT_T *ctx)
+{
+    RPIGRAFX_CAMERA_T *cam = rpigrafx_open_camera(ctx, 0);
+    RPIGRAFX_FRAME_T *held = NULL, *f = NULL;
+    uint32_t held_sum;
+    int i;
+
+    rpigrafx_camera_ignite_capture(cam);
+    held = rpigrafx_camera_get_frame_handle(cam);
+    held_sum = frame_sum(held);
+    CHECK(rpigrafx_camera_get_frame(cam) == rpigrafx_frame_get_data(held));
+
+    for (i = 0; i < 4; i ++) {
+        rpigrafx_camera_ignite_capture(cam);
+        CHECK(rpigrafx_camera_get_frame(cam) != rpigrafx_frame_get_data(held));
+        f = rpigrafx_camera_get_frame_handle(cam);
+        CHECK(rpigrafx_frame_get_sequence(f) == rpigrafx_frame_get_sequence(held) + i + 1);
+        rpigrafx_release_frame(f);
+    }
+    CHECK(frame_sum(held) == held_sum);
+
+    rpigrafx_release_frame(held);
+    rpigrafx_close_camera(cam);
+}
+
+int main()
+{
+    RPIGRAFX_CONTEXT_T *ctx = test_create_context();
+
+    test_no_drops(ctx, 3);
+    test_no_drops(ctx, 6);
+    test_sequence_gaps(ctx);
+    test_async_lifetime(ctx);
+    test_sync_lifetime(ctx);
+
+    rpigrafx_destroy_context(ctx);
+    return 0;
+}
@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "rpigrafx.h"
+#include "local/context.h"
+#include "local/soft.h"
+#include "test.h"
+
+/*
+ * Resource pooling, attribute changes, tiling and async commits, checked
+ * through the calls the soft display counts and the framebuffer it
+ * composites.
+ */
+
+#define NUM_FRAMES 20
+#define NUM_BOXES 30
+
+static void get_counts(RPIGRAFX_DISPLAY_T *disp, struct local_rpigrafx_soft_display_counts *counts)
+{
+    int display_num;
+
+    local_rpigrafx_soft_display_get_counts(local_rpigrafx_display_get_backend(disp, &display_num), counts);
+}
+
+static uint32_t read_pixel(RPIGRAFX_DISPLAY_T *disp, const int x, const int y)
+{
+    uint32_t *fb = NULL, val;
+    int width, height, display_num;
+
+    rpigrafx_display_get_screen_size(disp, &width, &height);
+    fb = malloc(width * height * 4);
+    CHECK(fb != NULL);
+    local_rpigrafx_soft_display_read_framebuffer(local_rpigrafx_display_get_backend(disp, &display_num), fb);
+    val = fb[y * width + x];
+    free(fb);
+    return val;
+}
+
+static int64_t now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Boxes redrawn every frame reuse the resources of earlier frames.  Those
+ * removed in a frame are on the screen until it is committed, so the first
+ * two frames create a set each and later frames create none.  Each box is
+ * one write.
+ */
+static void test_resource_reuse(RPIGRAFX_CONTEXT_T *ctx)
+{
+    RPIGRAFX_DISPLAY_T *disp = rpigrafx_open_display(ctx, 0);
+    struct local_rpigrafx_soft_display_counts first, before, after;
+    int i, j;
+
+    for (i = 0; i < NUM_FRAMES; i ++) {
+        get_counts(disp, &before);
+        rpigrafx_display_remove_all_elements(disp);
+        for (j = 0; j < NUM_BOXES; j ++)
+            rpigrafx_display_draw_box(disp, j * 8, j * 6, 40 + j % 3, 30, 2, RPIGRAFX_COLOR_RED);
+        rpigrafx_display_commit_drawings(disp);
+        get_counts(disp, &after);
+        CHECK(after.resource_writes - before.resource_writes == NUM_BOXES);
+        CHECK(after.updates - before.updates == 1);
+        if (i == 0)
+            CHECK(after.resources_created == NUM_BOXES);
+        if (i == 1) {
+            CHECK(after.resources_created == 2 * NUM_BOXES);
+            first = after;
+        }
+    }
+    CHECK(after.resources_created == first.resources_created);
+    CHECK(after.resources_deleted == 0);
+
+    /* A surface is written in place: no resource is created per frame. */
+    {
+        uint32_t image[64 * 48];
+        RPIGRAFX_SURFACE_T *surf = rpigrafx_display_create_surface(disp, RPIGRAFX_FORMAT_RGBA32, 64, 48, 0, 0, 64, 48);
+
+        memset(image, 0xff, sizeof(image));
+        rpigrafx_display_commit_drawings(disp);
+        get_counts(disp, &before);
+        for (i = 0; i < NUM_FRAMES; i ++) {
+            rpigrafx_surface_write(surf, image);
+            rpigrafx_display_commit_drawings(disp);
+        }
+        get_counts(disp, &after);
+        CHECK(after.resources_created == before.resources_created);
+        CHECK(after.resource_writes - before.resource_writes == NUM_FRAMES);
+        rpigrafx_destroy_surface(surf);
+    }
+
+    rpigrafx_close_display(disp);
+}
+
+/*
+ * The layer, alpha, transform and clip of a surface change on the screen
+ * with the next commit and write no resource: the same resources show the
+ * same pixels differently.
+ */
+static void test_attribute_changes(RPIGRAFX_CONTEXT_T *ctx)
+{
+    RPIGRAFX_DISPLAY_T *disp = rpigrafx_open_display(ctx, 0);
+    RPIGRAFX_SURFACE_T *surf = NULL;
+    struct local_rpigrafx_soft_display_counts before, after;
+    uint32_t image[64 * 48], background;
+    int x, y;
+
+    /* Red on the left half and blue on the right half. */
+    for (y = 0; y < 48; y ++)
+        for (x = 0; x < 64; x ++)
+            image[y * 64 + x] = x < 32 ? 0xff0000ff : 0xffff0000;
+    rpigrafx_display_commit_drawings(disp);
+    background = read_pixel(disp, 8, 8);
+
+    /* A box on the default layer 5, under the surface on layer 6. */
+    rpigrafx_display_draw_box(disp, 0, 0, 20, 20, 10, RPIGRAFX_COLOR_GREEN);
+    surf = rpigrafx_display_create_surface(disp, RPIGRAFX_FORMAT_RGBA32, 64, 48, 0, 0, 64, 48);
+    rpigrafx_surface_set_layer(surf, 6);
+    rpigrafx_surface_write(surf, image);
+    rpigrafx_display_commit_drawings(disp);
+    CHECK(read_pixel(disp, 8, 8) == 0xff0000ff);
+    CHECK(read_pixel(disp, 56, 8) == 0xffff0000);
+    get_counts(disp, &before);
+
+    rpigrafx_surface_set_layer(surf, 4);
+    rpigrafx_display_commit_drawings(disp);
+    CHECK(read_pixel(disp, 8, 8) == 0xff00ff00);
+    CHECK(read_pixel(disp, 56, 8) == 0xffff0000);
+    rpigrafx_surface_set_layer(surf, 6);
+
+    rpigrafx_surface_set_transform(surf, RPIGRAFX_TRANSFORM_FLIP_H);
+    rpigrafx_display_commit_drawings(disp);
+    CHECK(read_pixel(disp, 8, 8) == 0xffff0000);
+    CHECK(read_pixel(disp, 56, 8) == 0xff0000ff);
+    rpigrafx_surface_set_transform(surf, RPIGRAFX_TRANSFORM_NONE);
+
+    /* Adds the element again, but still writes nothing. */
+    rpigrafx_surface_set_alpha(surf, RPIGRAFX_ALPHA_FIXED, 0);
+    rpigrafx_display_commit_drawings(disp);
+    CHECK(read_pixel(disp, 8, 8) == 0xff00ff00);
+    CHECK(read_pixel(disp, 56, 8) == background);
+    rpigrafx_surface_set_alpha(surf, RPIGRAFX_ALPHA_SOURCE, 255);
+
+    rpigrafx_surface_set_clip(surf, 32, 0, 32, 48);
+    rpigrafx_display_commit_drawings(disp);
+    CHECK(read_pixel(disp, 8, 8) == 0xff00ff00);
+    CHECK(read_pixel(disp, 56, 8) == 0xffff0000);
+    rpigrafx_surface_reset_clip(surf);
+
+    rpigrafx_display_commit_drawings(disp);
+    CHECK(read_pixel(disp, 8, 8) == 0xff0000ff);
+    CHECK(read_pixel(disp, 56, 8) == 0xffff0000);
+
+    get_counts(disp, &after);
+    CHECK(after.resource_writes == before.resource_writes);
+    CHECK(after.resources_created == before.resources_created);
+    CHECK(after.resources_deleted == before.resources_deleted);
+    CHECK(after.updates - before.updates == 5);
+
+    rpigrafx_destroy_surface(surf);
+    rpigrafx_close_display(disp);
+}
+
+/*
+ * Check that the framebuffer at (x, y) is the image of width x height,
+ * whose rows are aligned to 32 bytes, as RGB24 if bpp is 3.
+ */
+static void check_image(RPIGRAFX_DISPLAY_T *disp, const uint8_t *image, const int bpp,
+                        const int x, const int y, const int width, const int height)
+{
+    const int pitch = (width * bpp + 31) & ~31;
+    uint8_t *fb = NULL, *q = NULL;
+    const uint8_t *s = NULL;
+    int screen_width, screen_height, display_num, i, j;
+
+    rpigrafx_display_get_screen_size(disp, &screen_width, &screen_height);
+    fb = malloc(screen_width * screen_height * 4);
+    CHECK(fb != NULL);
+    local_rpigrafx_soft_display_read_framebuffer(local_rpigrafx_display_get_backend(disp, &display_num), fb);
+    for (i = 0; i < height; i ++)
+        for (j = 0; j < width; j ++) {
+            q = fb + ((y + i) * screen_width + x + j) * 4;
+            s = image + i * pitch + j * bpp;
+            if (memcmp(q, s, 3) || q[3] != (bpp == 4 ? s[3] : 0xff)) {
+                fprintf(stderr, "Pixel (%d, %d) of the image differs\n", j, i);
+                CHECK(!memcmp(q, s, 3));
+                CHECK(q[3] == (bpp == 4 ? s[3] : 0xff));
+            }
+        }
+    free(fb);
+}
+
+/*
+ * Images larger than the tile size are split into a resource per tile,
+ * each written at the pitch of its resource, and put back together on the
+ * screen exactly, whatever the alignment of the width of the image.
+ */
+static void test_tiles(RPIGRAFX_CONTEXT_T *ctx)
+{
+    RPIGRAFX_DISPLAY_T *disp = rpigrafx_open_display(ctx, 0);
+    RPIGRAFX_SURFACE_T *surf = NULL;
+    struct local_rpigrafx_soft_display_counts before, after;
+    const int width = 203, height = 157;
+    uint8_t *image = NULL;
+    uint32_t state = 1;
+    int i;
+
+    rpigrafx_display_set_tile_size(disp, 64, 48);
+    image = malloc(((width * 4 + 31) & ~31) * height);
+    CHECK(image != NULL);
+
+    /* Opaque RGBA32 in 4 x 4 tiles. */
+    for (i = 0; i < ((width * 4 + 31) & ~31) * height; i ++)
+        image[i] = i % 4 == 3 ? 0xff : test_random(&state);
+    get_counts(disp, &before);
+    rpigrafx_display_render_image(disp, image, 7, 5, width, height);
+    rpigrafx_display_commit_drawings(disp);
+    get_counts(disp, &after);
+    CHECK(after.resource_writes - before.resource_writes == 4 * 4);
+    check_image(disp, image, 4, 7, 5, width, height);
+    rpigrafx_display_remove_all_elements(disp);
+
+    /* RGB24, whose rows of the image are not of the pitch of a tile. */
+    for (i = 0; i < ((width * 3 + 31) & ~31) * height; i ++)
+        image[i] = test_random(&state);
+    surf = rpigrafx_display_create_surface(disp, RPIGRAFX_FORMAT_RGB24, width, height, 11, 3, width, height);
+    rpigrafx_surface_write(surf, image);
+    rpigrafx_display_commit_drawings(disp);
+    check_image(disp, image, 3, 11, 3, width, height);
+
+    /* Rows across the boundary of two rows of tiles. */
+    for (i = 40 * ((width * 3 + 31) & ~31); i < 60 * ((width * 3 + 31) & ~31); i ++)
+        image[i] = test_random(&state);
+    rpigrafx_surface_write_rows(surf, image, 40, 20);
+    rpigrafx_display_commit_drawings(disp);
+    check_image(disp, image, 3, 11, 3, width, height);
+
+    rpigrafx_destroy_surface(surf);
+    free(image);
+    rpigrafx_close_display(disp);
+}
+
+/*
+ * An async commit returns before its vsync, the next frame is drawn while
+ * it is in flight, and only what was committed is on the screen.
+ */
+static void test_async_commit(RPIGRAFX_CONTEXT_T *ctx)
+{
+    RPIGRAFX_DISPLAY_T *disp = NULL;
+    int64_t t;
+
+    /* A vsync every 200 ms leaves plenty of time to draw in between. */
+    setenv("RPIGRAFX_SOFT_DISPLAY_HZ", "5", 1);
+    disp = rpigrafx_open_display(ctx, 0);
+    setenv("RPIGRAFX_SOFT_DISPLAY_HZ", "0", 1);
+
+    rpigrafx_display_draw_box(disp, 10, 10, 20, 20, 10, RPIGRAFX_COLOR_RED);
+    rpigrafx_display_commit_drawings(disp);
+    CHECK(read_pixel(disp, 15, 15) == 0xff0000ff);
+
+    rpigrafx_display_remove_all_elements(disp);
+    rpigrafx_display_draw_box(disp, 10, 10, 20, 20, 10, RPIGRAFX_COLOR_BLUE);
+    t = now_ms();
+    rpigrafx_display_commit_drawings_async(disp);
+    CHECK(now_ms() - t < 100);
+    CHECK(!rpigrafx_display_poll_drawings(disp));
+
+    /* Frame N + 1, drawn while frame N is in flight. */
+    rpigrafx_display_remove_all_elements(disp);
+    rpigrafx_display_draw_box(disp, 10, 10, 20, 20, 10, RPIGRAFX_COLOR_GREEN);
+    CHECK(!rpigrafx_display_wait_drawings(disp, 0));
+    CHECK(read_pixel(disp, 15, 15) == 0xff0000ff);
+
+    CHECK(rpigrafx_display_wait_drawings(disp, -1));
+    CHECK(rpigrafx_display_poll_drawings(disp));
+    CHECK(read_pixel(disp, 15, 15) == 0xffff0000);
+
+    rpigrafx_display_commit_drawings(disp);
+    CHECK(read_pixel(disp, 15, 15) == 0xff00ff00);
+
+    rpigrafx_close_display(disp);
+}
+
+int main()
+{
+    RPIGRAFX_CONTEXT_T *ctx = test_create_context();
+
+    test_resource_reuse(ctx);
+    test_attribute_changes(ctx);
+    test_tiles(ctx);
+    test_async_commit(ctx);
+
+    rpigrafx_destroy_context(ctx);
+    return 0;
+}
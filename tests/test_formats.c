@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "rpigrafx.h"
+#include "test.h"
+
+/*
+ * Frames of every format against references computed here from the
+ * captured RGBA32 frame: BT.601 limited range for luma and chroma, and
+ * chroma from the rounded average of each 2x2 block, the last column and
+ * row repeated for odd sizes.  The streams resize with the nearest filter,
+ * so that the references are exact.
+ */
+
+static int nearest(const int i, const int dst_len, const int src_len)
+{
+    return (int) ((int64_t) (2 * i + 1) * src_len / (2 * dst_len));
+}
+
+static int y_of(const int r, const int g, const int b)
+{
+    return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+static int u_of(const int r, const int g, const int b)
+{
+    return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+static int v_of(const int r, const int g, const int b)
+{
+    return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+/* Pixel (x, y) of the stream of width x height made from src. */
+static const uint8_t* source_pixel(RPIGRAFX_FRAME_T *src, const int width, const int height, int x, int y)
+{
+    if (x >= width)
+        x = width - 1;
+    if (y >= height)
+        y = height - 1;
+    x = nearest(x, width, rpigrafx_frame_get_width(src));
+    y = nearest(y, height, rpigrafx_frame_get_height(src));
+    return (const uint8_t*) rpigrafx_frame_get_data(src) + y * rpigrafx_frame_get_stride(src) + x * 4;
+}
+
+static void check_frame(RPIGRAFX_FRAME_T *f, RPIGRAFX_FRAME_T *src)
+{
+    const RPIGRAFX_FORMAT_T format = rpigrafx_frame_get_format(f);
+    const int width = rpigrafx_frame_get_width(f), height = rpigrafx_frame_get_height(f);
+    const uint8_t *planes[3], *s, *block[4];
+    int strides[3], num_planes, x, y, i, rgb[3], c;
+
+    num_planes = rpigrafx_frame_get_num_planes(f);
+    CHECK(num_planes == (format == RPIGRAFX_FORMAT_I420 ? 3 : format == RPIGRAFX_FORMAT_NV12 ? 2 : 1));
+    for (i = 0; i < num_planes; i ++) {
+        planes[i] = rpigrafx_frame_get_plane_data(f, i);
+        strides[i] = rpigrafx_frame_get_plane_stride(f, i);
+    }
+    CHECK(planes[0] == rpigrafx_frame_get_data(f));
+    CHECK(strides[0] == rpigrafx_frame_get_stride(f));
+
+    for (y = 0; y < height; y ++)
+        for (x = 0; x < width; x ++) {
+            s = source_pixel(src, width, height, x, y);
+            switch (format) {
+                case RPIGRAFX_FORMAT_RGBA32:
+                    CHECK(!memcmp(planes[0] + y * strides[0] + x * 4, s, 4));
+                    break;
+                case RPIGRAFX_FORMAT_RGB24:
+                    CHECK(!memcmp(planes[0] + y * strides[0] + x * 3, s, 3));
+                    break;
+                case RPIGRAFX_FORMAT_BGR24:
+                    for (c = 0; c < 3; c ++)
+                        CHECK(planes[0][y * strides[0] + x * 3 + c] == s[2 - c]);
+                    break;
+                default:
+                    CHECK(planes[0][y * strides[0] + x] == y_of(s[0], s[1], s[2]));
+                    break;
+            }
+        }
+    if (format != RPIGRAFX_FORMAT_I420 && format != RPIGRAFX_FORMAT_NV12)
+        return;
+
+    for (y = 0; y < height; y += 2)
+        for (x = 0; x < width; x += 2) {
+            block[0] = source_pixel(src, width, height, x, y);
+            block[1] = source_pixel(src, width, height, x + 1, y);
+            block[2] = source_pixel(src, width, height, x, y + 1);
+            block[3] = source_pixel(src, width, height, x + 1, y + 1);
+            for (c = 0; c < 3; c ++)
+                rgb[c] = (block[0][c] + block[1][c] + block[2][c] + block[3][c] + 2) >> 2;
+            if (format == RPIGRAFX_FORMAT_I420) {
+                CHECK(planes[1][y / 2 * strides[1] + x / 2] == u_of(rgb[0], rgb[1], rgb[2]));
+                CHECK(planes[2][y / 2 * strides[2] + x / 2] == v_of(rgb[0], rgb[1], rgb[2]));
+            } else {
+                CHECK(planes[1][y / 2 * strides[1] + x] == u_of(rgb[0], rgb[1], rgb[2]));
+                CHECK(planes[1][y / 2 * strides[1] + x + 1] == v_of(rgb[0], rgb[1], rgb[2]));
+            }
+        }
+}
+
+int main()
+{
+    static const int sizes[][2] = {
+        {320, 240},
+        {150, 75},
+        {33, 17},
+    };
+    RPIGRAFX_CONTEXT_T *ctx = test_create_context();
+    RPIGRAFX_CAMERA_T *cam = rpigrafx_open_camera(ctx, 0);
+    RPIGRAFX_STREAM_T *stream = NULL;
+    RPIGRAFX_FRAME_T *full = NULL, *f = NULL;
+    RPIGRAFX_FORMAT_T format;
+    int i;
+
+    for (format = RPIGRAFX_FORMAT_MIN + 1; format < RPIGRAFX_FORMAT_MAX; format ++)
+        for (i = 0; i < (int) (sizeof(sizes) / sizeof(sizes[0])); i ++) {
+            stream = rpigrafx_create_stream(cam, sizes[i][0], sizes[i][1], format);
+            rpigrafx_stream_set_resizer(stream, RPIGRAFX_RESIZER_CPU, RPIGRAFX_FILTER_NEAREST);
+            rpigrafx_camera_ignite_capture(cam);
+            full = rpigrafx_camera_get_frame_handle(cam);
+            f = rpigrafx_get_stream_frame(full, stream);
+            CHECK(rpigrafx_frame_get_format(f) == format);
+            CHECK(rpigrafx_frame_get_width(f) == sizes[i][0]);
+            CHECK(rpigrafx_frame_get_height(f) == sizes[i][1]);
+            check_frame(f, full);
+            rpigrafx_release_frame(f);
+            rpigrafx_release_frame(full);
+            rpigrafx_destroy_stream(stream);
+        }
+
+    rpigrafx_close_camera(cam);
+    rpigrafx_destroy_context(ctx);
+    return 0;
+}
@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "rpigrafx.h"
+#include "local/draw.h"
+#include "test.h"
+
+/*
+ * The SIMD pixel kernels against the scalar ones, on every length up to a
+ * few vectors and at every alignment of 4-byte pixels, so that the vector
+ * loops and their tails are both exercised.
+ */
+
+#define MAX_LEN 67
+/* Pixels around each output which must not be touched. */
+#define GUARD 8
+
+static uint32_t state = 1;
+
+static void fill_random(void *p, const int size)
+{
+    uint8_t *d = p;
+    int i;
+
+    for (i = 0; i < size; i ++)
+        d[i] = test_random(&state);
+}
+
+static void test_fill_span(const struct local_rpigrafx_draw_kernels *k)
+{
+    uint32_t ref[MAX_LEN + 2 * GUARD], out[MAX_LEN + 2 * GUARD];
+    int n, off;
+
+    for (n = 0; n <= MAX_LEN; n ++)
+        for (off = 0; off < 4; off ++) {
+            fill_random(ref, sizeof(ref));
+            memcpy(out, ref, sizeof(out));
+            local_rpigrafx_fill_span_rgba32_scalar(ref + GUARD + off, n, 0x12345678);
+            k->fill_span_rgba32(out + GUARD + off, n, 0x12345678);
+            CHECK(!memcmp(ref, out, sizeof(out)));
+        }
+}
+
+static void test_swap_rb(const struct local_rpigrafx_draw_kernels *k)
+{
+    uint32_t src[MAX_LEN + 4], ref[MAX_LEN + 2 * GUARD], out[MAX_LEN + 2 * GUARD];
+    int n, off;
+
+    for (n = 0; n <= MAX_LEN; n ++)
+        for (off = 0; off < 4; off ++) {
+            fill_random(src, sizeof(src));
+            fill_random(ref, sizeof(ref));
+            memcpy(out, ref, sizeof(out));
+            local_rpigrafx_swap_rb_rgba32_scalar(ref + GUARD, src + off, n);
+            k->swap_rb_rgba32(out + GUARD, src + off, n);
+            CHECK(!memcmp(ref, out, sizeof(out)));
+        }
+    /* In place, as the BGR24 conversion does it. */
+    fill_random(src, sizeof(src));
+    memcpy(ref, src, sizeof(src));
+    local_rpigrafx_swap_rb_rgba32_scalar(ref, ref, MAX_LEN);
+    k->swap_rb_rgba32(src, src, MAX_LEN);
+    CHECK(!memcmp(ref, src, MAX_LEN * 4));
+}
+
+static void test_rgb24(const struct local_rpigrafx_draw_kernels *k)
+{
+    uint32_t src[MAX_LEN + 4], ref[MAX_LEN + 2 * GUARD], out[MAX_LEN + 2 * GUARD];
+    uint8_t src24[(MAX_LEN + 4) * 3], ref24[(MAX_LEN + 2 * GUARD) * 3], out24[(MAX_LEN + 2 * GUARD) * 3];
+    int n, off;
+
+    for (n = 0; n <= MAX_LEN; n ++)
+        for (off = 0; off < 4; off ++) {
+            fill_random(src, sizeof(src));
+            fill_random(ref24, sizeof(ref24));
+            memcpy(out24, ref24, sizeof(out24));
+            local_rpigrafx_rgba32_to_rgb24_scalar(ref24 + GUARD * 3, src + off, n);
+            k->rgba32_to_rgb24(out24 + GUARD * 3, src + off, n);
+            CHECK(!memcmp(ref24, out24, sizeof(out24)));
+
+            fill_random(src24, sizeof(src24));
+            fill_random(ref, sizeof(ref));
+            memcpy(out, ref, sizeof(out));
+            local_rpigrafx_rgb24_to_rgba32_scalar(ref + GUARD, src24 + off * 3, n);
+            k->rgb24_to_rgba32(out + GUARD, src24 + off * 3, n);
+            CHECK(!memcmp(ref, out, sizeof(out)));
+        }
+}
+
+static void test_lerp_rows(const struct local_rpigrafx_draw_kernels *k)
+{
+    uint32_t a[MAX_LEN], b[MAX_LEN], ref[MAX_LEN + 2 * GUARD], out[MAX_LEN + 2 * GUARD];
+    static const int weights[] = {1, 2, 64, 127, 128, 129, 200, 254, 255};
+    int n, w;
+
+    for (n = 0; n <= MAX_LEN; n ++)
+        for (w = 0; w < (int) (sizeof(weights) / sizeof(weights[0])); w ++) {
+            fill_random(a, sizeof(a));
+            fill_random(b, sizeof(b));
+            fill_random(ref, sizeof(ref));
+            memcpy(out, ref, sizeof(out));
+            local_rpigrafx_lerp_rows_rgba32_scalar(ref + GUARD, a, b, weights[w], n);
+            k->lerp_rows_rgba32(out + GUARD, a, b, weights[w], n);
+            CHECK(!memcmp(ref, out, sizeof(out)));
+        }
+}
+
+static void test_sum_cells(const struct local_rpigrafx_draw_kernels *k)
+{
+    enum {MAX_CELLS = 19};
+    uint32_t src[MAX_CELLS * 8 + 4], ref[MAX_CELLS + 2 * GUARD], out[MAX_CELLS + 2 * GUARD];
+    uint8_t gray[MAX_CELLS * 8 + 4];
+    int n, off;
+
+    for (n = 0; n <= MAX_CELLS; n ++)
+        for (off = 0; off < 4; off ++) {
+            /* The sums are added to, and can be large already. */
+            fill_random(src, sizeof(src));
+            fill_random(ref, sizeof(ref));
+            memcpy(out, ref, sizeof(out));
+            local_rpigrafx_sum_cells_rgba32_scalar(ref + GUARD, src + off, n);
+            k->sum_cells_rgba32(out + GUARD, src + off, n);
+            CHECK(!memcmp(ref, out, sizeof(out)));
+
+            fill_random(gray, sizeof(gray));
+            fill_random(ref, sizeof(ref));
+            memcpy(out, ref, sizeof(out));
+            local_rpigrafx_sum_cells_gray8_scalar(ref + GUARD, gray + off, n);
+            k->sum_cells_gray8(out + GUARD, gray + off, n);
+            CHECK(!memcmp(ref, out, sizeof(out)));
+        }
+    /* The largest sums of a cell. */
+    memset(src, 0xff, sizeof(src));
+    memset(ref, 0, sizeof(ref));
+    memset(out, 0, sizeof(out));
+    local_rpigrafx_sum_cells_rgba32_scalar(ref, src, MAX_CELLS);
+    k->sum_cells_rgba32(out, src, MAX_CELLS);
+    CHECK(ref[0] == 8 * 4 * 255);
+    CHECK(!memcmp(ref, out, sizeof(out)));
+}
+
+static void test_sad(const struct local_rpigrafx_draw_kernels *k)
+{
+    enum {MAX_BYTES = 4 * MAX_LEN};
+    uint8_t a[MAX_BYTES + 4], b[MAX_BYTES + 4];
+    int n, off;
+
+    for (n = 0; n <= MAX_BYTES; n ++)
+        for (off = 0; off < 4; off ++) {
+            fill_random(a, sizeof(a));
+            fill_random(b, sizeof(b));
+            CHECK(k->sad_u8(a + off, b + (3 - off), n) == local_rpigrafx_sad_u8_scalar(a + off, b + (3 - off), n));
+        }
+    /* Differences of 255 both ways, which overflow 8 and 16 bits when summed. */
+    for (n = 0; n < MAX_BYTES; n ++) {
+        a[n] = n % 2 ? 0xff : 0;
+        b[n] = n % 2 ? 0 : 0xff;
+    }
+    CHECK(k->sad_u8(a, b, MAX_BYTES) == 255 * MAX_BYTES);
+}
+
+/* Identity, normalization, saturation at both ends and int8 as the tensors use them. */
+static const struct local_rpigrafx_tensor_params tensor_params[] = {
+    {{1, 1, 1, 0}, {0, 0, 0, 0}, 0, 0},
+    {{1 / (255 * 0.229f), 1 / (255 * 0.224f), 1 / (255 * 0.225f), 0}, {-2.1f, -2.0f, -1.8f, 0}, 1, 0},
+    {{1.5f, 0.7f, 2, 0}, {-40, 30.3f, -255, 0}, 0, 0},
+    {{1, 1, 1, 0}, {0 + 128, -60 + 128, 20 + 128, 0}, 1, 0x80},
+};
+
+static void test_tensor_f32(const struct local_rpigrafx_draw_kernels *k, const struct local_rpigrafx_tensor_params *p)
+{
+    uint32_t src[MAX_LEN + 4];
+    float ref[3][MAX_LEN + 2 * GUARD], out[3][MAX_LEN + 2 * GUARD];
+    float pref[(MAX_LEN + 2 * GUARD) * 3], pout[(MAX_LEN + 2 * GUARD) * 3];
+    int n, off;
+
+    for (n = 0; n <= MAX_LEN; n ++)
+        for (off = 0; off < 4; off ++) {
+            fill_random(src, sizeof(src));
+            fill_random(ref, sizeof(ref));
+            memcpy(out, ref, sizeof(out));
+            local_rpigrafx_rgba32_to_planar_f32_scalar((float *const[3]) {ref[0] + GUARD, ref[1] + GUARD, ref[2] + GUARD}, src + off, p, n);
+            k->rgba32_to_planar_f32((float *const[3]) {out[0] + GUARD, out[1] + GUARD, out[2] + GUARD}, src + off, p, n);
+            CHECK(!memcmp(ref, out, sizeof(out)));
+
+            fill_random(pref, sizeof(pref));
+            memcpy(pout, pref, sizeof(pout));
+            local_rpigrafx_rgba32_to_packed_f32_scalar(pref + GUARD * 3, src + off, p, n);
+            k->rgba32_to_packed_f32(pout + GUARD * 3, src + off, p, n);
+            CHECK(!memcmp(pref, pout, sizeof(pout)));
+        }
+}
+
+static void test_tensor_u8(const struct local_rpigrafx_draw_kernels *k, const struct local_rpigrafx_tensor_params *p)
+{
+    uint32_t src[MAX_LEN + 4];
+    uint8_t ref[3][MAX_LEN + 2 * GUARD], out[3][MAX_LEN + 2 * GUARD];
+    uint8_t pref[(MAX_LEN + 2 * GUARD) * 3], pout[(MAX_LEN + 2 * GUARD) * 3];
+    int n, off;
+
+    for (n = 0; n <= MAX_LEN; n ++)
+        for (off = 0; off < 4; off ++) {
+            fill_random(src, sizeof(src));
+            fill_random(ref, sizeof(ref));
+            memcpy(out, ref, sizeof(out));
+            local_rpigrafx_rgba32_to_planar_u8_scalar((uint8_t *const[3]) {ref[0] + GUARD, ref[1] + GUARD, ref[2] + GUARD}, src + off, p, n);
+            k->rgba32_to_planar_u8((uint8_t *const[3]) {out[0] + GUARD, out[1] + GUARD, out[2] + GUARD}, src + off, p, n);
+            CHECK(!memcmp(ref, out, sizeof(out)));
+
+            fill_random(pref, sizeof(pref));
+            memcpy(pout, pref, sizeof(pout));
+            local_rpigrafx_rgba32_to_packed_u8_scalar(pref + GUARD * 3, src + off, p, n);
+            k->rgba32_to_packed_u8(pout + GUARD * 3, src + off, p, n);
+            CHECK(!memcmp(pref, pout, sizeof(pout)));
+        }
+}
+
+static void test_tensor(const struct local_rpigrafx_draw_kernels *k)
+{
+    int i;
+
+    for (i = 0; i < (int) (sizeof(tensor_params) / sizeof(tensor_params[0])); i ++) {
+        if (k->rgba32_to_planar_f32 != NULL && k->rgba32_to_packed_f32 != NULL)
+            test_tensor_f32(k, &tensor_params[i]);
+        if (k->rgba32_to_planar_u8 != NULL && k->rgba32_to_packed_u8 != NULL)
+            test_tensor_u8(k, &tensor_params[i]);
+    }
+}
+
+static void test_kernels(const struct local_rpigrafx_draw_kernels *k)
+{
+    if (k->fill_span_rgba32 != NULL)
+        test_fill_span(k);
+    if (k->swap_rb_rgba32 != NULL)
+        test_swap_rb(k);
+    if (k->rgba32_to_rgb24 != NULL && k->rgb24_to_rgba32 != NULL)
+        test_rgb24(k);
+    if (k->lerp_rows_rgba32 != NULL)
+        test_lerp_rows(k);
+    if (k->sum_cells_rgba32 != NULL && k->sum_cells_gray8 != NULL)
+        test_sum_cells(k);
+    if (k->sad_u8 != NULL)
+        test_sad(k);
+    test_tensor(k);
+}
+
+/* Outlines touch exactly the border pixels of the part of the rect in the image. */
+static void test_outline()
+{
+    enum {WIDTH = 37, HEIGHT = 23, STRIDE = 40};
+    uint32_t image[STRIDE * HEIGHT];
+    static const struct {
+        int x, y, w, h, border;
+    } rects[] = {
+        {0, 0, WIDTH, HEIGHT, 1},
+        {3, 2, 20, 10, 3},
+        {-5, -4, 17, 13, 4},
+        {30, 18, 20, 20, 6},
+        {5, 5, 7, 9, 100},
+    };
+    int i, x, y, bw, bh, is_border;
+
+    for (i = 0; i < (int) (sizeof(rects) / sizeof(rects[0])); i ++) {
+        memset(image, 0, sizeof(image));
+        local_rpigrafx_outline_rgba32(image, STRIDE, WIDTH, HEIGHT, rects[i].x, rects[i].y, rects[i].w, rects[i].h,
+                                      rects[i].border, 0xffffffff);
+        bw = rects[i].border <= rects[i].w / 2 ? rects[i].border : rects[i].w / 2;
+        bh = rects[i].border <= rects[i].h / 2 ? rects[i].border : rects[i].h / 2;
+        for (y = 0; y < HEIGHT; y ++)
+            for (x = 0; x < STRIDE; x ++) {
+                is_border = x < WIDTH
+                            && x >= rects[i].x && x < rects[i].x + rects[i].w
+                            && y >= rects[i].y && y < rects[i].y + rects[i].h
+                            && (x < rects[i].x + bw || x >= rects[i].x + rects[i].w - bw
+                                || y < rects[i].y + bh || y >= rects[i].y + rects[i].h - bh);
+                CHECK(image[y * STRIDE + x] == (is_border ? 0xffffffff : 0));
+            }
+    }
+}
+
+int main()
+{
+    printf("Selected kernels: %s\n", local_rpigrafx_draw_kernels_name());
+#ifdef __SSE2__
+    test_kernels(&local_rpigrafx_draw_kernels_sse2);
+#endif
+#ifdef HAVE_NEON
+    /* Selected only if the CPU has NEON. */
+    if (!strcmp(local_rpigrafx_draw_kernels_name(), "neon"))
+        test_kernels(&local_rpigrafx_draw_kernels_neon);
+#endif
+    test_outline();
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "rpigrafx.h"
+#include "test.h"
+
+/*
+ * The motion detector on synthetic sequences of gray images: the tiles
+ * changed, the score and the reset on a change of size, the same in every
+ * format.  A tile is 5 x 5 cells of 8 x 8 pixels here.
+ */
+
+#define TILES_X 4
+#define TILES_Y 3
+#define WIDTH 160
+#define HEIGHT 120
+#define THRESHOLD 10
+#define NUM_CELLS ((WIDTH / 8) * (HEIGHT / 8))
+
+static const RPIGRAFX_FORMAT_T formats[] = {
+    RPIGRAFX_FORMAT_RGBA32,
+    RPIGRAFX_FORMAT_RGB24,
+    RPIGRAFX_FORMAT_BGR24,
+    RPIGRAFX_FORMAT_GRAY8,
+};
+
+static uint8_t image[(WIDTH + 8) * 4 * HEIGHT];
+
+/* Fill the image with gray level v, and level v + d in rect, if any. */
+static int make_image(const RPIGRAFX_FORMAT_T format, const int width, const int v, const RPIGRAFX_RECT_T *rect, const int d)
+{
+    const int bpp = format == RPIGRAFX_FORMAT_RGBA32 ? 4 : format == RPIGRAFX_FORMAT_GRAY8 ? 1 : 3;
+    const int stride = ((width * bpp + 31) & ~31);
+    int x, y, c, level;
+
+    for (y = 0; y < HEIGHT; y ++)
+        for (x = 0; x < width; x ++) {
+            level = v;
+            if (rect != NULL && x >= rect->x && x < rect->x + rect->width && y >= rect->y && y < rect->y + rect->height)
+                level += d;
+            for (c = 0; c < bpp; c ++)
+                image[y * stride + x * bpp + c] = c == 3 ? 0xff : level;
+        }
+    return stride;
+}
+
+static int update(RPIGRAFX_MOTION_DETECTOR_T *det, const RPIGRAFX_FORMAT_T format, const int width,
+                  const int v, const RPIGRAFX_RECT_T *rect, const int d)
+{
+    const int stride = make_image(format, width, v, rect, d);
+
+    return rpigrafx_motion_detector_update_image(det, image, format, width, HEIGHT, stride);
+}
+
+/* Only tile (tx, ty) is flagged, or none if tx is -1. */
+static void check_changed(RPIGRAFX_MOTION_DETECTOR_T *det, const int tx, const int ty)
+{
+    const uint8_t *changed = rpigrafx_motion_detector_get_changed_tiles(det);
+    int x, y;
+
+    for (y = 0; y < TILES_Y; y ++)
+        for (x = 0; x < TILES_X; x ++)
+            CHECK(!!changed[y * TILES_X + x] == (x == tx && y == ty));
+    CHECK(rpigrafx_motion_detector_get_num_changed(det) == (tx >= 0));
+}
+
+static void test_sequence(const RPIGRAFX_FORMAT_T format)
+{
+    RPIGRAFX_MOTION_DETECTOR_T *det = rpigrafx_create_motion_detector(TILES_X, TILES_Y, THRESHOLD);
+    RPIGRAFX_RECT_T rect;
+    int i;
+
+    /* The first image changed everywhere. */
+    CHECK(update(det, format, WIDTH, 100, NULL, 0) == TILES_X * TILES_Y);
+    CHECK(rpigrafx_motion_detector_get_score(det) == 255);
+
+    CHECK(update(det, format, WIDTH, 100, NULL, 0) == 0);
+    check_changed(det, -1, -1);
+    CHECK(rpigrafx_motion_detector_get_score(det) == 0);
+
+    /* A change over one tile, brighter and then back. */
+    rpigrafx_motion_detector_get_tile_rect(det, 2, 1, &rect);
+    CHECK(rect.x == 80 && rect.y == 40 && rect.width == 40 && rect.height == 40);
+    CHECK(update(det, format, WIDTH, 100, &rect, 50) == 1);
+    check_changed(det, 2, 1);
+    CHECK(rpigrafx_motion_detector_get_score(det) == (float) (25 * 50) / NUM_CELLS);
+    CHECK(update(det, format, WIDTH, 100, NULL, 0) == 1);
+    check_changed(det, 2, 1);
+
+    /* A tile changes if the mean difference of its cells is above the threshold. */
+    rpigrafx_motion_detector_get_tile_rect(det, 0, 2, &rect);
+    CHECK(update(det, format, WIDTH, 100, &rect, -THRESHOLD) == 0);
+    check_changed(det, -1, -1);
+    CHECK(rpigrafx_motion_detector_get_score(det) == (float) (25 * THRESHOLD) / NUM_CELLS);
+    CHECK(update(det, format, WIDTH, 100, &rect, 1) == 1);
+    check_changed(det, 0, 2);
+
+    /* A change of one cell of a tile is averaged over the 25 cells. */
+    CHECK(update(det, format, WIDTH, 0, NULL, 0) == TILES_X * TILES_Y);
+    rect.width = 8;
+    rect.height = 8;
+    for (i = 0; i < 2; i ++) {
+        CHECK(update(det, format, WIDTH, 0, &rect, 25 * THRESHOLD) == 0);
+        CHECK(update(det, format, WIDTH, 0, NULL, 0) == 0);
+    }
+    CHECK(update(det, format, WIDTH, 0, &rect, 25 * THRESHOLD + 1) == 1);
+    check_changed(det, 0, 2);
+    CHECK(rpigrafx_motion_detector_get_score(det) == (float) (25 * THRESHOLD + 1) / NUM_CELLS);
+
+    /* Another size starts over. */
+    CHECK(update(det, format, WIDTH + 8, 100, NULL, 0) == TILES_X * TILES_Y);
+    CHECK(rpigrafx_motion_detector_get_score(det) == 255);
+    CHECK(update(det, format, WIDTH + 8, 100, NULL, 0) == 0);
+
+    rpigrafx_destroy_motion_detector(det);
+}
+
+/*
+ * Pixels right of the last whole cell are not looked at, and the tiles at
+ * the edge cover them.
+ */
+static void test_partial_cells()
+{
+    RPIGRAFX_MOTION_DETECTOR_T *det = rpigrafx_create_motion_detector(TILES_X, TILES_Y, THRESHOLD);
+    const RPIGRAFX_RECT_T rect = {WIDTH, 0, 5, HEIGHT};
+    RPIGRAFX_RECT_T tile;
+
+    update(det, RPIGRAFX_FORMAT_GRAY8, WIDTH + 5, 100, NULL, 0);
+    CHECK(update(det, RPIGRAFX_FORMAT_GRAY8, WIDTH + 5, 100, &rect, 100) == 0);
+    CHECK(rpigrafx_motion_detector_get_score(det) == 0);
+
+    rpigrafx_motion_detector_get_tile_rect(det, TILES_X - 1, TILES_Y - 1, &tile);
+    CHECK(tile.x == 120 && tile.y == 80 && tile.width == 45 && tile.height == 40);
+
+    rpigrafx_destroy_motion_detector(det);
+}
+
+int main()
+{
+    int i;
+
+    for (i = 0; i < (int) (sizeof(formats) / sizeof(formats[0])); i ++)
+        test_sequence(formats[i]);
+    test_partial_cells();
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "rpigrafx.h"
+#include "local/record.h"
+#include "test.h"
+
+/*
+ * Frames written by a recorder come back from the recording and from the
+ * soft camera replaying it, with their pixels and timestamps.  A recording
+ * smaller than the frames written keeps the newest ones.
+ */
+
+#define NUM_FRAMES 8
+#define FRAME_SIZE (320 * 240 * 4)
+
+static uint32_t sums[NUM_FRAMES];
+static int64_t timestamps[NUM_FRAMES];
+
+static uint32_t data_sum(const uint8_t *p, const int size)
+{
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < size; i ++)
+        sum = sum * 31 + p[i];
+    return sum;
+}
+
+/*
+ * Record NUM_FRAMES frames of the camera, each followed by a frame of a
+ * GRAY8 stream, which the replay skips.
+ */
+static void record(RPIGRAFX_CONTEXT_T *ctx, const char *path, const int64_t size)
+{
+    RPIGRAFX_RECORDER_T *rec = rpigrafx_create_recorder(path, size);
+    RPIGRAFX_CAMERA_T *cam = rpigrafx_open_camera(ctx, 0);
+    RPIGRAFX_STREAM_T *stream = rpigrafx_create_stream(cam, 160, 120, RPIGRAFX_FORMAT_GRAY8);
+    RPIGRAFX_FRAME_T *f = NULL, *gray = NULL;
+    int i;
+
+    for (i = 0; i < NUM_FRAMES; i ++) {
+        rpigrafx_camera_ignite_capture(cam);
+        f = rpigrafx_camera_get_frame_handle(cam);
+        CHECK(rpigrafx_frame_get_stride(f) * rpigrafx_frame_get_height(f) == FRAME_SIZE);
+        sums[i] = data_sum(rpigrafx_frame_get_data(f), FRAME_SIZE);
+        timestamps[i] = rpigrafx_frame_get_timestamp(f);
+        rpigrafx_recorder_write_frame(rec, f);
+        gray = rpigrafx_get_stream_frame(f, stream);
+        rpigrafx_recorder_write_frame(rec, gray);
+        rpigrafx_release_frame(gray);
+        rpigrafx_release_frame(f);
+    }
+
+    rpigrafx_destroy_stream(stream);
+    rpigrafx_close_camera(cam);
+    rpigrafx_destroy_recorder(rec);
+}
+
+/* The recording holds the frames from first on, each followed by its GRAY8 frame. */
+static void check_recording(const char *path, const int first)
+{
+    struct local_rpigrafx_recording *r = local_rpigrafx_open_recording(path);
+    struct local_rpigrafx_recorded_frame rf;
+    int i;
+
+    CHECK(local_rpigrafx_recording_num_frames(r) == 2 * (NUM_FRAMES - first));
+    for (i = first; i < NUM_FRAMES; i ++) {
+        local_rpigrafx_recording_get_frame(r, 2 * (i - first), &rf);
+        CHECK(rf.width == 320 && rf.height == 240 && rf.format == RPIGRAFX_FORMAT_RGBA32);
+        CHECK(rf.size == FRAME_SIZE);
+        CHECK(rf.timestamp == timestamps[i]);
+        CHECK(data_sum(rf.data, rf.size) == sums[i]);
+        local_rpigrafx_recording_get_frame(r, 2 * (i - first) + 1, &rf);
+        CHECK(rf.width == 160 && rf.height == 120 && rf.format == RPIGRAFX_FORMAT_GRAY8);
+        CHECK(rf.timestamp == timestamps[i]);
+    }
+    local_rpigrafx_close_recording(r);
+}
+
+/* The soft camera replays the RGBA32 frames over and over. */
+static void check_replay(const char *path)
+{
+    RPIGRAFX_CONTEXT_T *ctx = NULL;
+    RPIGRAFX_CAMERA_T *cam = NULL;
+    RPIGRAFX_FRAME_T *f = NULL;
+    int i;
+
+    setenv("RPIGRAFX_SOFT_CAMERA_REPLAY", path, 1);
+    ctx = test_create_context();
+    cam = rpigrafx_open_camera(ctx, 0);
+    unsetenv("RPIGRAFX_SOFT_CAMERA_REPLAY");
+
+    for (i = 0; i < 2 * NUM_FRAMES; i ++) {
+        rpigrafx_camera_ignite_capture(cam);
+        f = rpigrafx_camera_get_frame_handle(cam);
+        CHECK(rpigrafx_frame_get_width(f) == 320 && rpigrafx_frame_get_height(f) == 240);
+        CHECK(rpigrafx_frame_get_timestamp(f) == timestamps[i % NUM_FRAMES]);
+        CHECK(data_sum(rpigrafx_frame_get_data(f), FRAME_SIZE) == sums[i % NUM_FRAMES]);
+        rpigrafx_release_frame(f);
+    }
+
+    rpigrafx_close_camera(cam);
+    rpigrafx_destroy_context(ctx);
+}
+
+int main()
+{
+    char path[] = "/tmp/rpigrafx-record-XXXXXX";
+    RPIGRAFX_CONTEXT_T *ctx = test_create_context();
+    int fd;
+
+    fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+
+    /* Room for all the frames. */
+    record(ctx, path, (int64_t) 4 * NUM_FRAMES * FRAME_SIZE);
+    check_recording(path, 0);
+    check_replay(path);
+
+    /*
+     * Room for fewer than 4 pairs of frames: the oldest are overwritten, and
+     * the ring wraps around its end.
+     */
+    record(ctx, path, (int64_t) 4 * (FRAME_SIZE + FRAME_SIZE / 16));
+    check_recording(path, NUM_FRAMES - 3);
+
+    rpigrafx_destroy_context(ctx);
+    unlink(path);
+    return 0;
+}
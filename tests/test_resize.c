@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "rpigrafx.h"
+#include "local/camera.h"
+#include "local/resize.h"
+#include "local/workers.h"
+#include "test.h"
+
+/*
+ * The CPU resizer against references in floating point: nearest exactly,
+ * area within 1 level and bilinear within 2, all on pixel centers.  The
+ * output does not depend on the number of threads, and converting in bands
+ * gives what converting the whole RGBA32 image does.
+ */
+
+#define SRC_WIDTH 197
+#define SRC_HEIGHT 143
+#define SRC_STRIDE (224 * 4)
+#define MAX_THREADS 8
+
+static uint8_t src[SRC_STRIDE * SRC_HEIGHT];
+
+static const RPIGRAFX_RECT_T rects[] = {
+    {0, 0, SRC_WIDTH, SRC_HEIGHT},
+    /* A region at an odd place. */
+    {13, 7, 150, 101},
+};
+
+static const int sizes[][2] = {
+    {64, 48},
+    {33, 17},
+    {300, 211},
+};
+
+/* Value of channel c at (x, y) of the source, the edges repeated. */
+static int src_at(int x, int y, const int c, const RPIGRAFX_RECT_T *r)
+{
+    x = x < 0 ? 0 : x >= r->width ? r->width - 1 : x;
+    y = y < 0 ? 0 : y >= r->height ? r->height - 1 : y;
+    return src[(r->y + y) * SRC_STRIDE + (r->x + x) * 4 + c];
+}
+
+static double bilinear_ref(const int i, const int j, const int c, const RPIGRAFX_RECT_T *r, const int dst_width, const int dst_height)
+{
+    double x = (i + 0.5) * r->width / dst_width - 0.5, y = (j + 0.5) * r->height / dst_height - 0.5;
+    double fx, fy;
+    int x0, y0;
+
+    x = x < 0 ? 0 : x > r->width - 1 ? r->width - 1 : x;
+    y = y < 0 ? 0 : y > r->height - 1 ? r->height - 1 : y;
+    x0 = (int) x;
+    y0 = (int) y;
+    fx = x - x0;
+    fy = y - y0;
+    return (src_at(x0, y0, c, r) * (1 - fx) + src_at(x0 + 1, y0, c, r) * fx) * (1 - fy)
+            + (src_at(x0, y0 + 1, c, r) * (1 - fx) + src_at(x0 + 1, y0 + 1, c, r) * fx) * fy;
+}
+
+/* Overlap of [lo, hi) with pixel k, in pixels. */
+static double overlap(const double lo, const double hi, const int k)
+{
+    const double a = lo > k ? lo : k, b = hi < k + 1 ? hi : k + 1;
+
+    return b > a ? b - a : 0;
+}
+
+static double area_ref(const int i, const int j, const int c, const RPIGRAFX_RECT_T *r, const int dst_width, const int dst_height)
+{
+    const double x0 = (double) i * r->width / dst_width, x1 = (double) (i + 1) * r->width / dst_width;
+    const double y0 = (double) j * r->height / dst_height, y1 = (double) (j + 1) * r->height / dst_height;
+    double sum = 0;
+    int x, y;
+
+    for (y = (int) y0; y < y1; y ++)
+        for (x = (int) x0; x < x1; x ++)
+            sum += overlap(x0, x1, x) * overlap(y0, y1, y) * src_at(x, y, c, r);
+    return sum / ((x1 - x0) * (y1 - y0));
+}
+
+static uint8_t* resize(const RPIGRAFX_FILTER_T filter, const RPIGRAFX_FORMAT_T format, const int width, const int height,
+                       const RPIGRAFX_RECT_T *r, struct local_rpigrafx_workers *workers, const int num_bands)
+{
+    struct local_rpigrafx_resizer *rs = NULL;
+    int num_planes, offsets[MAX_PLANES], strides[MAX_PLANES], size;
+    uint8_t *dst = NULL;
+
+    size = local_rpigrafx_frame_layout(format, width, height, &num_planes, offsets, strides);
+    dst = calloc(1, size);
+    CHECK(dst != NULL);
+    rs = local_rpigrafx_create_resizer(filter, format, width, height, SRC_WIDTH, SRC_HEIGHT, num_bands);
+    local_rpigrafx_resize(rs, workers, dst, src, SRC_STRIDE, r);
+    local_rpigrafx_destroy_resizer(rs);
+    return dst;
+}
+
+static void test_references(const RPIGRAFX_FILTER_T filter, const RPIGRAFX_RECT_T *r, const int width, const int height)
+{
+    const int stride = ((width + 31) & ~31) * 4;
+    uint8_t *dst = resize(filter, RPIGRAFX_FORMAT_RGBA32, width, height, r, NULL, 1);
+    double ref;
+    int i, j, c, v;
+
+    for (j = 0; j < height; j ++)
+        for (i = 0; i < width; i ++)
+            for (c = 0; c < 4; c ++) {
+                v = dst[j * stride + i * 4 + c];
+                switch (filter) {
+                    case RPIGRAFX_FILTER_NEAREST:
+                        ref = src_at((2 * i + 1) * r->width / (2 * width), (2 * j + 1) * r->height / (2 * height), c, r);
+                        CHECK(v == ref);
+                        break;
+                    case RPIGRAFX_FILTER_BILINEAR:
+                        ref = bilinear_ref(i, j, c, r, width, height);
+                        CHECK(v - ref <= 2 && ref - v <= 2);
+                        break;
+                    default:
+                        ref = area_ref(i, j, c, r, width, height);
+                        CHECK(v - ref <= 1 && ref - v <= 1);
+                        break;
+                }
+            }
+    free(dst);
+}
+
+/* Any number of threads and bands gives the output of one. */
+static void test_threads(const RPIGRAFX_FILTER_T filter, const RPIGRAFX_FORMAT_T format, const RPIGRAFX_RECT_T *r,
+                         const int width, const int height, struct local_rpigrafx_workers **workers)
+{
+    int num_planes, offsets[MAX_PLANES], strides[MAX_PLANES], size, n;
+    uint8_t *expected = resize(filter, format, width, height, r, NULL, 1), *dst = NULL;
+
+    size = local_rpigrafx_frame_layout(format, width, height, &num_planes, offsets, strides);
+    for (n = 1; n <= MAX_THREADS; n ++) {
+        dst = resize(filter, format, width, height, r, workers[n - 1], n);
+        CHECK(!memcmp(dst, expected, size));
+        free(dst);
+    }
+    free(expected);
+}
+
+/* Converted in bands while resizing, and as a whole after. */
+static void test_conversion(const RPIGRAFX_FILTER_T filter, const RPIGRAFX_FORMAT_T format, const RPIGRAFX_RECT_T *r,
+                            const int width, const int height, struct local_rpigrafx_workers *workers)
+{
+    int num_planes, offsets[MAX_PLANES], strides[MAX_PLANES], size;
+    int rgba_planes, rgba_offsets[MAX_PLANES], rgba_strides[MAX_PLANES];
+    uint8_t *banded = resize(filter, format, width, height, r, workers, MAX_THREADS);
+    uint8_t *rgba = resize(filter, RPIGRAFX_FORMAT_RGBA32, width, height, r, NULL, 1), *whole = NULL;
+
+    size = local_rpigrafx_frame_layout(format, width, height, &num_planes, offsets, strides);
+    local_rpigrafx_frame_layout(RPIGRAFX_FORMAT_RGBA32, width, height, &rgba_planes, rgba_offsets, rgba_strides);
+    whole = calloc(1, size);
+    CHECK(whole != NULL);
+    local_rpigrafx_convert_rgba32(whole, format, offsets, strides, rgba, rgba_strides[0], width, height);
+    CHECK(!memcmp(banded, whole, size));
+    free(whole);
+    free(rgba);
+    free(banded);
+}
+
+int main()
+{
+    struct local_rpigrafx_workers *workers[MAX_THREADS];
+    RPIGRAFX_FILTER_T filter;
+    RPIGRAFX_FORMAT_T format;
+    uint32_t state = 1;
+    int i, j;
+
+    for (i = 0; i < (int) sizeof(src); i ++)
+        src[i] = test_random(&state);
+    for (i = 0; i < MAX_THREADS; i ++)
+        workers[i] = local_rpigrafx_create_workers(i + 1);
+
+    for (filter = RPIGRAFX_FILTER_MIN + 1; filter < RPIGRAFX_FILTER_MAX; filter ++)
+        for (i = 0; i < (int) (sizeof(rects) / sizeof(rects[0])); i ++)
+            for (j = 0; j < (int) (sizeof(sizes) / sizeof(sizes[0])); j ++) {
+                test_references(filter, &rects[i], sizes[j][0], sizes[j][1]);
+                for (format = RPIGRAFX_FORMAT_MIN + 1; format < RPIGRAFX_FORMAT_MAX; format ++) {
+                    test_threads(filter, format, &rects[i], sizes[j][0], sizes[j][1], workers);
+                    test_conversion(filter, format, &rects[i], sizes[j][0], sizes[j][1], workers[MAX_THREADS - 1]);
+                }
+            }
+
+    for (i = 0; i < MAX_THREADS; i ++)
+        local_rpigrafx_destroy_workers(workers[i]);
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "rpigrafx.h"
+#include "test.h"
+
+/*
+ * A subscriber in a child process reads a ring which the parent publishes
+ * to in steps: the frames in order, the frames dropped when the ring laps
+ * the subscriber, the newest frame, a frame kept until its slot is
+ * rewritten, and a wait woken by a publication.
+ * Each step starts when the child asks for it, and the child checks what
+ * it reads once the parent has published all the frames of the step.
+ */
+
+#define NUM_SLOTS 4
+#define WIDTH 64
+#define HEIGHT 48
+
+/* Frames published by each step. */
+static const int steps[] = {3, 10, 5, 3, 1, 1};
+
+/* Publication n holds n in its bytes, timestamp 1000 n and sequence n. */
+static void publish(RPIGRAFX_PUBLISHER_T *pub, const uint64_t n)
+{
+    memset(rpigrafx_publisher_begin_frame(pub), (uint8_t) n, WIDTH * HEIGHT);
+    rpigrafx_publisher_end_frame(pub, 1000 * n, 0, n);
+}
+
+static void check_frame(RPIGRAFX_SUBSCRIBER_T *sub, const RPIGRAFX_SHARED_FRAME_T *f, const uint64_t n, const uint64_t dropped)
+{
+    CHECK(f->publication == n);
+    CHECK(f->dropped == dropped);
+    CHECK(f->sequence == n && f->timestamp == (int64_t) (1000 * n));
+    CHECK(f->width == WIDTH && f->height == HEIGHT && f->format == RPIGRAFX_FORMAT_GRAY8);
+    CHECK(((const uint8_t*) f->data)[0] == (uint8_t) n && ((const uint8_t*) f->data)[WIDTH * HEIGHT - 1] == (uint8_t) n);
+    CHECK(rpigrafx_subscriber_is_frame_valid(sub, f));
+}
+
+/* Ask the parent for the next step and wait until it has been published. */
+static void step(const int to_parent, const int from_parent)
+{
+    char c = 0;
+
+    CHECK(write(to_parent, &c, 1) == 1);
+    CHECK(read(from_parent, &c, 1) == 1);
+}
+
+static void subscribe(const char *name, const int to_parent, const int from_parent)
+{
+    RPIGRAFX_SUBSCRIBER_T *sub = rpigrafx_open_subscriber(name);
+    RPIGRAFX_SHARED_FRAME_T f, kept;
+    int width, height, i;
+    RPIGRAFX_FORMAT_T format;
+    char c = 0;
+
+    rpigrafx_subscriber_get_frame_size(sub, &width, &height, &format);
+    CHECK(width == WIDTH && height == HEIGHT && format == RPIGRAFX_FORMAT_GRAY8);
+
+    /* 0 to 2 in order, then nothing more. */
+    step(to_parent, from_parent);
+    for (i = 0; i < 3; i ++) {
+        CHECK(rpigrafx_subscriber_get_next_frame(sub, &f, 1000));
+        check_frame(sub, &f, i, 0);
+    }
+    CHECK(!rpigrafx_subscriber_get_next_frame(sub, &f, 0));
+    CHECK(!rpigrafx_subscriber_get_next_frame(sub, &f, 50));
+
+    /* 3 to 12 lap the ring, which keeps the last NUM_SLOTS - 1. */
+    step(to_parent, from_parent);
+    CHECK(rpigrafx_subscriber_get_next_frame(sub, &f, 1000));
+    check_frame(sub, &f, 13 - (NUM_SLOTS - 1), 10 - (NUM_SLOTS - 1));
+    for (i = 14 - (NUM_SLOTS - 1); i < 13; i ++) {
+        CHECK(rpigrafx_subscriber_get_next_frame(sub, &f, 1000));
+        check_frame(sub, &f, i, 0);
+    }
+    CHECK(!rpigrafx_subscriber_get_next_frame(sub, &f, 0));
+
+    /* The newest of 13 to 17, the others dropped. */
+    step(to_parent, from_parent);
+    CHECK(rpigrafx_subscriber_get_latest_frame(sub, &kept, 1000));
+    check_frame(sub, &kept, 17, 4);
+    CHECK(!rpigrafx_subscriber_get_latest_frame(sub, &f, 0));
+
+    /* 18 to 20 leave its slot alone, and 21 rewrites it. */
+    step(to_parent, from_parent);
+    CHECK(rpigrafx_subscriber_is_frame_valid(sub, &kept));
+    step(to_parent, from_parent);
+    CHECK(!rpigrafx_subscriber_is_frame_valid(sub, &kept));
+    CHECK(rpigrafx_subscriber_get_latest_frame(sub, &f, 0));
+    check_frame(sub, &f, 21, 3);
+
+    /* Asleep before 22 is published. */
+    CHECK(write(to_parent, &c, 1) == 1);
+    CHECK(rpigrafx_subscriber_get_next_frame(sub, &f, 5000));
+    check_frame(sub, &f, 22, 0);
+    CHECK(read(from_parent, &c, 1) == 1);
+
+    rpigrafx_close_subscriber(sub);
+}
+
+int main()
+{
+    char name[64];
+    RPIGRAFX_PUBLISHER_T *pub = NULL;
+    int to_parent[2], from_parent[2], status, i, j;
+    uint64_t n = 0;
+    pid_t pid;
+    char c;
+
+    snprintf(name, sizeof(name), "/rpigrafx-test-shm-%d", (int) getpid());
+    pub = rpigrafx_create_publisher(name, WIDTH, HEIGHT, RPIGRAFX_FORMAT_GRAY8, NUM_SLOTS);
+    CHECK(!pipe(to_parent) && !pipe(from_parent));
+
+    pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        close(to_parent[0]);
+        close(from_parent[1]);
+        subscribe(name, to_parent[1], from_parent[0]);
+        exit(EXIT_SUCCESS);
+    }
+    close(to_parent[1]);
+    close(from_parent[0]);
+
+    /* A child which failed closes its end of the pipe. */
+    for (i = 0; i < (int) (sizeof(steps) / sizeof(steps[0])) && read(to_parent[0], &c, 1) == 1; i ++) {
+        /* Give the child time to sleep on the ring before the last one. */
+        if (i == (int) (sizeof(steps) / sizeof(steps[0])) - 1)
+            usleep(100000);
+        for (j = 0; j < steps[i]; j ++)
+            publish(pub, n ++);
+        CHECK(write(from_parent[1], &c, 1) == 1);
+    }
+
+    CHECK(waitpid(pid, &status, 0) == pid);
+    rpigrafx_destroy_publisher(pub);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "rpigrafx.h"
+#include "test.h"
+
+/*
+ * The statistics after a known number of frames, commits and elements.
+ * Skipped unless the library is configured with --enable-stats.
+ */
+
+#define NUM_FRAMES 10
+/* Exit status of a skipped test for "make check". */
+#define EXIT_SKIP 77
+
+static void sleep_ms(const int ms)
+{
+    const struct timespec ts = {ms / 1000, ms % 1000 * 1000000};
+
+    nanosleep(&ts, NULL);
+}
+
+/* Synchronous captures through a resized default stream. */
+static void test_sync_capture(RPIGRAFX_CONTEXT_T *ctx)
+{
+    RPIGRAFX_CAMERA_T *cam = rpigrafx_open_camera(ctx, 0);
+    RPIGRAFX_STATS_T s;
+    RPIGRAFX_FRAME_T *f = NULL;
+    int i;
+
+    rpigrafx_camera_set_frame_size(cam, 160, 120);
+    rpigrafx_reset_stats(ctx);
+    for (i = 0; i < NUM_FRAMES; i ++) {
+        rpigrafx_camera_ignite_capture(cam);
+        f = rpigrafx_camera_get_frame_handle(cam);
+        rpigrafx_release_frame(f);
+    }
+    rpigrafx_close_camera(cam);
+
+    CHECK(rpigrafx_get_stats(ctx, &s));
+    CHECK(s.counters[RPIGRAFX_COUNTER_FRAMES_CAPTURED] == NUM_FRAMES);
+    CHECK(s.counters[RPIGRAFX_COUNTER_FRAMES_DROPPED] == 0);
+    /* Every captured buffer went back to the pool, the last one at close. */
+    CHECK(s.counters[RPIGRAFX_COUNTER_BUFFERS_RECYCLED] == NUM_FRAMES);
+    CHECK(s.stages[RPIGRAFX_STAGE_CAPTURE_WAIT].count == NUM_FRAMES);
+    CHECK(s.stages[RPIGRAFX_STAGE_RESIZE].count == NUM_FRAMES);
+    CHECK(s.stages[RPIGRAFX_STAGE_RESIZE].min_ns <= s.stages[RPIGRAFX_STAGE_RESIZE].max_ns);
+    CHECK(s.stages[RPIGRAFX_STAGE_RESIZE].total_ns >= NUM_FRAMES * s.stages[RPIGRAFX_STAGE_RESIZE].min_ns);
+}
+
+/*
+ * A consumer which falls behind an unpaced camera: the frames it skips
+ * are counted as dropped, exactly as many as the frames it gets report,
+ * and every buffer is recycled once capture stops.
+ */
+static void test_async_drops(RPIGRAFX_CONTEXT_T *ctx)
+{
+    RPIGRAFX_CAMERA_T *cam = rpigrafx_open_camera(ctx, 0);
+    RPIGRAFX_STATS_T s;
+    RPIGRAFX_FRAME_T *f = NULL;
+    uint64_t dropped = 0;
+    int i;
+
+    rpigrafx_camera_set_capture_buffer_num(cam, 3);
+    rpigrafx_reset_stats(ctx);
+    rpigrafx_camera_start_capture(cam);
+    for (i = 0; i < NUM_FRAMES; i ++) {
+        sleep_ms(i % 2 == 0 ? 20 : 0);
+        f = i % 2 == 0 ? rpigrafx_camera_get_latest_frame(cam) : rpigrafx_camera_get_next_frame(cam, -1);
+        dropped += rpigrafx_frame_get_dropped(f);
+        rpigrafx_release_frame(f);
+    }
+    rpigrafx_camera_stop_capture(cam);
+
+    CHECK(rpigrafx_get_stats(ctx, &s));
+    CHECK(dropped > 0);
+    CHECK(s.counters[RPIGRAFX_COUNTER_FRAMES_DROPPED] == dropped);
+    CHECK(s.counters[RPIGRAFX_COUNTER_FRAMES_CAPTURED] >= NUM_FRAMES + dropped);
+    CHECK(s.counters[RPIGRAFX_COUNTER_BUFFERS_RECYCLED] == s.counters[RPIGRAFX_COUNTER_FRAMES_CAPTURED]);
+    CHECK(s.stages[RPIGRAFX_STAGE_CAPTURE_WAIT].count == NUM_FRAMES);
+    rpigrafx_close_camera(cam);
+}
+
+/* Commits of boxes: each commit, element, resource and write is counted. */
+static void test_commits(RPIGRAFX_CONTEXT_T *ctx)
+{
+    RPIGRAFX_DISPLAY_T *disp = rpigrafx_open_display(ctx, 0);
+    RPIGRAFX_STATS_T s;
+    int i, j;
+
+    rpigrafx_reset_stats(ctx);
+    for (i = 0; i < NUM_FRAMES; i ++) {
+        rpigrafx_display_remove_all_elements(disp);
+        for (j = 0; j <= i % 4; j ++)
+            rpigrafx_display_draw_box(disp, j * 20, 0, 16, 16, 2, RPIGRAFX_COLOR_GREEN);
+        rpigrafx_display_commit_drawings(disp);
+    }
+    rpigrafx_close_display(disp);
+
+    CHECK(rpigrafx_get_stats(ctx, &s));
+    /* 1 + 2 + 3 + 4 + 1 + 2 + 3 + 4 + 1 + 2 boxes. */
+    CHECK(s.counters[RPIGRAFX_COUNTER_COMMITS] == NUM_FRAMES);
+    CHECK(s.counters[RPIGRAFX_COUNTER_ELEMENTS] == 23);
+    CHECK(s.max_elements == 4);
+    CHECK(s.counters[RPIGRAFX_COUNTER_RESOURCES_CREATED] + s.counters[RPIGRAFX_COUNTER_RESOURCES_REUSED] == 23);
+    CHECK(s.counters[RPIGRAFX_COUNTER_RESOURCES_REUSED] > 0);
+    CHECK(s.stages[RPIGRAFX_STAGE_RESOURCE_WRITE].count == 23);
+    CHECK(s.stages[RPIGRAFX_STAGE_VSYNC_WAIT].count == NUM_FRAMES);
+}
+
+int main()
+{
+    RPIGRAFX_CONTEXT_T *ctx = test_create_context();
+    RPIGRAFX_STATS_T s;
+
+    if (!rpigrafx_get_stats(ctx, &s)) {
+        printf("Statistics are compiled out; configure with --enable-stats\n");
+        rpigrafx_destroy_context(ctx);
+        return EXIT_SKIP;
+    }
+    test_sync_capture(ctx);
+    test_async_drops(ctx);
+    test_commits(ctx);
+
+    rpigrafx_destroy_context(ctx);
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "rpigrafx.h"
+#include "test.h"
+
+/*
+ * Streams and ROI streams.
+ * The CPU resizer with the nearest filter takes, for destination pixel i of
+ * n, the source pixel whose center is the nearest to its center, so every
+ * output pixel is checked against the captured frame exactly.
+ */
+
+static int nearest(const int i, const int dst_len, const int src_start, const int src_len)
+{
+    return src_start + (int) ((int64_t) (2 * i + 1) * src_len / (2 * dst_len));
+}
+
+static const uint8_t* pixel(RPIGRAFX_FRAME_T *f, const int x, const int y)
+{
+    return (const uint8_t*) rpigrafx_frame_get_data(f) + y * rpigrafx_frame_get_stride(f) + x * 4;
+}
+
+/* BT.601 limited range, as the library converts. */
+static uint8_t luma(const uint8_t *p)
+{
+    return ((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16;
+}
+
+/* dst shows rect of the captured frame src. */
+static void check_resized(RPIGRAFX_FRAME_T *dst, RPIGRAFX_FRAME_T *src, const RPIGRAFX_RECT_T *rect)
+{
+    const int width = rpigrafx_frame_get_width(dst), height = rpigrafx_frame_get_height(dst);
+    const uint8_t *d = rpigrafx_frame_get_data(dst), *s = NULL;
+    const int stride = rpigrafx_frame_get_stride(dst);
+    int x, y;
+
+    CHECK(rpigrafx_frame_get_sequence(dst) == rpigrafx_frame_get_sequence(src));
+    CHECK(rpigrafx_frame_get_timestamp(dst) == rpigrafx_frame_get_timestamp(src));
+    for (y = 0; y < height; y ++)
+        for (x = 0; x < width; x ++) {
+            s = pixel(src, nearest(x, width, rect->x, rect->width), nearest(y, height, rect->y, rect->height));
+            switch (rpigrafx_frame_get_format(dst)) {
+                case RPIGRAFX_FORMAT_RGBA32:
+                    CHECK(!memcmp(d + y * stride + x * 4, s, 4));
+                    break;
+                case RPIGRAFX_FORMAT_GRAY8:
+                    CHECK(d[y * stride + x] == luma(s));
+                    break;
+                default:
+                    CHECK(!"unexpected format");
+            }
+        }
+}
+
+/* Each stream gets its own size and format from the same captured frame. */
+static void test_streams(RPIGRAFX_CAMERA_T *cam)
+{
+    RPIGRAFX_STREAM_T *streams[3];
+    RPIGRAFX_FRAME_T *full = NULL, *f = NULL;
+    RPIGRAFX_RECT_T rect = {0, 0, 0, 0};
+    static const struct {
+        int width, height;
+        RPIGRAFX_FORMAT_T format;
+    } configs[3] = {
+        {160, 120, RPIGRAFX_FORMAT_RGBA32},
+        {100,  60, RPIGRAFX_FORMAT_GRAY8},
+        {320, 240, RPIGRAFX_FORMAT_RGBA32},
+    };
+    int i, j;
+
+    rpigrafx_camera_get_frame_full_size(cam, &rect.width, &rect.height);
+    for (i = 0; i < 3; i ++) {
+        streams[i] = rpigrafx_create_stream(cam, configs[i].width, configs[i].height, configs[i].format);
+        rpigrafx_stream_set_resizer(streams[i], RPIGRAFX_RESIZER_CPU, RPIGRAFX_FILTER_NEAREST);
+    }
+
+    for (j = 0; j < 3; j ++) {
+        rpigrafx_camera_ignite_capture(cam);
+        full = rpigrafx_camera_get_frame_handle(cam);
+        for (i = 0; i < 3; i ++) {
+            f = rpigrafx_get_stream_frame(full, streams[i]);
+            CHECK(rpigrafx_frame_get_width(f) == configs[i].width);
+            CHECK(rpigrafx_frame_get_height(f) == configs[i].height);
+            CHECK(rpigrafx_frame_get_format(f) == configs[i].format);
+            /* The frame of a stream is made once per captured frame. */
+            CHECK(rpigrafx_get_stream_frame(full, streams[i]) == f);
+            rpigrafx_release_frame(f);
+            check_resized(f, full, &rect);
+            rpigrafx_release_frame(f);
+        }
+        rpigrafx_release_frame(full);
+    }
+
+    for (i = 0; i < 3; i ++)
+        rpigrafx_destroy_stream(streams[i]);
+}
+
+/* Each ROI is cropped from the captured frame and scaled to the stream size. */
+static void test_rois(RPIGRAFX_CAMERA_T *cam)
+{
+    static const RPIGRAFX_RECT_T rois[4] = {
+        {0, 0, 320, 240},
+        {100, 50, 128, 64},
+        {287, 201, 33, 39},
+        {10, 20, 7, 5},
+    };
+    RPIGRAFX_STREAM_T *stream = rpigrafx_create_roi_stream(cam, 64, 48, RPIGRAFX_FORMAT_RGBA32, 4);
+    RPIGRAFX_FRAME_T *full = NULL, *frames[4];
+    int i;
+
+    rpigrafx_stream_set_resizer(stream, RPIGRAFX_RESIZER_CPU, RPIGRAFX_FILTER_NEAREST);
+    rpigrafx_camera_ignite_capture(cam);
+    full = rpigrafx_camera_get_frame_handle(cam);
+    rpigrafx_get_roi_frames(full, stream, rois, 4, frames);
+    for (i = 0; i < 4; i ++) {
+        CHECK(rpigrafx_frame_get_width(frames[i]) == 64);
+        CHECK(rpigrafx_frame_get_height(frames[i]) == 48);
+        check_resized(frames[i], full, &rois[i]);
+    }
+    /* The ROIs have their own buffers. */
+    for (i = 1; i < 4; i ++)
+        CHECK(rpigrafx_frame_get_data(frames[i]) != rpigrafx_frame_get_data(frames[0]));
+    for (i = 0; i < 4; i ++)
+        rpigrafx_release_frame(frames[i]);
+    rpigrafx_release_frame(full);
+    rpigrafx_destroy_stream(stream);
+}
+
+int main()
+{
+    RPIGRAFX_CONTEXT_T *ctx = test_create_context();
+    RPIGRAFX_CAMERA_T *cam = rpigrafx_open_camera(ctx, 0);
+
+    test_streams(cam);
+    test_rois(cam);
+
+    rpigrafx_close_camera(cam);
+    rpigrafx_destroy_context(ctx);
+    return 0;
+}
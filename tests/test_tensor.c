@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "rpigrafx.h"
+#include "test.h"
+
+/*
+ * Tensors of images against a scalar reference of what rpigrafx.h says
+ * they hold, in every layout, channel order and element type.  The widths
+ * leave tails to the vector loops, and bands of rows on the worker threads
+ * give the tensor of the calling thread.
+ */
+
+#define SRC_WIDTH 45
+#define SRC_HEIGHT 13
+#define SRC_STRIDE (48 * 4)
+#define MAX_THREADS 4
+
+static uint8_t src[SRC_STRIDE * SRC_HEIGHT];
+
+static const int widths[] = {1, 3, 15, 16, 17, 37, SRC_WIDTH};
+
+static const struct {
+    float scale[3], offset[3];
+} params[] = {
+    /* As they come. */
+    {{1, 1, 1}, {0, 0, 0}},
+    /* Normalization by the mean and standard deviation of ImageNet. */
+    {{1 / (255 * 0.229f), 1 / (255 * 0.224f), 1 / (255 * 0.225f)}, {-0.485f / 0.229f, -0.456f / 0.224f, -0.406f / 0.225f}},
+    /* Centered, and saturated at both ends. */
+    {{1, 1, 1}, {-128, -128, -128}},
+    {{1.5f, 0.7f, 2}, {-40, 30.3f, -255}},
+};
+
+/* Element c of the pixel at (x, y), rounded and saturated to lo to hi for integers. */
+static float ref_element(const RPIGRAFX_TENSOR_CONFIG_T *config, const int x, const int y, const int c)
+{
+    const int src_c = config->order == RPIGRAFX_CHANNEL_ORDER_BGR ? 2 - c : c;
+    const float lo = config->type == RPIGRAFX_TENSOR_TYPE_INT8 ? -128 : 0;
+    const float hi = lo + 255;
+    float f = src[y * SRC_STRIDE + x * 4 + src_c] * config->scale[c];
+
+    f += config->offset[c];
+    if (config->type == RPIGRAFX_TENSOR_TYPE_FLOAT32)
+        return f;
+    f = f < lo ? lo : f > hi ? hi : f;
+    /* Rounded half up, as (int) would round towards zero below 0. */
+    return (int) (f - lo + 0.5f) + lo;
+}
+
+static float element(const RPIGRAFX_TENSOR_CONFIG_T *config, const void *tensor, const int width, const int x, const int y, const int c)
+{
+    const size_t i = config->layout == RPIGRAFX_TENSOR_LAYOUT_NHWC
+                     ? ((size_t) y * width + x) * 3 + c
+                     : ((size_t) c * SRC_HEIGHT + y) * width + x;
+
+    switch (config->type) {
+        case RPIGRAFX_TENSOR_TYPE_FLOAT32:
+            return ((const float*) tensor)[i];
+        case RPIGRAFX_TENSOR_TYPE_UINT8:
+            return ((const uint8_t*) tensor)[i];
+        default:
+            return ((const int8_t*) tensor)[i];
+    }
+}
+
+static void test_config(RPIGRAFX_CONTEXT_T *ctx, RPIGRAFX_TENSOR_CONFIG_T *config, const int width)
+{
+    const size_t size = rpigrafx_get_tensor_size(config, width, SRC_HEIGHT);
+    uint8_t *tensor = NULL, *banded = NULL;
+    int x, y, c, n;
+
+    CHECK(size == (size_t) width * SRC_HEIGHT * 3 * (config->type == RPIGRAFX_TENSOR_TYPE_FLOAT32 ? 4 : 1));
+    tensor = malloc(size + 1);
+    banded = malloc(size + 1);
+    CHECK(tensor != NULL && banded != NULL);
+
+    /* One past the end must not be written. */
+    tensor[size] = 0xa5;
+    config->threads = 1;
+    rpigrafx_image_to_tensor(NULL, src, width, SRC_HEIGHT, SRC_STRIDE, config, tensor);
+    CHECK(tensor[size] == 0xa5);
+    for (y = 0; y < SRC_HEIGHT; y ++)
+        for (x = 0; x < width; x ++)
+            for (c = 0; c < 3; c ++)
+                CHECK(element(config, tensor, width, x, y, c) == ref_element(config, x, y, c));
+
+    for (n = 2; n <= MAX_THREADS; n ++) {
+        memset(banded, 0, size);
+        config->threads = n;
+        rpigrafx_image_to_tensor(ctx, src, width, SRC_HEIGHT, SRC_STRIDE, config, banded);
+        CHECK(!memcmp(banded, tensor, size));
+    }
+
+    free(banded);
+    free(tensor);
+}
+
+int main()
+{
+    RPIGRAFX_CONTEXT_T *ctx = test_create_context();
+    RPIGRAFX_TENSOR_CONFIG_T config;
+    uint32_t state = 1;
+    int i, j, c;
+
+    for (i = 0; i < (int) sizeof(src); i ++)
+        src[i] = test_random(&state);
+    rpigrafx_set_resize_threads(ctx, MAX_THREADS);
+
+    for (config.layout = RPIGRAFX_TENSOR_LAYOUT_MIN + 1; config.layout < RPIGRAFX_TENSOR_LAYOUT_MAX; config.layout ++)
+        for (config.order = RPIGRAFX_CHANNEL_ORDER_MIN + 1; config.order < RPIGRAFX_CHANNEL_ORDER_MAX; config.order ++)
+            for (config.type = RPIGRAFX_TENSOR_TYPE_MIN + 1; config.type < RPIGRAFX_TENSOR_TYPE_MAX; config.type ++)
+                for (i = 0; i < (int) (sizeof(params) / sizeof(params[0])); i ++) {
+                    for (c = 0; c < 3; c ++) {
+                        config.scale[c] = params[i].scale[c];
+                        config.offset[c] = params[i].offset[c];
+                    }
+                    for (j = 0; j < (int) (sizeof(widths) / sizeof(widths[0])); j ++)
+                        test_config(ctx, &config, widths[j]);
+                }
+
+    rpigrafx_destroy_context(ctx);
+    return 0;
+}
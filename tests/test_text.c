@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "rpigrafx.h"
+#include "local/context.h"
+#include "local/soft.h"
+#include "local/text.h"
+#include "test.h"
+
+/*
+ * Labels of the built-in font drawn on an overlay, compared pixel by pixel
+ * with the framebuffer of the soft display.  The golden image below is the
+ * text "A 1\n1" in font8x8_basic, written out by hand: '#' is a pixel of a
+ * glyph and '.' is the background of the label.
+ * A PSF2 font of two glyphs, too small to have '?', leaves the characters
+ * it lacks blank.
+ */
+
+#define GOLDEN_WIDTH 24
+#define GOLDEN_HEIGHT 16
+
+static const char *text = "A 1\n1";
+static const char *golden[GOLDEN_HEIGHT] = {
+    "..##..............##....",
+    ".####............###....",
+    "##..##............##....",
+    "##..##............##....",
+    "######............##....",
+    "##..##............##....",
+    "##..##..........######..",
+    "........................",
+    "..##....................",
+    ".###....................",
+    "..##....................",
+    "..##....................",
+    "..##....................",
+    "..##....................",
+    "######..................",
+    "........................",
+};
+
+#define RGBA32_RED 0xff0000ff
+#define RGBA32_BLUE 0xffff0000
+#define RGBA32_WHITE 0xffffffff
+
+static void read_framebuffer(RPIGRAFX_DISPLAY_T *disp, uint32_t *fb)
+{
+    int display_num;
+
+    local_rpigrafx_soft_display_read_framebuffer(local_rpigrafx_display_get_backend(disp, &display_num), fb);
+}
+
+/*
+ * Check that the label at (x, y) of scale is the golden image, its glyphs
+ * in fg and the rest in bg, and that the screen around it is untouched.
+ */
+static void check_label(const uint32_t *fb, const uint32_t *screen, const int screen_width, const int screen_height,
+                        const int x, const int y, const int scale, const uint32_t fg, const uint32_t bg)
+{
+    int sx, sy, gx, gy;
+    uint32_t expected;
+
+    for (sy = 0; sy < screen_height; sy ++)
+        for (sx = 0; sx < screen_width; sx ++) {
+            expected = screen[sy * screen_width + sx];
+            if (sx >= x && sx < x + GOLDEN_WIDTH * scale && sy >= y && sy < y + GOLDEN_HEIGHT * scale) {
+                gx = (sx - x) / scale;
+                gy = (sy - y) / scale;
+                if (golden[gy][gx] == '#')
+                    expected = fg;
+                else if (bg != 0)
+                    expected = bg;
+            }
+            if (fb[sy * screen_width + sx] != expected) {
+                fprintf(stderr, "Pixel (%d, %d) of the label at (%d, %d) scale %d: %08x, expected %08x\n",
+                        sx, sy, x, y, scale, fb[sy * screen_width + sx], expected);
+                CHECK(fb[sy * screen_width + sx] == expected);
+            }
+        }
+}
+
+static void put_le32(uint8_t *p, const uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/* Write a PSF2 font of two 8x8 glyphs, 0 blank and 1 filled, to path. */
+static void write_small_font(const char *path)
+{
+    uint8_t font[32 + 2 * 8];
+    FILE *fp = NULL;
+
+    memset(font, 0, sizeof(font));
+    put_le32(font, 0x864ab572);
+    /* Version, header size, flags, glyphs, bytes per glyph, height, width. */
+    put_le32(font + 4, 0);
+    put_le32(font + 8, 32);
+    put_le32(font + 12, 0);
+    put_le32(font + 16, 2);
+    put_le32(font + 20, 8);
+    put_le32(font + 24, 8);
+    put_le32(font + 28, 8);
+    memset(font + 32 + 8, 0xff, 8);
+    fp = fopen(path, "wb");
+    CHECK(fp != NULL);
+    CHECK(fwrite(font, 1, sizeof(font), fp) == sizeof(font));
+    fclose(fp);
+}
+
+/* "\001A\001": the filled glyph, nothing for 'A' and the filled glyph again. */
+static void test_small_font(RPIGRAFX_DISPLAY_T *disp, RPIGRAFX_OVERLAY_T *ov, const uint32_t *screen,
+                            const int screen_width, const int screen_height)
+{
+    char path[] = "/tmp/rpigrafx-font-XXXXXX";
+    RPIGRAFX_LABEL_T label = {3, 2, "\001A\001", 2, RPIGRAFX_COLOR_WHITE, RPIGRAFX_COLOR_BLUE};
+    RPIGRAFX_FONT_T *font = NULL;
+    struct local_rpigrafx_glyph_pos *glyphs = NULL;
+    int glyphs_len = 0;
+    uint32_t *fb = malloc(screen_width * screen_height * 4), expected;
+    int fd, width, height, x, y;
+
+    CHECK(fb != NULL);
+    fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+    write_small_font(path);
+    font = rpigrafx_load_font(path);
+    unlink(path);
+
+    rpigrafx_font_measure_text(font, label.text, 2, &width, &height);
+    CHECK(width == 2 * 24 && height == 2 * 8);
+    CHECK(local_rpigrafx_layout_text(font, label.text, &glyphs, &glyphs_len, &width, &height) == 2);
+    CHECK(glyphs[0].glyph == 1 && glyphs[0].x == 0 && glyphs[1].glyph == 1 && glyphs[1].x == 16);
+    CHECK(width == 24 && height == 8);
+    free(glyphs);
+    width *= 2;
+    height *= 2;
+
+    rpigrafx_overlay_set_font(ov, font);
+    rpigrafx_overlay_draw_labels(ov, &label, 1);
+    rpigrafx_display_commit_drawings(disp);
+    read_framebuffer(disp, fb);
+    for (y = 0; y < screen_height; y ++)
+        for (x = 0; x < screen_width; x ++) {
+            expected = screen[y * screen_width + x];
+            if (x >= label.x && x < label.x + width && y >= label.y && y < label.y + height)
+                expected = (x - label.x) / 16 == 1 ? RGBA32_BLUE : RGBA32_WHITE;
+            CHECK(fb[y * screen_width + x] == expected);
+        }
+
+    rpigrafx_overlay_draw_labels(ov, NULL, 0);
+    rpigrafx_overlay_set_font(ov, NULL);
+    rpigrafx_destroy_font(font);
+    free(fb);
+}
+
+int main()
+{
+    RPIGRAFX_CONTEXT_T *ctx = test_create_context();
+    RPIGRAFX_DISPLAY_T *disp = rpigrafx_open_display(ctx, 0);
+    RPIGRAFX_OVERLAY_T *ov = NULL;
+    RPIGRAFX_LABEL_T label = {0, 0, NULL, 1, RPIGRAFX_COLOR_WHITE, RPIGRAFX_COLOR_BLUE};
+    uint32_t *screen = NULL, *fb = NULL;
+    int width, height, scale;
+
+    rpigrafx_display_get_screen_size(disp, &width, &height);
+    screen = malloc(width * height * 4);
+    fb = malloc(width * height * 4);
+    CHECK(screen != NULL && fb != NULL);
+
+    /* The screen without the overlay. */
+    rpigrafx_display_commit_drawings(disp);
+    read_framebuffer(disp, screen);
+
+    rpigrafx_font_measure_text(NULL, text, 1, &width, &height);
+    CHECK(width == GOLDEN_WIDTH && height == GOLDEN_HEIGHT);
+    rpigrafx_font_measure_text(NULL, text, 3, &width, &height);
+    CHECK(width == 3 * GOLDEN_WIDTH && height == 3 * GOLDEN_HEIGHT);
+
+    rpigrafx_display_get_screen_size(disp, &width, &height);
+    ov = rpigrafx_display_create_overlay(disp, width, height, 0, 0, width, height);
+    label.text = text;
+    for (scale = 1; scale <= 4; scale ++) {
+        /* On a background, and at an odd place. */
+        label.x = 5 + scale;
+        label.y = 7 * scale;
+        label.scale = scale;
+        label.color = RPIGRAFX_COLOR_WHITE;
+        label.background = RPIGRAFX_COLOR_BLUE;
+        rpigrafx_overlay_draw_labels(ov, &label, 1);
+        rpigrafx_display_commit_drawings(disp);
+        read_framebuffer(disp, fb);
+        check_label(fb, screen, width, height, label.x, label.y, scale, RGBA32_WHITE, RGBA32_BLUE);
+
+        /* Transparent around the glyphs. */
+        label.color = RPIGRAFX_COLOR_RED;
+        label.background = RPIGRAFX_COLOR_TRANSPARENT;
+        rpigrafx_overlay_draw_labels(ov, &label, 1);
+        rpigrafx_display_commit_drawings(disp);
+        read_framebuffer(disp, fb);
+        check_label(fb, screen, width, height, label.x, label.y, scale, RGBA32_RED, 0);
+    }
+
+    /* Removing the label leaves the screen as it was. */
+    rpigrafx_overlay_draw_labels(ov, NULL, 0);
+    rpigrafx_display_commit_drawings(disp);
+    read_framebuffer(disp, fb);
+    CHECK(!memcmp(fb, screen, width * height * 4));
+
+    test_small_font(disp, ov, screen, width, height);
+
+    rpigrafx_destroy_overlay(ov);
+    free(fb);
+    free(screen);
+    rpigrafx_close_display(disp);
+    rpigrafx_destroy_context(ctx);
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "rpigrafx.h"
+#include "test.h"
+
+/*
+ * The routing of the preview ports, as the soft camera writes it to the
+ * file RPIGRAFX_SOFT_TOPOLOGY: the preview port of a camera goes to a
+ * null sink unless a preview is started, and then to the video renderer
+ * of the display at the given place, layer and alpha.
+ */
+
+static char path[] = "/tmp/rpigrafx-topology-XXXXXX";
+
+static void check_topology(const char *expected)
+{
+    char buf[1024];
+    FILE *fp = NULL;
+    size_t len;
+
+    fp = fopen(path, "r");
+    CHECK(fp != NULL);
+    len = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[len] = '\0';
+    if (strcmp(buf, expected)) {
+        fprintf(stderr, "Topology:\n%sExpected:\n%s", buf, expected);
+        CHECK(!strcmp(buf, expected));
+    }
+}
+
+int main()
+{
+    RPIGRAFX_CONTEXT_T *ctx[2] = {NULL, NULL};
+    RPIGRAFX_CAMERA_T *cam[2] = {NULL, NULL};
+    RPIGRAFX_DISPLAY_T *disp = NULL;
+    int fd;
+
+    fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+    setenv("RPIGRAFX_SOFT_TOPOLOGY", path, 1);
+
+    ctx[0] = test_create_context();
+    ctx[1] = test_create_context();
+    disp = rpigrafx_open_display(ctx[0], 0);
+
+    cam[0] = rpigrafx_open_camera(ctx[0], 0);
+    check_topology("camera 0 preview -> null_sink\n");
+
+    rpigrafx_camera_start_preview(cam[0], disp, 10, 20, 160, 120, 2, 255);
+    check_topology("camera 0 preview -> video_render display 0 dst 10,20,160x120 layer 2 alpha 255\n");
+
+    /* Starting it again moves the preview. */
+    rpigrafx_camera_start_preview(cam[0], disp, 0, 0, 320, 240, 3, 128);
+    check_topology("camera 0 preview -> video_render display 0 dst 0,0,320x240 layer 3 alpha 128\n");
+
+    /* One line per open camera, the last opened first. */
+    cam[1] = rpigrafx_open_camera(ctx[1], 0);
+    check_topology("camera 0 preview -> null_sink\n"
+                   "camera 0 preview -> video_render display 0 dst 0,0,320x240 layer 3 alpha 128\n");
+
+    rpigrafx_camera_stop_preview(cam[0]);
+    check_topology("camera 0 preview -> null_sink\n"
+                   "camera 0 preview -> null_sink\n");
+
+    rpigrafx_close_camera(cam[1]);
+    check_topology("camera 0 preview -> null_sink\n");
+
+    /* Closing a camera with its preview running stops the preview. */
+    rpigrafx_camera_start_preview(cam[0], disp, 10, 20, 160, 120, 2, 255);
+    rpigrafx_close_camera(cam[0]);
+    check_topology("");
+
+    rpigrafx_close_display(disp);
+    rpigrafx_destroy_context(ctx[1]);
+    rpigrafx_destroy_context(ctx[0]);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2017 Sugizaki Yukimasa (ysugi@idein.jp)
+ * All rights reserved.
+ *
+ * This software is licensed under a Modified (3-Clause) BSD License.
+ * You should have received a copy of this license along with this
+ * software. If not, contact the copyright holder above.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "rpigrafx.h"
+#include "test.h"
+
+/*
+ * Video mode on the simulated sensor of the soft camera: the frame rate
+ * of the mode paces the frames, and a fixed pool of buffers is recycled.
+ */
+
+#define NUM_FRAMES 16
+#define NUM_BUFFERS 4
+
+/* Frames stream at the rate of the mode, whatever the still-mode rate is. */
+static void test_pacing(RPIGRAFX_CAMERA_T *cam, const int fps)
+{
+    RPIGRAFX_FRAME_T *f = NULL;
+    int64_t first = 0, last = 0, expected;
+    int i, dropped = 0;
+
+    rpigrafx_camera_set_video_mode(cam, 160, 120, fps, 0);
+    rpigrafx_camera_start_capture(cam);
+    for (i = 0; i < NUM_FRAMES; i ++) {
+        f = rpigrafx_camera_get_next_frame(cam, 1000);
+        CHECK(f != NULL);
+        CHECK(rpigrafx_frame_get_width(f) == 160);
+        CHECK(rpigrafx_frame_get_height(f) == 120);
+        if (i == 0)
+            first = rpigrafx_frame_get_timestamp(f);
+        else
+            dropped += rpigrafx_frame_get_dropped(f);
+        last = rpigrafx_frame_get_timestamp(f);
+        rpigrafx_release_frame(f);
+    }
+    rpigrafx_camera_stop_capture(cam);
+
+    /* Timestamps are in microseconds; allow a period of slack for scheduling. */
+    expected = (int64_t) (NUM_FRAMES - 1 + dropped) * 1000000 / fps;
+    CHECK(last - first >= expected - 1000000 / fps);
+    CHECK(last - first <= expected + 1000000 / fps);
+}
+
+/*
+ * The buffers of the pool come back to the sensor when released: however
+ * long a consumer holds every one of them, capture goes on afterwards in
+ * the same buffers.
+ */
+static void test_recycling(RPIGRAFX_CONTEXT_T *ctx, RPIGRAFX_CAMERA_T *cam)
+{
+    const struct timespec hold = {0, 200000000};
+    RPIGRAFX_FRAME_T *held[NUM_BUFFERS], *f = NULL;
+    RPIGRAFX_POOL_STATS_T stats;
+    void *buffers[NUM_BUFFERS];
+    int i, j;
+
+    rpigrafx_camera_set_video_mode(cam, 160, 120, 100, 0);
+    rpigrafx_camera_set_capture_buffer_num(cam, NUM_BUFFERS);
+    rpigrafx_camera_start_capture(cam);
+
+    for (i = 0; i < NUM_BUFFERS; i ++) {
+        held[i] = rpigrafx_camera_get_next_frame(cam, 1000);
+        CHECK(held[i] != NULL);
+        buffers[i] = rpigrafx_frame_get_data(held[i]);
+        for (j = 0; j < i; j ++)
+            CHECK(buffers[i] != buffers[j]);
+    }
+    /* Nothing can be captured while every buffer is held. */
+    nanosleep(&hold, NULL);
+    CHECK(rpigrafx_camera_get_next_frame(cam, 0) == NULL);
+    for (i = 0; i < NUM_BUFFERS; i ++)
+        rpigrafx_release_frame(held[i]);
+
+    for (i = 0; i < NUM_FRAMES; i ++) {
+        f = rpigrafx_camera_get_next_frame(cam, 1000);
+        CHECK(f != NULL);
+        for (j = 0; j < NUM_BUFFERS && rpigrafx_frame_get_data(f) != buffers[j]; j ++)
+            ;
+        CHECK(j < NUM_BUFFERS);
+        rpigrafx_release_frame(f);
+    }
+    rpigrafx_camera_stop_capture(cam);
+
+    rpigrafx_get_pool_stats(ctx, &stats);
+    CHECK(stats.size.frame_buffers == NUM_BUFFERS);
+    CHECK(stats.high.frame_buffers == NUM_BUFFERS);
+}
+
+int main()
+{
+    RPIGRAFX_CONTEXT_T *ctx = NULL;
+    RPIGRAFX_CAMERA_T *cam = NULL;
+
+    /* The still-mode rate, which video mode must not follow. */
+    setenv("RPIGRAFX_SOFT_CAMERA_FPS", "1000", 1);
+    ctx = test_create_context();
+    cam = rpigrafx_open_camera(ctx, 0);
+
+    test_pacing(cam, 25);
+    test_pacing(cam, 50);
+    test_recycling(ctx, cam);
+
+    rpigrafx_close_camera(cam);
+    rpigrafx_destroy_context(ctx);
+    return 0;
+}